@@ -0,0 +1,24 @@
+# Runs an example for ctest and compares what it prints with the expected
+# output:
+#   cmake -DAXEON=<binary> -DSCRIPT=<example> -DEXPECTED=<file> "-DARGS=<flags>" -P run_example.cmake
+# ARGS holds the flags separated by spaces. Given -DERROR=<regex>, the
+# example must instead fail with an error matching it, after printing the
+# expected output.
+
+separate_arguments(flags UNIX_COMMAND "${ARGS}")
+execute_process(COMMAND ${AXEON} ${SCRIPT} ${flags}
+                OUTPUT_VARIABLE output
+                ERROR_VARIABLE errors
+                RESULT_VARIABLE result)
+if(DEFINED ERROR)
+    if(result EQUAL 0 OR NOT errors MATCHES "${ERROR}")
+        message(FATAL_ERROR "${SCRIPT} ${ARGS} exited with ${result} instead of reporting ${ERROR}\n${errors}")
+    endif()
+elseif(NOT result EQUAL 0)
+    message(FATAL_ERROR "${SCRIPT} ${ARGS} exited with ${result}\n${errors}")
+endif()
+
+file(READ ${EXPECTED} expected)
+if(NOT output STREQUAL expected)
+    message(FATAL_ERROR "${SCRIPT} ${ARGS} printed\n${output}\ninstead of\n${expected}")
+endif()
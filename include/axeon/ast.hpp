@@ -40,7 +40,7 @@ struct Stmt;
 using StmtPtr = std::unique_ptr<Stmt>;
 
 struct Expr {
-    struct Literal { std::variant<double, std::string> value; };
+    struct Literal { std::variant<double, std::string> value; bool integer; }; // integer: written without a fraction
     struct Variable { std::string name; };
     struct Binary { ExprPtr left; Token op; ExprPtr right; };
     struct Assign { std::string name; ExprPtr value; };
@@ -114,4 +114,14 @@ public:
     std::string toString() const override { return "Statement"; }
 };
 
+// Annotations naming one of the built-in integer types
+inline bool isIntegerTypeName(const std::string& type) {
+    static const char* const names[] = {"i8", "i16", "i32", "i64", "i128", "u8", "u16", "u32", "u64", "u128",
+                                        "int", "usize", "isize"};
+    for (const char* name : names) {
+        if (type == name) return true;
+    }
+    return false;
+}
+
 } // namespace kio
@@ -0,0 +1,56 @@
+/*
+Copyright (c) 2025 Dipanjan Dhar
+SPDX-License-Identifier: GPL-3.0-only
+*/
+
+#pragma once
+
+#include "axeon/bytecode.hpp"
+#include "axeon/jit_engine.hpp"
+#include <atomic>
+#include <memory>
+
+namespace kio {
+
+// Tier 1. Translates a hot loop to x86-64 in a single pass by stitching a
+// fixed machine-code template per instruction; there is no analysis and no
+// type specialization, so compiling takes microseconds. Values stay boxed in
+// the interpreter's own stack slots, which lets the code hand any
+// instruction it has no template for back to the interpreter as it is.
+// Loops that stay hot move on to JITEngine.
+class BaselineJIT {
+public:
+    struct Stats {
+        size_t loops = 0;
+        size_t failed = 0;
+        size_t bytes = 0;      // Machine code emitted
+        double totalMs = 0;
+        double maxMs = 0;
+    };
+
+    BaselineJIT();
+    ~BaselineJIT();
+
+    // False where this build or CPU has no baseline tier; compileLoop then
+    // always fails.
+    static bool available();
+
+    // Compiles the loop from header through its back edge, the LOOP at
+    // backEdge, with JITEngine::CompiledLoop's contract: the code returns the
+    // offset the interpreter resumes at, with the stack as that instruction
+    // expects it. Instructions without a template and jumps out of the loop
+    // return that way. Each back edge increments *backEdges; the code returns
+    // the header when the count reaches tierUpAt (never when it is 0), and
+    // once optimized, if given, holds code.
+    JITEngine::CompiledLoop compileLoop(const Chunk& chunk, const uint8_t* header, const uint8_t* backEdge,
+                                        uint64_t* backEdges, uint64_t tierUpAt,
+                                        const std::atomic<JITEngine::CompiledLoop>* optimized);
+
+    const Stats& stats() const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+} // namespace kio
@@ -5,106 +5,118 @@ SPDX-License-Identifier: GPL-3.0-only
 
 #pragma once
 
+#include "axeon/bytecode.hpp"
 #include <string>
 #include <vector>
-#include <functional>
 #include <unordered_map>
 
 namespace kio {
 
-class Value; // Forward declaration
-
-using BuiltinFunction = std::function<Value(const std::vector<Value>&)>;
+// Registry the VM binds to ObjNative globals at startup
+struct BuiltinEntry {
+    NativeFn function;
+    int arity;     // -1 when variadic
+    uint8_t flags; // NativeFlags
+};
 
 class BuiltinFunctions {
 public:
     BuiltinFunctions();
     ~BuiltinFunctions();
     
-    void registerFunction(const std::string& name, BuiltinFunction func);
+    void registerFunction(const std::string& name, NativeFn func, int arity = -1, uint8_t flags = NATIVE_ALLOCATES);
     bool hasFunction(const std::string& name) const;
-    Value callFunction(const std::string& name, const std::vector<Value>& args) const;
+    const std::unordered_map<std::string, BuiltinEntry>& functions() const { return functions_; }
     
     std::vector<std::string> getFunctionNames() const;
     
     // Built-in function implementations
-    static Value print(const std::vector<Value>& args);
-    static Value println(const std::vector<Value>& args);
-    static Value len(const std::vector<Value>& args);
-    static Value type(const std::vector<Value>& args);
-    static Value str(const std::vector<Value>& args);
-    static Value int_func(const std::vector<Value>& args);
-    static Value float_func(const std::vector<Value>& args);
-    static Value bool_func(const std::vector<Value>& args);
+    static Value print(int argCount, Value* args);
+    static Value println(int argCount, Value* args);
+    static Value len(int argCount, Value* args);
+    static Value type(int argCount, Value* args);
+    static Value str(int argCount, Value* args);
+    static Value int_func(int argCount, Value* args);
+    static Value float_func(int argCount, Value* args);
+    static Value bool_func(int argCount, Value* args);
     
     // Math functions
-    static Value abs_func(const std::vector<Value>& args);
-    static Value min_func(const std::vector<Value>& args);
-    static Value max_func(const std::vector<Value>& args);
-    static Value pow_func(const std::vector<Value>& args);
-    static Value sqrt_func(const std::vector<Value>& args);
+    static Value abs_func(int argCount, Value* args);
+    static Value min_func(int argCount, Value* args);
+    static Value max_func(int argCount, Value* args);
+    static Value pow_func(int argCount, Value* args);
+    static Value sqrt_func(int argCount, Value* args);
     
     // String functions
-    static Value substr(const std::vector<Value>& args);
-    static Value split(const std::vector<Value>& args);
-    static Value join(const std::vector<Value>& args);
-    static Value upper_func(const std::vector<Value>& args);
-    static Value lower_func(const std::vector<Value>& args);
+    static Value substr(int argCount, Value* args);
+    static Value split(int argCount, Value* args);
+    static Value join(int argCount, Value* args);
+    static Value upper_func(int argCount, Value* args);
+    static Value lower_func(int argCount, Value* args);
 
-    static Value floor_func(const std::vector<Value>& args);
+    static Value floor_func(int argCount, Value* args);
     
     // Math functions
-    static Value sin_func(const std::vector<Value>& args);
-    static Value cos_func(const std::vector<Value>& args);
-    static Value tan_func(const std::vector<Value>& args);
-    static Value asin_func(const std::vector<Value>& args);
-    static Value acos_func(const std::vector<Value>& args);
-    static Value atan_func(const std::vector<Value>& args);
-    static Value atan2_func(const std::vector<Value>& args);
-    static Value ceil_func(const std::vector<Value>& args);
-    static Value round_func(const std::vector<Value>& args);
-    static Value log_func(const std::vector<Value>& args);
-    static Value log10_func(const std::vector<Value>& args);
-    static Value exp_func(const std::vector<Value>& args);
-    static Value sign_func(const std::vector<Value>& args);
+    static Value sin_func(int argCount, Value* args);
+    static Value cos_func(int argCount, Value* args);
+    static Value tan_func(int argCount, Value* args);
+    static Value asin_func(int argCount, Value* args);
+    static Value acos_func(int argCount, Value* args);
+    static Value atan_func(int argCount, Value* args);
+    static Value atan2_func(int argCount, Value* args);
+    static Value ceil_func(int argCount, Value* args);
+    static Value round_func(int argCount, Value* args);
+    static Value log_func(int argCount, Value* args);
+    static Value log10_func(int argCount, Value* args);
+    static Value exp_func(int argCount, Value* args);
+    static Value sign_func(int argCount, Value* args);
     
     // Time functions
-    static Value time_func(const std::vector<Value>& args);
-    static Value sleep_func(const std::vector<Value>& args);
-    static Value timestamp_func(const std::vector<Value>& args);
+    static Value time_func(int argCount, Value* args);
+    static Value sleep_func(int argCount, Value* args);
+    static Value timestamp_func(int argCount, Value* args);
     
     // Random functions
-    static Value rand_func(const std::vector<Value>& args);
-    static Value rand_int_func(const std::vector<Value>& args);
-    static Value rand_float_func(const std::vector<Value>& args);
+    static Value rand_func(int argCount, Value* args);
+    static Value rand_int_func(int argCount, Value* args);
+    static Value rand_float_func(int argCount, Value* args);
     
     // String functions
-    static Value trim_func(const std::vector<Value>& args);
-    static Value replace_func(const std::vector<Value>& args);
-    static Value contains_func(const std::vector<Value>& args);
-    static Value startswith_func(const std::vector<Value>& args);
-    static Value endswith_func(const std::vector<Value>& args);
-    static Value split_func(const std::vector<Value>& args);
-    static Value join_func(const std::vector<Value>& args);
+    static Value trim_func(int argCount, Value* args);
+    static Value replace_func(int argCount, Value* args);
+    static Value contains_func(int argCount, Value* args);
+    static Value startswith_func(int argCount, Value* args);
+    static Value endswith_func(int argCount, Value* args);
+    static Value split_func(int argCount, Value* args);
+    static Value join_func(int argCount, Value* args);
     
     // Array functions
-    static Value range_func(const std::vector<Value>& args);
-    static Value map_func(const std::vector<Value>& args);
-    static Value filter_func(const std::vector<Value>& args);
-    static Value reduce_func(const std::vector<Value>& args);
-    static Value sum_func(const std::vector<Value>& args);
-    static Value avg_func(const std::vector<Value>& args);
-    static Value sort_func(const std::vector<Value>& args);
-    static Value reverse_func(const std::vector<Value>& args);
+    static Value range_func(int argCount, Value* args);
+    static Value map_func(int argCount, Value* args);
+    static Value filter_func(int argCount, Value* args);
+    static Value reduce_func(int argCount, Value* args);
+    static Value sum_func(int argCount, Value* args);
+    static Value avg_func(int argCount, Value* args);
+    static Value sort_func(int argCount, Value* args);
+    static Value reverse_func(int argCount, Value* args);
+
+    // Typed array constructors: take a length or an array to copy from
+    static Value float64_array_func(int argCount, Value* args);
+    static Value float32_array_func(int argCount, Value* args);
+    static Value int32_array_func(int argCount, Value* args);
+    static Value int64_array_func(int argCount, Value* args);
+    static Value uint8_array_func(int argCount, Value* args);
     
     // File functions
-    static Value read_file_func(const std::vector<Value>& args);
-    static Value write_file_func(const std::vector<Value>& args);
-    static Value exists_func(const std::vector<Value>& args);
-    static Value list_dir_func(const std::vector<Value>& args);
+    static Value read_file_func(int argCount, Value* args);
+    static Value write_file_func(int argCount, Value* args);
+    static Value exists_func(int argCount, Value* args);
+    static Value list_dir_func(int argCount, Value* args);
+
+    static Value stub_func(int argCount, Value* args);
     
 private:
-    std::unordered_map<std::string, BuiltinFunction> functions_;
+    std::unordered_map<std::string, BuiltinEntry> functions_;
     
     void registerBuiltinFunctions();
 };
@@ -5,6 +5,7 @@ SPDX-License-Identifier: GPL-3.0-only
 
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 #include <vector>
 #include <string>
@@ -12,6 +13,8 @@ SPDX-License-Identifier: GPL-3.0-only
 #include <cmath>
 #include <map>
 #include <memory>
+#include <unordered_map>
+#include <cstdlib>
 
 namespace kio {
 
@@ -21,15 +24,99 @@ enum class OpCode : uint8_t {
     ADD, SUBTRACT, MULTIPLY, DIVIDE, MODULO,
     EQUAL, GREATER, GREATER_EQUAL, LESS, LESS_EQUAL,
     NOT, NEGATE, PRINT, JUMP, JUMP_IF_FALSE, LOOP,
-    CALL, INVOKE, RETURN, // Logic
-    CLASS, METHOD, GET_PROPERTY, SET_PROPERTY, INHERIT, // OOP
+    CALL, INVOKE, RETURN, TAIL_CALL, // Logic; TAIL_CALL is CALL reusing the caller's frame
+    CLASS, METHOD, GET_PROPERTY, SET_PROPERTY, INHERIT, // OOP; property ops end with an inline cache index
     ARRAY_NEW, ARRAY_GET, ARRAY_SET, SYS_QUERY,
     FLOOR, SQRT,
+    // Slot-indexed globals (16-bit slot operand)
+    GET_GLOBAL_SLOT, SET_GLOBAL_SLOT, DEFINE_GLOBAL_SLOT,
+    // Superinstructions for the hottest sequences (see Compiler)
+    ADD_CONST,                                          // k           CONSTANT k; ADD
+    ADD_LOCALS, SUBTRACT_LOCALS, MULTIPLY_LOCALS,       // a b         GET_LOCAL a; GET_LOCAL b; op
+    INCREMENT_LOCAL,                                    // s k         s = s + k as a statement
+    INCREMENT_GLOBAL_SLOT,                              // s16 k       same for a global slot
+    LESS_JUMP_IF_FALSE, EQUAL_JUMP_IF_FALSE,            // off16       op; JUMP_IF_FALSE
+    LESS_LOCALS_JUMP_IF_FALSE,                          // a b off16   GET_LOCAL a; GET_LOCAL b; LESS; JUMP_IF_FALSE
+    NOT_EQUAL,                                          //             EQUAL; NOT (fused by Peephole)
+    // Integer-specialized operators, emitted where both operands are known
+    // to be ints; any other operands take the generic opcode's path
+    ADD_INT, SUBTRACT_INT, MULTIPLY_INT, MODULO_INT,
+    LESS_INT, LESS_EQUAL_INT, GREATER_INT, GREATER_EQUAL_INT,
+    MASK_INT,                                           // bits        MODULO_INT by 2^bits, as a mask when l >= 0
+    // Quickened forms. VM::run() rewrites a generic instruction in place into
+    // one of these (or a *_INT form) once it has seen the operand types, and
+    // back when the guard fails. _NUM takes two doubles, ADD_STR two strings.
+    ADD_NUM, SUBTRACT_NUM, MULTIPLY_NUM,
+    LESS_NUM, LESS_EQUAL_NUM, GREATER_NUM, GREATER_EQUAL_NUM,
+    ADD_STR,
+    GET_PROPERTY_SLOT,                                  // k cache     GET_PROPERTY whose cache holds one field
+    // Unchecked forms, emitted where TypeInference has proven the operand
+    // types: _F64 takes two doubles, CONCAT a string on at least one side,
+    // and the array forms a Float64Array with a number index and value
+    ADD_F64, SUBTRACT_F64, MULTIPLY_F64, DIVIDE_F64,
+    LESS_F64, LESS_EQUAL_F64, GREATER_F64, GREATER_EQUAL_F64,
+    CONCAT, ARRAY_GET_F64, ARRAY_SET_F64,
     // Fast native loop for benchmarks
     FAST_LOOP,
     HALT
 };
 
+// Size in bytes of an instruction including its operands.
+static inline int instructionLength(OpCode op) {
+    switch (op) {
+        case OpCode::CONSTANT: case OpCode::GET_LOCAL: case OpCode::SET_LOCAL:
+        case OpCode::GET_GLOBAL: case OpCode::DEFINE_GLOBAL: case OpCode::SET_GLOBAL:
+        case OpCode::CALL: case OpCode::TAIL_CALL: case OpCode::CLASS: case OpCode::METHOD:
+        case OpCode::ARRAY_NEW: case OpCode::SYS_QUERY: case OpCode::ADD_CONST: case OpCode::MASK_INT:
+            return 2;
+        case OpCode::JUMP: case OpCode::JUMP_IF_FALSE: case OpCode::LOOP:
+        case OpCode::GET_PROPERTY: case OpCode::SET_PROPERTY: case OpCode::GET_PROPERTY_SLOT:
+        case OpCode::GET_GLOBAL_SLOT: case OpCode::SET_GLOBAL_SLOT: case OpCode::DEFINE_GLOBAL_SLOT:
+        case OpCode::ADD_LOCALS: case OpCode::SUBTRACT_LOCALS: case OpCode::MULTIPLY_LOCALS:
+        case OpCode::INCREMENT_LOCAL: case OpCode::LESS_JUMP_IF_FALSE: case OpCode::EQUAL_JUMP_IF_FALSE:
+            return 3;
+        case OpCode::INCREMENT_GLOBAL_SLOT: case OpCode::INVOKE:
+            return 4;
+        case OpCode::LESS_LOCALS_JUMP_IF_FALSE:
+            return 5;
+        default:
+            return 1;
+    }
+}
+
+// The generic instruction a quickened one was rewritten from. The *_INT
+// forms are left alone; every tier implements them.
+static inline OpCode unquickened(OpCode op) {
+    switch (op) {
+        case OpCode::ADD_NUM: case OpCode::ADD_STR: return OpCode::ADD;
+        case OpCode::SUBTRACT_NUM: return OpCode::SUBTRACT;
+        case OpCode::MULTIPLY_NUM: return OpCode::MULTIPLY;
+        case OpCode::LESS_NUM: return OpCode::LESS;
+        case OpCode::LESS_EQUAL_NUM: return OpCode::LESS_EQUAL;
+        case OpCode::GREATER_NUM: return OpCode::GREATER;
+        case OpCode::GREATER_EQUAL_NUM: return OpCode::GREATER_EQUAL;
+        case OpCode::GET_PROPERTY_SLOT: return OpCode::GET_PROPERTY;
+        default: return op;
+    }
+}
+
+// The generic instruction a *_INT or unchecked _F64 form specializes. Tiers
+// that compute in their own representation only need the operator.
+static inline OpCode genericForm(OpCode op) {
+    switch (op) {
+        case OpCode::ADD_INT: case OpCode::ADD_F64: return OpCode::ADD;
+        case OpCode::SUBTRACT_INT: case OpCode::SUBTRACT_F64: return OpCode::SUBTRACT;
+        case OpCode::MULTIPLY_INT: case OpCode::MULTIPLY_F64: return OpCode::MULTIPLY;
+        case OpCode::MODULO_INT: return OpCode::MODULO;
+        case OpCode::DIVIDE_F64: return OpCode::DIVIDE;
+        case OpCode::LESS_INT: case OpCode::LESS_F64: return OpCode::LESS;
+        case OpCode::LESS_EQUAL_INT: case OpCode::LESS_EQUAL_F64: return OpCode::LESS_EQUAL;
+        case OpCode::GREATER_INT: case OpCode::GREATER_F64: return OpCode::GREATER;
+        case OpCode::GREATER_EQUAL_INT: case OpCode::GREATER_EQUAL_F64: return OpCode::GREATER_EQUAL;
+        default: return op;
+    }
+}
+
 enum class ValueType { VAL_NUMBER, VAL_BOOL, VAL_NIL, VAL_OBJ };
 
 struct Obj;
@@ -56,16 +143,38 @@ struct Value {
     bool operator==(const Value& other) const;
 };
 
-static inline bool isNumber(Value v) { return (v.v & 0x7ff8000000000000) != 0x7ff8000000000000; }
+// Small integers are boxed under their own quiet-NaN tag with a 48-bit
+// two's complement payload. Both they and doubles count as numbers.
+#define INT_TAG  ((uint64_t)0x7ffc000000000000)
+#define TAG_MASK ((uint64_t)0xffff000000000000)
+static constexpr int64_t INT_MIN_48 = -((int64_t)1 << 47);
+static constexpr int64_t INT_MAX_48 = ((int64_t)1 << 47) - 1;
+
+static inline bool isDouble(Value v) { return (v.v & 0x7ff8000000000000) != 0x7ff8000000000000; }
+static inline bool isInt(Value v)    { return (v.v & TAG_MASK) == INT_TAG; }
+static inline bool isNumber(Value v) { return isDouble(v) || isInt(v); }
+static inline bool bothInts(Value l, Value r) { return (((l.v ^ INT_TAG) | (r.v ^ INT_TAG)) & TAG_MASK) == 0; }
 static inline bool isNil(Value v)    { return v.v == ((uint64_t)(0x7ff8000000000000) | 1); }
 static inline bool isBool(Value v)   { return (v.v & ~1) == ((uint64_t)(0x7ff8000000000000) | 2); }
 static inline bool isObj(Value v)    { return (v.v & (0x8000000000000000 | 0x7ff8000000000000)) == (0x8000000000000000 | 0x7ff8000000000000); }
 
-static inline double valueToDouble(Value v) {
+// Reads a value already known to be a double.
+static inline double asDouble(Value v) {
     union { uint64_t u; double d; } cast;
     cast.u = v.v;
     return cast.d;
 }
+static inline int64_t valueToInt(Value v) { return (int64_t)(v.v << 16) >> 16; }
+static inline bool fitsInt(int64_t n) { return ((int64_t)((uint64_t)n << 16) >> 16) == n; }
+static inline Value intToValue(int64_t n) { return Value(INT_TAG | ((uint64_t)n & ~TAG_MASK)); }
+// Integer results that leave the small-int range are promoted to doubles
+static inline Value numberToValue(int64_t n) { return fitsInt(n) ? intToValue(n) : Value((double)n); }
+// Numeric literals written without a fraction compile to ints when they fit
+static inline Value literalToValue(double d, bool integer) {
+    return integer && std::fabs(d) <= (double)INT_MAX_48 ? intToValue((int64_t)d) : Value(d);
+}
+
+static inline double valueToDouble(Value v) { return isInt(v) ? (double)valueToInt(v) : asDouble(v); }
 static inline Value doubleToValue(double d) { return Value(d); }
 static inline Obj* valueToObj(Value v) { return (Obj*)(uintptr_t)(v.v & ~(0x8000000000000000 | 0x7ff8000000000000)); }
 static inline Value objToValue(Obj* o) { return Value(o); }
@@ -74,17 +183,150 @@ static inline Value objToValue(Obj* o) { return Value(o); }
 #define FALSE_VAL Value(false)
 #define TRUE_VAL  Value(true)
 #define BOOL_VAL(b) Value(b)
+// Marks a global slot that has been resolved but never assigned.
+#define UNDEFINED_VAL Value((uint64_t)(0x7ff8000000000000 | 4))
+
+static inline bool isUndefined(Value v) { return v.v == ((uint64_t)(0x7ff8000000000000) | 4); }
+
+// Numeric operators shared by the dispatch loops. Two doubles take the first
+// branch; two ints give an int, or a double once the result leaves the
+// small-int range; anything else is done in doubles. Callers handle
+// non-numbers first where it matters.
+static inline bool bothDoubles(Value l, Value r) { return isDouble(l) & isDouble(r); }
+// With the payloads shifted into the top 48 bits, the sum overflows int64
+// exactly when the small-int result would
+static inline bool addInts(Value l, Value r, Value& result) {
+    uint64_t a = l.v << 16, b = r.v << 16, sum = a + b;
+    if ((int64_t)((a ^ sum) & (b ^ sum)) < 0) return false;
+    result = Value((sum >> 16) | INT_TAG);
+    return true;
+}
+static inline bool subtractInts(Value l, Value r, Value& result) {
+    uint64_t a = l.v << 16, b = r.v << 16, difference = a - b;
+    if ((int64_t)((a ^ b) & (a ^ difference)) < 0) return false;
+    result = Value((difference >> 16) | INT_TAG);
+    return true;
+}
+static inline bool multiplyInts(Value l, Value r, Value& result) {
+    // Products within the small-int range are exact in a double as well
+    double product = (double)valueToInt(l) * (double)valueToInt(r);
+    if (!(std::fabs(product) <= (double)INT_MAX_48)) return false;
+    result = intToValue(valueToInt(l) * valueToInt(r));
+    return true;
+}
+// An int remainder by zero is left to fmod, which gives NaN
+static inline bool moduloInts(Value l, Value r, Value& result) {
+    if (valueToInt(r) == 0) return false;
+    result = intToValue(valueToInt(l) % valueToInt(r));
+    return true;
+}
+static inline Value addNumbers(Value l, Value r) {
+    Value result;
+    if (bothDoubles(l, r)) return Value(asDouble(l) + asDouble(r));
+    if (bothInts(l, r) && addInts(l, r, result)) return result;
+    return Value(valueToDouble(l) + valueToDouble(r));
+}
+static inline Value subtractNumbers(Value l, Value r) {
+    Value result;
+    if (bothDoubles(l, r)) return Value(asDouble(l) - asDouble(r));
+    if (bothInts(l, r) && subtractInts(l, r, result)) return result;
+    return Value(valueToDouble(l) - valueToDouble(r));
+}
+static inline Value multiplyNumbers(Value l, Value r) {
+    Value result;
+    if (bothDoubles(l, r)) return Value(asDouble(l) * asDouble(r));
+    if (bothInts(l, r) && multiplyInts(l, r, result)) return result;
+    return Value(valueToDouble(l) * valueToDouble(r));
+}
+static inline Value moduloNumbers(Value l, Value r) {
+    Value result;
+    if (bothInts(l, r) && moduloInts(l, r, result)) return result;
+    return Value(std::fmod(valueToDouble(l), valueToDouble(r)));
+}
+// l > r and l >= r are lessNumbers(r, l) and lessEqualNumbers(r, l)
+static inline bool lessNumbers(Value l, Value r) {
+    if (bothDoubles(l, r)) return asDouble(l) < asDouble(r);
+    if (bothInts(l, r)) return valueToInt(l) < valueToInt(r);
+    return valueToDouble(l) < valueToDouble(r);
+}
+static inline bool lessEqualNumbers(Value l, Value r) {
+    if (bothDoubles(l, r)) return asDouble(l) <= asDouble(r);
+    if (bothInts(l, r)) return valueToInt(l) <= valueToInt(r);
+    return valueToDouble(l) <= valueToDouble(r);
+}
+// l % 2^bits: a mask for non-negative ints, and MODULO_INT's result otherwise
+static inline Value moduloPowerOfTwo(Value l, int bits) {
+    int64_t divisor = (int64_t)1 << bits;
+    if (isInt(l) && valueToInt(l) >= 0) return intToValue(valueToInt(l) & (divisor - 1));
+    return moduloNumbers(l, intToValue(divisor));
+}
+static inline Value negateNumber(Value v) {
+    if (isInt(v)) return numberToValue(-valueToInt(v));
+    return Value(-valueToDouble(v));
+}
 
-enum class ObjType { OBJ_STRING, OBJ_ARRAY, OBJ_FUNCTION, OBJ_CLASS, OBJ_INSTANCE };
+enum class ObjType : uint8_t { OBJ_STRING, OBJ_ARRAY, OBJ_FUNCTION, OBJ_CLASS, OBJ_INSTANCE, OBJ_ROPE, OBJ_NATIVE, OBJ_TYPED_ARRAY };
 struct Obj {
     ObjType type;
+    bool remembered = false; // Old object already in the collector's remembered set
+    uint32_t markEpoch = 0;  // Equals the collector's epoch once marked
+    Obj* next = nullptr;     // Old space: heap list link. Nursery: forwarding pointer
     virtual ~Obj() = default;
 protected: Obj(ObjType t) : type(t) {}
 };
 
+// FNV-1a; cached in every ObjString so table probes never rehash the chars.
+static inline uint32_t hashString(const char* chars, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (uint8_t)chars[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Immutable once constructed. Interned strings are unique per content, so two
+// interned strings are equal exactly when they are the same object.
 struct ObjString : public Obj {
     std::string chars;
-    ObjString(const std::string& s) : Obj(ObjType::OBJ_STRING), chars(s) {}
+    uint32_t hash;
+    bool interned = false;
+    ObjString(const std::string& s)
+        : Obj(ObjType::OBJ_STRING), chars(s), hash(hashString(s.data(), s.size())) {}
+    ObjString(std::string&& s)
+        : Obj(ObjType::OBJ_STRING), chars(std::move(s)), hash(hashString(chars.data(), chars.size())) {}
+};
+
+// Lazy concatenation. ADD builds one of these instead of copying once the
+// result reaches ROPE_MIN_LENGTH; flattenRope() materializes the bytes the
+// first time they are needed and then drops the children.
+struct ObjRope : public Obj {
+    size_t length;
+    Value left;  // ObjString or ObjRope; nil once flattened
+    Value right;
+    Value flat;  // The flattened ObjString, nil until first use
+    ObjRope(size_t len) : Obj(ObjType::OBJ_ROPE), length(len) {}
+};
+
+static constexpr size_t ROPE_MIN_LENGTH = 256;
+
+ObjString* flattenRope(ObjRope* rope);
+
+// Flat strings and ropes alike
+static inline bool isString(Value v) {
+    return isObj(v) && (valueToObj(v)->type == ObjType::OBJ_STRING || valueToObj(v)->type == ObjType::OBJ_ROPE);
+}
+
+// Returns v itself, or the flattened string if v is a rope. Call before
+// handing a value to code that inspects string bytes.
+static inline Value flattenValue(Value v) {
+    if (isObj(v) && valueToObj(v)->type == ObjType::OBJ_ROPE) return objToValue(flattenRope((ObjRope*)valueToObj(v)));
+    return v;
+}
+
+// Hashes interned keys by their cached hash; equality is pointer identity.
+struct ObjStringHash {
+    size_t operator()(const ObjString* s) const { return s->hash; }
 };
 
 struct ObjArray : public Obj {
@@ -92,30 +334,323 @@ struct ObjArray : public Obj {
     ObjArray() : Obj(ObjType::OBJ_ARRAY) {}
 };
 
+enum class ElementKind : uint8_t { FLOAT64, FLOAT32, INT32, INT64, UINT8 };
+
+static inline size_t elementSize(ElementKind kind) {
+    switch (kind) {
+        case ElementKind::FLOAT64: case ElementKind::INT64: return 8;
+        case ElementKind::FLOAT32: case ElementKind::INT32: return 4;
+        case ElementKind::UINT8: return 1;
+    }
+    return 8;
+}
+
+// Fixed-length array of unboxed numbers (Float64Array and friends). Storage
+// is contiguous and aligned for 256-bit vector loads; elements read back as
+// doubles, and stores to integer kinds truncate and wrap like a C cast.
+struct ObjTypedArray : public Obj {
+    static constexpr size_t ALIGNMENT = 32;
+
+    ElementKind kind;
+    size_t length;
+    void* data;
+
+    ObjTypedArray(ElementKind k, size_t n) : Obj(ObjType::OBJ_TYPED_ARRAY), kind(k), length(n) {
+        size_t bytes = (n * elementSize(k) + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+        data = std::aligned_alloc(ALIGNMENT, bytes ? bytes : ALIGNMENT);
+        std::memset(data, 0, bytes);
+    }
+    ~ObjTypedArray() override { std::free(data); }
+    ObjTypedArray(const ObjTypedArray&) = delete;
+    ObjTypedArray& operator=(const ObjTypedArray&) = delete;
+
+    template <typename T> T* as() const { return (T*)data; }
+
+    // Out of line so the interpreter loops keep ObjArray as the hot path.
+    // i must be below length; VM::typedArrayIndex checks it for the loops.
+    double get(size_t i) const;
+    void set(size_t i, double v);
+    const char* kindName() const {
+        switch (kind) {
+            case ElementKind::FLOAT64: return "Float64Array";
+            case ElementKind::FLOAT32: return "Float32Array";
+            case ElementKind::INT32:   return "Int32Array";
+            case ElementKind::INT64:   return "Int64Array";
+            case ElementKind::UINT8:   return "Uint8Array";
+        }
+        return "TypedArray";
+    }
+};
+
+// Hidden class describing the field layout of instances. Every class has a
+// root shape; adding a field moves an instance along a transition to the
+// shape with one more slot, so instances whose fields were added in the same
+// order share a Shape. Shapes are never freed, which keeps them valid as
+// inline cache keys, and the names they hold stay interned.
+struct Shape {
+    Shape* parent;
+    std::vector<ObjString*> names; // Field name of each slot
+    std::vector<std::pair<ObjString*, Shape*>> transitions;
+
+    explicit Shape(Shape* p) : parent(p) {}
+
+    int slotOf(ObjString* name) const {
+        for (size_t i = 0; i < names.size(); i++) {
+            if (names[i] == name) return (int)i;
+        }
+        return -1;
+    }
+    Shape* withField(ObjString* name);
+
+    static Shape* newRoot();
+    static const std::vector<Shape*>& all();
+};
+
+struct ObjInstance;
+
+// Per-site cache for GET_PROPERTY, SET_PROPERTY and INVOKE keyed by the
+// receiver's shape. It holds up to CACHE_SIZE shapes (monomorphic with one,
+// polymorphic beyond); a full cache is megamorphic and stops learning.
+struct InlineCache {
+    static constexpr int CACHE_SIZE = 4;
+    static constexpr uint8_t NONE = 0xff; // Operand of sites without a cache
+
+    struct Entry {
+        Shape* shape;
+        int slot;         // Field slot, or -1 for a method
+        Shape* next;      // SET_PROPERTY that adds the field: shape afterwards
+        Value method;
+        uint32_t epoch;   // methodEpoch when the method was cached
+    };
+
+    Entry entries[CACHE_SIZE];
+    int count {0};
+
+    // Bumped whenever a method is (re)defined, retiring cached methods
+    static inline uint32_t methodEpoch = 0;
+
+    const Entry* find(const Shape* shape) const {
+        for (int i = 0; i < count; i++) {
+            if (entries[i].shape == shape) return &entries[i];
+        }
+        return nullptr;
+    }
+    void add(const Entry& entry) {
+        if (count < CACHE_SIZE) entries[count++] = entry;
+    }
+
+    // Fast paths; false means the caller takes the generic route
+    inline bool load(Value receiver, Value& out) const;
+    inline bool store(Value receiver, Value value) const;
+    inline bool method(ObjInstance* instance, Value& out) const;
+};
+
+// One instruction of a chunk's pre-decoded, direct-threaded form. Operands
+// are widened and resolved once so the dispatcher never parses bytes.
+struct ThreadedInstr {
+    const void* handler;          // Address of the opcode's handler label
+    Value constant;               // Inlined constant or name operand
+    ThreadedInstr* target;        // Absolute jump target
+    uint16_t a;                   // Slot, argument count or element count
+    uint16_t b;                   // Second local slot
+    InlineCache* cache;           // Property site cache, if any
+    uint8_t* ip;                  // Position in the bytecode this was decoded from
+};
+
+// Three-address instruction set of the register VM (--vm=reg). A function's
+// locals live in fixed registers and temporaries above them; R0 holds the
+// callee (or the receiver in methods) like stack slot 0 does. K is the
+// chunk's constant table, d a constant index, global slot or jump offset
+// relative to the next instruction.
+enum class RegOp : uint8_t {
+    MOVE,                                   // a b         R[a] = R[b]
+    LOADK, LOADNIL, LOADTRUE, LOADFALSE,    // a d         R[a] = K[d] / nil / true / false
+    GET_GLOBAL, SET_GLOBAL,                 // a d         R[a] = G[d] / G[d] = R[a]
+    ADD, SUBTRACT, MULTIPLY, DIVIDE, MODULO,// a b c       R[a] = R[b] op R[c]
+    ADDK, SUBTRACTK, MULTIPLYK,             // a b d       R[a] = R[b] op K[d]
+    ADD_INT, SUBTRACT_INT, MULTIPLY_INT, MODULO_INT, // a b c  int-specialized forms of the above
+    EQUAL, NOT_EQUAL, LESS, LESS_EQUAL,     // a b c       R[a] = R[b] op R[c]
+    LESS_INT, LESS_EQUAL_INT,               // a b c
+    NOT, NEGATE,                            // a b         R[a] = op R[b]
+    JUMP,                                   // d
+    JUMP_IF_FALSE, JUMP_IF_TRUE,            // a d         if R[a] is falsy / truthy
+    JUMP_IF_NOT_LESS, JUMP_IF_NOT_LESS_EQUAL,   // b c d   if !(R[b] op R[c])
+    JUMP_IF_NOT_LESS_INT, JUMP_IF_NOT_LESS_EQUAL_INT,
+    JUMP_IF_NOT_EQUAL, JUMP_IF_EQUAL,           // b c d
+    JUMP_IF_NOT_LESSK, JUMP_IF_NOT_LESS_EQUALK, // b c d   if !(R[b] op K[c])
+    JUMP_IF_NOT_GREATERK, JUMP_IF_NOT_GREATER_EQUALK,
+    CALL,                                   // a b         R[a] = R[a](R[a+1] .. R[a+b])
+    INVOKE,                                 // a b c d     R[a] = R[a].K[d](R[a+1] .. R[a+b]), cache c
+    RETURN,                                 // a
+    TAIL_CALL,                              // a b         CALL reusing the current frame; a RETURN follows
+    CLASS,                                  // a d         R[a] = class named K[d]
+    METHOD,                                 // a b d       R[a].methods[K[d]] = R[b]
+    GET_PROPERTY,                           // a b c d     R[a] = R[b].K[d], cache c
+    SET_PROPERTY,                           // a b c d     R[a].K[d] = R[b], cache c
+    ARRAY_NEW,                              // a b c       R[a] = [R[b] .. R[b+c-1]]
+    ARRAY_GET,                              // a b c       R[a] = R[b][R[c]]
+    ARRAY_SET,                              // a b c       R[a][R[b]] = R[c]
+    SYS_QUERY,                              // a d         R[a] = sys K[d]
+    PRINT,                                  // a
+    FLOOR, SQRT,                            // a b
+    HALT
+};
+
+struct RegInstr {
+    RegOp op;
+    uint8_t a, b, c;
+    int32_t d;
+};
+
+// Operand kinds seen at one instruction. VM::run() records them before
+// quickening, and they stay on the Chunk for later tiers to read.
+struct TypeFeedback {
+    enum Kind : uint8_t { INT = 1, DOUBLE = 2, STRING = 4, OTHER = 8 };
+    // After this many failed guards a site is left generic
+    static constexpr uint8_t MAX_DEOPTS = 4;
+
+    uint8_t seen {0};   // Kinds seen so far, or-ed together
+    uint8_t deopts {0}; // Quickened forms rewritten back; MAX_DEOPTS once mixed
+
+    inline void record(Value v);
+    // True once something was seen and all of it was among kinds
+    bool only(uint8_t kinds) const { return seen != 0 && (seen & ~kinds) == 0; }
+    bool monomorphic() const { return seen != 0 && (seen & (seen - 1)) == 0; }
+    bool canQuicken() const { return deopts < MAX_DEOPTS; }
+};
+
 struct Chunk {
     std::vector<uint8_t> code;
     std::vector<Value> constants;
+    std::vector<ThreadedInstr> threaded; // Built on first use by VM::runThreaded()
+    std::vector<RegInstr> registerCode;  // Emitted by RegisterCompiler instead of code
+    int registerCount {0};               // Frame size of registerCode
+    std::vector<InlineCache> caches;     // One per property site
+    std::vector<TypeFeedback> feedback;  // Indexed like code
     int addConstant(Value v) { constants.push_back(v); return constants.size()-1; }
-    void write(uint8_t b, int l) { code.push_back(b); }
+    uint8_t addCache() {
+        if (caches.size() >= InlineCache::NONE) return InlineCache::NONE;
+        caches.emplace_back();
+        return (uint8_t)(caches.size() - 1);
+    }
+    InlineCache* cache(uint8_t index) { return index == InlineCache::NONE ? nullptr : &caches[index]; }
+    void write(uint8_t b, int l) { code.push_back(b); feedback.emplace_back(); }
+    TypeFeedback& feedbackAt(const uint8_t* instruction) { return feedback[instruction - code.data()]; }
+};
+
+// Maps global names to dense slot indices. The compiler resolves every global
+// reference to a slot up front; the name lookup is only needed for late-bound
+// access through the string-keyed GET_GLOBAL family.
+struct GlobalTable {
+    std::vector<std::string> names;
+    std::unordered_map<std::string, int> slots;
+
+    int resolve(const std::string& name) {
+        auto it = slots.find(name);
+        if (it != slots.end()) return it->second;
+        int slot = (int)names.size();
+        names.push_back(name);
+        slots.emplace(name, slot);
+        return slot;
+    }
+    int find(const std::string& name) const {
+        auto it = slots.find(name);
+        return it != slots.end() ? it->second : -1;
+    }
+    size_t size() const { return names.size(); }
+
+    static GlobalTable& shared();
 };
 
+// Native code the method JIT compiled a function to. args are the call's
+// arguments; on true result holds the return value. False means the call
+// had no effect and the interpreter should make it.
+using NativeEntry = bool (*)(const Value* args, Value* globals, Value* result);
+
 struct ObjFunction : public Obj {
     int arity;
     Chunk chunk;
     std::string name;
+    uint32_t calls = 0;          // Interpreted calls, counted up to the method JIT's threshold
+    // Created when the function is queued for the method JIT, whose compiler
+    // thread publishes the entry point into it; shared, as either the
+    // function or the pending compile may go first
+    std::shared_ptr<std::atomic<NativeEntry>> native;
+    bool nativeDisabled = false; // The native code gave a call back
     ObjFunction() : Obj(ObjType::OBJ_FUNCTION), arity(0) {}
 };
 
+// Builtins take their arguments in place: args points at the caller's stack.
+using NativeFn = Value (*)(int argCount, Value* args);
+
+enum NativeFlags : uint8_t {
+    NATIVE_ALLOCATES = 1 << 0, // May allocate; the collector is paused across the call
+    NATIVE_STUB      = 1 << 1, // Not implemented yet; calling it reports the name
+};
+
+struct ObjNative : public Obj {
+    std::string name;
+    NativeFn function;
+    int arity;     // -1 when variadic
+    uint8_t flags; // NativeFlags
+    ObjNative(const std::string& n, NativeFn fn, int a, uint8_t f)
+        : Obj(ObjType::OBJ_NATIVE), name(n), function(fn), arity(a), flags(f) {}
+};
+
 struct ObjClass : public Obj {
     std::string name;
-    std::map<std::string, Value> methods;
-    ObjClass(const std::string& n) : Obj(ObjType::OBJ_CLASS), name(n) {}
+    std::unordered_map<ObjString*, Value, ObjStringHash> methods; // Keyed by interned name
+    Shape* instanceShape; // Root shape of new instances
+    ObjClass(const std::string& n) : Obj(ObjType::OBJ_CLASS), name(n), instanceShape(Shape::newRoot()) {}
 };
 
 struct ObjInstance : public Obj {
     ObjClass* klass;
-    std::map<std::string, Value> fields;
-    ObjInstance(ObjClass* k) : Obj(ObjType::OBJ_INSTANCE), klass(k) {}
+    Shape* shape;
+    std::vector<Value> fields; // Indexed by shape->slotOf(name)
+    ObjInstance(ObjClass* k) : Obj(ObjType::OBJ_INSTANCE), klass(k), shape(k->instanceShape) {}
 };
 
+static inline bool isInstance(Value v) {
+    return isObj(v) && valueToObj(v)->type == ObjType::OBJ_INSTANCE;
+}
+
+void TypeFeedback::record(Value v) {
+    if (isInt(v)) seen |= INT;
+    else if (isDouble(v)) seen |= DOUBLE;
+    else if (isString(v)) seen |= STRING;
+    else seen |= OTHER;
+}
+
+bool InlineCache::load(Value receiver, Value& out) const {
+    if (!isInstance(receiver)) return false;
+    ObjInstance* instance = (ObjInstance*)valueToObj(receiver);
+    const Entry* entry = find(instance->shape);
+    if (!entry || entry->slot < 0) return false;
+    out = instance->fields[entry->slot];
+    return true;
+}
+
+// The caller still runs the write barrier
+bool InlineCache::store(Value receiver, Value value) const {
+    if (!isInstance(receiver)) return false;
+    ObjInstance* instance = (ObjInstance*)valueToObj(receiver);
+    const Entry* entry = find(instance->shape);
+    if (!entry) return false;
+    if (entry->next) {
+        instance->shape = entry->next;
+        instance->fields.push_back(value);
+    } else {
+        instance->fields[entry->slot] = value;
+    }
+    return true;
+}
+
+bool InlineCache::method(ObjInstance* instance, Value& out) const {
+    const Entry* entry = find(instance->shape);
+    if (!entry || entry->slot >= 0 || entry->epoch != methodEpoch) return false;
+    out = entry->method;
+    return true;
+}
+
 } // namespace kio
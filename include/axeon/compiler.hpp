@@ -7,6 +7,9 @@ SPDX-License-Identifier: GPL-3.0-only
 
 #include "axeon/ast.hpp"
 #include "axeon/bytecode.hpp"
+#include "axeon/type_inference.hpp"
+#include <iosfwd>
+#include <unordered_set>
 
 namespace kio {
 
@@ -17,10 +20,21 @@ public:
     Compiler(Compiler* parent = nullptr, FunctionType type = FunctionType::TYPE_SCRIPT);
     ObjFunction* compile(const std::vector<StmtPtr>& statements);
 
+    // Fused superinstructions are on by default; turning them off emits only
+    // the generic opcodes (for comparing dispatch counts).
+    static void setSuperinstructions(bool enabled) { superinstructions_ = enabled; }
+    // The Peephole pass runs over each function once it is compiled. Given a
+    // report stream, it prints the function's instruction count before and after.
+    static void setPeephole(bool enabled, std::ostream* report = nullptr) {
+        peephole_ = enabled;
+        peepholeReport_ = report;
+    }
+
 private:
     struct Local {
         std::string name;
         int depth;
+        bool integer = false; // Declared with an integer type annotation
     };
 
     Compiler* parent_;
@@ -29,9 +43,26 @@ private:
 
     std::vector<Local> locals_;
     int scopeDepth {0};
+    bool hadError_ {false}; // Root compiler only; compile() then returns nullptr
+    bool tailCall_ {false}; // The call being compiled is the value of a return
+    std::unordered_set<std::string> integerGlobals_; // Root compiler only
+    const TypeInference* types_; // Shared with nested compilers during compile()
+
+    static bool superinstructions_;
+    static bool peephole_;
+    static std::ostream* peepholeReport_;
 
     void compileStmt(const StmtPtr& stmt);
     void compileExpr(const ExprPtr& expr);
+    void compileEffect(const ExprPtr& expr);
+    int compileConditionJump(const ExprPtr& condition);
+    bool emitIncrement(const Expr::Assign& assign);
+    int localOperand(const ExprPtr& expr);
+    bool isIntExpr(const ExprPtr& expr);
+    StaticType staticType(const ExprPtr& expr) const { return types_ ? types_->typeOf(expr) : StaticType(); }
+    OpCode uncheckedBinary(const Expr::Binary& binary) const;
+    static int powerOfTwo(const ExprPtr& expr);
+    void finishChunk();
     
     void emitByte(uint8_t byte);
     void emitBytes(uint8_t b1, uint8_t b2);
@@ -42,8 +73,9 @@ private:
     int emitJump(OpCode instruction);
     void patchJump(int offset);
     void emitLoop(int loopStart);
+    void emitGlobal(OpCode op, const std::string& name);
 
-    void addLocal(const std::string& name);
+    void addLocal(const std::string& name, bool integer = false);
     int resolveLocal(const std::string& name);
     
     Chunk* currentChunk() { return &function_->chunk; }
@@ -6,21 +6,67 @@ SPDX-License-Identifier: GPL-3.0-only
 #pragma once
 
 #include "axeon/bytecode.hpp"
+#include <atomic>
 #include <memory>
 #include <string>
 #include <unordered_map>
 
 namespace kio {
 
+// Compiles hot loops and functions with LLVM. Requests are queued to
+// compiler threads and the interpreter keeps running the bytecode meanwhile;
+// the compiled code is published through an atomic the VM polls. The
+// destructor waits for the compile in progress and drops the rest.
 class JITEngine {
 public:
-    JITEngine();
+    // Compiles done on the compiler threads so far
+    struct Stats {
+        size_t loops = 0;
+        size_t functions = 0;
+        size_t failed = 0;
+        double totalMs = 0;
+        double maxMs = 0;
+    };
+
+    explicit JITEngine(unsigned compileThreads = 1);
     ~JITEngine();
 
-    // Native loop function type: stack base, stack pointer reference, slots offset, globals map
-    typedef void (*CompiledLoop)(Value* stack, int& sp, int slots, std::unordered_map<std::string, Value>& globals);
+    // False when this build has no LLVM or it failed to start; requests are
+    // then dropped.
+    bool available() const;
+    Stats stats() const;
+
+    // Native loop function type: stack base, stack pointer reference, slots
+    // offset, global slot table. Returns the bytecode offset the interpreter
+    // resumes at.
+    typedef int (*CompiledLoop)(Value* stack, int& sp, int slots, Value* globals);
+
+    // slots (slotCount of them live) and globals hold the values at the loop
+    // header. The native loop is specialized to the int or double kind of
+    // each slot it touches and returns the header at once if they differ on
+    // entry. It leaves by a side exit: when the loop ends, a branch goes
+    // where it was not compiled for, or an int operation overflows. The exit
+    // writes the slots and the operands the interpreter expects back to the
+    // stack and returns the offset of the instruction to resume at.
+    CompiledLoop compileLoop(Chunk* chunk, uint8_t* startIp, const Value* slots, int slotCount, const Value* globals);
+    // compileLoop on a compiler thread, over copies of the code and values
+    // taken now. out receives the loop once it is compiled and is left
+    // alone if it cannot be; it must outlive the JITEngine.
+    void requestLoop(const Chunk& chunk, const uint8_t* startIp, const Value* slots, int slotCount,
+                     const Value* globals, size_t globalCount, std::atomic<CompiledLoop>* out);
 
-    CompiledLoop compileLoop(Chunk* chunk, uint8_t* startIp);
+    // Compiles function together with every function it calls through a
+    // global slot, which call each other natively. All of them may only
+    // compute on numbers, read globals and call each other; a function that
+    // prints, writes a global or calls anything else stays interpreted, as
+    // does every function that calls it. globals holds the slot values now:
+    // each call site is bound to the function its slot holds and the native
+    // code gives the call back to the interpreter if that changes.
+    NativeEntry compileFunction(ObjFunction* function, const Value* globals, size_t globalCount);
+    // compileFunction on a compiler thread, over copies of the code and
+    // globals taken now. out receives the entry point once it is compiled.
+    void requestFunction(ObjFunction* function, const Value* globals, size_t globalCount,
+                         std::shared_ptr<std::atomic<NativeEntry>> out);
 
 private:
     struct Impl;
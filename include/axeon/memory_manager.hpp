@@ -5,47 +5,208 @@ SPDX-License-Identifier: GPL-3.0-only
 
 #pragma once
 
-#include <memory>
+#include "axeon/bytecode.hpp"
+#include <functional>
+#include <iosfwd>
+#include <new>
+#include <type_traits>
+#include <utility>
 #include <vector>
-#include <atomic>
-#include <mutex>
 
 namespace kio {
 
+// Object kinds that usually die young. They are bump-allocated in the nursery
+// and promoted to the old space only if they survive a minor collection.
+template <typename T> struct AllocatesInNursery : std::false_type {};
+template <> struct AllocatesInNursery<ObjString> : std::true_type {};
+template <> struct AllocatesInNursery<ObjArray> : std::true_type {};
+template <> struct AllocatesInNursery<ObjRope> : std::true_type {};
+
+// Weak set of interned strings: open addressing with linear probing over the
+// cached hash. Entries that did not survive a full collection are dropped
+// before the sweep frees them.
+class StringTable {
+public:
+    ObjString* find(const std::string& chars, uint32_t hash) const;
+    void insert(ObjString* string);
+    void removeUnmarked(uint32_t epoch);
+    size_t size() const { return count_; }
+
+private:
+    std::vector<ObjString*> entries_;
+    size_t count_ {0};
+
+    void grow();
+};
+
+// Generational collector for every VM heap object. All Obj allocation goes
+// through allocate<T>(). Short-lived kinds are bump-allocated in a nursery
+// that is evacuated by a copying minor collection; survivors and all other
+// objects live in an old space managed by precise mark-sweep. Roots are
+// enumerated by the registered root markers (one per live VM), which must
+// pass slots by reference so that evacuated objects can be forwarded.
 class MemoryManager {
 public:
-    MemoryManager(size_t initial_pool_size = 1024 * 1024); // 1MB default
+    struct Stats {
+        size_t collections = 0;
+        size_t minorCollections = 0;
+        size_t objectsAllocated = 0;
+        size_t youngAllocated = 0;
+        size_t objectsPromoted = 0;
+        size_t objectsFreed = 0;
+        size_t bytesFreed = 0;
+        size_t liveObjects = 0;
+        size_t peakHeapSize = 0;
+        double lastPauseMs = 0;
+        double maxPauseMs = 0;
+        double totalPauseMs = 0;
+        double minorPauseMs = 0;
+    };
+
+    using RootMarker = std::function<void(MemoryManager&)>;
+
+    // Disables collection for its lifetime. Native code that holds objects in
+    // C++ locals (builtins, the compiler) runs under one of these.
+    class Pause {
+    public:
+        explicit Pause(MemoryManager& gc) : gc_(gc) { gc_.pause_depth_++; }
+        ~Pause() { gc_.pause_depth_--; }
+        Pause(const Pause&) = delete;
+        Pause& operator=(const Pause&) = delete;
+    private:
+        MemoryManager& gc_;
+    };
+
+    MemoryManager();
     ~MemoryManager();
-    
-    // Fast allocation from memory pools
-    void* allocate(size_t size, size_t alignment = 8);
-    void deallocate(void* ptr);
-    
-    // Garbage collection
+
+    static MemoryManager& heap();
+
+    template <typename T, typename... Args>
+    T* allocate(Args&&... args) {
+        if constexpr (AllocatesInNursery<T>::value) {
+            constexpr size_t size = nurserySize(sizeof(T));
+            if (stress_mode_) collectIfAllowed();
+            else if (nursery_top_ + size > nursery_end_ || young_bytes_ > YOUNG_BYTES_LIMIT) collectYoungIfAllowed();
+
+            // Falls through to the old space while collection is paused
+            if (nursery_top_ + size <= nursery_end_) {
+                T* obj = new (nursery_top_) T(std::forward<Args>(args)...);
+                nursery_top_ += size;
+                young_bytes_ += objectSize(obj);
+                stats_.objectsAllocated++;
+                stats_.youngAllocated++;
+                return obj;
+            }
+        }
+        return allocateOld<T>(std::forward<Args>(args)...);
+    }
+
+    // Allocates directly in the old space, for objects whose address must
+    // stay stable (interned strings).
+    template <typename T, typename... Args>
+    T* allocateOld(Args&&... args) {
+        if (stress_mode_ || bytes_allocated_ + sizeof(T) > next_gc_) collectIfAllowed();
+
+        T* obj = new T(std::forward<Args>(args)...);
+        track(obj);
+        stats_.objectsAllocated++;
+        return obj;
+    }
+
+    // Returns the unique string object with these contents, creating it on
+    // first use. Used for all compiler constants and identifier names.
+    ObjString* intern(const std::string& chars);
+
+    // Must be called after storing value into container (array element,
+    // instance field) so that old-to-young references are found by the next
+    // minor collection.
+    void writeBarrier(Obj* container, Value value) {
+        if (!container->remembered && isObj(value) && isYoung(valueToObj(value)) && !isYoung(container)) {
+            container->remembered = true;
+            remembered_set_.push_back(container);
+        }
+    }
+
+    bool isYoung(const Obj* obj) const {
+        return (const char*)obj >= nursery_start_ && (const char*)obj < nursery_end_;
+    }
+
+    // Garbage collection. collectGarbage() is a full collection; the nursery
+    // is always evacuated first so the mark phase only sees the old space.
     void collectGarbage();
+    void collectYoung();
     void setGCThreshold(size_t threshold);
-    
+    void setStressMode(bool enabled) { stress_mode_ = enabled; }
+    bool isStressMode() const { return stress_mode_; }
+
+    // Root registration; owner is used as the key for removal
+    void addRoots(void* owner, RootMarker marker);
+    void removeRoots(void* owner);
+
+    // Called by root markers and while tracing. During a minor collection a
+    // young referent is evacuated and the slot is rewritten to its new home.
+    void markValue(Value& value);
+    void markObject(Obj* obj);
+
     // Memory statistics
-    size_t getTotalAllocated() const;
-    size_t getPoolSize() const;
-    size_t getFragmentation() const;
-    
-    // Memory limits
-    void setMemoryLimit(size_t limit);
-    bool isMemoryLimitExceeded() const;
+    size_t getTotalAllocated() const { return bytes_allocated_; }
+    size_t getObjectCount() const { return stats_.liveObjects; }
+    size_t getInternedCount() const { return strings_.size(); }
+    const Stats& getStats() const { return stats_; }
+    void printStats(std::ostream& out) const;
 
 private:
-    struct MemoryPool;
-    std::vector<std::unique_ptr<MemoryPool>> pools_;
-    
-    std::atomic<size_t> total_allocated_{0};
-    std::atomic<size_t> memory_limit_{SIZE_MAX};
-    std::atomic<size_t> gc_threshold_{1024 * 1024}; // 1MB
-    
-    mutable std::mutex allocation_mutex_;
-    
-    void expandPool();
-    void compactPools();
+    // Old space
+    Obj* objects_ {nullptr};
+    Obj* scanned_old_ {nullptr}; // Old objects from here on hold no young references
+    std::vector<Obj*> gray_stack_;
+    std::vector<std::pair<void*, RootMarker>> roots_;
+    StringTable strings_;
+
+    // Nursery
+    char* nursery_start_;
+    char* nursery_top_;
+    char* nursery_end_;
+    size_t young_bytes_ {0}; // Including string and element buffers owned by young objects
+    std::vector<Obj*> remembered_set_;
+    std::vector<Obj*> promoted_;
+    bool minor_ {false};
+
+    size_t bytes_allocated_ {0};
+    size_t next_gc_;
+    size_t min_threshold_;
+    uint32_t epoch_ {0};
+    int pause_depth_ {0};
+    bool stress_mode_ {false};
+    Stats stats_;
+
+    static constexpr size_t HEAP_GROW_FACTOR = 2;
+    static constexpr size_t NURSERY_SIZE = 1024 * 1024;
+    static constexpr size_t YOUNG_BYTES_LIMIT = 8 * NURSERY_SIZE;
+
+    static constexpr size_t nurserySize(size_t size) { return (size + 15) & ~(size_t)15; }
+
+    void collectIfAllowed();
+    void collectYoungIfAllowed();
+    void track(Obj* obj);
+    Obj* evacuate(Obj* obj);
+    void releaseNursery();
+    void traceReferences();
+    void blacken(Obj* obj);
+    void sweep();
+    static size_t objectSize(const Obj* obj);
 };
 
+// Allocates a VM heap object through the shared collector.
+template <typename T, typename... Args>
+T* allocateObject(Args&&... args) {
+    return MemoryManager::heap().allocate<T>(std::forward<Args>(args)...);
+}
+
+// Interns a string in the shared collector.
+inline ObjString* internString(const std::string& chars) {
+    return MemoryManager::heap().intern(chars);
+}
+
 } // namespace kio
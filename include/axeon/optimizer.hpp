@@ -5,50 +5,106 @@ SPDX-License-Identifier: GPL-3.0-only
 
 #pragma once
 
-#include <memory>
-#include <vector>
-#include <unordered_map>
+#include "axeon/ast.hpp"
+#include <iosfwd>
+#include <optional>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 namespace kio {
 
-class ASTNode; // Forward declaration
-class Expr; // Forward declaration
-class Stmt; // Forward declaration
-
+// AST optimization pipeline, run between Parser::parse() and the compilers.
+// Passes rewrite the program in place. -O0 runs none of them; -O1 folds
+// constants and removes dead code; -O2 also inlines small functions,
+// replaces non-escaping arrays with locals and propagates `const` bindings,
+// repeats the pipeline while it keeps finding work, and then optimizes loops.
 class Optimizer {
 public:
-    Optimizer();
+    enum class Level { O0, O1, O2 };
+
+    explicit Optimizer(Level level = Level::O1);
     ~Optimizer();
-    
-    // Optimize AST
-    std::vector<std::unique_ptr<ASTNode>> optimize(
-        const std::vector<std::unique_ptr<ASTNode>>& ast
-    );
-    
-    // Individual optimization passes
-    std::unique_ptr<Expr> optimizeExpression(std::unique_ptr<Expr> expr);
-    std::unique_ptr<Stmt> optimizeStatement(std::unique_ptr<Stmt> stmt);
-    
+
+    void optimize(std::vector<StmtPtr>& program);
+
     // Configuration
     void enableOptimization(const std::string& name, bool enabled = true);
     void disableOptimization(const std::string& name);
     bool isOptimizationEnabled(const std::string& name) const;
-    
-    // Statistics
-    size_t getOptimizationCount() const { return optimization_count_; }
+
+    // Statistics, one entry per pass in pipeline order
+    struct PassStats {
+        std::string name;
+        size_t removed = 0;  // AST nodes
+        size_t rewrites = 0; // Nodes replaced or statements dropped
+    };
+    const std::vector<PassStats>& statistics() const { return stats_; }
+    // Verbose output also lists every call site that was inlined
+    void printStats(std::ostream& out, bool verbose = false) const;
     void resetStatistics();
 
 private:
+    using Scope = std::unordered_map<std::string, std::optional<Expr::Literal>>; // nullopt: not a constant
+
+    Level level_;
     std::unordered_map<std::string, bool> enabled_optimizations_;
-    size_t optimization_count_;
-    
+    std::vector<PassStats> stats_;
+    size_t rewrites_ = 0; // For the running pass
+
+    // Constant propagation state
+    std::unordered_set<std::string> unstable_; // Assigned somewhere, or declared twice as a global
+    std::vector<Scope> scopes_;                // Innermost last; globals first
+    bool globalsVisible_ = true;               // False once the program loads code we cannot see
+    size_t temporaries_ = 0;                   // Locals the loop pass has introduced
+
+    // Function inlining state
+    std::unordered_map<std::string, Stmt::Function*> inlinable_; // Global leaf functions declared so far
+    bool inlining_ = false;                   // propagate() is walking for the inliner
+    std::string caller_;                      // Function the walk is in
+    std::vector<std::string> inlinedSites_;   // "callee into caller", in program order
+
+    bool runPass(const std::string& name, std::vector<StmtPtr>& program, void (Optimizer::*pass)(std::vector<StmtPtr>&));
+
     // Optimization passes
-    std::unique_ptr<Expr> constantFolding(std::unique_ptr<Expr> expr);
-    std::unique_ptr<Expr> deadCodeElimination(std::unique_ptr<Expr> expr);
-    std::unique_ptr<Expr> commonSubexpressionElimination(std::unique_ptr<Expr> expr);
-    std::unique_ptr<Stmt> loopOptimization(std::unique_ptr<Stmt> stmt);
-    
+    void functionInlining(std::vector<StmtPtr>& program);
+    void constantPropagation(std::vector<StmtPtr>& program);
+    void constantFolding(std::vector<StmtPtr>& program);
+    void deadCodeElimination(std::vector<StmtPtr>& program);
+    void loopOptimization(std::vector<StmtPtr>& program);
+    void scalarReplacement(std::vector<StmtPtr>& program);
+
+    void scanProgram(std::vector<StmtPtr>& program);
+    int scopeOf(const std::string& name) const;
+    std::vector<Scope> enterFunction(const std::vector<std::pair<std::string, std::string>>& params, bool method);
+
+    void propagate(StmtPtr& stmt, bool unconditional);
+    void propagate(ExprPtr& expr);
+    void propagateFunction(const std::vector<std::pair<std::string, std::string>>& params, std::vector<StmtPtr>& body,
+                           bool method);
+    void declare(const std::string& name, const ExprPtr& initializer, bool isConst, bool unconditional);
+    void addInlinable(Stmt::Function& function);
+    void inlineCall(ExprPtr& expr);
+    void fold(StmtPtr& stmt);
+    void fold(ExprPtr& expr);
+    void eliminate(std::vector<StmtPtr>& statements);
+    void eliminate(StmtPtr& stmt);
+    void eliminate(ExprPtr& expr);
+
+    struct LoopEffects;
+    static LoopEffects loopEffects(StmtPtr& loop);
+    void optimizeLoops(std::vector<StmtPtr>& statements);
+    void optimizeLoops(StmtPtr& stmt, std::vector<StmtPtr>* list, size_t index);
+    void optimizeLoops(ExprPtr& expr);
+    void hoistInvariants(StmtPtr& loop, const LoopEffects& effects, std::vector<StmtPtr>& preheader);
+    bool invariant(const ExprPtr& expr, const LoopEffects& effects) const;
+    void reduceStrength(StmtPtr& loop, std::vector<StmtPtr>* list, size_t index, const LoopEffects& effects,
+                        std::vector<StmtPtr>& preheader);
+
+    void replaceArrays(std::vector<StmtPtr>& statements, bool global);
+    void replaceArrays(StmtPtr& stmt);
+
     void initializeOptimizations();
 };
 
@@ -27,6 +27,7 @@ private:
     const Token &advance();
     bool check(TokenType type) const;
     bool match(std::initializer_list<TokenType> types);
+    bool checkTypeName() const;
 
     StmtPtr declaration();
     StmtPtr varDeclaration();
@@ -0,0 +1,54 @@
+/*
+Copyright (c) 2026 Dipanjan Dhar
+SPDX-License-Identifier: GPL-3.0-only
+*/
+
+#pragma once
+
+#include "axeon/bytecode.hpp"
+#include <cstdint>
+#include <vector>
+
+namespace kio {
+
+// Peephole optimization over a finished Chunk, run by the Compiler on each
+// function as it completes. The code is decoded into instructions, rewritten
+// there, and encoded again with every jump offset relocated:
+//   SET_LOCAL x; POP; GET_LOCAL x  ->  SET_LOCAL x   (and the global slot form)
+//   EQUAL; NOT                     ->  NOT_EQUAL
+//   jumps to jumps are threaded to the final target, jumps to the next
+//   instruction are dropped, and code no path reaches is removed (the NIL
+//   RETURN after an explicit return, the HALT after a final one).
+// Constants are deduplicated and the ones no instruction uses are dropped.
+class Peephole {
+public:
+    struct Stats {
+        size_t instructionsBefore = 0;
+        size_t instructionsAfter = 0;
+        size_t constantsBefore = 0;
+        size_t constantsAfter = 0;
+    };
+
+    // Leaves the chunk as it was if it cannot be decoded or a relocated
+    // offset no longer fits its operand.
+    static Stats optimize(Chunk& chunk);
+
+private:
+    struct Instruction {
+        OpCode op;
+        uint8_t operands[4] = {};
+        int target = -1;    // Instruction a jump lands on
+        bool label = false; // Some jump lands here
+        bool live = true;
+    };
+
+    static bool decode(const Chunk& chunk, std::vector<Instruction>& code);
+    static bool threadJumps(std::vector<Instruction>& code);
+    static bool rewrite(std::vector<Instruction>& code);
+    static bool removeUnreachable(std::vector<Instruction>& code);
+    static void markLabels(std::vector<Instruction>& code);
+    static bool encode(const std::vector<Instruction>& code, std::vector<uint8_t>& out);
+    static void compactConstants(std::vector<Instruction>& code, std::vector<Value>& constants);
+};
+
+} // namespace kio
@@ -0,0 +1,69 @@
+/*
+Copyright (c) 2026 Dipanjan Dhar
+SPDX-License-Identifier: GPL-3.0-only
+*/
+
+#pragma once
+
+#include "axeon/ast.hpp"
+#include "axeon/bytecode.hpp"
+#include <unordered_set>
+
+namespace kio {
+
+// Compiles the AST to the three-address register instruction set (RegOp)
+// run by VM::interpretRegisters(). Locals are pinned to registers in
+// declaration order; temporaries are allocated above them and released at
+// the end of each statement, so a frame needs locals + deepest temps.
+class RegisterCompiler {
+public:
+    enum class FunctionType { TYPE_FUNCTION, TYPE_METHOD, TYPE_SCRIPT };
+
+    explicit RegisterCompiler(FunctionType type = FunctionType::TYPE_SCRIPT);
+    ObjFunction* compile(const std::vector<StmtPtr>& statements); // nullptr on error
+
+private:
+    struct Local {
+        std::string name;
+        int depth;
+        bool integer = false; // Declared with an integer type annotation
+    };
+
+    ObjFunction* function_;
+    FunctionType type_;
+
+    std::vector<Local> locals_; // Register i holds locals_[i]
+    int scopeDepth_ {0};
+    int freeReg_ {0};
+    bool hadError_ {false};
+    std::unordered_set<std::string> integerGlobals_; // Inherited by nested functions
+
+    void compileStmt(const StmtPtr& stmt);
+    void compileBlock(const std::vector<StmtPtr>& statements);
+    void compileEffect(const ExprPtr& expr);
+    void compileExpr(const ExprPtr& expr, int dst);
+    int compileOperand(const ExprPtr& expr, bool copyLocals = false);
+    void compileAssign(const ExprPtr& value, int local);
+    void compileCall(const Expr::Call& call, int dst, bool tail = false); // tail: emit TAIL_CALL
+    int compileConditionJump(const ExprPtr& condition);
+    bool isIntExpr(const ExprPtr& expr);
+    ObjFunction* compileFunction(const std::string& name, const std::vector<std::pair<std::string, std::string>>& params,
+                                 const std::vector<StmtPtr>& body, FunctionType type);
+
+    int emit(RegOp op, int a = 0, int b = 0, int c = 0, int32_t d = 0);
+    void patchJump(int index);
+    void emitLoop(int loopStart);
+    int constant(Value value);
+    int globalSlot(const std::string& name);
+
+    void beginScope() { scopeDepth_++; }
+    void endScope();
+    int addLocal(const std::string& name, bool integer = false);
+    int resolveLocal(const std::string& name);
+    int allocateRegister();
+    void releaseTemporaries() { freeReg_ = (int)locals_.size(); }
+
+    Chunk* currentChunk() { return &function_->chunk; }
+};
+
+} // namespace kio
@@ -25,29 +25,8 @@ namespace kio {
 // Type Feedback System
 // ============================================================================
 
-struct TypeFeedback {
-    ValueType type = ValueType::VAL_NIL;
-    bool is_monomorphic = true;  // Always same type
-    bool is_number = false;
-    bool is_integer = false;
-    int sample_count = 0;
-    
-    void record(ValueType t) {
-        sample_count++;
-        if (type == ValueType::VAL_NIL) {
-            type = t;
-        } else if (type != t) {
-            is_monomorphic = false;
-        }
-        if (t == ValueType::VAL_NUMBER) {
-            is_number = true;
-        }
-    }
-    
-    bool canEliminateTypeCheck() const {
-        return is_monomorphic && sample_count > 10;
-    }
-};
+// TypeFeedback lives in bytecode.hpp; the interpreter fills one per code
+// offset in Chunk::feedback.
 
 // ============================================================================
 // Trace Instruction
@@ -95,20 +74,28 @@ private:
 // Code Buffer for Native Code Generation
 // ============================================================================
 
+// Writable memory that becomes executable, and read-only, once finalized.
 class CodeBuffer {
 public:
     CodeBuffer(size_t size = 64 * 1024);
     ~CodeBuffer();
+    CodeBuffer(const CodeBuffer&) = delete;
+    CodeBuffer& operator=(const CodeBuffer&) = delete;
     
     void* getBuffer() const { return buffer_; }
     size_t getSize() const { return size_; }
     size_t getOffset() const { return offset_; }
+    // False if the memory could not be mapped or an emit did not fit; the
+    // code is incomplete then and must not run
+    bool isValid() const { return buffer_ != nullptr && !overflowed_; }
     
     void emitByte(uint8_t byte);
     void emitBytes(const uint8_t* bytes, size_t count);
     void emitInt32(int32_t value);
     void emitInt64(int64_t value);
     void emitDouble(double value);
+    // Rewrites four bytes emitted earlier, such as a jump displacement
+    void patchInt32(size_t offset, int32_t value);
     
     void* finalize();
     
@@ -116,6 +103,7 @@ private:
     void* buffer_;
     size_t size_;
     size_t offset_;
+    bool overflowed_ {false};
     
     bool allocateExecutableMemory();
     void makeExecutable();
@@ -125,67 +113,118 @@ private:
 // Native Code Generator (x86_64)
 // ============================================================================
 
+// Emits System V x86-64 machine code into a CodeBuffer. Every integer
+// operation is 64 bits wide unless its name says otherwise.
 class NativeCodeGenerator {
 public:
+    // In encoding order
     enum class Register {
-        RAX, RBX, RCX, RDX, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15
+        RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15
+    };
+    enum class XmmRegister {
+        XMM0, XMM1, XMM2, XMM3, XMM4, XMM5, XMM6, XMM7,
+        XMM8, XMM9, XMM10, XMM11, XMM12, XMM13, XMM14, XMM15
+    };
+    // Branch and setcc conditions in encoding order. B/A compare unsigned
+    // and L/G signed; ucomisd sets the unsigned flags.
+    enum class Condition : uint8_t {
+        O, NO, B, AE, E, NE, BE, A, S, NS, P, NP, L, GE, LE, G
     };
     
     NativeCodeGenerator(CodeBuffer& buffer);
     
-    // Prologue/Epilogue
+    // Prologue/Epilogue. The prologue saves rbx and r12-r15, which leaves
+    // rsp 16-byte aligned for calls; the epilogue restores them and returns.
     void emitPrologue();
     void emitEpilogue();
     
     // Register operations
     void emitMov(Register dest, Register src);
     void emitMov(Register reg, int64_t imm);
-    void emitMov(Register reg, void* addr);
-    void emitMov(void* addr, Register reg);
+    void emitLoad(Register dest, Register base, int32_t disp);        // mov dest, [base + disp]
+    void emitStore(Register base, int32_t disp, Register src);        // mov [base + disp], src
+    void emitLoadInt32(Register dest, Register base, int32_t disp);   // movsxd dest, dword [base + disp]
+    void emitStoreInt32(Register base, int32_t disp, Register src);   // mov dword [base + disp], src32
+    void emitMovsxd(Register dest, Register src);                     // Sign-extends src32
+    void emitLea(Register dest, Register base, int32_t disp);
+    void emitLea(Register dest, Register base, Register index, uint8_t scale);
     
     // Stack operations
     void emitPush(Register reg);
     void emitPop(Register reg);
+    
+    // Integer arithmetic and logic
     void emitAdd(Register reg, int32_t imm);
     void emitSub(Register reg, int32_t imm);
+    void emitAdd(Register dest, Register src);
+    void emitSub(Register dest, Register src);
+    void emitImul(Register dest, Register src);
+    void emitAnd(Register dest, Register src);
+    void emitOr(Register dest, Register src);
+    void emitXor(Register dest, Register src);
+    void emitNeg(Register reg);
+    void emitShl(Register reg, uint8_t count);
+    void emitShr(Register reg, uint8_t count);
+    void emitSar(Register reg, uint8_t count);
     
     // Arithmetic operations (SSE2 for doubles)
-    void emitAddSD(Register xmm_dest, Register xmm_src);
-    void emitSubSD(Register xmm_dest, Register xmm_src);
-    void emitMulSD(Register xmm_dest, Register xmm_src);
-    void emitDivSD(Register xmm_dest, Register xmm_src);
-    
-    // SIMD Vectorization (AVX2)
-    void emitVAddPD(Register ymm_dest, Register ymm_src1, Register ymm_src2);
-    void emitVMulPD(Register ymm_dest, Register ymm_src1, Register ymm_src2);
-    void emitVLoadPD(Register ymm_dest, void* addr);
-    void emitVStorePD(void* addr, Register ymm_src);
+    void emitAddSD(XmmRegister xmm_dest, XmmRegister xmm_src);
+    void emitSubSD(XmmRegister xmm_dest, XmmRegister xmm_src);
+    void emitMulSD(XmmRegister xmm_dest, XmmRegister xmm_src);
+    void emitDivSD(XmmRegister xmm_dest, XmmRegister xmm_src);
+    void emitMovq(XmmRegister xmm_dest, Register src);
+    void emitMovq(Register dest, XmmRegister xmm_src);
+    
+    // SIMD Vectorization (AVX, 256-bit)
+    void emitVAddPD(XmmRegister ymm_dest, XmmRegister ymm_src1, XmmRegister ymm_src2);
+    void emitVMulPD(XmmRegister ymm_dest, XmmRegister ymm_src1, XmmRegister ymm_src2);
+    void emitVLoadPD(XmmRegister ymm_dest, Register base, int32_t disp);
+    void emitVStorePD(Register base, int32_t disp, XmmRegister ymm_src);
     
     // Comparison and branching
     void emitCmp(Register reg1, Register reg2);
+    void emitCmp(Register reg, int32_t imm);
+    void emitTest(Register reg1, Register reg2);
+    void emitUcomisd(XmmRegister xmm1, XmmRegister xmm2);
+    // Sets the low byte of reg to 1 if cc holds and 0 otherwise
+    void emitSetcc(Condition cc, Register reg);
+    // movzx dest32, src8
+    void emitMovzxByte(Register dest, Register src);
     void emitJump(void* target);
-    void emitJumpIfEqual(void* target);
-    void emitJumpIfNotEqual(void* target);
-    void emitJumpIfGreater(void* target);
-    void emitJumpIfLess(void* target);
-    
-    // Type operations (with elimination)
-    void emitTypeCheck(Register reg, ValueType expected_type, bool can_eliminate);
-    void emitLoadValue(Register xmm_reg, Register stack_ptr, int offset);
-    void emitStoreValue(Register stack_ptr, int offset, Register xmm_reg);
-    
-    // Loop operations
-    void emitLoopStart(Register counter_reg, int limit);
-    void emitLoopEnd(void* loop_start);
+    void emitJumpIf(Condition cc, void* target);
+    // Jumps to a target not emitted yet. Each returns the offset of its
+    // displacement, which bind() points at the target later.
+    size_t emitJump();
+    size_t emitJumpIf(Condition cc);
+    void bind(size_t jump);                // At the current offset
+    void bind(size_t jump, size_t target); // At target, an offset into the buffer
+    void emitCall(Register target);
+    
+    // Double loads and stores
+    void emitLoadValue(XmmRegister xmm_reg, Register base, int32_t disp);
+    void emitStoreValue(Register base, int32_t disp, XmmRegister xmm_reg);
     
 private:
     CodeBuffer& buffer_;
     
-    // Helper methods
-    void emitREX(bool w, bool r, bool x, bool b);
+    // Helper methods. Register numbers are 0-15; emitREX leaves the prefix
+    // out when no bit is set unless force is given (byte registers 4-7).
+    void emitREX(bool w, int reg, int index, int base, bool force = false);
     void emitModRM(uint8_t mod, uint8_t reg, uint8_t rm);
     void emitSIB(uint8_t scale, uint8_t index, uint8_t base);
+    // ModRM, SIB and displacement for [base + disp]
+    void emitMemory(int reg, Register base, int32_t disp);
+    // REX.W op reg, rm with both operands registers
+    void emitRegisterOp(uint8_t opcode, int reg, int rm);
+    // Group-1 (81/83) or shift (C1) instruction with an immediate
+    void emitImmediateOp(uint8_t extension, Register reg, int32_t imm);
+    void emitShift(uint8_t extension, Register reg, uint8_t count);
+    // prefix [REX] 0F opcode with two xmm or mixed operands
+    void emitSSE(uint8_t prefix, bool w, uint8_t opcode, int reg, int rm);
+    void emitVEX(int reg, int vvvv, int rm, uint8_t opcode, bool ymm);
+    int32_t displacementTo(const void* target) const;
     uint8_t regToBits(Register reg);
+    uint8_t regToBits(XmmRegister reg);
 };
 
 // ============================================================================
@@ -207,7 +246,7 @@ public:
     void recordInstruction(OpCode opcode, uint8_t* ip);
     
     // Record type information
-    void recordType(int stack_slot, ValueType type);
+    void recordType(int stack_slot, Value value);
     
     // Stop recording and compile the trace
     CompiledTrace stopRecordingAndCompile();
@@ -244,35 +283,8 @@ private:
     void optimizeAndVectorize();
 };
 
-// ============================================================================
-// Inline Cache for Property Access
-// ============================================================================
-
-class InlineCache {
-public:
-    static constexpr int CACHE_SIZE = 4;
-    
-    struct CacheEntry {
-        void* handler;
-        ValueType type;
-        bool valid;
-    };
-    
-    InlineCache();
-    
-    // Lookup in cache
-    CacheEntry* lookup(ValueType type);
-    
-    // Update cache
-    void update(ValueType type, void* handler);
-    
-    // Clear cache
-    void clear();
-    
-private:
-    CacheEntry entries_[CACHE_SIZE];
-    size_t next_entry_;
-};
+// Property access inline caches are per-site InlineCache entries keyed on
+// instance shapes; see bytecode.hpp.
 
 // ============================================================================
 // Hot Path Optimizer
@@ -327,7 +339,6 @@ public:
 private:
     std::unique_ptr<TracingJIT> tracing_jit_;
     std::unique_ptr<HotPathOptimizer> hot_path_optimizer_;
-    std::unique_ptr<InlineCache> inline_cache_;
     
     std::unordered_map<Chunk*, bool> optimized_chunks_;
 };
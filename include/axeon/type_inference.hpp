@@ -0,0 +1,91 @@
+/*
+Copyright (c) 2026 Dipanjan Dhar
+SPDX-License-Identifier: GPL-3.0-only
+*/
+
+#pragma once
+
+#include "axeon/ast.hpp"
+#include "axeon/bytecode.hpp"
+#include "axeon/type_system.hpp"
+#include <functional>
+#include <unordered_map>
+
+namespace kio {
+
+// What is statically known about a value. Int is the int tag unless an
+// overflow promoted the value to a double; Float is always a double. Arrays
+// built by Float64Array() and friends keep their element kind for life.
+struct StaticType {
+    TypeKind kind = TypeKind::Any;
+    bool typedArray = false;
+    ElementKind element = ElementKind::FLOAT64; // When typedArray
+    bool unset = false; // No value seen yet; only while the pass iterates
+
+    static StaticType of(TypeKind kind) { return {kind}; }
+    static StaticType typed(ElementKind element) { return {TypeKind::Array, true, element}; }
+    static StaticType none() { return {TypeKind::Any, false, ElementKind::FLOAT64, true}; }
+
+    bool is(TypeKind k) const { return kind == k; }
+    bool isNumber() const { return kind == TypeKind::Int || kind == TypeKind::Float; }
+    bool isFloat64Array() const { return typedArray && element == ElementKind::FLOAT64; }
+    bool operator==(const StaticType& o) const {
+        return kind == o.kind && typedArray == o.typedArray && (!typedArray || element == o.element) && unset == o.unset;
+    }
+    bool operator!=(const StaticType& o) const { return !(*this == o); }
+};
+
+// Flow-sensitive type inference over the AST, run by Compiler::compile()
+// before code generation. Locals are tracked per program point, joining at
+// branches and iterating loops to a fixpoint; globals get one type for the
+// whole program, the join of every assignment to them, found by iterating
+// whole-program passes up from "unset". The results are proofs, not
+// guesses: the compiler emits unchecked opcodes from them.
+class TypeInference {
+public:
+    void run(const std::vector<StmtPtr>& program);
+
+    // Any for expressions the pass knows nothing about
+    StaticType typeOf(const ExprPtr& expr) const;
+
+private:
+    struct Local {
+        std::string name;
+        int depth;
+        StaticType type;
+    };
+    struct Env {
+        std::vector<Local> locals; // Mirrors Compiler::locals_
+        bool reachable = true;
+    };
+
+    std::unordered_map<const Expr*, StaticType> types_;
+    std::unordered_map<std::string, StaticType> globals_;  // Assumed for this pass
+    std::unordered_map<std::string, StaticType> assigned_; // Joined over this pass
+    bool opaque_ = false; // Code we cannot see may assign any global
+    int depth_ = 0;
+
+    void pass(const std::vector<StmtPtr>& program);
+    void function(const std::vector<std::pair<std::string, std::string>>& params, const std::vector<StmtPtr>& body,
+                  bool method);
+    void stmt(const StmtPtr& stmt, Env& env);
+    void loop(Env& env, const ExprPtr* condition, const StmtPtr& body, const std::function<void(Env&)>& step);
+    StaticType expr(const ExprPtr& expr, Env& env);
+    StaticType binary(const Expr::Binary& binary, Env& env);
+    StaticType call(const Expr::Call& call, Env& env);
+
+    void declare(const std::string& name, StaticType type, Env& env);
+    void assign(const std::string& name, StaticType type, Env& env);
+    StaticType read(const std::string& name, const Env& env) const;
+    void endScope(Env& env);
+
+    static StaticType join(StaticType a, StaticType b) {
+        if (a.unset) return b;
+        if (b.unset) return a;
+        return a == b ? a : StaticType();
+    }
+    static Env join(const Env& a, const Env& b);
+    static bool same(const Env& a, const Env& b);
+};
+
+} // namespace kio
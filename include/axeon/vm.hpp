@@ -6,16 +6,21 @@ SPDX-License-Identifier: GPL-3.0-only
 #pragma once
 
 #include "axeon/bytecode.hpp"
+#include "axeon/baseline_jit.hpp"
 #include "axeon/builtin_functions.hpp"
 #include "axeon/jit_engine.hpp"
+#include "axeon/memory_manager.hpp"
 #include <vector>
 #include <unordered_map>
+#include <algorithm>
 
 namespace kio {
 
 struct CallFrame {
     ObjFunction* function;
     uint8_t* ip;
+    ThreadedInstr* tip; // Resume point when running threaded code
+    const RegInstr* pc; // Resume point when running register code
     int slots; // Base pointer (offset into stack)
 };
 
@@ -27,39 +32,127 @@ enum class InterpretResult {
 
 class VM {
 public:
+    // When code moves up a tier: loops to the baseline JIT after
+    // baselineLoop back edges and to LLVM after optimizedLoop, functions to
+    // LLVM after optimizedFunction calls. 0 turns that tier off.
+    struct TierThresholds {
+        uint64_t baselineLoop = 16;
+        uint64_t optimizedLoop = 10000;
+        uint32_t optimizedFunction = 100;
+    };
+
     VM();
     ~VM();
 
     InterpretResult interpret(ObjFunction* function);
+    // Runs a script compiled by RegisterCompiler.
+    InterpretResult interpretRegisters(ObjFunction* function);
+
+    // Runs pre-decoded direct-threaded code instead of raw bytecode.
+    void setThreaded(bool enabled) { threaded_ = enabled; }
+    void setTierThresholds(const TierThresholds& tiers) { tiers_ = tiers; }
+    // Code each JIT tier produced and the time it took
+    void printJitStats(std::ostream& out) const;
     void push(Value value);
     Value pop();
 
+    // Instructions dispatched so far; only counted in builds configured
+    // with AXEON_DISPATCH_STATS.
+    uint64_t dispatchCount() const { return dispatch_count_; }
+    static bool countsDispatches();
+
 private:
-    static constexpr int STACK_MAX = 8192;
-    static constexpr int FRAMES_MAX = 128;
+    // The value stack and frame array start at these sizes, double when a
+    // call needs more and halve again once recursion has unwound.
+    // Reaching a limit is reported as a stack overflow.
+    static constexpr size_t STACK_INITIAL = 8192;
+    static constexpr size_t STACK_LIMIT = size_t(1) << 24;
+    static constexpr size_t FRAMES_INITIAL = 128;
+    static constexpr size_t FRAMES_LIMIT = size_t(1) << 20;
+    // Slots helpers may push above a frame's own operands
+    static constexpr size_t STACK_SLACK = 16;
 
-    CallFrame frames[FRAMES_MAX];
+    std::vector<CallFrame> frames;
     int frameCount;
+    int frameCapacity_ {FRAMES_INITIAL}; // frames.size()
 
-    Value stack_[STACK_MAX];
+    // Growing reallocates, so dispatch loops reload any Value* into the
+    // stack after a call.
+    std::vector<Value> stack_;
     int sp;
-    std::unordered_map<std::string, Value> globals_;
+    size_t stackCapacity_ {STACK_INITIAL}; // stack_.size()
+    int shrinkBelow_ {0};                 // A call made with sp below this shrinks the stack first
+    std::vector<Value> globals_; // Indexed by GlobalTable slot
     
     BuiltinFunctions builtins_;
+
+    // Back edges by loop header. Entries are never erased, so a compiler
+    // thread can publish into one, and baseline code count into it, while
+    // the interpreter adds others.
+    struct HotLoop {
+        uint64_t backEdges = 0; // Also counted by the baseline code
+        JITEngine::CompiledLoop baseline = nullptr;
+        bool baselineFailed = false;
+        bool requested = false;
+        std::atomic<JITEngine::CompiledLoop> optimized {nullptr};
+    };
+    std::unordered_map<uint8_t*, HotLoop> hot_loops_;
+    TierThresholds tiers_;
+    BaselineJIT baseline_;
+    // After hot_loops_, so its compiler threads are joined before the
+    // entries they publish into go away
     JITEngine jit_;
-    std::unordered_map<uint8_t*, JITEngine::CompiledLoop> optimized_loops_;
+
+    bool threaded_ {false};
 
     InterpretResult run();
+    InterpretResult runThreaded();
+    ThreadedInstr* threadedCode(Chunk& chunk, void* const* handlers);
+    InterpretResult runRegisters();
+    bool enterRegisterFrame();
     bool isTruthy(Value v);
     std::string valToString(Value v);
+    void concatenate(); // Replaces the two operands on top of the stack with a string or rope
     
     bool callValue(Value callee, int argCount);
     bool call(ObjFunction* function, int argCount);
-    bool invoke(const std::string& name, int argCount);
+    // Makes the call in native code if callee is a function the method JIT
+    // has compiled, compiling it once it is hot. False leaves the call, and
+    // the stack, to callValue().
+    bool callCompiled(Value callee, int argCount);
+    // Counts a back edge, the LOOP at backEdge, to header, with the frame's
+    // stack ending at top. Returns the code to run the loop with: the
+    // baseline JIT's once it is warm, LLVM's once a compiler thread has
+    // published it; the loop is queued for LLVM once it is hot.
+    JITEngine::CompiledLoop hotLoop(uint8_t* header, uint8_t* backEdge, int top);
+    bool callNative(ObjNative* native, int argCount);
+    // Stack slots a frame of function may use: its bytecode length bounds the
+    // operand depth of stack code, registerCount sizes register code.
+    static size_t frameSize(const ObjFunction* function) {
+        return std::max(function->chunk.code.size(), (size_t)function->chunk.registerCount) + STACK_SLACK;
+    }
+    bool ensureStack(size_t needed) { return needed <= stackCapacity_ || growStack(needed); }
+    bool growStack(size_t needed);
+    bool growFrames();
+    void shrinkStack();
+    bool invoke(ObjString* name, int argCount, InlineCache* cache = nullptr); // name must be interned
     bool bindMethod(ObjClass* klass, const std::string& name);
-    
-    std::unordered_map<uint8_t*, int> loop_hits_;
-    static constexpr int HOT_THRESHOLD = 100;
+    int globalSlot(const std::string& name);
+    Value readGlobal(uint16_t slot);
+    // Quickening (see OpCode::ADD_NUM); instruction points at the opcode byte
+    void quicken(Chunk& chunk, uint8_t* instruction, Value l, Value r);
+    void quickenProperty(Chunk& chunk, uint8_t* instruction, const InlineCache* cache);
+    void deoptimize(Chunk& chunk, uint8_t* instruction, OpCode generic);
+    bool getProperty(ObjString* name, InlineCache* cache);
+    bool setProperty(ObjString* name, InlineCache* cache);
+    void newArray(int elementCount);
+    // The element of array that index selects, truncated toward zero; false
+    // after reporting an index outside the array
+    bool typedArrayIndex(ObjTypedArray* array, Value index, size_t& at);
+    void sysQuery(const std::string& key);
+    void markRoots(MemoryManager& gc);
+
+    uint64_t dispatch_count_ {0};
 };
 
 } // namespace kio
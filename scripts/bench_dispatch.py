@@ -0,0 +1,44 @@
+import os
+import subprocess
+import sys
+
+# Compares interpreter dispatch counts and run times with and without
+# superinstructions. Needs a build configured with dispatch counting:
+#   cmake -S . -B build-stats -DAXEON_DISPATCH_STATS=ON -DAXEON_ENABLE_JIT=OFF
+#   cmake --build build-stats
+#   python3 scripts/bench_dispatch.py build-stats/axeon examples/benchmark.axe
+
+def run(axeon_bin, script, extra):
+    result = subprocess.run([axeon_bin, script, "--vm-stats"] + extra, capture_output=True, text=True)
+    if result.returncode != 0:
+        print(f"❌ {script} failed:")
+        print(result.stderr)
+        return None, None
+
+    dispatches = None
+    for line in result.stderr.splitlines():
+        if "instructions dispatched:" in line:
+            dispatches = int(line.split(":")[1].strip())
+    elapsed = None
+    for line in result.stdout.splitlines():
+        if "Time (ms):" in line:
+            elapsed = float(line.split(":")[1].strip())
+    return dispatches, elapsed
+
+if __name__ == "__main__":
+    axeon_bin = sys.argv[1] if len(sys.argv) > 1 else "./build-stats/axeon"
+    scripts = sys.argv[2:] or ["examples/benchmark.axe"]
+    if not os.path.exists(axeon_bin):
+        print(f"❌ Axeon binary not found at {axeon_bin}. Please build first.")
+        sys.exit(1)
+
+    for script in scripts:
+        generic, generic_ms = run(axeon_bin, script, ["--no-superinstructions"])
+        fused, fused_ms = run(axeon_bin, script, [])
+        if generic is None or fused is None:
+            print(f"❌ {script}: no dispatch count (was the build configured with AXEON_DISPATCH_STATS=ON?)")
+            continue
+        print(f"📊 {script}")
+        print(f"Generic opcodes:    {generic:>12,} dispatches" + (f", {generic_ms:.2f} ms" if generic_ms else ""))
+        print(f"Superinstructions:  {fused:>12,} dispatches" + (f", {fused_ms:.2f} ms" if fused_ms else ""))
+        print(f"Reduction:          {100.0 * (generic - fused) / generic:.1f}%")
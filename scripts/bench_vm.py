@@ -0,0 +1,41 @@
+import glob
+import os
+import subprocess
+import sys
+import time
+
+# Times the same scripts under each VM dispatch mode (--vm=<mode>) and
+# reports the best of several runs; speedup is the first mode over the last.
+#   python3 scripts/bench_vm.py build/axeon
+#   python3 scripts/bench_vm.py build/axeon examples/benchmark.axe
+
+MODES = ["stack", "threaded", "reg"]
+RUNS = 5
+
+def best_time(axeon_bin, script, mode):
+    best = None
+    for _ in range(RUNS):
+        start = time.perf_counter()
+        result = subprocess.run([axeon_bin, script, f"--vm={mode}"], capture_output=True, text=True)
+        elapsed = (time.perf_counter() - start) * 1000
+        if result.returncode != 0:
+            print(f"❌ {script} failed with --vm={mode}:")
+            print(result.stderr)
+            return None
+        best = elapsed if best is None else min(best, elapsed)
+    return best
+
+if __name__ == "__main__":
+    axeon_bin = sys.argv[1] if len(sys.argv) > 1 else "./build/axeon"
+    scripts = sys.argv[2:] or sorted(glob.glob("examples/*benchmark*.axe"))
+    if not os.path.exists(axeon_bin):
+        print(f"❌ Axeon binary not found at {axeon_bin}. Please build first.")
+        sys.exit(1)
+
+    print(f"{'script':<36}" + "".join(f"{mode:>12}" for mode in MODES) + f"{'speedup':>10}")
+    for script in scripts:
+        times = [best_time(axeon_bin, script, mode) for mode in MODES]
+        if None in times:
+            continue
+        row = f"{os.path.basename(script):<36}" + "".join(f"{t:>10.1f}ms" for t in times)
+        print(row + f"{times[0] / times[-1]:>9.2f}x")
@@ -0,0 +1,720 @@
+/*
+ Copyright (c) 2025 Dipanjan Dhar
+ SPDX-License-Identifier: GPL-3.0-only
+
+ Baseline (tier 1) template JIT for hot loops
+*/
+
+#include "axeon/baseline_jit.hpp"
+#include "axeon/memory_manager.hpp"
+#include "axeon/tracing_jit.hpp"
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <vector>
+
+namespace kio {
+
+namespace {
+
+using Register = NativeCodeGenerator::Register;
+using XmmRegister = NativeCodeGenerator::XmmRegister;
+using Condition = NativeCodeGenerator::Condition;
+
+// Registers the code keeps for the whole loop; all callee-saved, so they
+// survive calls to the helpers below
+constexpr Register FRAME = Register::RBX;    // &stack[slots]
+constexpr Register TOP = Register::R12;      // &stack[sp], one past the top operand
+constexpr Register GLOBALS = Register::R13;
+constexpr Register SP_REF = Register::R14;   // The int& sp argument
+constexpr Register STACK = Register::R15;
+
+constexpr uint64_t NIL_BITS = QNAN | 1;
+constexpr uint64_t FALSE_BITS = QNAN | 2;
+constexpr uint64_t TRUE_BITS = QNAN | 3;
+constexpr uint64_t UNDEFINED_BITS = QNAN | 4;
+// Returned by a helper when the interpreter has to run the instruction;
+// the template has not touched the stack yet when it checks
+constexpr uint64_t EXIT = UNDEFINED_BITS;
+
+// Helpers for the cases the templates do not inline. They take and return
+// raw Value bits and compute exactly what the interpreter's handlers do.
+uint64_t addSlow(uint64_t l, uint64_t r) {
+    // Strings and other objects concatenate, which allocates
+    if (!isNumber(Value(l)) || !isNumber(Value(r))) return EXIT;
+    return addNumbers(Value(l), Value(r)).v;
+}
+uint64_t subtractSlow(uint64_t l, uint64_t r) { return subtractNumbers(Value(l), Value(r)).v; }
+uint64_t multiplySlow(uint64_t l, uint64_t r) { return multiplyNumbers(Value(l), Value(r)).v; }
+uint64_t divideSlow(uint64_t l, uint64_t r) { return Value(valueToDouble(Value(l)) / valueToDouble(Value(r))).v; }
+uint64_t moduloSlow(uint64_t l, uint64_t r) { return moduloNumbers(Value(l), Value(r)).v; }
+uint64_t maskSlow(uint64_t l, uint64_t bits) { return moduloPowerOfTwo(Value(l), (int)bits).v; }
+uint64_t negateSlow(uint64_t v) { return negateNumber(Value(v)).v; }
+uint64_t floorSlow(uint64_t v) { return Value(std::floor(valueToDouble(Value(v)))).v; }
+uint64_t sqrtSlow(uint64_t v) { return Value(std::sqrt(valueToDouble(Value(v)))).v; }
+uint64_t lessSlow(uint64_t l, uint64_t r) { return lessNumbers(Value(l), Value(r)); }
+uint64_t lessEqualSlow(uint64_t l, uint64_t r) { return lessEqualNumbers(Value(l), Value(r)); }
+
+uint64_t equalSlow(uint64_t l, uint64_t r) {
+    // Comparing a rope flattens it, which allocates
+    auto rope = [](Value v) { return isObj(v) && valueToObj(v)->type == ObjType::OBJ_ROPE; };
+    if (rope(Value(l)) || rope(Value(r))) return EXIT;
+    return Value(l) == Value(r);
+}
+
+// VM::isTruthy
+uint64_t truthySlow(uint64_t bits) {
+    Value v(bits);
+    if (isNil(v)) return 0;
+    if (isBool(v)) return bits == TRUE_BITS;
+    if (isNumber(v)) return valueToDouble(v) != 0;
+    return 1;
+}
+
+// Indexes the interpreter would take on trust are checked here, and go
+// back to it when out of range
+bool arrayIndex(Value array, Value index, size_t& at) {
+    if (!isObj(array) || !isNumber(index)) return false;
+    Obj* obj = valueToObj(array);
+    int i = (int)index.toNumber();
+    if (i < 0) return false;
+    at = (size_t)i;
+    if (obj->type == ObjType::OBJ_ARRAY) return at < ((ObjArray*)obj)->elements.size();
+    if (obj->type == ObjType::OBJ_TYPED_ARRAY) return at < ((ObjTypedArray*)obj)->length;
+    return false;
+}
+
+uint64_t arrayGet(uint64_t array, uint64_t index) {
+    size_t at;
+    if (!arrayIndex(Value(array), Value(index), at)) return EXIT;
+    Obj* obj = valueToObj(Value(array));
+    if (obj->type == ObjType::OBJ_ARRAY) return ((ObjArray*)obj)->elements[at].v;
+    return doubleToValue(((ObjTypedArray*)obj)->get(at)).v;
+}
+
+uint64_t arraySet(uint64_t array, uint64_t index, uint64_t value) {
+    size_t at;
+    if (!arrayIndex(Value(array), Value(index), at)) return EXIT;
+    Obj* obj = valueToObj(Value(array));
+    if (obj->type == ObjType::OBJ_ARRAY) {
+        ((ObjArray*)obj)->elements[at] = Value(value);
+        MemoryManager::heap().writeBarrier(obj, Value(value));
+    } else {
+        ((ObjTypedArray*)obj)->set(at, Value(value).toNumber());
+    }
+    return value;
+}
+
+// Where an instruction reads an operand from or writes its result to
+struct Operand {
+    enum Kind { STACK, LOCAL, GLOBAL, CONSTANT } kind;
+    int index; // STACK: depth below the top, 1 for the top operand
+};
+
+Operand stackOperand(int depth) { return {Operand::STACK, depth}; }
+Operand localOperand(int slot) { return {Operand::LOCAL, slot}; }
+Operand globalOperand(int slot) { return {Operand::GLOBAL, slot}; }
+Operand constantOperand(int index) { return {Operand::CONSTANT, index}; }
+
+// Emits one loop. Control flow inside the loop becomes native jumps; every
+// way out returns the bytecode offset to resume at from a shared stub.
+class LoopCompiler {
+public:
+    LoopCompiler(CodeBuffer& buffer, const Chunk& chunk, size_t header, size_t backEdge)
+        : buffer_(buffer), gen_(buffer), chunk_(chunk), header_(header), backEdge_(backEdge) {}
+
+    // False if the region does not decode to whole instructions ending at the
+    // back edge
+    bool decode() {
+        size_t offset = header_;
+        while (offset < backEdge_) {
+            if (chunk_.code[offset] > (uint8_t)OpCode::HALT) return false;
+            starts_[offset] = 0;
+            offset += instructionLength((OpCode)chunk_.code[offset]);
+        }
+        if (offset != backEdge_ || (OpCode)chunk_.code[offset] != OpCode::LOOP) return false;
+        starts_[offset] = 0;
+        return true;
+    }
+
+    void compile(uint64_t* backEdges, uint64_t tierUpAt, const std::atomic<JITEngine::CompiledLoop>* optimized) {
+        gen_.emitPrologue();
+        gen_.emitMov(STACK, Register::RDI);
+        gen_.emitMov(SP_REF, Register::RSI);
+        gen_.emitMovsxd(Register::RDX, Register::RDX);
+        gen_.emitLea(FRAME, Register::RDI, Register::RDX, 8);
+        gen_.emitMov(GLOBALS, Register::RCX);
+        gen_.emitLoadInt32(Register::RAX, Register::RSI, 0);
+        gen_.emitLea(TOP, Register::RDI, Register::RAX, 8);
+
+        for (auto& [offset, native] : starts_) {
+            native = buffer_.getOffset();
+            current_ = offset;
+            const uint8_t* ip = chunk_.code.data() + offset;
+            if (offset == backEdge_) {
+                backEdge(backEdges, tierUpAt, optimized);
+            } else {
+                instruction(ip);
+            }
+        }
+
+        for (const auto& [jump, target] : internal_) gen_.bind(jump, starts_[target]);
+        std::vector<size_t> toCommon;
+        for (const auto& [offset, jumps] : exits_) {
+            for (size_t jump : jumps) gen_.bind(jump);
+            gen_.emitMov(Register::RAX, (int64_t)offset);
+            toCommon.push_back(gen_.emitJump());
+        }
+        // Writes sp back; eax holds the offset
+        for (size_t jump : toCommon) gen_.bind(jump);
+        gen_.emitMov(Register::RCX, TOP);
+        gen_.emitSub(Register::RCX, STACK);
+        gen_.emitSar(Register::RCX, 3);
+        gen_.emitStoreInt32(SP_REF, 0, Register::RCX);
+        gen_.emitEpilogue();
+    }
+
+private:
+    CodeBuffer& buffer_;
+    NativeCodeGenerator gen_;
+    const Chunk& chunk_;
+    size_t header_;
+    size_t backEdge_;
+    size_t current_ = 0;
+    std::map<size_t, size_t> starts_;                 // Instruction offset -> native offset
+    std::vector<std::pair<size_t, size_t>> internal_; // Jump -> instruction offset in the loop
+    std::map<size_t, std::vector<size_t>> exits_;     // Resume offset -> jumps to its stub
+
+    // --- Control ------------------------------------------------------------
+
+    // Goes to the instruction at target, natively when it is in the loop
+    void jumpTo(size_t target, const Condition* cc = nullptr) {
+        size_t jump = cc ? gen_.emitJumpIf(*cc) : gen_.emitJump();
+        if (starts_.count(target)) internal_.push_back({jump, target});
+        else exits_[target].push_back(jump);
+    }
+    void jumpToIf(Condition cc, size_t target) { jumpTo(target, &cc); }
+    // Leaves for the interpreter to run the current instruction
+    void exitIf(Condition cc) { exits_[current_].push_back(gen_.emitJumpIf(cc)); }
+    void exit() { exits_[current_].push_back(gen_.emitJump()); }
+
+    void call(uint64_t (*helper)(uint64_t, uint64_t)) {
+        gen_.emitMov(Register::RAX, (int64_t)(uintptr_t)helper);
+        gen_.emitCall(Register::RAX);
+    }
+    void call(uint64_t (*helper)(uint64_t)) {
+        gen_.emitMov(Register::RAX, (int64_t)(uintptr_t)helper);
+        gen_.emitCall(Register::RAX);
+    }
+    void call(uint64_t (*helper)(uint64_t, uint64_t, uint64_t)) {
+        gen_.emitMov(Register::RAX, (int64_t)(uintptr_t)helper);
+        gen_.emitCall(Register::RAX);
+    }
+    // Exits when the helper returned EXIT
+    void exitOnHelper() {
+        gen_.emitMov(Register::RCX, (int64_t)EXIT);
+        gen_.emitCmp(Register::RAX, Register::RCX);
+        exitIf(Condition::E);
+    }
+
+    // --- Operands -----------------------------------------------------------
+
+    void load(Register dest, Operand o) {
+        switch (o.kind) {
+            case Operand::STACK: gen_.emitLoad(dest, TOP, -8 * o.index); break;
+            case Operand::LOCAL: gen_.emitLoad(dest, FRAME, 8 * o.index); break;
+            case Operand::GLOBAL: gen_.emitLoad(dest, GLOBALS, 8 * o.index); break;
+            case Operand::CONSTANT: {
+                // Objects are read from the constant table, where the
+                // collector updates them
+                const Value& k = chunk_.constants[o.index];
+                if (isObj(k)) {
+                    gen_.emitMov(dest, (int64_t)(uintptr_t)&k);
+                    gen_.emitLoad(dest, dest, 0);
+                } else {
+                    gen_.emitMov(dest, (int64_t)k.v);
+                }
+                break;
+            }
+        }
+    }
+    void store(Operand o, Register src) {
+        switch (o.kind) {
+            case Operand::STACK: gen_.emitStore(TOP, -8 * o.index, src); break;
+            case Operand::LOCAL: gen_.emitStore(FRAME, 8 * o.index, src); break;
+            case Operand::GLOBAL: gen_.emitStore(GLOBALS, 8 * o.index, src); break;
+            case Operand::CONSTANT: break;
+        }
+    }
+    void push(Register src) {
+        gen_.emitStore(TOP, 0, src);
+        gen_.emitAdd(TOP, 8);
+    }
+    void pop(int count) { gen_.emitSub(TOP, 8 * count); }
+
+    // Jumps unless value holds an int; clobbers scratch
+    size_t jumpUnlessInt(Register value, Register scratch) {
+        gen_.emitMov(scratch, value);
+        gen_.emitShr(scratch, 48);
+        gen_.emitCmp(scratch, (int32_t)(INT_TAG >> 48));
+        return gen_.emitJumpIf(Condition::NE);
+    }
+    // Jumps unless value holds a double: its exponent and quiet bit are not all set
+    size_t jumpUnlessDouble(Register value, Register scratch) {
+        gen_.emitMov(scratch, value);
+        gen_.emitShl(scratch, 1);
+        gen_.emitShr(scratch, 52);
+        gen_.emitCmp(scratch, 0xfff);
+        return gen_.emitJumpIf(Condition::E);
+    }
+    // dest = INT_TAG | payload, for a payload already in the low 48 bits
+    void boxInt(Register dest, Register payload) {
+        gen_.emitMov(dest, (int64_t)INT_TAG);
+        gen_.emitOr(dest, payload);
+    }
+    // rax = 0 or 1 -> false or true
+    void boxBool(bool negate) {
+        if (negate) {
+            gen_.emitMov(Register::RCX, (int64_t)TRUE_BITS);
+            gen_.emitSub(Register::RCX, Register::RAX);
+            gen_.emitMov(Register::RAX, Register::RCX);
+        } else {
+            gen_.emitMov(Register::RCX, (int64_t)FALSE_BITS);
+            gen_.emitAdd(Register::RAX, Register::RCX);
+        }
+    }
+
+    // --- Templates ----------------------------------------------------------
+
+    // rax = l op r for ADD, SUBTRACT, MULTIPLY and DIVIDE. Two ints and two
+    // doubles are inline, other numbers go to a helper, and ADD exits for
+    // anything else.
+    void arithmetic(OpCode op, Operand l, Operand r) {
+        load(Register::RAX, l);
+        load(Register::RCX, r);
+        std::vector<size_t> slow, done;
+        if (op != OpCode::DIVIDE) {
+            std::vector<size_t> notInts = {jumpUnlessInt(Register::RAX, Register::RDX),
+                                           jumpUnlessInt(Register::RCX, Register::RDX)};
+            if (op == OpCode::MULTIPLY) {
+                gen_.emitMov(Register::RDX, Register::RAX);
+                gen_.emitShl(Register::RDX, 16);
+                gen_.emitSar(Register::RDX, 16);
+                gen_.emitMov(Register::RSI, Register::RCX);
+                gen_.emitShl(Register::RSI, 16);
+                gen_.emitSar(Register::RSI, 16);
+                gen_.emitImul(Register::RDX, Register::RSI);
+                slow.push_back(gen_.emitJumpIf(Condition::O));
+                // |product| <= INT_MAX_48 like multiplyInts: both it and
+                // its negation fit 48 bits
+                gen_.emitMov(Register::RSI, Register::RDX);
+                gen_.emitShl(Register::RSI, 16);
+                gen_.emitSar(Register::RSI, 16);
+                gen_.emitCmp(Register::RSI, Register::RDX);
+                slow.push_back(gen_.emitJumpIf(Condition::NE));
+                gen_.emitMov(Register::RSI, Register::RDX);
+                gen_.emitNeg(Register::RSI);
+                gen_.emitMov(Register::RDI, Register::RSI);
+                gen_.emitShl(Register::RDI, 16);
+                gen_.emitSar(Register::RDI, 16);
+                gen_.emitCmp(Register::RDI, Register::RSI);
+                slow.push_back(gen_.emitJumpIf(Condition::NE));
+                gen_.emitShl(Register::RDX, 16);
+                gen_.emitShr(Register::RDX, 16);
+            } else {
+                // With the payloads in the top 48 bits, the 64-bit operation
+                // overflows exactly when the small-int one would
+                gen_.emitMov(Register::RDX, Register::RAX);
+                gen_.emitShl(Register::RDX, 16);
+                gen_.emitMov(Register::RSI, Register::RCX);
+                gen_.emitShl(Register::RSI, 16);
+                if (op == OpCode::ADD) gen_.emitAdd(Register::RDX, Register::RSI);
+                else gen_.emitSub(Register::RDX, Register::RSI);
+                slow.push_back(gen_.emitJumpIf(Condition::O));
+                gen_.emitShr(Register::RDX, 16);
+            }
+            boxInt(Register::RAX, Register::RDX);
+            done.push_back(gen_.emitJump());
+            for (size_t jump : notInts) gen_.bind(jump);
+        }
+        slow.push_back(jumpUnlessDouble(Register::RAX, Register::RDX));
+        slow.push_back(jumpUnlessDouble(Register::RCX, Register::RDX));
+        gen_.emitMovq(XmmRegister::XMM0, Register::RAX);
+        gen_.emitMovq(XmmRegister::XMM1, Register::RCX);
+        switch (op) {
+            case OpCode::ADD: gen_.emitAddSD(XmmRegister::XMM0, XmmRegister::XMM1); break;
+            case OpCode::SUBTRACT: gen_.emitSubSD(XmmRegister::XMM0, XmmRegister::XMM1); break;
+            case OpCode::MULTIPLY: gen_.emitMulSD(XmmRegister::XMM0, XmmRegister::XMM1); break;
+            default: gen_.emitDivSD(XmmRegister::XMM0, XmmRegister::XMM1); break;
+        }
+        gen_.emitMovq(Register::RAX, XmmRegister::XMM0);
+        done.push_back(gen_.emitJump());
+
+        for (size_t jump : slow) gen_.bind(jump);
+        gen_.emitMov(Register::RDI, Register::RAX);
+        gen_.emitMov(Register::RSI, Register::RCX);
+        switch (op) {
+            case OpCode::ADD: call(addSlow); exitOnHelper(); break;
+            case OpCode::SUBTRACT: call(subtractSlow); break;
+            case OpCode::MULTIPLY: call(multiplySlow); break;
+            default: call(divideSlow); break;
+        }
+        for (size_t jump : done) gen_.bind(jump);
+    }
+
+    // rax = 1 if l op r holds and 0 otherwise, for LESS, LESS_EQUAL, GREATER
+    // and GREATER_EQUAL
+    void compare(OpCode op, Operand l, Operand r) {
+        load(Register::RAX, l);
+        load(Register::RCX, r);
+        std::vector<size_t> done;
+        std::vector<size_t> notInts = {jumpUnlessInt(Register::RAX, Register::RDX),
+                                       jumpUnlessInt(Register::RCX, Register::RDX)};
+        // Shifting the payloads to the top keeps their signed order
+        gen_.emitShl(Register::RAX, 16);
+        gen_.emitShl(Register::RCX, 16);
+        gen_.emitCmp(Register::RAX, Register::RCX);
+        Condition signedCc = op == OpCode::LESS ? Condition::L : op == OpCode::LESS_EQUAL ? Condition::LE
+                           : op == OpCode::GREATER ? Condition::G : Condition::GE;
+        gen_.emitSetcc(signedCc, Register::RAX);
+        gen_.emitMovzxByte(Register::RAX, Register::RAX);
+        done.push_back(gen_.emitJump());
+
+        for (size_t jump : notInts) gen_.bind(jump);
+        std::vector<size_t> slow = {jumpUnlessDouble(Register::RAX, Register::RDX),
+                                    jumpUnlessDouble(Register::RCX, Register::RDX)};
+        gen_.emitMovq(XmmRegister::XMM0, Register::RAX);
+        gen_.emitMovq(XmmRegister::XMM1, Register::RCX);
+        // Unordered operands set CF, so A and AE are false for NaN
+        bool less = op == OpCode::LESS || op == OpCode::LESS_EQUAL;
+        if (less) gen_.emitUcomisd(XmmRegister::XMM1, XmmRegister::XMM0);
+        else gen_.emitUcomisd(XmmRegister::XMM0, XmmRegister::XMM1);
+        bool strict = op == OpCode::LESS || op == OpCode::GREATER;
+        gen_.emitSetcc(strict ? Condition::A : Condition::AE, Register::RAX);
+        gen_.emitMovzxByte(Register::RAX, Register::RAX);
+        done.push_back(gen_.emitJump());
+
+        // l > r and l >= r are lessNumbers(r, l) and lessEqualNumbers(r, l)
+        for (size_t jump : slow) gen_.bind(jump);
+        gen_.emitMov(Register::RDI, less ? Register::RAX : Register::RCX);
+        gen_.emitMov(Register::RSI, less ? Register::RCX : Register::RAX);
+        call(strict ? lessSlow : lessEqualSlow);
+        for (size_t jump : done) gen_.bind(jump);
+    }
+
+    // rax = 1 if l == r and 0 otherwise
+    void equal(Operand l, Operand r) {
+        load(Register::RAX, l);
+        load(Register::RCX, r);
+        gen_.emitCmp(Register::RAX, Register::RCX);
+        size_t same = gen_.emitJumpIf(Condition::E);
+        // Ints equal the same doubles, and strings compare by content
+        gen_.emitMov(Register::RDI, Register::RAX);
+        gen_.emitMov(Register::RSI, Register::RCX);
+        call(equalSlow);
+        exitOnHelper();
+        size_t done = gen_.emitJump();
+        gen_.bind(same);
+        gen_.emitMov(Register::RAX, (int64_t)1);
+        gen_.bind(done);
+    }
+
+    // rax = 1 if the value in rax is truthy and 0 otherwise
+    void truthy() {
+        gen_.emitMov(Register::RCX, (int64_t)TRUE_BITS);
+        gen_.emitCmp(Register::RAX, Register::RCX);
+        size_t isTrue = gen_.emitJumpIf(Condition::E);
+        gen_.emitMov(Register::RCX, (int64_t)FALSE_BITS);
+        gen_.emitCmp(Register::RAX, Register::RCX);
+        size_t isFalse = gen_.emitJumpIf(Condition::E);
+        gen_.emitMov(Register::RDI, Register::RAX);
+        call(truthySlow);
+        size_t done = gen_.emitJump();
+        gen_.bind(isTrue);
+        gen_.emitMov(Register::RAX, (int64_t)1);
+        size_t done2 = gen_.emitJump();
+        gen_.bind(isFalse);
+        gen_.emitMov(Register::RAX, (int64_t)0);
+        gen_.bind(done);
+        gen_.bind(done2);
+    }
+
+    // Replaces the top operand with helper(top)
+    void unary(uint64_t (*helper)(uint64_t)) {
+        load(Register::RDI, stackOperand(1));
+        call(helper);
+        store(stackOperand(1), Register::RAX);
+    }
+
+    // Replaces the two top operands with helper(l, r)
+    void binary(uint64_t (*helper)(uint64_t, uint64_t)) {
+        load(Register::RDI, stackOperand(2));
+        load(Register::RSI, stackOperand(1));
+        call(helper);
+        store(stackOperand(2), Register::RAX);
+        pop(1);
+    }
+
+    // MODULO_INT by 2^bits: a mask for non-negative ints
+    void mask(int bits) {
+        load(Register::RAX, stackOperand(1));
+        size_t notInt = jumpUnlessInt(Register::RAX, Register::RDX);
+        gen_.emitMov(Register::RDX, Register::RAX);
+        gen_.emitShl(Register::RDX, 16);
+        size_t negative = gen_.emitJumpIf(Condition::S);
+        gen_.emitMov(Register::RCX, (int64_t)(INT_TAG | (((uint64_t)1 << bits) - 1)));
+        gen_.emitAnd(Register::RAX, Register::RCX);
+        size_t done = gen_.emitJump();
+        gen_.bind(notInt);
+        gen_.bind(negative);
+        gen_.emitMov(Register::RDI, Register::RAX);
+        gen_.emitMov(Register::RSI, (int64_t)bits);
+        call(maskSlow);
+        gen_.bind(done);
+        store(stackOperand(1), Register::RAX);
+    }
+
+    // Counts the iteration and returns to the header, or to the interpreter
+    // there when the loop is due to move up a tier
+    void backEdge(uint64_t* backEdges, uint64_t tierUpAt, const std::atomic<JITEngine::CompiledLoop>* optimized) {
+        gen_.emitMov(Register::RAX, (int64_t)(uintptr_t)backEdges);
+        gen_.emitLoad(Register::RCX, Register::RAX, 0);
+        gen_.emitAdd(Register::RCX, 1);
+        gen_.emitStore(Register::RAX, 0, Register::RCX);
+        if (tierUpAt) {
+            gen_.emitMov(Register::RDX, (int64_t)tierUpAt);
+            gen_.emitCmp(Register::RCX, Register::RDX);
+            exits_[header_].push_back(gen_.emitJumpIf(Condition::E));
+        }
+        if (optimized) {
+            // A plain load is an acquire on x86-64
+            gen_.emitMov(Register::RAX, (int64_t)(uintptr_t)optimized);
+            gen_.emitLoad(Register::RAX, Register::RAX, 0);
+            gen_.emitTest(Register::RAX, Register::RAX);
+            exits_[header_].push_back(gen_.emitJumpIf(Condition::NE));
+        }
+        internal_.push_back({gen_.emitJump(), header_});
+    }
+
+    void instruction(const uint8_t* ip) {
+        OpCode op = (OpCode)ip[0];
+        size_t next = current_ + instructionLength(op);
+        uint16_t u16 = (uint16_t)((ip[1] << 8) | ip[2]);
+        switch (op) {
+            case OpCode::CONSTANT:
+                load(Register::RAX, constantOperand(ip[1]));
+                push(Register::RAX);
+                break;
+            case OpCode::NIL:
+            case OpCode::TRUE:
+            case OpCode::FALSE:
+                gen_.emitMov(Register::RAX, (int64_t)(op == OpCode::NIL ? NIL_BITS : op == OpCode::TRUE ? TRUE_BITS : FALSE_BITS));
+                push(Register::RAX);
+                break;
+            case OpCode::POP:
+                pop(1);
+                break;
+            case OpCode::GET_LOCAL:
+                load(Register::RAX, localOperand(ip[1]));
+                push(Register::RAX);
+                break;
+            case OpCode::SET_LOCAL:
+                load(Register::RAX, stackOperand(1));
+                store(localOperand(ip[1]), Register::RAX);
+                break;
+            case OpCode::GET_GLOBAL_SLOT:
+                // An unset global is reported by the interpreter
+                load(Register::RAX, globalOperand(u16));
+                gen_.emitMov(Register::RCX, (int64_t)UNDEFINED_BITS);
+                gen_.emitCmp(Register::RAX, Register::RCX);
+                exitIf(Condition::E);
+                push(Register::RAX);
+                break;
+            case OpCode::SET_GLOBAL_SLOT:
+                load(Register::RAX, stackOperand(1));
+                store(globalOperand(u16), Register::RAX);
+                break;
+            case OpCode::DEFINE_GLOBAL_SLOT:
+                load(Register::RAX, stackOperand(1));
+                store(globalOperand(u16), Register::RAX);
+                pop(1);
+                break;
+
+            case OpCode::ADD: case OpCode::ADD_INT: case OpCode::ADD_NUM: case OpCode::ADD_F64:
+            case OpCode::SUBTRACT: case OpCode::SUBTRACT_INT: case OpCode::SUBTRACT_NUM: case OpCode::SUBTRACT_F64:
+            case OpCode::MULTIPLY: case OpCode::MULTIPLY_INT: case OpCode::MULTIPLY_NUM: case OpCode::MULTIPLY_F64:
+            case OpCode::DIVIDE: case OpCode::DIVIDE_F64:
+                arithmetic(genericForm(unquickened(op)), stackOperand(2), stackOperand(1));
+                store(stackOperand(2), Register::RAX);
+                pop(1);
+                break;
+            case OpCode::ADD_CONST:
+                arithmetic(OpCode::ADD, stackOperand(1), constantOperand(ip[1]));
+                store(stackOperand(1), Register::RAX);
+                break;
+            case OpCode::ADD_LOCALS:
+            case OpCode::SUBTRACT_LOCALS:
+            case OpCode::MULTIPLY_LOCALS:
+                arithmetic(op == OpCode::ADD_LOCALS ? OpCode::ADD : op == OpCode::SUBTRACT_LOCALS ? OpCode::SUBTRACT : OpCode::MULTIPLY,
+                           localOperand(ip[1]), localOperand(ip[2]));
+                push(Register::RAX);
+                break;
+            case OpCode::INCREMENT_LOCAL:
+                arithmetic(OpCode::ADD, localOperand(ip[1]), constantOperand(ip[2]));
+                store(localOperand(ip[1]), Register::RAX);
+                break;
+            case OpCode::INCREMENT_GLOBAL_SLOT:
+                arithmetic(OpCode::ADD, globalOperand(u16), constantOperand(ip[3]));
+                store(globalOperand(u16), Register::RAX);
+                break;
+            case OpCode::MODULO:
+            case OpCode::MODULO_INT:
+                binary(moduloSlow);
+                break;
+            case OpCode::MASK_INT:
+                mask(ip[1]);
+                break;
+            case OpCode::NEGATE:
+                unary(negateSlow);
+                break;
+            case OpCode::FLOOR:
+                unary(floorSlow);
+                break;
+            case OpCode::SQRT:
+                unary(sqrtSlow);
+                break;
+
+            case OpCode::LESS: case OpCode::LESS_INT: case OpCode::LESS_NUM: case OpCode::LESS_F64:
+            case OpCode::LESS_EQUAL: case OpCode::LESS_EQUAL_INT: case OpCode::LESS_EQUAL_NUM: case OpCode::LESS_EQUAL_F64:
+            case OpCode::GREATER: case OpCode::GREATER_INT: case OpCode::GREATER_NUM: case OpCode::GREATER_F64:
+            case OpCode::GREATER_EQUAL: case OpCode::GREATER_EQUAL_INT: case OpCode::GREATER_EQUAL_NUM: case OpCode::GREATER_EQUAL_F64:
+                compare(genericForm(unquickened(op)), stackOperand(2), stackOperand(1));
+                boxBool(false);
+                store(stackOperand(2), Register::RAX);
+                pop(1);
+                break;
+            case OpCode::EQUAL:
+            case OpCode::NOT_EQUAL:
+                equal(stackOperand(2), stackOperand(1));
+                boxBool(op == OpCode::NOT_EQUAL);
+                store(stackOperand(2), Register::RAX);
+                pop(1);
+                break;
+            case OpCode::NOT:
+                load(Register::RAX, stackOperand(1));
+                truthy();
+                boxBool(true);
+                store(stackOperand(1), Register::RAX);
+                break;
+
+            case OpCode::ARRAY_GET:
+            case OpCode::ARRAY_GET_F64:
+                load(Register::RDI, stackOperand(2));
+                load(Register::RSI, stackOperand(1));
+                call(arrayGet);
+                exitOnHelper();
+                store(stackOperand(2), Register::RAX);
+                pop(1);
+                break;
+            case OpCode::ARRAY_SET:
+            case OpCode::ARRAY_SET_F64:
+                // Leaves the value in place of the array
+                load(Register::RDI, stackOperand(3));
+                load(Register::RSI, stackOperand(2));
+                load(Register::RDX, stackOperand(1));
+                call(arraySet);
+                exitOnHelper();
+                store(stackOperand(3), Register::RAX);
+                pop(2);
+                break;
+
+            case OpCode::JUMP:
+                jumpTo(next + u16);
+                break;
+            case OpCode::LOOP:
+                jumpTo(next - u16);
+                break;
+            case OpCode::JUMP_IF_FALSE:
+                load(Register::RAX, stackOperand(1));
+                pop(1);
+                truthy();
+                gen_.emitTest(Register::RAX, Register::RAX);
+                jumpToIf(Condition::E, next + u16);
+                break;
+            case OpCode::LESS_JUMP_IF_FALSE:
+                compare(OpCode::LESS, stackOperand(2), stackOperand(1));
+                pop(2);
+                gen_.emitTest(Register::RAX, Register::RAX);
+                jumpToIf(Condition::E, next + u16);
+                break;
+            case OpCode::EQUAL_JUMP_IF_FALSE:
+                equal(stackOperand(2), stackOperand(1));
+                pop(2);
+                gen_.emitTest(Register::RAX, Register::RAX);
+                jumpToIf(Condition::E, next + u16);
+                break;
+            case OpCode::LESS_LOCALS_JUMP_IF_FALSE:
+                compare(OpCode::LESS, localOperand(ip[1]), localOperand(ip[2]));
+                gen_.emitTest(Register::RAX, Register::RAX);
+                jumpToIf(Condition::E, next + (uint16_t)((ip[3] << 8) | ip[4]));
+                break;
+
+            default:
+                // Calls, printing, objects, strings and late-bound globals
+                // stay with the interpreter
+                exit();
+                break;
+        }
+    }
+};
+
+} // namespace
+
+struct BaselineJIT::Impl {
+    std::vector<std::unique_ptr<CodeBuffer>> code; // Kept until the VM goes away
+    Stats stats;
+};
+
+BaselineJIT::BaselineJIT() : impl_(std::make_unique<Impl>()) {}
+BaselineJIT::~BaselineJIT() = default;
+
+bool BaselineJIT::available() {
+    return true;
+}
+
+const BaselineJIT::Stats& BaselineJIT::stats() const {
+    return impl_->stats;
+}
+
+JITEngine::CompiledLoop BaselineJIT::compileLoop(const Chunk& chunk, const uint8_t* header, const uint8_t* backEdge,
+                                                 uint64_t* backEdges, uint64_t tierUpAt,
+                                                 const std::atomic<JITEngine::CompiledLoop>* optimized) {
+    auto start = std::chrono::steady_clock::now();
+    size_t from = header - chunk.code.data();
+    size_t to = backEdge - chunk.code.data();
+
+    // A template is at most a few hundred bytes; the buffer is sized for
+    // the worst case and only the pages written are ever touched
+    auto buffer = std::make_unique<CodeBuffer>(4096 + (to - from + 3) * 512);
+    LoopCompiler compiler(*buffer, chunk, from, to);
+    void* code = nullptr;
+    if (compiler.decode()) {
+        compiler.compile(backEdges, tierUpAt, optimized);
+        code = buffer->finalize();
+    }
+
+    Stats& stats = impl_->stats;
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    stats.totalMs += ms;
+    stats.maxMs = std::max(stats.maxMs, ms);
+    if (!code) {
+        stats.failed++;
+        return nullptr;
+    }
+    stats.loops++;
+    stats.bytes += buffer->getOffset();
+    impl_->code.push_back(std::move(buffer));
+    return reinterpret_cast<JITEngine::CompiledLoop>(code);
+}
+
+} // namespace kio
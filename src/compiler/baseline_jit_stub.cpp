@@ -0,0 +1,31 @@
+/*
+ * Stub baseline JIT used off x86-64 or when AXEON_ENABLE_BASELINE_JIT=OFF.
+ *
+ * Loops then go from the interpreter straight to JITEngine.
+ */
+
+#include "axeon/baseline_jit.hpp"
+
+namespace kio {
+
+struct BaselineJIT::Impl {
+    Stats stats;
+};
+
+BaselineJIT::BaselineJIT() : impl_(std::make_unique<Impl>()) {}
+BaselineJIT::~BaselineJIT() = default;
+
+bool BaselineJIT::available() {
+    return false;
+}
+
+JITEngine::CompiledLoop BaselineJIT::compileLoop(const Chunk&, const uint8_t*, const uint8_t*, uint64_t*, uint64_t,
+                                                 const std::atomic<JITEngine::CompiledLoop>*) {
+    return nullptr;
+}
+
+const BaselineJIT::Stats& BaselineJIT::stats() const {
+    return impl_->stats;
+}
+
+} // namespace kio
@@ -4,13 +4,19 @@ SPDX-License-Identifier: GPL-3.0-only
 */
 
 #include "axeon/compiler.hpp"
+#include "axeon/memory_manager.hpp"
+#include "axeon/peephole.hpp"
 #include <iostream>
 
 namespace kio {
 
+bool Compiler::superinstructions_ = true;
+bool Compiler::peephole_ = true;
+std::ostream* Compiler::peepholeReport_ = nullptr;
+
 Compiler::Compiler(Compiler* parent, FunctionType type) 
-    : parent_(parent), type_(type) {
-    function_ = new ObjFunction();
+    : parent_(parent), type_(type), types_(parent ? parent->types_ : nullptr) {
+    function_ = allocateObject<ObjFunction>();
     if (type == FunctionType::TYPE_SCRIPT) {
         function_->name = "script";
     }
@@ -20,13 +26,31 @@ Compiler::Compiler(Compiler* parent, FunctionType type)
 }
 
 ObjFunction* Compiler::compile(const std::vector<StmtPtr>& statements) {
+    // Constants are unreachable from any VM root until the script is running
+    MemoryManager::Pause pause(MemoryManager::heap());
+    TypeInference types;
+    types.run(statements);
+    types_ = &types;
     for (const auto& stmt : statements) { compileStmt(stmt); }
     emitByte(static_cast<uint8_t>(OpCode::HALT));
-    return function_;
+    finishChunk();
+    types_ = nullptr;
+    return hadError_ ? nullptr : function_;
+}
+
+void Compiler::finishChunk() {
+    if (!peephole_) return;
+    Peephole::Stats stats = Peephole::optimize(*currentChunk());
+    if (peepholeReport_) {
+        *peepholeReport_ << "[Peephole] " << function_->name << ": " << stats.instructionsBefore << " -> "
+                         << stats.instructionsAfter << " instructions, " << stats.constantsBefore << " -> "
+                         << stats.constantsAfter << " constants" << std::endl;
+    }
 }
 
 void Compiler::emitByte(uint8_t byte) { currentChunk()->write(byte, 0); }
 void Compiler::emitBytes(uint8_t b1, uint8_t b2) { emitByte(b1); emitByte(b2); }
+void Compiler::emitBytes(uint8_t b1, uint8_t b2, uint8_t b3) { emitByte(b1); emitByte(b2); emitByte(b3); }
 
 int Compiler::addConstant(Value value) { return currentChunk()->addConstant(value); }
 
@@ -38,8 +62,21 @@ void Compiler::emitConstant(Value value) {
     emitBytes(static_cast<uint8_t>(OpCode::CONSTANT), static_cast<uint8_t>(idx));
 }
 
-void Compiler::addLocal(const std::string& name) {
-    locals_.push_back({name, scopeDepth});
+void Compiler::emitGlobal(OpCode op, const std::string& name) {
+    int slot = GlobalTable::shared().resolve(name);
+    if (slot > 0xffff) {
+        // The operand has 16 bits; a truncated slot would be another global
+        Compiler* root = this;
+        while (root->parent_) root = root->parent_;
+        if (!root->hadError_) std::cerr << "Too many globals (limit 65536): '" << name << "'" << std::endl;
+        root->hadError_ = true;
+        return;
+    }
+    emitBytes(static_cast<uint8_t>(op), (slot >> 8) & 0xff, slot & 0xff);
+}
+
+void Compiler::addLocal(const std::string& name, bool integer) {
+    locals_.push_back({name, scopeDepth, integer});
 }
 
 int Compiler::resolveLocal(const std::string& name) {
@@ -56,14 +93,17 @@ void Compiler::compileStmt(const StmtPtr& stmt) {
             compileExpr(node.expression);
             emitByte(static_cast<uint8_t>(OpCode::PRINT));
         } else if constexpr (std::is_same_v<T, Stmt::Expression>) {
-            compileExpr(node.expression);
-            emitByte(static_cast<uint8_t>(OpCode::POP));
+            compileEffect(node.expression);
         } else if constexpr (std::is_same_v<T, Stmt::Var>) {
              compileExpr(node.initializer);
+             bool integer = isIntegerTypeName(node.typeAnnotation);
              if (scopeDepth > 0) {
-                 addLocal(node.name);
+                 addLocal(node.name, integer);
              } else {
-                 emitBytes(static_cast<uint8_t>(OpCode::DEFINE_GLOBAL), static_cast<uint8_t>(addConstant(objToValue(new ObjString(node.name)))));
+                 Compiler* root = this;
+                 while (root->parent_) root = root->parent_;
+                 if (integer) root->integerGlobals_.insert(node.name);
+                 emitGlobal(OpCode::DEFINE_GLOBAL_SLOT, node.name);
              }
         } else if constexpr (std::is_same_v<T, Stmt::Function>) {
             Compiler sub(this, FunctionType::TYPE_FUNCTION);
@@ -71,35 +111,42 @@ void Compiler::compileStmt(const StmtPtr& stmt) {
             sub.function_->arity = node.params.size();
             sub.scopeDepth++;
             for (const auto& param : node.params) {
-                sub.addLocal(param.first);
+                sub.addLocal(param.first, isIntegerTypeName(param.second));
             }
             for (const auto& s : node.body) {
                 sub.compileStmt(s);
             }
-            sub.emitByte(static_cast<uint8_t>(OpCode::HALT));
-            
+            // Falling off the end returns nil
+            sub.emitByte(static_cast<uint8_t>(OpCode::NIL));
+            sub.emitByte(static_cast<uint8_t>(OpCode::RETURN));
+            sub.finishChunk();
+
             emitConstant(objToValue(sub.function_));
             if (scopeDepth > 0) {
                 addLocal(node.name);
             } else {
-                emitBytes(static_cast<uint8_t>(OpCode::DEFINE_GLOBAL), static_cast<uint8_t>(addConstant(objToValue(new ObjString(node.name)))));
+                emitGlobal(OpCode::DEFINE_GLOBAL_SLOT, node.name);
             }
         } else if constexpr (std::is_same_v<T, Stmt::Return>) {
             if (type_ == FunctionType::TYPE_SCRIPT) {
                 // Error actually, but emit halt/return nil for now
             }
             if (node.value) {
+                tailCall_ = type_ != FunctionType::TYPE_SCRIPT && std::holds_alternative<Expr::Call>(node.value->node);
                 compileExpr(node.value);
             } else {
                 emitByte(static_cast<uint8_t>(OpCode::NIL));
             }
             emitByte(static_cast<uint8_t>(OpCode::RETURN));
         } else if constexpr (std::is_same_v<T, Stmt::Class>) {
-            emitBytes(static_cast<uint8_t>(OpCode::CLASS), static_cast<uint8_t>(addConstant(objToValue(new ObjString(node.name)))));
+            emitBytes(static_cast<uint8_t>(OpCode::CLASS), static_cast<uint8_t>(addConstant(objToValue(internString(node.name)))));
+            // The definition takes the class; METHOD needs it back on top
             if (scopeDepth > 0) {
                 addLocal(node.name);
+                emitBytes(static_cast<uint8_t>(OpCode::GET_LOCAL), static_cast<uint8_t>(locals_.size() - 1));
             } else {
-                emitBytes(static_cast<uint8_t>(OpCode::DEFINE_GLOBAL), static_cast<uint8_t>(addConstant(objToValue(new ObjString(node.name)))));
+                emitGlobal(OpCode::DEFINE_GLOBAL_SLOT, node.name);
+                emitGlobal(OpCode::GET_GLOBAL_SLOT, node.name);
             }
             
             // Methods
@@ -109,22 +156,23 @@ void Compiler::compileStmt(const StmtPtr& stmt) {
                     sub.function_->name = func->name;
                     sub.function_->arity = func->params.size();
                     sub.scopeDepth++;
-                    sub.addLocal("this"); // Implicit this
+                    sub.locals_[0].name = "this"; // The receiver sits in the reserved slot 0
                     for (const auto& param : func->params) {
-                        sub.addLocal(param.first);
+                        sub.addLocal(param.first, isIntegerTypeName(param.second));
                     }
                     for (const auto& s : func->body) {
                         sub.compileStmt(s);
                     }
-                    sub.emitByte(static_cast<uint8_t>(OpCode::HALT));
+                    sub.emitByte(static_cast<uint8_t>(OpCode::NIL));
+                    sub.emitByte(static_cast<uint8_t>(OpCode::RETURN));
+                    sub.finishChunk();
                     emitConstant(objToValue(sub.function_));
-                    emitBytes(static_cast<uint8_t>(OpCode::METHOD), static_cast<uint8_t>(addConstant(objToValue(new ObjString(func->name)))));
+                    emitBytes(static_cast<uint8_t>(OpCode::METHOD), static_cast<uint8_t>(addConstant(objToValue(internString(func->name)))));
                 }
             }
             emitByte(static_cast<uint8_t>(OpCode::POP)); // Pop class name
         } else if constexpr (std::is_same_v<T, Stmt::If>) {
-            compileExpr(node.condition);
-            int thenJump = emitJump(OpCode::JUMP_IF_FALSE);
+            int thenJump = compileConditionJump(node.condition);
             compileStmt(node.thenBranch);
             int elseJump = emitJump(OpCode::JUMP);
             patchJump(thenJump);
@@ -132,8 +180,7 @@ void Compiler::compileStmt(const StmtPtr& stmt) {
             patchJump(elseJump);
         } else if constexpr (std::is_same_v<T, Stmt::While>) {
             int loopStart = currentChunk()->code.size();
-            compileExpr(node.condition);
-            int exitJump = emitJump(OpCode::JUMP_IF_FALSE);
+            int exitJump = compileConditionJump(node.condition);
             compileStmt(node.body);
             emitLoop(loopStart);
             patchJump(exitJump);
@@ -149,23 +196,34 @@ void Compiler::compileStmt(const StmtPtr& stmt) {
             for(int i=0; i<locals_to_pop; ++i) emitByte(static_cast<uint8_t>(OpCode::POP));
         } else if constexpr (std::is_same_v<T, Stmt::ForIn>) {
             scopeDepth++;
-            emitConstant(doubleToValue(0));
-            addLocal(node.name);
+            emitConstant(intToValue(0));
+            addLocal(node.name, true);
             int loopVarSlot = locals_.size() - 1;
             compileExpr(node.iterable);
             addLocal("_limit");
             int limitVarSlot = locals_.size() - 1;
             int loopStart = currentChunk()->code.size();
-            emitBytes(static_cast<uint8_t>(OpCode::GET_LOCAL), (uint8_t)loopVarSlot);
-            emitBytes(static_cast<uint8_t>(OpCode::GET_LOCAL), (uint8_t)limitVarSlot);
-            emitByte(static_cast<uint8_t>(OpCode::LESS));
-            int exitJump = emitJump(OpCode::JUMP_IF_FALSE);
+            int exitJump;
+            if (superinstructions_) {
+                emitBytes(static_cast<uint8_t>(OpCode::LESS_LOCALS_JUMP_IF_FALSE), (uint8_t)loopVarSlot, (uint8_t)limitVarSlot);
+                emitBytes(0xff, 0xff);
+                exitJump = currentChunk()->code.size() - 2;
+            } else {
+                emitBytes(static_cast<uint8_t>(OpCode::GET_LOCAL), (uint8_t)loopVarSlot);
+                emitBytes(static_cast<uint8_t>(OpCode::GET_LOCAL), (uint8_t)limitVarSlot);
+                emitByte(static_cast<uint8_t>(OpCode::LESS));
+                exitJump = emitJump(OpCode::JUMP_IF_FALSE);
+            }
             compileStmt(node.body);
-            emitBytes(static_cast<uint8_t>(OpCode::GET_LOCAL), (uint8_t)loopVarSlot);
-            emitConstant(doubleToValue(1));
-            emitByte(static_cast<uint8_t>(OpCode::ADD));
-            emitBytes(static_cast<uint8_t>(OpCode::SET_LOCAL), (uint8_t)loopVarSlot);
-            emitByte(static_cast<uint8_t>(OpCode::POP));
+            if (superinstructions_) {
+                emitBytes(static_cast<uint8_t>(OpCode::INCREMENT_LOCAL), (uint8_t)loopVarSlot, static_cast<uint8_t>(addConstant(intToValue(1))));
+            } else {
+                emitBytes(static_cast<uint8_t>(OpCode::GET_LOCAL), (uint8_t)loopVarSlot);
+                emitConstant(intToValue(1));
+                emitByte(static_cast<uint8_t>(OpCode::ADD));
+                emitBytes(static_cast<uint8_t>(OpCode::SET_LOCAL), (uint8_t)loopVarSlot);
+                emitByte(static_cast<uint8_t>(OpCode::POP));
+            }
             emitLoop(loopStart);
             patchJump(exitJump);
             locals_.pop_back(); locals_.pop_back();
@@ -176,15 +234,9 @@ void Compiler::compileStmt(const StmtPtr& stmt) {
             if (node.initializer) compileStmt(node.initializer);
             int loopStart = currentChunk()->code.size();
             int exitJump = -1;
-            if (node.condition) {
-                compileExpr(node.condition);
-                exitJump = emitJump(OpCode::JUMP_IF_FALSE);
-            }
+            if (node.condition) exitJump = compileConditionJump(node.condition);
             compileStmt(node.body);
-            if (node.increment) {
-                compileExpr(node.increment);
-                emitByte(static_cast<uint8_t>(OpCode::POP));
-            }
+            if (node.increment) compileEffect(node.increment);
             emitLoop(loopStart);
             if (exitJump != -1) patchJump(exitJump);
             int locals_to_pop = 0;
@@ -217,22 +269,206 @@ void Compiler::emitLoop(int loopStart) {
     emitByte(offset & 0xff);
 }
 
+// --- Superinstruction selection ---------------------------------------------
+
+// Returns the slot if expr reads a local variable, otherwise -1.
+int Compiler::localOperand(const ExprPtr& expr) {
+    if (auto var = std::get_if<Expr::Variable>(&expr->node)) return resolveLocal(var->name);
+    return -1;
+}
+
+// True if expr is statically an int: integer literals, variables declared
+// with an integer type, + - * % or negation of those, and whatever type
+// inference proved to be one. This only selects the *_INT opcodes, which
+// still handle any other operands correctly.
+bool Compiler::isIntExpr(const ExprPtr& expr) {
+    if (staticType(expr).is(TypeKind::Int)) return true;
+    if (auto literal = std::get_if<Expr::Literal>(&expr->node)) {
+        return literal->integer && isInt(literalToValue(std::get<double>(literal->value), true));
+    }
+    if (auto group = std::get_if<Expr::Grouping>(&expr->node)) return isIntExpr(group->expression);
+    if (auto var = std::get_if<Expr::Variable>(&expr->node)) {
+        int slot = resolveLocal(var->name);
+        if (slot != -1) return locals_[slot].integer;
+        Compiler* root = this;
+        while (root->parent_) root = root->parent_;
+        return root->integerGlobals_.count(var->name) > 0;
+    }
+    if (auto unary = std::get_if<Expr::Unary>(&expr->node)) {
+        return unary->op.type == TokenType::MINUS && isIntExpr(unary->right);
+    }
+    if (auto binary = std::get_if<Expr::Binary>(&expr->node)) {
+        TokenType op = binary->op.type;
+        bool arithmetic = op == TokenType::PLUS || op == TokenType::MINUS || op == TokenType::STAR || op == TokenType::PERCENT;
+        return arithmetic && isIntExpr(binary->left) && isIntExpr(binary->right);
+    }
+    return false;
+}
+
+// k if expr is the int literal 2^k, else -1
+int Compiler::powerOfTwo(const ExprPtr& expr) {
+    auto literal = std::get_if<Expr::Literal>(&expr->node);
+    if (!literal || !literal->integer) return -1;
+    Value v = literalToValue(std::get<double>(literal->value), true);
+    if (!isInt(v) || valueToInt(v) <= 0) return -1;
+    int64_t n = valueToInt(v);
+    if (n & (n - 1)) return -1;
+    int bits = 0;
+    while (n >>= 1) bits++;
+    return bits;
+}
+
+// The unchecked opcode for a binary operator whose operand types inference
+// has proven, or HALT if there is none.
+OpCode Compiler::uncheckedBinary(const Expr::Binary& binary) const {
+    StaticType l = staticType(binary.left);
+    StaticType r = staticType(binary.right);
+    if (binary.op.type == TokenType::PLUS && (l.is(TypeKind::String) || r.is(TypeKind::String))) return OpCode::CONCAT;
+    if (!l.is(TypeKind::Float) || !r.is(TypeKind::Float)) return OpCode::HALT;
+    switch (binary.op.type) {
+        case TokenType::PLUS:          return OpCode::ADD_F64;
+        case TokenType::MINUS:         return OpCode::SUBTRACT_F64;
+        case TokenType::STAR:          return OpCode::MULTIPLY_F64;
+        case TokenType::SLASH:         return OpCode::DIVIDE_F64;
+        case TokenType::LESS:          return OpCode::LESS_F64;
+        case TokenType::LESS_EQUAL:    return OpCode::LESS_EQUAL_F64;
+        case TokenType::GREATER:       return OpCode::GREATER_F64;
+        case TokenType::GREATER_EQUAL: return OpCode::GREATER_EQUAL_F64;
+        default:                       return OpCode::HALT;
+    }
+}
+
+// Compiles an expression whose value is discarded.
+void Compiler::compileEffect(const ExprPtr& expr) {
+    if (superinstructions_) {
+        if (auto assign = std::get_if<Expr::Assign>(&expr->node)) {
+            if (emitIncrement(*assign)) return;
+        }
+    }
+    compileExpr(expr);
+    emitByte(static_cast<uint8_t>(OpCode::POP));
+}
+
+// x = x + k and x = x - k for a numeric literal k.
+bool Compiler::emitIncrement(const Expr::Assign& assign) {
+    auto binary = std::get_if<Expr::Binary>(&assign.value->node);
+    if (!binary || (binary->op.type != TokenType::PLUS && binary->op.type != TokenType::MINUS)) return false;
+    auto var = std::get_if<Expr::Variable>(&binary->left->node);
+    auto literal = std::get_if<Expr::Literal>(&binary->right->node);
+    if (!var || var->name != assign.name || !literal || !std::holds_alternative<double>(literal->value)) return false;
+
+    double k = std::get<double>(literal->value);
+    if (binary->op.type == TokenType::MINUS) k = -k;
+    uint8_t constant = static_cast<uint8_t>(addConstant(literalToValue(k, literal->integer)));
+    int slot = resolveLocal(assign.name);
+    if (slot != -1) {
+        emitBytes(static_cast<uint8_t>(OpCode::INCREMENT_LOCAL), (uint8_t)slot, constant);
+    } else {
+        emitGlobal(OpCode::INCREMENT_GLOBAL_SLOT, assign.name);
+        emitByte(constant);
+    }
+    return true;
+}
+
+// Compiles a branch condition and the jump taken when it is false. Returns
+// the offset of the jump operand for patchJump().
+int Compiler::compileConditionJump(const ExprPtr& condition) {
+    auto binary = std::get_if<Expr::Binary>(&condition->node);
+    if (!superinstructions_ || !binary) {
+        compileExpr(condition);
+        return emitJump(OpCode::JUMP_IF_FALSE);
+    }
+    if (binary->op.type == TokenType::LESS) {
+        int a = localOperand(binary->left);
+        int b = localOperand(binary->right);
+        if (a != -1 && b != -1) {
+            emitBytes(static_cast<uint8_t>(OpCode::LESS_LOCALS_JUMP_IF_FALSE), (uint8_t)a, (uint8_t)b);
+            emitBytes(0xff, 0xff);
+            return currentChunk()->code.size() - 2;
+        }
+        compileExpr(binary->left);
+        compileExpr(binary->right);
+        return emitJump(OpCode::LESS_JUMP_IF_FALSE);
+    }
+    if (binary->op.type == TokenType::EQUAL_EQUAL) {
+        compileExpr(binary->left);
+        compileExpr(binary->right);
+        return emitJump(OpCode::EQUAL_JUMP_IF_FALSE);
+    }
+    compileExpr(condition);
+    return emitJump(OpCode::JUMP_IF_FALSE);
+}
+
 void Compiler::compileExpr(const ExprPtr& expr) {
     std::visit([&](auto&& node) {
         using T = std::decay_t<decltype(node)>;
         if constexpr (std::is_same_v<T, Expr::Literal>) {
             if (std::holds_alternative<double>(node.value)) {
-                emitConstant(doubleToValue(std::get<double>(node.value)));
+                emitConstant(literalToValue(std::get<double>(node.value), node.integer));
             } else {
                 std::string s = std::get<std::string>(node.value);
                 if (s == "true") emitByte(static_cast<uint8_t>(OpCode::TRUE));
                 else if (s == "false") emitByte(static_cast<uint8_t>(OpCode::FALSE));
                 else if (s == "") emitByte(static_cast<uint8_t>(OpCode::NIL));
-                else emitConstant(objToValue(new ObjString(s)));
+                else emitConstant(objToValue(internString(s)));
             }
         } else if constexpr (std::is_same_v<T, Expr::Binary>) {
+            if (superinstructions_) {
+                TokenType op = node.op.type;
+                if (op == TokenType::PLUS || op == TokenType::MINUS || op == TokenType::STAR) {
+                    int a = localOperand(node.left);
+                    int b = localOperand(node.right);
+                    if (a != -1 && b != -1) {
+                        OpCode fused = op == TokenType::PLUS ? OpCode::ADD_LOCALS
+                                     : op == TokenType::MINUS ? OpCode::SUBTRACT_LOCALS : OpCode::MULTIPLY_LOCALS;
+                        emitBytes(static_cast<uint8_t>(fused), (uint8_t)a, (uint8_t)b);
+                        return;
+                    }
+                }
+                auto literal = std::get_if<Expr::Literal>(&node.right->node);
+                if (op == TokenType::PLUS && literal) {
+                    // Only literals that compile to a CONSTANT (not true/false/"")
+                    bool isNumber = std::holds_alternative<double>(literal->value);
+                    const std::string* str = std::get_if<std::string>(&literal->value);
+                    if (isNumber || (str && *str != "" && *str != "true" && *str != "false")) {
+                        compileExpr(node.left);
+                        Value k = isNumber ? literalToValue(std::get<double>(literal->value), literal->integer) : objToValue(internString(*str));
+                        emitBytes(static_cast<uint8_t>(OpCode::ADD_CONST), static_cast<uint8_t>(addConstant(k)));
+                        return;
+                    }
+                }
+            }
+            int bits = powerOfTwo(node.right);
+            if (node.op.type == TokenType::PERCENT && bits != -1 && isIntExpr(node.left)) {
+                compileExpr(node.left);
+                emitBytes(static_cast<uint8_t>(OpCode::MASK_INT), (uint8_t)bits);
+                return;
+            }
             compileExpr(node.left);
             compileExpr(node.right);
+            OpCode unchecked = uncheckedBinary(node);
+            if (unchecked != OpCode::HALT) {
+                emitByte(static_cast<uint8_t>(unchecked));
+                return;
+            }
+            if (isIntExpr(node.left) && isIntExpr(node.right)) {
+                OpCode specialized = OpCode::HALT;
+                switch (node.op.type) {
+                    case TokenType::PLUS:          specialized = OpCode::ADD_INT; break;
+                    case TokenType::MINUS:         specialized = OpCode::SUBTRACT_INT; break;
+                    case TokenType::STAR:          specialized = OpCode::MULTIPLY_INT; break;
+                    case TokenType::PERCENT:       specialized = OpCode::MODULO_INT; break;
+                    case TokenType::LESS:          specialized = OpCode::LESS_INT; break;
+                    case TokenType::LESS_EQUAL:    specialized = OpCode::LESS_EQUAL_INT; break;
+                    case TokenType::GREATER:       specialized = OpCode::GREATER_INT; break;
+                    case TokenType::GREATER_EQUAL: specialized = OpCode::GREATER_EQUAL_INT; break;
+                    default: break;
+                }
+                if (specialized != OpCode::HALT) {
+                    emitByte(static_cast<uint8_t>(specialized));
+                    return;
+                }
+            }
             switch (node.op.type) {
                 case TokenType::PLUS:  emitByte(static_cast<uint8_t>(OpCode::ADD)); break;
                 case TokenType::MINUS: emitByte(static_cast<uint8_t>(OpCode::SUBTRACT)); break;
@@ -253,30 +489,47 @@ void Compiler::compileExpr(const ExprPtr& expr) {
                     std::cerr << "Unknown operator in compiler: " << (int)node.op.type << std::endl;
                     break;
             }
+        } else if constexpr (std::is_same_v<T, Expr::Unary>) {
+            compileExpr(node.right);
+            if (node.op.type == TokenType::MINUS) emitByte(static_cast<uint8_t>(OpCode::NEGATE));
+            else if (node.op.type == TokenType::BANG) emitByte(static_cast<uint8_t>(OpCode::NOT));
         } else if constexpr (std::is_same_v<T, Expr::Assign>) {
             compileExpr(node.value);
             int target = resolveLocal(node.name);
             if (target != -1) {
                 emitBytes(static_cast<uint8_t>(OpCode::SET_LOCAL), (uint8_t)target);
             } else {
-                emitBytes(static_cast<uint8_t>(OpCode::SET_GLOBAL), static_cast<uint8_t>(addConstant(objToValue(new ObjString(node.name)))));
+                emitGlobal(OpCode::SET_GLOBAL_SLOT, node.name);
             }
         } else if constexpr (std::is_same_v<T, Expr::Call>) {
+            OpCode call = tailCall_ ? OpCode::TAIL_CALL : OpCode::CALL;
+            tailCall_ = false;
             if (std::holds_alternative<Expr::Variable>(node.callee->node)) {
                 auto& var = std::get<Expr::Variable>(node.callee->node);
                 if (var.name == "floor") { compileExpr(node.arguments[0]); emitByte(static_cast<uint8_t>(OpCode::FLOOR)); return; }
                 if (var.name == "sqrt") { compileExpr(node.arguments[0]); emitByte(static_cast<uint8_t>(OpCode::SQRT)); return; }
             }
-            for (const auto& arg : node.arguments) compileExpr(arg);
+            if (auto get = std::get_if<Expr::Get>(&node.callee->node)) {
+                // Method call: the receiver stays in the callee slot as the method's `this`
+                compileExpr(get->object);
+                for (const auto& arg : node.arguments) compileExpr(arg);
+                emitBytes(static_cast<uint8_t>(OpCode::INVOKE), static_cast<uint8_t>(addConstant(objToValue(internString(get->name)))));
+                emitBytes((uint8_t)node.arguments.size(), currentChunk()->addCache());
+                return;
+            }
+            // Callee sits below its arguments; the callee's frame starts at its slot
             compileExpr(node.callee);
-            emitBytes(static_cast<uint8_t>(OpCode::CALL), (uint8_t)node.arguments.size());
+            for (const auto& arg : node.arguments) compileExpr(arg);
+            emitBytes(static_cast<uint8_t>(call), (uint8_t)node.arguments.size());
         } else if constexpr (std::is_same_v<T, Expr::Get>) {
             compileExpr(node.object);
-            emitBytes(static_cast<uint8_t>(OpCode::GET_PROPERTY), static_cast<uint8_t>(addConstant(objToValue(new ObjString(node.name)))));
+            emitBytes(static_cast<uint8_t>(OpCode::GET_PROPERTY), static_cast<uint8_t>(addConstant(objToValue(internString(node.name)))),
+                      currentChunk()->addCache());
         } else if constexpr (std::is_same_v<T, Expr::Set>) {
             compileExpr(node.object);
             compileExpr(node.value);
-            emitBytes(static_cast<uint8_t>(OpCode::SET_PROPERTY), static_cast<uint8_t>(addConstant(objToValue(new ObjString(node.name)))));
+            emitBytes(static_cast<uint8_t>(OpCode::SET_PROPERTY), static_cast<uint8_t>(addConstant(objToValue(internString(node.name)))),
+                      currentChunk()->addCache());
         } else if constexpr (std::is_same_v<T, Expr::This>) {
             int slot = resolveLocal("this");
             if (slot != -1) emitBytes(static_cast<uint8_t>(OpCode::GET_LOCAL), (uint8_t)slot);
@@ -285,24 +538,27 @@ void Compiler::compileExpr(const ExprPtr& expr) {
             if (slot != -1) {
                 emitBytes(static_cast<uint8_t>(OpCode::GET_LOCAL), (uint8_t)slot);
             } else {
-                emitBytes(static_cast<uint8_t>(OpCode::GET_GLOBAL), static_cast<uint8_t>(addConstant(objToValue(new ObjString(node.name)))));
+                emitGlobal(OpCode::GET_GLOBAL_SLOT, node.name);
             }
         } else if constexpr (std::is_same_v<T, Expr::Grouping>) {
             compileExpr(node.expression);
         } else if constexpr (std::is_same_v<T, Expr::SysQuery>) {
-            emitBytes(static_cast<uint8_t>(OpCode::SYS_QUERY), static_cast<uint8_t>(addConstant(objToValue(new ObjString(node.key)))));
+            emitBytes(static_cast<uint8_t>(OpCode::SYS_QUERY), static_cast<uint8_t>(addConstant(objToValue(internString(node.key)))));
         } else if constexpr (std::is_same_v<T, Expr::Array>) {
             for (const auto& element : node.elements) compileExpr(element);
             emitBytes(static_cast<uint8_t>(OpCode::ARRAY_NEW), (uint8_t)node.elements.size());
         } else if constexpr (std::is_same_v<T, Expr::Index>) {
             compileExpr(node.object);
             compileExpr(node.index);
-            emitByte(static_cast<uint8_t>(OpCode::ARRAY_GET));
+            bool f64 = staticType(node.object).isFloat64Array() && staticType(node.index).isNumber();
+            emitByte(static_cast<uint8_t>(f64 ? OpCode::ARRAY_GET_F64 : OpCode::ARRAY_GET));
         } else if constexpr (std::is_same_v<T, Expr::IndexSet>) {
             compileExpr(node.object);
             compileExpr(node.index);
             compileExpr(node.value);
-            emitByte(static_cast<uint8_t>(OpCode::ARRAY_SET));
+            bool f64 = staticType(node.object).isFloat64Array() && staticType(node.index).isNumber() &&
+                       staticType(node.value).isNumber();
+            emitByte(static_cast<uint8_t>(f64 ? OpCode::ARRAY_SET_F64 : OpCode::ARRAY_SET));
         }
     }, expr->node);
 }
@@ -28,17 +28,55 @@
 #include <iostream>
 #include <cmath>
 #include <chrono>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
 
 using namespace llvm;
 using namespace llvm::orc;
 
 namespace kio {
 
+static void optimizeModule(llvm::Module* M) {
+    LoopAnalysisManager LAM;
+    FunctionAnalysisManager FAM;
+    CGSCCAnalysisManager CGAM;
+    ModuleAnalysisManager MAM;
+    PassBuilder PB;
+
+    PB.registerModuleAnalyses(MAM);
+    PB.registerCGSCCAnalyses(CGAM);
+    PB.registerFunctionAnalyses(FAM);
+    PB.registerLoopAnalyses(LAM);
+    PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+    ModulePassManager MPM = PB.buildPerModuleDefaultPipeline(OptimizationLevel::O3);
+    MPM.run(*M, MAM);
+}
+
 struct JITEngine::Impl {
-    std::unique_ptr<llvm::LLVMContext> context;
     std::unique_ptr<llvm::orc::LLJIT> lljit;
+    std::atomic<int> compiledLoops {0};
+    std::atomic<int> compiledFunctions {0};
+
+    mutable std::mutex statsLock;
+    Stats stats;
 
-    Impl() : context(std::make_unique<llvm::LLVMContext>()) {
+    // Requests waiting for a compiler thread. Each compile builds its module
+    // in a context of its own, so the threads share only LLJIT, which locks.
+    std::mutex queueLock;
+    std::condition_variable queueReady;
+    std::deque<std::function<void()>> queue;
+    bool stopping = false;
+    std::vector<std::thread> compilers;
+
+    explicit Impl(unsigned compileThreads) {
         llvm::InitializeNativeTarget();
         llvm::InitializeNativeTargetAsmPrinter();
         llvm::InitializeNativeTargetAsmParser();
@@ -52,332 +90,1465 @@ struct JITEngine::Impl {
             jit_builder.setJITTargetMachineBuilder(std::move(*JTMB));
         }
         
+        // Modules are compiled on the thread that adds them, which is one of
+        // ours; LLJIT needs no pool of its own
         jit_builder.setNumCompileThreads(0);
         
         auto jit_or_err = jit_builder.create();
         if (jit_or_err) {
             lljit = std::move(*jit_or_err);
         } else {
-            lljit = nullptr;
+            llvm::consumeError(jit_or_err.takeError());
+            return;
+        }
+        for (unsigned i = 0; i < std::max(compileThreads, 1u); i++) {
+            compilers.emplace_back([this] { compileRequests(); });
         }
     }
 
-    void optimizeModule(llvm::Module* M) {
-        LoopAnalysisManager LAM;
-        FunctionAnalysisManager FAM;
-        CGSCCAnalysisManager CGAM;
-        ModuleAnalysisManager MAM;
-        PassBuilder PB;
+    ~Impl() {
+        {
+            std::lock_guard<std::mutex> lock(queueLock);
+            stopping = true;
+        }
+        queueReady.notify_all();
+        for (std::thread& compiler : compilers) compiler.join();
+    }
 
-        PB.registerModuleAnalyses(MAM);
-        PB.registerCGSCCAnalyses(CGAM);
-        PB.registerFunctionAnalyses(FAM);
-        PB.registerLoopAnalyses(LAM);
-        PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+    void record(std::chrono::steady_clock::time_point start, bool compiled, size_t Stats::*counter) {
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::lock_guard<std::mutex> lock(statsLock);
+        stats.totalMs += ms;
+        stats.maxMs = std::max(stats.maxMs, ms);
+        if (compiled) stats.*counter += 1;
+        else stats.failed++;
+    }
 
-        ModulePassManager MPM = PB.buildPerModuleDefaultPipeline(OptimizationLevel::O3);
-        MPM.run(*M, MAM);
+    void enqueue(std::function<void()> request) {
+        {
+            std::lock_guard<std::mutex> lock(queueLock);
+            queue.push_back(std::move(request));
+        }
+        queueReady.notify_one();
+    }
+
+    void compileRequests() {
+        for (;;) {
+            std::function<void()> request;
+            {
+                std::unique_lock<std::mutex> lock(queueLock);
+                queueReady.wait(lock, [this] { return stopping || !queue.empty(); });
+                if (stopping) return;
+                request = std::move(queue.front());
+                queue.pop_front();
+            }
+            request();
+        }
     }
 };
 
-JITEngine::JITEngine() : impl_(std::make_unique<Impl>()) {}
+JITEngine::JITEngine(unsigned compileThreads) : impl_(std::make_unique<Impl>(compileThreads)) {}
 JITEngine::~JITEngine() = default;
 
-JITEngine::CompiledLoop JITEngine::compileLoop(Chunk* chunk, uint8_t* startIp) {
-    if (!impl_->lljit) return nullptr;
+bool JITEngine::available() const {
+    return impl_->lljit != nullptr;
+}
 
-    // 1. Scan bytecode to find max local slot usage
-    int max_slot = -1;
-    uint8_t* scan = startIp;
-    bool scan_done = false;
-    bool uses_globals = false;
-    int limit = 1000;
-    
-    while (!scan_done && limit-- > 0 && scan < chunk->code.data() + chunk->code.size()) {
-        OpCode op = (OpCode)(*scan);
-        switch (op) {
-            case OpCode::CONSTANT: scan += 2; break;
+JITEngine::Stats JITEngine::stats() const {
+    std::lock_guard<std::mutex> lock(impl_->statsLock);
+    return impl_->stats;
+}
+
+namespace {
+
+// The target of the jump at offset, if the instruction there is one; past
+// the end of code if it points out of the function
+bool jumpTarget(const std::vector<uint8_t>& code, size_t offset, size_t& target) {
+    OpCode op = (OpCode)code[offset];
+    size_t next = offset + instructionLength(op);
+    switch (op) {
+        case OpCode::JUMP:
+        case OpCode::JUMP_IF_FALSE:
+        case OpCode::LESS_JUMP_IF_FALSE:
+        case OpCode::EQUAL_JUMP_IF_FALSE:
+            target = next + (size_t)((code[offset + 1] << 8) | code[offset + 2]);
+            return true;
+        case OpCode::LESS_LOCALS_JUMP_IF_FALSE:
+            target = next + (size_t)((code[offset + 3] << 8) | code[offset + 4]);
+            return true;
+        case OpCode::LOOP: {
+            size_t distance = (size_t)((code[offset + 1] << 8) | code[offset + 2]);
+            target = distance > next ? code.size() : next - distance;
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+// Translates loops for JITEngine::compileLoop into
+//   i32 loop(ptr stack, ptr sp, i32 slots, ptr globals)
+// The region compiled is the loop's code from its header through the LOOP
+// that closes it, with the loops and branches nested in it. It is split into
+// basic blocks at jump targets and after jumps, and each block maps every
+// value the loop uses to an SSA value: the locals below the stack top at the
+// header and the global slots, each specialized to the kind of number it
+// holds when the loop is compiled, and the entries pushed above that top,
+// locals declared in the loop and operands. Where control flow joins, a phi
+// per value merges the edges. Jumps out of the region and instructions
+// without a translation leave for the interpreter through side exits.
+//
+// A slot holding an int that the loop also gives a double fails the
+// translation and is added to doubles; translating again keeps it as a
+// double throughout.
+class LoopTranslator {
+public:
+    LoopTranslator(llvm::LLVMContext& context, llvm::Module& module, const Chunk& chunk, size_t header,
+                   const Value* slots, int slotCount, const Value* globals, std::set<size_t>& doubles)
+        : context_(context), module_(module), chunk_(chunk), header_(header), values_(slots),
+          slotCount_(slotCount), globals_(globals), doubles_(doubles), builder_(context) {}
+
+    // Nullptr if the region cannot be compiled
+    llvm::Function* translate(const std::string& name) {
+        if (!graph()) return nullptr;
+
+        llvm::Type* ptrTy = builder_.getPtrTy();
+        llvm::FunctionType* FT = llvm::FunctionType::get(builder_.getInt32Ty(), {ptrTy, ptrTy, builder_.getInt32Ty(), ptrTy}, false);
+        F_ = llvm::Function::Create(FT, llvm::Function::ExternalLinkage, name, module_);
+        llvm::BasicBlock* entryBB = llvm::BasicBlock::Create(context_, "entry", F_);
+        llvm::BasicBlock* bailBB = llvm::BasicBlock::Create(context_, "bail", F_);
+
+        // Load the slots into registers; if any no longer holds the kind the
+        // loop was compiled for, return the header and let the interpreter
+        // run it
+        builder_.SetInsertPoint(entryBB);
+        State state;
+        llvm::Value* kindsMatch = builder_.getTrue();
+        for (const Slot& slot : slots_) {
+            llvm::Value* raw = builder_.CreateLoad(i64(), slotPtr(slot));
+            if (slot.integer) {
+                kindsMatch = builder_.CreateAnd(kindsMatch, holdsInt(raw));
+                state.slots.push_back({builder_.CreateAShr(builder_.CreateShl(raw, 16), 16), true});
+            } else {
+                // Ints are converted, for the slots in doubles_
+                llvm::Value* isInt = holdsInt(raw);
+                llvm::Value* isDouble = builder_.CreateICmpNE(builder_.CreateAnd(raw, builder_.getInt64(QNAN)), builder_.getInt64(QNAN));
+                kindsMatch = builder_.CreateAnd(kindsMatch, builder_.CreateOr(isInt, isDouble));
+                llvm::Value* converted = builder_.CreateSIToFP(builder_.CreateAShr(builder_.CreateShl(raw, 16), 16), doubleTy());
+                state.slots.push_back({builder_.CreateSelect(isInt, converted, builder_.CreateBitCast(raw, doubleTy())), false});
+            }
+        }
+        builder_.CreateCondBr(kindsMatch, reach(header_, state), bailBB);
+
+        builder_.SetInsertPoint(bailBB);
+        builder_.CreateRet(builder_.getInt32((int)header_));
+
+        while (!failed_ && !work_.empty()) {
+            size_t offset = work_.back();
+            work_.pop_back();
+            block(offset);
+        }
+        return failed_ ? nullptr : F_;
+    }
+
+private:
+    // A value on the simulated stack or in a slot: i64 for ints, i1 for
+    // booleans and double otherwise. Booleans only feed branches and NOT;
+    // anything else the interpreter does with one is left to it.
+    struct Operand {
+        llvm::Value* value;
+        bool integer;
+        bool boolean = false;
+    };
+
+    // A local below the stack top at the header, or a global slot
+    struct Slot {
+        bool local;
+        int index;
+        bool integer;
+    };
+
+    // The values at a point in the region
+    struct State {
+        std::vector<Operand> slots; // By position in slots_
+        std::vector<Operand> stack; // Pushed since the header
+    };
+
+    struct Block {
+        std::vector<size_t> instructions; // Offsets, up to the one that ends it
+        std::vector<size_t> successors;   // In the region, one per edge
+        int predecessors = 0;             // Edges in from reachable blocks and the entry
+        bool reachable = false;
+        llvm::BasicBlock* bb = nullptr;
+        State entry;                      // All phis when more than one edge comes in
+    };
+
+    llvm::LLVMContext& context_;
+    llvm::Module& module_;
+    const Chunk& chunk_;
+    size_t header_;
+    size_t end_ = 0; // Just past the LOOP that closes the region
+    const Value* values_;
+    int slotCount_;
+    const Value* globals_;
+    std::set<size_t>& doubles_; // Positions in slots_
+    llvm::IRBuilder<> builder_;
+
+    std::vector<Slot> slots_;
+    std::map<int, size_t> locals_;       // Local slot -> position in slots_
+    std::map<uint16_t, size_t> globalSlots_;
+    std::map<size_t, Block> blocks_;     // By leader offset
+    std::vector<size_t> work_;
+
+    llvm::Function* F_ = nullptr;
+    State state_;
+    // The instruction being translated and the state before it; a guard
+    // that fails exits to the interpreter there
+    size_t opStart_ = 0;
+    State opState_;
+    bool failed_ = false;
+
+    llvm::Type* i64() { return builder_.getInt64Ty(); }
+    llvm::Type* doubleTy() { return builder_.getDoubleTy(); }
+    bool inRegion(size_t offset) const { return offset >= header_ && offset < end_; }
+    bool fail() {
+        failed_ = true;
+        return true;
+    }
+
+    // --- Control flow graph -------------------------------------------------
+
+    // A local the loop can keep in a register: declared in the loop, or
+    // holding a number now
+    bool numberLocal(int slot) const { return slot >= slotCount_ || isNumber(values_[slot]); }
+
+    // Whether the instruction at offset has a translation; the others exit
+    bool translatable(size_t offset) const {
+        const uint8_t* ip = &chunk_.code[offset];
+        if ((OpCode)ip[0] == OpCode::ADD_STR) return false;
+        switch (genericForm(unquickened((OpCode)ip[0]))) {
+            case OpCode::CONSTANT: {
+                Value v = chunk_.constants[ip[1]];
+                return isNumber(v) || isBool(v);
+            }
+            case OpCode::ADD_CONST:
+                return isNumber(chunk_.constants[ip[1]]);
             case OpCode::GET_LOCAL:
-            case OpCode::SET_LOCAL: {
-                uint8_t slot = scan[1];
-                if (slot > max_slot) max_slot = slot;
-                scan += 2;
-                break;
+            case OpCode::SET_LOCAL:
+                return numberLocal(ip[1]);
+            case OpCode::INCREMENT_LOCAL:
+                return numberLocal(ip[1]) && isNumber(chunk_.constants[ip[2]]);
+            case OpCode::ADD_LOCALS:
+            case OpCode::SUBTRACT_LOCALS:
+            case OpCode::MULTIPLY_LOCALS:
+            case OpCode::LESS_LOCALS_JUMP_IF_FALSE:
+                return numberLocal(ip[1]) && numberLocal(ip[2]);
+            case OpCode::GET_GLOBAL_SLOT:
+            case OpCode::SET_GLOBAL_SLOT:
+                return isNumber(globals_[(ip[1] << 8) | ip[2]]);
+            case OpCode::INCREMENT_GLOBAL_SLOT:
+                return isNumber(globals_[(ip[1] << 8) | ip[2]]) && isNumber(chunk_.constants[ip[3]]);
+            case OpCode::TRUE: case OpCode::FALSE: case OpCode::POP:
+            case OpCode::ADD: case OpCode::SUBTRACT: case OpCode::MULTIPLY: case OpCode::MODULO:
+            case OpCode::DIVIDE: case OpCode::MASK_INT: case OpCode::NEGATE: case OpCode::NOT:
+            case OpCode::FLOOR: case OpCode::SQRT:
+            case OpCode::LESS: case OpCode::LESS_EQUAL: case OpCode::GREATER: case OpCode::GREATER_EQUAL:
+            case OpCode::EQUAL: case OpCode::NOT_EQUAL:
+            case OpCode::JUMP: case OpCode::JUMP_IF_FALSE: case OpCode::LOOP:
+            case OpCode::LESS_JUMP_IF_FALSE: case OpCode::EQUAL_JUMP_IF_FALSE:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // Finds the region, splits it into blocks and collects the slots the
+    // reachable ones use. False if the code does not decode.
+    bool graph() {
+        const std::vector<uint8_t>& code = chunk_.code;
+        std::set<size_t> starts;
+        for (size_t offset = header_; offset < code.size();) {
+            if (code[offset] > (uint8_t)OpCode::HALT) return false;
+            size_t next = offset + instructionLength((OpCode)code[offset]);
+            if (next > code.size()) return false;
+            starts.insert(offset);
+            size_t target;
+            if ((OpCode)code[offset] == OpCode::LOOP && jumpTarget(code, offset, target) && target == header_) end_ = next;
+            offset = next;
+        }
+        if (!end_ || !translatable(header_)) return false;
+
+        std::set<size_t> leaders = {header_};
+        for (size_t offset : starts) {
+            if (offset >= end_) break;
+            size_t next = offset + instructionLength((OpCode)code[offset]);
+            size_t target;
+            if (jumpTarget(code, offset, target)) {
+                if (target >= code.size() || (inRegion(target) && !starts.count(target))) return false;
+                if (inRegion(target)) leaders.insert(target);
+                if (next < end_) leaders.insert(next);
+            } else if (!translatable(offset) && next < end_) {
+                leaders.insert(next);
             }
-            case OpCode::GET_GLOBAL:
-            case OpCode::SET_GLOBAL:
-            case OpCode::DEFINE_GLOBAL:
-                return nullptr; // Globals use string keys, not supported in JIT
-            case OpCode::JUMP: 
-            case OpCode::JUMP_IF_FALSE: scan += 3; break;
-            case OpCode::LOOP: {
-                scan_done = true;
-                scan += 3;
-                break;
+        }
+
+        for (auto leader = leaders.begin(); leader != leaders.end(); ++leader) {
+            Block& block = blocks_[*leader];
+            size_t limit = std::next(leader) == leaders.end() ? end_ : *std::next(leader);
+            for (size_t offset = *leader;;) {
+                OpCode op = (OpCode)code[offset];
+                size_t next = offset + instructionLength(op);
+                size_t target;
+                block.instructions.push_back(offset);
+                if (!translatable(offset)) break;
+                if (jumpTarget(code, offset, target)) {
+                    if (op != OpCode::JUMP && op != OpCode::LOOP) block.successors.push_back(next);
+                    if (inRegion(target)) block.successors.push_back(target);
+                    break;
+                }
+                if (next == limit) {
+                    block.successors.push_back(next);
+                    break;
+                }
+                offset = next;
             }
-            case OpCode::CALL: 
-            case OpCode::PRINT: 
-            case OpCode::HALT:
-            case OpCode::SYS_QUERY:
-            case OpCode::ARRAY_NEW:
-            case OpCode::ARRAY_GET:
-            case OpCode::ARRAY_SET:
-            case OpCode::FLOOR:
-            case OpCode::SQRT:
-                scan += 1;
+        }
+
+        std::vector<size_t> work = {header_};
+        blocks_[header_].reachable = true;
+        blocks_[header_].predecessors = 1;
+        while (!work.empty()) {
+            Block& block = blocks_[work.back()];
+            work.pop_back();
+            for (size_t successor : block.successors) {
+                Block& next = blocks_[successor];
+                next.predecessors++;
+                if (!next.reachable) {
+                    next.reachable = true;
+                    work.push_back(successor);
+                }
+            }
+            for (size_t offset : block.instructions) {
+                if (translatable(offset)) use(offset);
+            }
+        }
+        return true;
+    }
+
+    // Tracks the slots the instruction at offset reads or writes
+    void use(size_t offset) {
+        const uint8_t* ip = &chunk_.code[offset];
+        auto local = [&](int slot) {
+            if (slot < slotCount_ && !locals_.count(slot)) {
+                locals_[slot] = slots_.size();
+                slots_.push_back({true, slot, isInt(values_[slot]) && !doubles_.count(slots_.size())});
+            }
+        };
+        switch ((OpCode)ip[0]) {
+            case OpCode::GET_LOCAL:
+            case OpCode::SET_LOCAL:
+            case OpCode::INCREMENT_LOCAL:
+                local(ip[1]);
                 break;
-            default: 
-                scan += 1; // Single-byte ops (ADD, SUB, etc.)
+            case OpCode::ADD_LOCALS:
+            case OpCode::SUBTRACT_LOCALS:
+            case OpCode::MULTIPLY_LOCALS:
+            case OpCode::LESS_LOCALS_JUMP_IF_FALSE:
+                local(ip[1]);
+                local(ip[2]);
+                break;
+            case OpCode::GET_GLOBAL_SLOT:
+            case OpCode::SET_GLOBAL_SLOT:
+            case OpCode::INCREMENT_GLOBAL_SLOT: {
+                uint16_t slot = (uint16_t)((ip[1] << 8) | ip[2]);
+                if (!globalSlots_.count(slot)) {
+                    globalSlots_[slot] = slots_.size();
+                    slots_.push_back({false, slot, isInt(globals_[slot]) && !doubles_.count(slots_.size())});
+                }
+                break;
+            }
+            default:
                 break;
         }
     }
-    
-    if (limit <= 0) return nullptr;
-    
-    max_slot += 2; 
 
-    auto M = std::make_unique<llvm::Module>("kio_jit_module", *impl_->context);
-    M->setDataLayout(impl_->lljit->getDataLayout());
-    
-    llvm::IRBuilder<> builder(*impl_->context);
-
-    llvm::Type* i32 = builder.getInt32Ty();
-    llvm::Type* doubleTy = builder.getDoubleTy();
-    llvm::Type* voidTy = builder.getVoidTy();
-    llvm::PointerType* ptrTy = builder.getPtrTy();
-
-    std::vector<llvm::Type*> argTypes = { ptrTy, ptrTy, i32, ptrTy };
-    llvm::FunctionType* FT = llvm::FunctionType::get(voidTy, argTypes, false);
-    llvm::Function* F = llvm::Function::Create(FT, llvm::Function::ExternalLinkage, "hot_loop", M.get());
-
-    llvm::BasicBlock* entryBB = llvm::BasicBlock::Create(*impl_->context, "entry", F);
-    llvm::BasicBlock* loopDetailsBB = llvm::BasicBlock::Create(*impl_->context, "loop_setup", F);
-    llvm::BasicBlock* loopBodyBB = llvm::BasicBlock::Create(*impl_->context, "loop_body", F);
-    llvm::BasicBlock* exitBB = llvm::BasicBlock::Create(*impl_->context, "exit", F);
-
-    builder.SetInsertPoint(entryBB);
-    
-    llvm::FastMathFlags fmf;
-    fmf.setFast();
-    builder.setFastMathFlags(fmf);
-
-    llvm::Value* stackBase = F->getArg(0);
-    llvm::Value* slotsOffset = F->getArg(2);
-
-    llvm::Value* stackStructPtr = builder.CreateBitCast(stackBase, llvm::PointerType::get(*impl_->context, 0));
-
-    std::vector<llvm::Value*> localAllocas(max_slot + 1, nullptr);
-    for (int i = 0; i <= max_slot; i++) {
-        localAllocas[i] = builder.CreateAlloca(doubleTy, nullptr, "local_" + std::to_string(i));
-    }
-    
-    // Load initial values from stack
-    for (int i = 0; i <= max_slot; i++) {
-        llvm::Value* idx = builder.CreateAdd(slotsOffset, builder.getInt32(i));
-        llvm::Value* valPtr = builder.CreateGEP(doubleTy, stackStructPtr, idx);
-        llvm::Value* rawVal = builder.CreateLoad(doubleTy, valPtr);
-        builder.CreateStore(rawVal, localAllocas[i]);
-    }
-
-    builder.CreateBr(loopDetailsBB);
-    builder.SetInsertPoint(loopDetailsBB);
-    builder.CreateBr(loopBodyBB);
-    builder.SetInsertPoint(loopBodyBB);
-
-    std::vector<llvm::Value*> simStack;
-
-    uint8_t* ip = startIp;
-    bool compiling = true;
-    
-    while (compiling) {
-        OpCode op = (OpCode)(*ip++);
-        std::cerr << "[JIT] Compiling op: " << (int)op << " at offset " << (int)(ip - startIp - 1) << std::endl;
+    // The block at offset, entered with state from the block being
+    // translated
+    llvm::BasicBlock* reach(size_t offset, const State& state) {
+        Block& block = blocks_[offset];
+        llvm::BasicBlock* from = builder_.GetInsertBlock();
+        if (!block.bb) {
+            block.bb = llvm::BasicBlock::Create(context_, "at_" + std::to_string(offset), F_);
+            block.entry = state;
+            if (block.predecessors > 1) {
+                llvm::IRBuilder<> at(block.bb);
+                auto phi = [&](Operand& o) {
+                    llvm::Type* type = o.boolean ? (llvm::Type*)builder_.getInt1Ty() : o.integer ? i64() : doubleTy();
+                    o.value = at.CreatePHI(type, block.predecessors);
+                };
+                for (Operand& o : block.entry.slots) phi(o);
+                for (Operand& o : block.entry.stack) phi(o);
+            }
+            work_.push_back(offset);
+        }
+        if (block.predecessors > 1) {
+            // Every edge in must agree on the kind of each value; an int
+            // meeting a double becomes one
+            if (state.stack.size() != block.entry.stack.size()) failed_ = true;
+            auto incoming = [&](const Operand& phi, const Operand& o) {
+                llvm::Value* value = o.value;
+                if (phi.boolean != o.boolean || (phi.integer && !o.integer)) return false;
+                if (!phi.integer && o.integer) value = builder_.CreateSIToFP(o.value, doubleTy());
+                llvm::cast<llvm::PHINode>(phi.value)->addIncoming(value, from);
+                return true;
+            };
+            for (size_t i = 0; !failed_ && i < state.slots.size(); i++) {
+                if (incoming(block.entry.slots[i], state.slots[i])) continue;
+                if (!state.slots[i].boolean) doubles_.insert(i);
+                failed_ = true;
+            }
+            for (size_t i = 0; !failed_ && i < state.stack.size(); i++) {
+                if (!incoming(block.entry.stack[i], state.stack[i])) failed_ = true;
+            }
+        }
+        return block.bb;
+    }
+
+    // --- Values -------------------------------------------------------------
+
+    llvm::Value* holdsInt(llvm::Value* v) {
+        return builder_.CreateICmpEQ(builder_.CreateAnd(v, builder_.getInt64(TAG_MASK)), builder_.getInt64(INT_TAG));
+    }
+    llvm::Value* slotPtr(const Slot& slot) {
+        if (slot.local) return builder_.CreateGEP(i64(), F_->getArg(0), builder_.CreateAdd(F_->getArg(2), builder_.getInt32(slot.index)));
+        return builder_.CreateGEP(i64(), F_->getArg(3), builder_.getInt32(slot.index));
+    }
+    llvm::Value* box(const Operand& o) {
+        if (o.boolean) return builder_.CreateSelect(o.value, builder_.getInt64(TRUE_VAL.v), builder_.getInt64(FALSE_VAL.v));
+        if (o.integer) return builder_.CreateOr(builder_.CreateAnd(o.value, builder_.getInt64(~TAG_MASK)), builder_.getInt64(INT_TAG));
+        return builder_.CreateBitCast(o.value, i64());
+    }
+    llvm::Value* toDouble(const Operand& o) {
+        failed_ |= o.boolean;
+        return o.integer ? builder_.CreateSIToFP(o.value, doubleTy()) : o.value;
+    }
+    Operand constant(Value v) {
+        if (isInt(v)) return {builder_.getInt64(valueToInt(v)), true};
+        return {llvm::ConstantFP::get(doubleTy(), valueToDouble(v)), false};
+    }
+
+    // A block that leaves the loop for the interpreter at resume: boxes the
+    // slots back, pushes the entries of state's stack and returns resume's
+    // offset
+    llvm::BasicBlock* sideExit(size_t resume, const State& state) {
+        llvm::BasicBlock* exitBB = llvm::BasicBlock::Create(context_, "side_exit", F_);
+        llvm::IRBuilderBase::InsertPointGuard keep(builder_);
+        builder_.SetInsertPoint(exitBB);
+        for (size_t i = 0; i < slots_.size(); i++) builder_.CreateStore(box(state.slots[i]), slotPtr(slots_[i]));
+        if (!state.stack.empty()) {
+            llvm::Value* spRef = F_->getArg(1);
+            llvm::Value* sp = builder_.CreateLoad(builder_.getInt32Ty(), spRef);
+            for (size_t i = 0; i < state.stack.size(); i++) {
+                llvm::Value* at = builder_.CreateAdd(sp, builder_.getInt32((int)i));
+                builder_.CreateStore(box(state.stack[i]), builder_.CreateGEP(i64(), F_->getArg(0), at));
+            }
+            builder_.CreateStore(builder_.CreateAdd(sp, builder_.getInt32((int)state.stack.size())), spRef);
+        }
+        builder_.CreateRet(builder_.getInt32((int)resume));
+        return exitBB;
+    }
+    // Continues in a new block when ok holds, otherwise side-exits to rerun
+    // the current instruction in the interpreter, which promotes to doubles
+    void guard(llvm::Value* ok) {
+        llvm::BasicBlock* okBB = llvm::BasicBlock::Create(context_, "int_ok", F_);
+        builder_.CreateCondBr(ok, okBB, sideExit(opStart_, opState_));
+        builder_.SetInsertPoint(okBB);
+    }
+    llvm::Value* fitsInt(llvm::Value* n) {
+        return builder_.CreateICmpEQ(builder_.CreateAShr(builder_.CreateShl(n, 16), 16), n);
+    }
+
+    Operand arithmetic(OpCode op, const Operand& a, const Operand& b) {
+        if (a.integer && b.integer) {
+            llvm::Value* result;
+            if (op == OpCode::MULTIPLY) {
+                llvm::Function* smul = llvm::Intrinsic::getOrInsertDeclaration(&module_, llvm::Intrinsic::smul_with_overflow, {i64()});
+                llvm::Value* product = builder_.CreateCall(smul, {a.value, b.value});
+                result = builder_.CreateExtractValue(product, 0);
+                guard(builder_.CreateAnd(fitsInt(result), builder_.CreateNot(builder_.CreateExtractValue(product, 1))));
+                return {result, true};
+            }
+            if (op == OpCode::MODULO) {
+                guard(builder_.CreateICmpNE(b.value, builder_.getInt64(0)));
+                return {builder_.CreateSRem(a.value, b.value), true};
+            }
+            result = op == OpCode::ADD ? builder_.CreateAdd(a.value, b.value) : builder_.CreateSub(a.value, b.value);
+            guard(fitsInt(result));
+            return {result, true};
+        }
+        llvm::Value* x = toDouble(a);
+        llvm::Value* y = toDouble(b);
+        if (op == OpCode::ADD) return {builder_.CreateFAdd(x, y), false};
+        if (op == OpCode::SUBTRACT) return {builder_.CreateFSub(x, y), false};
+        if (op == OpCode::MULTIPLY) return {builder_.CreateFMul(x, y), false};
+        return {builder_.CreateFRem(x, y), false};
+    }
+    llvm::Value* compare(OpCode op, const Operand& a, const Operand& b) {
+        if (a.integer && b.integer) {
+            if (op == OpCode::LESS) return builder_.CreateICmpSLT(a.value, b.value);
+            if (op == OpCode::GREATER) return builder_.CreateICmpSGT(a.value, b.value);
+            if (op == OpCode::LESS_EQUAL) return builder_.CreateICmpSLE(a.value, b.value);
+            if (op == OpCode::GREATER_EQUAL) return builder_.CreateICmpSGE(a.value, b.value);
+            if (op == OpCode::NOT_EQUAL) return builder_.CreateICmpNE(a.value, b.value);
+            return builder_.CreateICmpEQ(a.value, b.value);
+        }
+        llvm::Value* x = toDouble(a);
+        llvm::Value* y = toDouble(b);
+        if (op == OpCode::LESS) return builder_.CreateFCmpOLT(x, y);
+        if (op == OpCode::GREATER) return builder_.CreateFCmpOGT(x, y);
+        if (op == OpCode::LESS_EQUAL) return builder_.CreateFCmpOLE(x, y);
+        if (op == OpCode::GREATER_EQUAL) return builder_.CreateFCmpOGE(x, y);
+        if (op == OpCode::NOT_EQUAL) return builder_.CreateFCmpUNE(x, y);
+        return builder_.CreateFCmpOEQ(x, y);
+    }
+    // Whether the interpreter would take o as false
+    llvm::Value* isFalsy(const Operand& o) {
+        if (o.boolean) return builder_.CreateNot(o.value);
+        return o.integer ? builder_.CreateICmpEQ(o.value, builder_.getInt64(0))
+                         : builder_.CreateFCmpOEQ(o.value, llvm::ConstantFP::get(doubleTy(), 0.0));
+    }
+
+    // --- Stack and slots ----------------------------------------------------
+
+    Operand pop() {
+        if (state_.stack.empty()) {
+            failed_ = true;
+            return {builder_.getInt64(0), true};
+        }
+        Operand o = state_.stack.back();
+        state_.stack.pop_back();
+        return o;
+    }
+    Operand* local(int slot) {
+        if (slot < slotCount_) return &state_.slots[locals_.at(slot)];
+        if ((size_t)(slot - slotCount_) >= state_.stack.size()) {
+            failed_ = true;
+            return nullptr;
+        }
+        return &state_.stack[slot - slotCount_];
+    }
+    Operand* global(uint16_t slot) { return &state_.slots[globalSlots_.at(slot)]; }
+    Operand read(Operand* slot) { return slot ? *slot : Operand{builder_.getInt64(0), true}; }
+    // A local declared in the loop takes any value. A specialized slot keeps
+    // its kind: booleans cannot be stored into a number slot, and a double
+    // stored into an int slot makes it one of doubles_.
+    void write(Operand* slot, const Operand& o, bool declared) {
+        if (!slot) return;
+        if (declared) {
+            *slot = o;
+        } else if (o.boolean) {
+            failed_ = true;
+        } else if (slot->integer && !o.integer) {
+            doubles_.insert(slot - state_.slots.data());
+            failed_ = true;
+        } else {
+            slot->value = slot->integer ? o.value : toDouble(o);
+        }
+    }
+
+    // --- Blocks -------------------------------------------------------------
+
+    void block(size_t start) {
+        Block& block = blocks_[start];
+        builder_.SetInsertPoint(block.bb);
+        state_ = block.entry;
+        for (size_t offset : block.instructions) {
+            if (!translatable(offset)) {
+                builder_.CreateBr(sideExit(offset, state_));
+                return;
+            }
+            if (instruction(offset) || failed_) return;
+        }
+        // Falls through to the next block
+        size_t last = block.instructions.back();
+        size_t next = last + instructionLength((OpCode)chunk_.code[last]);
+        if (!builder_.GetInsertBlock()->getTerminator()) builder_.CreateBr(reach(next, state_));
+    }
+
+    // Translates the instruction at offset; true if it ends the block or
+    // cannot be translated
+    bool instruction(size_t offset) {
+        const uint8_t* ip = &chunk_.code[offset];
+        OpCode op = genericForm(unquickened((OpCode)ip[0]));
+        size_t next = offset + instructionLength((OpCode)ip[0]);
+        opStart_ = offset;
+        opState_ = state_;
         switch (op) {
             case OpCode::CONSTANT: {
-                uint8_t idx = *ip++;
-                Value v = chunk->constants[idx];
-                if (isNumber(v)) {
-                    simStack.push_back(llvm::ConstantFP::get(doubleTy, valueToDouble(v)));
-                } else if (isBool(v)) {
-                     simStack.push_back(llvm::ConstantFP::get(doubleTy, (v.v == (0x7ff8000000000000 | 3)) ? 1.0 : 0.0));
-                } else return nullptr;
+                Value v = chunk_.constants[ip[1]];
+                if (isNumber(v)) state_.stack.push_back(constant(v));
+                else state_.stack.push_back({builder_.getInt1(v.v == TRUE_VAL.v), false, true});
                 break;
             }
-            case OpCode::GET_LOCAL: {
-                uint8_t idx = *ip++;
-                if (idx > max_slot) return nullptr;
-                llvm::Value* val = builder.CreateLoad(doubleTy, localAllocas[idx]);
-                simStack.push_back(val);
+            case OpCode::TRUE:
+            case OpCode::FALSE:
+                state_.stack.push_back({builder_.getInt1(op == OpCode::TRUE), false, true});
+                break;
+            case OpCode::POP:
+                pop();
+                break;
+            case OpCode::GET_LOCAL:
+                state_.stack.push_back(read(local(ip[1])));
                 break;
-            }
             case OpCode::SET_LOCAL: {
-                uint8_t idx = *ip++;
-                if (simStack.empty()) return nullptr;
-                llvm::Value* val = simStack.back();
-                simStack.pop_back();
-                builder.CreateStore(val, localAllocas[idx]);
+                if (state_.stack.empty()) return fail();
+                Operand top = state_.stack.back();
+                write(local(ip[1]), top, ip[1] >= slotCount_);
+                break;
+            }
+            case OpCode::GET_GLOBAL_SLOT:
+                state_.stack.push_back(*global((uint16_t)((ip[1] << 8) | ip[2])));
+                break;
+            case OpCode::SET_GLOBAL_SLOT: {
+                if (state_.stack.empty()) return fail();
+                Operand top = state_.stack.back();
+                write(global((uint16_t)((ip[1] << 8) | ip[2])), top, false);
                 break;
             }
             case OpCode::ADD:
             case OpCode::SUBTRACT:
-            case OpCode::MULTIPLY: {
-                if (simStack.size() < 2) return nullptr;
-                llvm::Value* b = simStack.back(); simStack.pop_back();
-                llvm::Value* a = simStack.back(); simStack.pop_back();
-                if (op == OpCode::ADD) simStack.push_back(builder.CreateFAdd(a, b));
-                else if (op == OpCode::SUBTRACT) simStack.push_back(builder.CreateFSub(a, b));
-                else simStack.push_back(builder.CreateFMul(a, b));
+            case OpCode::MULTIPLY:
+            case OpCode::MODULO: {
+                Operand b = pop();
+                Operand a = pop();
+                if (failed_) return true;
+                state_.stack.push_back(arithmetic(op, a, b));
                 break;
             }
-            case OpCode::DIVIDE: {
-                if (simStack.size() < 2) return nullptr;
-                llvm::Value* b = simStack.back(); simStack.pop_back();
-                llvm::Value* a = simStack.back(); simStack.pop_back();
-                // Optimize divide by constant
-                if (llvm::ConstantFP* CFP = llvm::dyn_cast<llvm::ConstantFP>(b)) {
-                    double val = CFP->getValueAPF().convertToDouble();
-                    if (val != 0.0) {
-                        simStack.push_back(builder.CreateFMul(a, llvm::ConstantFP::get(doubleTy, 1.0 / val)));
-                        break;
-                    }
-                }
-                simStack.push_back(builder.CreateFDiv(a, b));
+            case OpCode::MASK_INT: {
+                // LLVM lowers the remainder by a power of two itself
+                Operand a = pop();
+                if (failed_) return true;
+                state_.stack.push_back(arithmetic(OpCode::MODULO, a, constant(intToValue((int64_t)1 << ip[1]))));
                 break;
             }
-            case OpCode::MODULO: {
-                if (simStack.size() < 2) return nullptr;
-                llvm::Value* b = simStack.back(); simStack.pop_back();
-                llvm::Value* a = simStack.back(); simStack.pop_back();
-                // a % b = a - b * floor(a / b)
-                // This is often faster than fmod call
-                llvm::Function* floorFunc = llvm::Intrinsic::getOrInsertDeclaration(M.get(), llvm::Intrinsic::floor, {doubleTy});
-                
-                llvm::Value* div;
-                // Optimization: if b is constant, use fmul by reciprocal
-                if (llvm::ConstantFP* CFP = llvm::dyn_cast<llvm::ConstantFP>(b)) {
-                    double val = CFP->getValueAPF().convertToDouble();
-                    div = builder.CreateFMul(a, llvm::ConstantFP::get(doubleTy, 1.0 / val));
-                } else {
-                    div = builder.CreateFDiv(a, b);
-                }
-                
-                llvm::Value* fl = builder.CreateCall(floorFunc, {div});
-                llvm::Value* mul = builder.CreateFMul(b, fl);
-                simStack.push_back(builder.CreateFSub(a, mul));
+            case OpCode::DIVIDE: {
+                // InstCombine turns a division by a power of two into a
+                // multiply; any other reciprocal would round differently
+                llvm::Value* b = toDouble(pop());
+                llvm::Value* a = toDouble(pop());
+                state_.stack.push_back({builder_.CreateFDiv(a, b), false});
                 break;
             }
             case OpCode::LESS:
-            case OpCode::GREATER: 
+            case OpCode::GREATER:
             case OpCode::LESS_EQUAL:
             case OpCode::GREATER_EQUAL:
-            case OpCode::EQUAL: {
-                    if (simStack.size() < 2) return nullptr;
-                    llvm::Value* b = simStack.back(); simStack.pop_back();
-                    llvm::Value* a = simStack.back(); simStack.pop_back();
-                    llvm::Value* cmp = nullptr;
-                    if (op == OpCode::LESS) cmp = builder.CreateFCmpOLT(a, b);
-                    else if (op == OpCode::GREATER) cmp = builder.CreateFCmpOGT(a, b);
-                    else if (op == OpCode::LESS_EQUAL) cmp = builder.CreateFCmpOLE(a, b);
-                    else if (op == OpCode::GREATER_EQUAL) cmp = builder.CreateFCmpOGE(a, b);
-                    else cmp = builder.CreateFCmpOEQ(a, b);
-                    simStack.push_back(builder.CreateUIToFP(cmp, doubleTy));
-                    break;
+            case OpCode::EQUAL:
+            case OpCode::NOT_EQUAL: {
+                Operand b = pop();
+                Operand a = pop();
+                if (failed_) return true;
+                state_.stack.push_back({compare(op, a, b), false, true});
+                break;
             }
             case OpCode::NEGATE: {
-                if (simStack.empty()) return nullptr;
-                llvm::Value* val = simStack.back(); simStack.pop_back();
-                simStack.push_back(builder.CreateFNeg(val));
+                Operand val = pop();
+                if (failed_ || val.boolean) return fail();
+                if (val.integer) {
+                    llvm::Value* negated = builder_.CreateNeg(val.value);
+                    guard(fitsInt(negated));
+                    state_.stack.push_back({negated, true});
+                } else {
+                    state_.stack.push_back({builder_.CreateFNeg(val.value), false});
+                }
                 break;
             }
             case OpCode::NOT: {
-                if (simStack.empty()) return nullptr;
-                llvm::Value* val = simStack.back(); simStack.pop_back();
-                // Not in KIO is: v == 0 ? 1 : 0
-                llvm::Value* isZero = builder.CreateFCmpOEQ(val, llvm::ConstantFP::get(doubleTy, 0.0));
-                simStack.push_back(builder.CreateUIToFP(isZero, doubleTy));
-                break;
-            }
-            case OpCode::FLOOR: {
-                if (simStack.empty()) return nullptr;
-                llvm::Value* val = simStack.back(); simStack.pop_back();
-                llvm::Function* floorFunc = llvm::Intrinsic::getOrInsertDeclaration(M.get(), llvm::Intrinsic::floor, {doubleTy});
-                simStack.push_back(builder.CreateCall(floorFunc, {val}));
+                Operand val = pop();
+                if (failed_) return true;
+                state_.stack.push_back({isFalsy(val), false, true});
                 break;
             }
+            case OpCode::FLOOR:
             case OpCode::SQRT: {
-                if (simStack.empty()) return nullptr;
-                llvm::Value* val = simStack.back(); simStack.pop_back();
-                llvm::Function* sqrtFunc = llvm::Intrinsic::getOrInsertDeclaration(M.get(), llvm::Intrinsic::sqrt, {doubleTy});
-                simStack.push_back(builder.CreateCall(sqrtFunc, {val}));
+                llvm::Value* val = toDouble(pop());
+                llvm::Intrinsic::ID id = op == OpCode::FLOOR ? llvm::Intrinsic::floor : llvm::Intrinsic::sqrt;
+                llvm::Function* intrinsic = llvm::Intrinsic::getOrInsertDeclaration(&module_, id, {doubleTy()});
+                state_.stack.push_back({builder_.CreateCall(intrinsic, {val}), false});
                 break;
             }
-            case OpCode::JUMP_IF_FALSE: {
-                ip += 2;
-                if (simStack.empty()) return nullptr;
-                llvm::Value* condVal = simStack.back(); simStack.pop_back();
-                llvm::Value* isZero = builder.CreateFCmpOEQ(condVal, llvm::ConstantFP::get(doubleTy, 0.0));
-                llvm::BasicBlock* nextBB = llvm::BasicBlock::Create(*impl_->context, "cont", F);
-                builder.CreateCondBr(isZero, exitBB, nextBB);
-                builder.SetInsertPoint(nextBB);
+            case OpCode::ADD_CONST: {
+                Operand a = pop();
+                if (failed_) return true;
+                state_.stack.push_back(arithmetic(OpCode::ADD, a, constant(chunk_.constants[ip[1]])));
                 break;
             }
-            case OpCode::LOOP: {
-                ip += 2;
-                builder.CreateBr(loopBodyBB);
-                compiling = false;
+            case OpCode::ADD_LOCALS:
+            case OpCode::SUBTRACT_LOCALS:
+            case OpCode::MULTIPLY_LOCALS: {
+                Operand a = read(local(ip[1]));
+                Operand b = read(local(ip[2]));
+                if (failed_) return true;
+                OpCode generic = op == OpCode::ADD_LOCALS ? OpCode::ADD
+                               : op == OpCode::SUBTRACT_LOCALS ? OpCode::SUBTRACT : OpCode::MULTIPLY;
+                state_.stack.push_back(arithmetic(generic, a, b));
                 break;
             }
-            case OpCode::POP: { 
-                if (!simStack.empty()) simStack.pop_back(); 
-                break; 
+            case OpCode::INCREMENT_LOCAL: {
+                Operand value = read(local(ip[1]));
+                if (failed_) return true;
+                Operand sum = arithmetic(OpCode::ADD, value, constant(chunk_.constants[ip[2]]));
+                write(local(ip[1]), sum, ip[1] >= slotCount_);
+                break;
             }
-            case OpCode::JUMP: {
-                // Jump forward by 2-byte offset (used for else branches, etc.)
-                uint8_t hi = *ip++;
-                uint8_t lo = *ip++;
-                uint16_t offset = (hi << 8) | lo;
-                ip += offset;  // Jump forward from current position
+            case OpCode::INCREMENT_GLOBAL_SLOT: {
+                Operand* slot = global((uint16_t)((ip[1] << 8) | ip[2]));
+                write(slot, arithmetic(OpCode::ADD, *slot, constant(chunk_.constants[ip[3]])), false);
                 break;
             }
-            default: 
-                std::cerr << "[JIT] Unknown opcode: " << (int)op << std::endl;
-                return nullptr;
-        }
-    }
-    
-    builder.SetInsertPoint(exitBB);
-    
-    for (int i = 0; i <= max_slot; i++) {
-        llvm::Value* idx = builder.CreateAdd(slotsOffset, builder.getInt32(i));
-        llvm::Value* valPtr = builder.CreateGEP(doubleTy, stackStructPtr, idx);
-        llvm::Value* val = builder.CreateLoad(doubleTy, localAllocas[i]);
-        builder.CreateStore(val, valPtr);
-    }
-    
-    builder.CreateRetVoid();
-
-    if (llvm::verifyFunction(*F, &llvm::errs())) return nullptr;
-    impl_->optimizeModule(M.get());
-    
-    auto TSM = llvm::orc::ThreadSafeModule(std::move(M), std::move(impl_->context));
-    if (auto err = impl_->lljit->addIRModule(std::move(TSM))) return nullptr;
-    
-    auto sym = impl_->lljit->lookup("hot_loop");
-    if (!sym) return nullptr;
-
-    impl_->context = std::make_unique<llvm::LLVMContext>();
+            case OpCode::JUMP:
+            case OpCode::LOOP: {
+                size_t target;
+                jumpTarget(chunk_.code, offset, target);
+                builder_.CreateBr(inRegion(target) ? reach(target, state_) : sideExit(target, state_));
+                return true;
+            }
+            case OpCode::JUMP_IF_FALSE:
+            case OpCode::LESS_JUMP_IF_FALSE:
+            case OpCode::EQUAL_JUMP_IF_FALSE:
+            case OpCode::LESS_LOCALS_JUMP_IF_FALSE: {
+                llvm::Value* taken; // Falls through when this holds
+                if (op == OpCode::JUMP_IF_FALSE) {
+                    Operand condition = pop();
+                    if (failed_) return true;
+                    taken = builder_.CreateNot(isFalsy(condition));
+                } else if (op == OpCode::LESS_LOCALS_JUMP_IF_FALSE) {
+                    Operand a = read(local(ip[1]));
+                    Operand b = read(local(ip[2]));
+                    if (failed_) return true;
+                    taken = compare(OpCode::LESS, a, b);
+                } else {
+                    Operand b = pop();
+                    Operand a = pop();
+                    if (failed_) return true;
+                    taken = compare(op == OpCode::EQUAL_JUMP_IF_FALSE ? OpCode::EQUAL : OpCode::LESS, a, b);
+                }
+                size_t target;
+                jumpTarget(chunk_.code, offset, target);
+                llvm::BasicBlock* fallthrough = reach(next, state_);
+                builder_.CreateCondBr(taken, fallthrough, inRegion(target) ? reach(target, state_) : sideExit(target, state_));
+                return true;
+            }
+            default:
+                return fail();
+        }
+        return false;
+    }
+};
+
+} // namespace
+
+JITEngine::CompiledLoop JITEngine::compileLoop(Chunk* chunk, uint8_t* startIp, const Value* slots, int slotCount,
+                                               const Value* globals) {
+    if (!impl_->lljit) return nullptr;
+
+    auto context = std::make_unique<llvm::LLVMContext>();
+    auto M = std::make_unique<llvm::Module>("kio_jit_module", *context);
+    M->setDataLayout(impl_->lljit->getDataLayout());
+
+    // Every module defines its own symbol; LLJIT rejects a second definition
+    // of a name it has already linked
+    std::string name = "hot_loop_" + std::to_string(impl_->compiledLoops++);
+    // Each failed translation that finds more slots to keep as doubles is
+    // retried in a fresh module
+    std::set<size_t> doubles;
+    llvm::Function* F = nullptr;
+    for (size_t widened = 0;; widened = doubles.size()) {
+        LoopTranslator translator(*context, *M, *chunk, startIp - chunk->code.data(), slots, slotCount, globals, doubles);
+        F = translator.translate(name);
+        if (F || doubles.size() == widened) break;
+        M = std::make_unique<llvm::Module>("kio_jit_module", *context);
+        M->setDataLayout(impl_->lljit->getDataLayout());
+    }
+    if (!F || llvm::verifyFunction(*F, &llvm::errs())) return nullptr;
+    optimizeModule(M.get());
+
+    auto TSM = llvm::orc::ThreadSafeModule(std::move(M), std::move(context));
+    if (auto err = impl_->lljit->addIRModule(std::move(TSM))) {
+        llvm::consumeError(std::move(err));
+        return nullptr;
+    }
+
+    auto sym = impl_->lljit->lookup(name);
+    if (!sym) {
+        llvm::consumeError(sym.takeError());
+        return nullptr;
+    }
     return (CompiledLoop)sym->getValue();
 }
 
+namespace {
+
+constexpr size_t MAX_FUNCTIONS = 16;   // Functions compiled into one module
+constexpr int MAX_NATIVE_DEPTH = 4096; // Deeper recursion is left to the interpreter's frames
+
+// What compileFunction reads of the functions it compiles, copied on the
+// interpreter thread: their code, which the interpreter quickens in place,
+// and what each global slot held. The functions themselves are constants of
+// the chunks that define them and outlive the compile.
+struct FunctionSource {
+    struct Code {
+        int arity;
+        std::string name;
+        std::vector<uint8_t> code;
+        std::vector<Value> constants;
+    };
+    std::unordered_map<ObjFunction*, Code> functions; // The root and what it reaches through global slots
+    std::vector<Value> globals;
+    std::vector<ObjFunction*> globalFunctions;        // The function each slot holds, or nullptr
+
+    FunctionSource(ObjFunction* root, const Value* slots, size_t count)
+        : globals(slots, slots + count), globalFunctions(count, nullptr) {
+        for (size_t i = 0; i < count; i++) {
+            Obj* o = isObj(globals[i]) ? valueToObj(globals[i]) : nullptr;
+            if (o && o->type == ObjType::OBJ_FUNCTION) globalFunctions[i] = (ObjFunction*)o;
+        }
+        std::vector<ObjFunction*> work {root};
+        while (!work.empty() && functions.size() < MAX_FUNCTIONS) {
+            ObjFunction* function = work.back();
+            work.pop_back();
+            if (functions.count(function)) continue;
+            const std::vector<uint8_t>& code = function->chunk.code;
+            functions[function] = {function->arity, function->name, code, function->chunk.constants};
+            for (size_t offset = 0; offset + 2 < code.size(); offset += instructionLength((OpCode)code[offset])) {
+                if ((OpCode)code[offset] != OpCode::GET_GLOBAL_SLOT) continue;
+                size_t slot = (size_t)((code[offset + 1] << 8) | code[offset + 2]);
+                if (slot < count && globalFunctions[slot]) work.push_back(globalFunctions[slot]);
+            }
+        }
+    }
+
+    const Code* find(ObjFunction* function) const {
+        auto found = functions.find(function);
+        return found == functions.end() ? nullptr : &found->second;
+    }
+};
+
+// Translates whole functions for JITEngine::compileFunction. Every function
+// becomes an internal LLVM function over boxed Values, so compiled functions
+// call each other directly:
+//   i64 fn(ptr globals, ptr failed, i32 depth, i64 arg1, ..., i64 argN)
+// A call that cannot finish natively sets *failed and each native caller
+// returns at once. Nothing it did is visible, since the functions only read
+// globals and call each other; the interpreter makes the outermost call again.
+class FunctionTranslator {
+public:
+    FunctionTranslator(llvm::LLVMContext& context, llvm::Module& module, const FunctionSource& source)
+        : context_(context), module_(module), source_(source), builder_(context) {}
+
+    // The translated root, or nullptr if it or a function it reaches cannot
+    // be compiled
+    llvm::Function* translate(ObjFunction* root) {
+        llvm::Function* F = declare(root);
+        while (F && !pending_.empty()) {
+            ObjFunction* function = pending_.back();
+            pending_.pop_back();
+            if (!body(function)) return nullptr;
+        }
+        return F;
+    }
+
+    // The externally visible NativeEntry for body, which declines the call
+    // unless every argument is a number
+    llvm::Function* entry(ObjFunction* function, llvm::Function* body, const std::string& name) {
+        llvm::Type* ptrTy = builder_.getPtrTy();
+        llvm::FunctionType* FT = llvm::FunctionType::get(builder_.getInt1Ty(), {ptrTy, ptrTy, ptrTy}, false);
+        llvm::Function* F = llvm::Function::Create(FT, llvm::Function::ExternalLinkage, name, module_);
+        F->addRetAttr(llvm::Attribute::ZExt);
+        llvm::BasicBlock* entryBB = llvm::BasicBlock::Create(context_, "entry", F);
+        llvm::BasicBlock* runBB = llvm::BasicBlock::Create(context_, "run", F);
+        llvm::BasicBlock* doneBB = llvm::BasicBlock::Create(context_, "done", F);
+        llvm::BasicBlock* declineBB = llvm::BasicBlock::Create(context_, "decline", F);
+
+        builder_.SetInsertPoint(entryBB);
+        std::vector<llvm::Value*> args = {F->getArg(1), nullptr, builder_.getInt32(0)};
+        llvm::Value* numbers = builder_.getTrue();
+        for (int i = 0; i < source_.find(function)->arity; i++) {
+            llvm::Value* arg = builder_.CreateLoad(i64(), builder_.CreateGEP(i64(), F->getArg(0), builder_.getInt32(i)));
+            numbers = builder_.CreateAnd(numbers, holdsNumber(arg));
+            args.push_back(arg);
+        }
+        llvm::Value* failed = builder_.CreateAlloca(builder_.getInt8Ty());
+        builder_.CreateStore(builder_.getInt8(0), failed);
+        args[1] = failed;
+        builder_.CreateCondBr(numbers, runBB, declineBB);
+
+        builder_.SetInsertPoint(runBB);
+        llvm::Value* result = builder_.CreateCall(body, args);
+        builder_.CreateCondBr(builder_.CreateICmpNE(builder_.CreateLoad(builder_.getInt8Ty(), failed), builder_.getInt8(0)),
+                              declineBB, doneBB);
+
+        builder_.SetInsertPoint(doneBB);
+        builder_.CreateStore(result, F->getArg(2));
+        builder_.CreateRet(builder_.getTrue());
+
+        builder_.SetInsertPoint(declineBB);
+        builder_.CreateRet(builder_.getFalse());
+        return F;
+    }
+
+private:
+    // What the translator knows about a stack entry: a number, a boolean
+    // from a comparison or literal, or the function a global slot held.
+    // The callee in slot 0 is never read.
+    struct Kind {
+        enum Tag : uint8_t { CALLEE, NUMBER, BOOLEAN, FUNCTION } tag;
+        ObjFunction* function = nullptr;
+        bool operator==(const Kind& other) const { return tag == other.tag && function == other.function; }
+    };
+
+    // A basic block, starting at a jump target or after a jump or return
+    struct Block {
+        llvm::BasicBlock* bb = nullptr;
+        std::vector<Kind> kinds; // The stack on entry, fixed by the first edge that reaches it
+        bool reached = false;
+    };
+
+    llvm::LLVMContext& context_;
+    llvm::Module& module_;
+    const FunctionSource& source_;
+    llvm::IRBuilder<> builder_;
+    std::unordered_map<ObjFunction*, llvm::Function*> functions_;
+    std::vector<ObjFunction*> pending_;
+
+    // The function being translated. Stack entries live in one alloca per
+    // depth, which mem2reg turns into SSA values with phis at the joins.
+    llvm::Function* F_ = nullptr;
+    std::vector<llvm::AllocaInst*> entries_;
+    std::map<size_t, Block> blocks_;
+    std::vector<size_t> work_;
+    std::vector<Kind> kinds_;
+    llvm::BasicBlock* failBB_ = nullptr;
+
+    llvm::Type* i64() { return builder_.getInt64Ty(); }
+    llvm::Type* doubleTy() { return builder_.getDoubleTy(); }
+
+    llvm::Function* declare(ObjFunction* function) {
+        auto found = functions_.find(function);
+        if (found != functions_.end()) return found->second;
+        const FunctionSource::Code* code = source_.find(function);
+        if (!code) return nullptr;
+        llvm::Type* ptrTy = builder_.getPtrTy();
+        std::vector<llvm::Type*> params = {ptrTy, ptrTy, builder_.getInt32Ty()};
+        params.insert(params.end(), code->arity, i64());
+        llvm::FunctionType* FT = llvm::FunctionType::get(i64(), params, false);
+        llvm::Function* F = llvm::Function::Create(FT, llvm::Function::InternalLinkage, "fn_" + code->name, module_);
+        functions_[function] = F;
+        pending_.push_back(function);
+        return F;
+    }
+
+    // Boxed numbers, as in bytecode.hpp
+    llvm::Value* holdsInt(llvm::Value* v) {
+        return builder_.CreateICmpEQ(builder_.CreateAnd(v, builder_.getInt64(TAG_MASK)), builder_.getInt64(INT_TAG));
+    }
+    llvm::Value* holdsNumber(llvm::Value* v) {
+        llvm::Value* isDouble = builder_.CreateICmpNE(builder_.CreateAnd(v, builder_.getInt64(QNAN)), builder_.getInt64(QNAN));
+        return builder_.CreateOr(isDouble, holdsInt(v));
+    }
+    llvm::Value* intOf(llvm::Value* v) { return builder_.CreateAShr(builder_.CreateShl(v, 16), 16); }
+    llvm::Value* boxInt(llvm::Value* n) {
+        return builder_.CreateOr(builder_.CreateAnd(n, builder_.getInt64(~TAG_MASK)), builder_.getInt64(INT_TAG));
+    }
+    llvm::Value* fitsInt(llvm::Value* n) { return builder_.CreateICmpEQ(intOf(n), n); }
+    llvm::Value* toDouble(llvm::Value* v) {
+        return builder_.CreateSelect(holdsInt(v), builder_.CreateSIToFP(intOf(v), doubleTy()), builder_.CreateBitCast(v, doubleTy()));
+    }
+    llvm::Value* boxDouble(llvm::Value* d) { return builder_.CreateBitCast(d, i64()); }
+    llvm::Value* boxBool(llvm::Value* b) {
+        return builder_.CreateSelect(b, builder_.getInt64(TRUE_VAL.v), builder_.getInt64(FALSE_VAL.v));
+    }
+
+    // addNumbers and friends: an int result when both operands are ints and
+    // it fits in 48 bits, a double otherwise
+    llvm::Value* arithmetic(OpCode op, llvm::Value* a, llvm::Value* b) {
+        llvm::Value* x = intOf(a);
+        llvm::Value* y = intOf(b);
+        llvm::Value* n;
+        llvm::Value* fits;
+        llvm::Value* d;
+        llvm::Value* dx = toDouble(a);
+        llvm::Value* dy = toDouble(b);
+        switch (op) {
+            case OpCode::ADD:
+                n = builder_.CreateAdd(x, y);
+                fits = fitsInt(n);
+                d = builder_.CreateFAdd(dx, dy);
+                break;
+            case OpCode::SUBTRACT:
+                n = builder_.CreateSub(x, y);
+                fits = fitsInt(n);
+                d = builder_.CreateFSub(dx, dy);
+                break;
+            case OpCode::MULTIPLY: {
+                llvm::Function* smul = llvm::Intrinsic::getOrInsertDeclaration(&module_, llvm::Intrinsic::smul_with_overflow, {i64()});
+                llvm::Value* product = builder_.CreateCall(smul, {x, y});
+                n = builder_.CreateExtractValue(product, 0);
+                fits = builder_.CreateAnd(fitsInt(n), builder_.CreateNot(builder_.CreateExtractValue(product, 1)));
+                d = builder_.CreateFMul(dx, dy);
+                break;
+            }
+            default: // MODULO; an int remainder by zero is the double one, NaN
+                fits = builder_.CreateICmpNE(y, builder_.getInt64(0));
+                n = builder_.CreateSRem(x, builder_.CreateSelect(fits, y, builder_.getInt64(1)));
+                d = builder_.CreateFRem(dx, dy);
+                break;
+        }
+        llvm::Value* ints = builder_.CreateAnd(builder_.CreateAnd(holdsInt(a), holdsInt(b)), fits);
+        return builder_.CreateSelect(ints, boxInt(n), boxDouble(d));
+    }
+    llvm::Value* compare(OpCode op, llvm::Value* a, llvm::Value* b) {
+        llvm::Value* x = intOf(a);
+        llvm::Value* y = intOf(b);
+        llvm::Value* dx = toDouble(a);
+        llvm::Value* dy = toDouble(b);
+        llvm::Value* ints;
+        llvm::Value* doubles;
+        switch (op) {
+            case OpCode::LESS: ints = builder_.CreateICmpSLT(x, y); doubles = builder_.CreateFCmpOLT(dx, dy); break;
+            case OpCode::LESS_EQUAL: ints = builder_.CreateICmpSLE(x, y); doubles = builder_.CreateFCmpOLE(dx, dy); break;
+            case OpCode::GREATER: ints = builder_.CreateICmpSGT(x, y); doubles = builder_.CreateFCmpOGT(dx, dy); break;
+            default: ints = builder_.CreateICmpSGE(x, y); doubles = builder_.CreateFCmpOGE(dx, dy); break;
+        }
+        return builder_.CreateSelect(builder_.CreateAnd(holdsInt(a), holdsInt(b)), ints, doubles);
+    }
+    // Value::operator== for anything but strings: the same bits, or an int
+    // and a number of the same value
+    llvm::Value* equal(llvm::Value* a, llvm::Value* b) {
+        llvm::Value* numeric = builder_.CreateAnd(builder_.CreateOr(holdsInt(a), holdsInt(b)),
+                                                  builder_.CreateAnd(holdsNumber(a), holdsNumber(b)));
+        llvm::Value* same = builder_.CreateAnd(numeric, builder_.CreateFCmpOEQ(toDouble(a), toDouble(b)));
+        return builder_.CreateOr(builder_.CreateICmpEQ(a, b), same);
+    }
+    llvm::Value* truthy(const Kind& kind, llvm::Value* v) {
+        if (kind.tag == Kind::BOOLEAN) return builder_.CreateICmpEQ(v, builder_.getInt64(TRUE_VAL.v));
+        if (kind.tag == Kind::FUNCTION) return builder_.getTrue();
+        return builder_.CreateFCmpUNE(toDouble(v), llvm::ConstantFP::get(doubleTy(), 0.0));
+    }
+
+    llvm::AllocaInst* entry(size_t depth) {
+        while (entries_.size() <= depth) {
+            llvm::IRBuilder<> at(&F_->getEntryBlock(), F_->getEntryBlock().begin());
+            entries_.push_back(at.CreateAlloca(i64(), nullptr, "stack_" + std::to_string(entries_.size())));
+        }
+        return entries_[depth];
+    }
+    void push(Kind kind, llvm::Value* v) {
+        builder_.CreateStore(v, entry(kinds_.size()));
+        kinds_.push_back(kind);
+    }
+    llvm::Value* load(size_t depth) { return builder_.CreateLoad(i64(), entry(depth)); }
+    // Pops n entries, all numbers; false if one is not
+    bool popNumbers(size_t n, std::vector<llvm::Value*>& out) {
+        if (kinds_.size() < n + 1) return false;
+        size_t base = kinds_.size() - n;
+        out.clear();
+        for (size_t i = base; i < kinds_.size(); i++) {
+            if (kinds_[i].tag != Kind::NUMBER) return false;
+            out.push_back(load(i));
+        }
+        kinds_.resize(base);
+        return true;
+    }
+    bool localNumber(size_t slot, llvm::Value*& v) {
+        if (slot == 0 || slot >= kinds_.size() || kinds_[slot].tag != Kind::NUMBER) return false;
+        v = load(slot);
+        return true;
+    }
+    // Continues in a new block when ok holds, otherwise fails the call
+    void guard(llvm::Value* ok) {
+        llvm::BasicBlock* okBB = llvm::BasicBlock::Create(context_, "ok", F_);
+        builder_.CreateCondBr(ok, okBB, failBB_);
+        builder_.SetInsertPoint(okBB);
+    }
+    // The block at offset, entered with the current stack
+    llvm::BasicBlock* reach(size_t offset, bool& consistent) {
+        Block& block = blocks_[offset];
+        if (!block.reached) {
+            block.reached = true;
+            block.kinds = kinds_;
+            block.bb = llvm::BasicBlock::Create(context_, "at_" + std::to_string(offset), F_);
+            work_.push_back(offset);
+        } else if (!(block.kinds == kinds_)) {
+            consistent = false;
+        }
+        return block.bb;
+    }
+
+    bool body(ObjFunction* function) {
+        const FunctionSource::Code& source = *source_.find(function);
+        const std::vector<uint8_t>& code = source.code;
+        const std::vector<Value>& constants = source.constants;
+        F_ = functions_[function];
+        entries_.clear();
+        blocks_.clear();
+        work_.clear();
+
+        // Block boundaries, and every jump target must start an instruction
+        std::set<size_t> starts, leaders;
+        for (size_t offset = 0; offset < code.size();) {
+            OpCode op = (OpCode)code[offset];
+            size_t next = offset + instructionLength(op);
+            if (next > code.size()) return false;
+            starts.insert(offset);
+            size_t target;
+            if (jumpTarget(code, offset, target)) {
+                if (target >= code.size()) return false;
+                leaders.insert(target);
+                leaders.insert(next);
+            } else if (op == OpCode::RETURN || op == OpCode::TAIL_CALL) {
+                leaders.insert(next);
+            }
+            offset = next;
+        }
+        for (size_t leader : leaders) {
+            if (leader < code.size() && !starts.count(leader)) return false;
+        }
+
+        llvm::BasicBlock* entryBB = llvm::BasicBlock::Create(context_, "entry", F_);
+        failBB_ = llvm::BasicBlock::Create(context_, "fail", F_);
+        builder_.SetInsertPoint(failBB_);
+        builder_.CreateStore(builder_.getInt8(1), F_->getArg(1));
+        builder_.CreateRet(builder_.getInt64(0));
+
+        builder_.SetInsertPoint(entryBB);
+        kinds_.assign(1, Kind{Kind::CALLEE});
+        for (int i = 0; i < source.arity; i++) push(Kind{Kind::NUMBER}, F_->getArg(3 + i));
+        llvm::Value* depth = F_->getArg(2);
+        llvm::BasicBlock* startBB = llvm::BasicBlock::Create(context_, "start", F_);
+        builder_.CreateCondBr(builder_.CreateICmpSLT(depth, builder_.getInt32(MAX_NATIVE_DEPTH)), startBB, failBB_);
+        builder_.SetInsertPoint(startBB);
+        bool consistent = true;
+        builder_.CreateBr(reach(0, consistent));
+
+        while (!work_.empty()) {
+            size_t offset = work_.back();
+            work_.pop_back();
+            Block& block = blocks_[offset];
+            builder_.SetInsertPoint(block.bb);
+            kinds_ = block.kinds;
+
+            for (bool open = true; open;) {
+                if (offset >= code.size()) return false; // Ran off the end
+                const uint8_t* operands = &code[offset + 1];
+                OpCode raw = (OpCode)code[offset];
+                OpCode op = genericForm(unquickened(raw));
+                size_t next = offset + instructionLength(raw);
+                uint16_t u16 = (uint16_t)((operands[0] << 8) | operands[1]);
+                std::vector<llvm::Value*> values;
+
+                switch (op) {
+                    case OpCode::CONSTANT: {
+                        Value v = constants[operands[0]];
+                        if (isNumber(v)) push(Kind{Kind::NUMBER}, builder_.getInt64(v.v));
+                        else if (isBool(v)) push(Kind{Kind::BOOLEAN}, builder_.getInt64(v.v));
+                        else return false;
+                        break;
+                    }
+                    case OpCode::TRUE:
+                    case OpCode::FALSE:
+                        push(Kind{Kind::BOOLEAN}, builder_.getInt64((op == OpCode::TRUE ? TRUE_VAL : FALSE_VAL).v));
+                        break;
+                    case OpCode::POP:
+                        if (kinds_.size() <= (size_t)source.arity + 1) return false;
+                        kinds_.pop_back();
+                        break;
+                    case OpCode::GET_LOCAL: {
+                        size_t slot = operands[0];
+                        if (slot == 0 || slot >= kinds_.size()) return false;
+                        push(kinds_[slot], load(slot));
+                        break;
+                    }
+                    case OpCode::SET_LOCAL: {
+                        size_t slot = operands[0];
+                        if (slot == 0 || slot >= kinds_.size()) return false;
+                        builder_.CreateStore(load(kinds_.size() - 1), entry(slot));
+                        kinds_[slot] = kinds_.back();
+                        break;
+                    }
+                    case OpCode::GET_GLOBAL_SLOT: {
+                        // Bound to what the slot holds now; the guard catches a change
+                        if (u16 >= source_.globals.size()) return false;
+                        Value now = source_.globals[u16];
+                        llvm::Value* v = builder_.CreateLoad(i64(), builder_.CreateGEP(i64(), F_->getArg(0), builder_.getInt32(u16)));
+                        if (ObjFunction* callee = source_.globalFunctions[u16]) {
+                            guard(builder_.CreateICmpEQ(v, builder_.getInt64(now.v)));
+                            push(Kind{Kind::FUNCTION, callee}, v);
+                        } else if (isNumber(now)) {
+                            guard(holdsNumber(v));
+                            push(Kind{Kind::NUMBER}, v);
+                        } else {
+                            return false;
+                        }
+                        break;
+                    }
+                    case OpCode::ADD:
+                    case OpCode::SUBTRACT:
+                    case OpCode::MULTIPLY:
+                    case OpCode::MODULO:
+                        if (!popNumbers(2, values)) return false;
+                        push(Kind{Kind::NUMBER}, arithmetic(op, values[0], values[1]));
+                        break;
+                    case OpCode::DIVIDE:
+                        if (!popNumbers(2, values)) return false;
+                        push(Kind{Kind::NUMBER}, boxDouble(builder_.CreateFDiv(toDouble(values[0]), toDouble(values[1]))));
+                        break;
+                    case OpCode::ADD_CONST: {
+                        Value k = constants[operands[0]];
+                        if (!isNumber(k) || !popNumbers(1, values)) return false;
+                        push(Kind{Kind::NUMBER}, arithmetic(OpCode::ADD, values[0], builder_.getInt64(k.v)));
+                        break;
+                    }
+                    case OpCode::MASK_INT:
+                        if (!popNumbers(1, values)) return false;
+                        push(Kind{Kind::NUMBER}, arithmetic(OpCode::MODULO, values[0], builder_.getInt64(intToValue((int64_t)1 << operands[0]).v)));
+                        break;
+                    case OpCode::ADD_LOCALS:
+                    case OpCode::SUBTRACT_LOCALS:
+                    case OpCode::MULTIPLY_LOCALS: {
+                        llvm::Value* a;
+                        llvm::Value* b;
+                        if (!localNumber(operands[0], a) || !localNumber(operands[1], b)) return false;
+                        OpCode generic = op == OpCode::ADD_LOCALS ? OpCode::ADD
+                                       : op == OpCode::SUBTRACT_LOCALS ? OpCode::SUBTRACT : OpCode::MULTIPLY;
+                        push(Kind{Kind::NUMBER}, arithmetic(generic, a, b));
+                        break;
+                    }
+                    case OpCode::INCREMENT_LOCAL: {
+                        Value k = constants[operands[1]];
+                        llvm::Value* v;
+                        if (!isNumber(k) || !localNumber(operands[0], v)) return false;
+                        builder_.CreateStore(arithmetic(OpCode::ADD, v, builder_.getInt64(k.v)), entry(operands[0]));
+                        break;
+                    }
+                    case OpCode::LESS:
+                    case OpCode::LESS_EQUAL:
+                    case OpCode::GREATER:
+                    case OpCode::GREATER_EQUAL:
+                        if (!popNumbers(2, values)) return false;
+                        push(Kind{Kind::BOOLEAN}, boxBool(compare(op, values[0], values[1])));
+                        break;
+                    case OpCode::EQUAL:
+                    case OpCode::NOT_EQUAL: {
+                        if (kinds_.size() < 3) return false;
+                        llvm::Value* b = load(kinds_.size() - 1);
+                        llvm::Value* a = load(kinds_.size() - 2);
+                        kinds_.resize(kinds_.size() - 2);
+                        llvm::Value* same = equal(a, b);
+                        push(Kind{Kind::BOOLEAN}, boxBool(op == OpCode::EQUAL ? same : builder_.CreateNot(same)));
+                        break;
+                    }
+                    case OpCode::NOT: {
+                        if (kinds_.size() < 2) return false;
+                        Kind kind = kinds_.back();
+                        llvm::Value* v = load(kinds_.size() - 1);
+                        kinds_.pop_back();
+                        push(Kind{Kind::BOOLEAN}, boxBool(builder_.CreateNot(truthy(kind, v))));
+                        break;
+                    }
+                    case OpCode::NEGATE: {
+                        // negateNumber: only -2^47 leaves the int range
+                        if (!popNumbers(1, values)) return false;
+                        llvm::Value* n = builder_.CreateNeg(intOf(values[0]));
+                        llvm::Value* ints = builder_.CreateAnd(holdsInt(values[0]), fitsInt(n));
+                        push(Kind{Kind::NUMBER}, builder_.CreateSelect(ints, boxInt(n), boxDouble(builder_.CreateFNeg(toDouble(values[0])))));
+                        break;
+                    }
+                    case OpCode::FLOOR:
+                    case OpCode::SQRT: {
+                        if (!popNumbers(1, values)) return false;
+                        llvm::Intrinsic::ID id = op == OpCode::FLOOR ? llvm::Intrinsic::floor : llvm::Intrinsic::sqrt;
+                        llvm::Function* intrinsic = llvm::Intrinsic::getOrInsertDeclaration(&module_, id, {doubleTy()});
+                        push(Kind{Kind::NUMBER}, boxDouble(builder_.CreateCall(intrinsic, {toDouble(values[0])})));
+                        break;
+                    }
+                    case OpCode::JUMP:
+                        builder_.CreateBr(reach(next + u16, consistent));
+                        open = false;
+                        break;
+                    case OpCode::LOOP:
+                        builder_.CreateBr(reach(next - u16, consistent));
+                        open = false;
+                        break;
+                    case OpCode::JUMP_IF_FALSE:
+                    case OpCode::LESS_JUMP_IF_FALSE:
+                    case OpCode::EQUAL_JUMP_IF_FALSE:
+                    case OpCode::LESS_LOCALS_JUMP_IF_FALSE: {
+                        llvm::Value* taken; // Falls through when this holds
+                        size_t target = next + u16;
+                        if (op == OpCode::JUMP_IF_FALSE) {
+                            if (kinds_.size() < 2) return false;
+                            Kind kind = kinds_.back();
+                            taken = truthy(kind, load(kinds_.size() - 1));
+                            kinds_.pop_back();
+                        } else if (op == OpCode::LESS_LOCALS_JUMP_IF_FALSE) {
+                            llvm::Value* a;
+                            llvm::Value* b;
+                            if (!localNumber(operands[0], a) || !localNumber(operands[1], b)) return false;
+                            taken = compare(OpCode::LESS, a, b);
+                            target = next + (size_t)((operands[2] << 8) | operands[3]);
+                        } else if (op == OpCode::LESS_JUMP_IF_FALSE) {
+                            if (!popNumbers(2, values)) return false;
+                            taken = compare(OpCode::LESS, values[0], values[1]);
+                        } else {
+                            if (kinds_.size() < 3) return false;
+                            llvm::Value* b = load(kinds_.size() - 1);
+                            llvm::Value* a = load(kinds_.size() - 2);
+                            kinds_.resize(kinds_.size() - 2);
+                            taken = equal(a, b);
+                        }
+                        llvm::BasicBlock* fallthrough = reach(next, consistent);
+                        builder_.CreateCondBr(taken, fallthrough, reach(target, consistent));
+                        open = false;
+                        break;
+                    }
+                    case OpCode::CALL:
+                    case OpCode::TAIL_CALL: {
+                        size_t argCount = operands[0];
+                        if (kinds_.size() < argCount + 2) return false;
+                        const Kind& callee = kinds_[kinds_.size() - argCount - 1];
+                        if (callee.tag != Kind::FUNCTION) return false;
+                        llvm::Function* target = declare(callee.function);
+                        if (!target || target->arg_size() != argCount + 3 || !popNumbers(argCount, values)) return false;
+                        kinds_.pop_back();
+                        values.insert(values.begin(), {F_->getArg(0), F_->getArg(1), builder_.CreateAdd(depth, builder_.getInt32(1))});
+                        llvm::Value* result = builder_.CreateCall(target, values);
+                        guard(builder_.CreateICmpEQ(builder_.CreateLoad(builder_.getInt8Ty(), F_->getArg(1)), builder_.getInt8(0)));
+                        if (op == OpCode::TAIL_CALL) {
+                            builder_.CreateRet(result);
+                            open = false;
+                        } else {
+                            push(Kind{Kind::NUMBER}, result);
+                        }
+                        break;
+                    }
+                    case OpCode::RETURN:
+                        if (!popNumbers(1, values)) return false;
+                        builder_.CreateRet(values[0]);
+                        open = false;
+                        break;
+                    default:
+                        // Globals written, objects, printing: effects a failed
+                        // call could not take back
+                        return false;
+                }
+                if (!consistent) return false;
+                if (open && leaders.count(next)) {
+                    builder_.CreateBr(reach(next, consistent));
+                    if (!consistent) return false;
+                    open = false;
+                }
+                offset = next;
+            }
+        }
+        return true;
+    }
+};
+
+} // namespace
+
+// Compiles what source holds for function into a module exporting name, on
+// whichever thread calls it
+static NativeEntry compileSource(llvm::orc::LLJIT& lljit, const std::string& name, ObjFunction* function,
+                                 const FunctionSource& source) {
+    auto context = std::make_unique<llvm::LLVMContext>();
+    auto M = std::make_unique<llvm::Module>("kio_jit_functions", *context);
+    M->setDataLayout(lljit.getDataLayout());
+    FunctionTranslator translator(*context, *M, source);
+    llvm::Function* body = translator.translate(function);
+    if (!body) return nullptr;
+    translator.entry(function, body, name);
+
+    if (llvm::verifyModule(*M, &llvm::errs())) return nullptr;
+    optimizeModule(M.get());
+
+    auto TSM = llvm::orc::ThreadSafeModule(std::move(M), std::move(context));
+    if (auto err = lljit.addIRModule(std::move(TSM))) {
+        llvm::consumeError(std::move(err));
+        return nullptr;
+    }
+
+    auto sym = lljit.lookup(name);
+    if (!sym) {
+        llvm::consumeError(sym.takeError());
+        return nullptr;
+    }
+    return (NativeEntry)sym->getValue();
+}
+
+NativeEntry JITEngine::compileFunction(ObjFunction* function, const Value* globals, size_t globalCount) {
+    if (!impl_->lljit) return nullptr;
+    std::string name = "function_" + std::to_string(impl_->compiledFunctions++);
+    return compileSource(*impl_->lljit, name, function, FunctionSource(function, globals, globalCount));
+}
+
+void JITEngine::requestFunction(ObjFunction* function, const Value* globals, size_t globalCount,
+                                std::shared_ptr<std::atomic<NativeEntry>> out) {
+    if (!impl_->lljit) return;
+    auto source = std::make_shared<FunctionSource>(function, globals, globalCount);
+    std::string name = "function_" + std::to_string(impl_->compiledFunctions++);
+    Impl* impl = impl_.get();
+    // function only keys the copies from here on; it may be collected first
+    impl_->enqueue([impl, name, function, source, out] {
+        auto start = std::chrono::steady_clock::now();
+        NativeEntry native = compileSource(*impl->lljit, name, function, *source);
+        impl->record(start, native != nullptr, &Stats::functions);
+        if (native) out->store(native, std::memory_order_release);
+    });
+}
+
+void JITEngine::requestLoop(const Chunk& chunk, const uint8_t* startIp, const Value* slots, int slotCount,
+                            const Value* globals, size_t globalCount, std::atomic<CompiledLoop>* out) {
+    if (!impl_->lljit) return;
+    // The interpreter quickens the original in place; the compiler thread
+    // works on a copy, and resume offsets are the same in both
+    auto copy = std::make_shared<Chunk>();
+    copy->code = chunk.code;
+    copy->constants = chunk.constants;
+    size_t start = startIp - chunk.code.data();
+    auto values = std::make_shared<std::vector<Value>>(slots, slots + slotCount);
+    auto globalValues = std::make_shared<std::vector<Value>>(globals, globals + globalCount);
+    impl_->enqueue([this, copy, start, values, globalValues, out] {
+        auto begin = std::chrono::steady_clock::now();
+        CompiledLoop loop = compileLoop(copy.get(), copy->code.data() + start, values->data(), (int)values->size(),
+                                        globalValues->data());
+        impl_->record(begin, loop != nullptr, &Stats::loops);
+        if (loop) out->store(loop, std::memory_order_release);
+    });
+}
+
 } // namespace kio
 
 #else
 namespace kio {
 struct JITEngine::Impl {};
-JITEngine::JITEngine() : impl_(nullptr) {}
+JITEngine::JITEngine(unsigned) : impl_(nullptr) {}
 JITEngine::~JITEngine() = default;
-JITEngine::CompiledLoop JITEngine::compileLoop(Chunk* chunk, uint8_t* startIp) {
+bool JITEngine::available() const {
+    return false;
+}
+JITEngine::Stats JITEngine::stats() const {
+    return {};
+}
+JITEngine::CompiledLoop JITEngine::compileLoop(Chunk*, uint8_t*, const Value*, int, const Value*) {
+    return nullptr;
+}
+NativeEntry JITEngine::compileFunction(ObjFunction*, const Value*, size_t) {
     return nullptr;
 }
+void JITEngine::requestLoop(const Chunk&, const uint8_t*, const Value*, int, const Value*, size_t,
+                            std::atomic<CompiledLoop>*) {}
+void JITEngine::requestFunction(ObjFunction*, const Value*, size_t, std::shared_ptr<std::atomic<NativeEntry>>) {}
 } // namespace kio
 #endif
@@ -11,13 +11,30 @@ namespace kio {
 
 struct JITEngine::Impl {};
 
-JITEngine::JITEngine() = default;
+JITEngine::JITEngine(unsigned) {}
 JITEngine::~JITEngine() = default;
 
-JITEngine::CompiledLoop JITEngine::compileLoop(Chunk*, uint8_t*) {
+bool JITEngine::available() const {
+    return false;
+}
+
+JITEngine::Stats JITEngine::stats() const {
+    return {};
+}
+
+JITEngine::CompiledLoop JITEngine::compileLoop(Chunk*, uint8_t*, const Value*, int, const Value*) {
     // JIT is disabled; signal no compiled loop is available.
     return nullptr;
 }
 
+NativeEntry JITEngine::compileFunction(ObjFunction*, const Value*, size_t) {
+    return nullptr;
+}
+
+void JITEngine::requestLoop(const Chunk&, const uint8_t*, const Value*, int, const Value*, size_t,
+                            std::atomic<CompiledLoop>*) {}
+
+void JITEngine::requestFunction(ObjFunction*, const Value*, size_t, std::shared_ptr<std::atomic<NativeEntry>>) {}
+
 } // namespace kio
 
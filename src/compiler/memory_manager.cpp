@@ -3,54 +3,334 @@ Copyright (c) 2026 Dipanjan Dhar
 SPDX-License-Identifier: GPL-3.0-only
 */
 
-#include <vector>
-#include <set>
-#include "axeon/bytecode.hpp"
+#include "axeon/memory_manager.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
 
 namespace kio {
 
-class MemoryManager {
-    std::vector<Obj*> objects;
-    size_t bytesAllocated {0};
-    size_t nextGC {1024 * 1024}; // 1MB threshold
+MemoryManager::MemoryManager()
+    : next_gc_(1024 * 1024), min_threshold_(1024 * 1024) { // 1MB threshold
+    nursery_start_ = static_cast<char*>(::operator new(NURSERY_SIZE, std::align_val_t(16)));
+    nursery_top_ = nursery_start_;
+    nursery_end_ = nursery_start_ + NURSERY_SIZE;
+}
+
+MemoryManager::~MemoryManager() {
+    releaseNursery();
+    ::operator delete(nursery_start_, std::align_val_t(16));
+    Obj* obj = objects_;
+    while (obj) {
+        Obj* next = obj->next;
+        delete obj;
+        obj = next;
+    }
+}
+
+MemoryManager& MemoryManager::heap() {
+    static MemoryManager gc;
+    return gc;
+}
+
+void MemoryManager::setGCThreshold(size_t threshold) {
+    min_threshold_ = threshold;
+    next_gc_ = std::max(threshold, bytes_allocated_);
+}
+
+void MemoryManager::addRoots(void* owner, RootMarker marker) {
+    roots_.emplace_back(owner, std::move(marker));
+}
+
+void MemoryManager::removeRoots(void* owner) {
+    roots_.erase(std::remove_if(roots_.begin(), roots_.end(),
+                                [owner](const auto& r) { return r.first == owner; }),
+                 roots_.end());
+}
+
+void MemoryManager::track(Obj* obj) {
+    obj->next = objects_;
+    objects_ = obj;
+    bytes_allocated_ += objectSize(obj);
+    stats_.liveObjects++;
+    stats_.peakHeapSize = std::max(stats_.peakHeapSize, bytes_allocated_);
+}
+
+void MemoryManager::collectIfAllowed() {
+    // Without a registered VM nothing is reachable yet (e.g. during compilation)
+    if (pause_depth_ > 0 || roots_.empty()) return;
+    collectGarbage();
+}
+
+void MemoryManager::collectYoungIfAllowed() {
+    if (pause_depth_ > 0 || roots_.empty()) return;
+    collectYoung();
+    if (bytes_allocated_ > next_gc_) collectGarbage();
+}
+
+// --- Interned strings -------------------------------------------------------
+
+ObjString* StringTable::find(const std::string& chars, uint32_t hash) const {
+    if (entries_.empty()) return nullptr;
+    size_t mask = entries_.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        ObjString* entry = entries_[i];
+        if (!entry) return nullptr;
+        if (entry->hash == hash && entry->chars == chars) return entry;
+    }
+}
+
+void StringTable::insert(ObjString* string) {
+    if ((count_ + 1) * 4 > entries_.size() * 3) grow();
+    size_t mask = entries_.size() - 1;
+    size_t i = string->hash & mask;
+    while (entries_[i]) i = (i + 1) & mask;
+    entries_[i] = string;
+    count_++;
+}
+
+void StringTable::removeUnmarked(uint32_t epoch) {
+    // Rebuilding keeps probe chains intact without tombstones
+    std::vector<ObjString*> old;
+    old.swap(entries_);
+    entries_.assign(old.size(), nullptr);
+    count_ = 0;
+    for (ObjString* entry : old) {
+        if (entry && entry->markEpoch == epoch) insert(entry);
+    }
+}
+
+void StringTable::grow() {
+    std::vector<ObjString*> old;
+    old.swap(entries_);
+    entries_.assign(old.empty() ? 64 : old.size() * 2, nullptr);
+    count_ = 0;
+    for (ObjString* entry : old) {
+        if (entry) insert(entry);
+    }
+}
+
+ObjString* MemoryManager::intern(const std::string& chars) {
+    if (ObjString* string = strings_.find(chars, hashString(chars.data(), chars.size()))) return string;
+    ObjString* string = allocateOld<ObjString>(chars);
+    string->interned = true;
+    strings_.insert(string);
+    return string;
+}
+
+// --- Minor collection -------------------------------------------------------
+
+void MemoryManager::collectYoung() {
+    auto start = std::chrono::steady_clock::now();
+    minor_ = true;
+
+    // Roots, then every old object that may point into the nursery: those
+    // allocated since the last minor collection and those caught by the
+    // write barrier. Promoted copies are scanned as they are created.
+    Obj* head = objects_;
+    for (auto& root : roots_) root.second(*this);
+    for (Obj* obj = head; obj != scanned_old_; obj = obj->next) blacken(obj);
+    for (Obj* obj : remembered_set_) {
+        obj->remembered = false;
+        blacken(obj);
+    }
+    remembered_set_.clear();
+    while (!promoted_.empty()) {
+        Obj* obj = promoted_.back();
+        promoted_.pop_back();
+        blacken(obj);
+    }
+
+    releaseNursery();
+    scanned_old_ = objects_;
+    minor_ = false;
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    stats_.minorCollections++;
+    stats_.minorPauseMs += ms;
+    stats_.totalPauseMs += ms;
+    stats_.maxPauseMs = std::max(stats_.maxPauseMs, ms);
+}
+
+Obj* MemoryManager::evacuate(Obj* obj) {
+    if (obj->next) return obj->next; // Already forwarded
+
+    Obj* copy = nullptr;
+    switch (obj->type) {
+        case ObjType::OBJ_STRING: copy = new ObjString(std::move(*(ObjString*)obj)); break;
+        case ObjType::OBJ_ARRAY:  copy = new ObjArray(std::move(*(ObjArray*)obj)); break;
+        case ObjType::OBJ_ROPE:   copy = new ObjRope(std::move(*(ObjRope*)obj)); break;
+        default: return obj; // Only nursery kinds are ever young
+    }
+    copy->markEpoch = 0;
+    track(copy);
+    obj->next = copy;
+    promoted_.push_back(copy);
+    stats_.objectsPromoted++;
+    return copy;
+}
 
-public:
-    void* allocate(size_t size, ObjType type) {
-        bytesAllocated += size;
-        if (bytesAllocated > nextGC) {
-            collect();
+void MemoryManager::releaseNursery() {
+    // Run destructors so dead (and moved-from) objects release their buffers
+    char* p = nursery_start_;
+    while (p < nursery_top_) {
+        Obj* obj = (Obj*)p;
+        switch (obj->type) {
+            case ObjType::OBJ_STRING: p += nurserySize(sizeof(ObjString)); break;
+            case ObjType::OBJ_ARRAY:  p += nurserySize(sizeof(ObjArray)); break;
+            case ObjType::OBJ_ROPE:   p += nurserySize(sizeof(ObjRope)); break;
+            default: p = nursery_top_; continue;
         }
-        
-        Obj* obj = nullptr;
-        if (type == ObjType::OBJ_ARRAY) obj = new ObjArray();
-        else if (type == ObjType::OBJ_STRING) obj = new ObjString("");
-        
-        if (obj) objects.push_back(obj);
-        return obj;
-    }
-
-    void collect() {
-        std::set<Obj*> marked;
-        for (auto it = objects.begin(); it != objects.end(); ) {
-            if (marked.find(*it) == marked.end()) {
-                delete *it;
-                it = objects.erase(it);
-            } else {
-                ++it;
+        obj->~Obj();
+    }
+    nursery_top_ = nursery_start_;
+    young_bytes_ = 0;
+}
+
+// --- Full collection --------------------------------------------------------
+
+void MemoryManager::collectGarbage() {
+    auto start = std::chrono::steady_clock::now();
+    double minorMs = stats_.minorPauseMs;
+
+    collectYoung();
+    minorMs = stats_.minorPauseMs - minorMs;
+    epoch_++;
+    for (auto& root : roots_) root.second(*this);
+    // Shapes outlive their instances, so their transition keys must too
+    for (Shape* shape : Shape::all()) {
+        if (!shape->names.empty()) markObject(shape->names.back());
+    }
+    traceReferences();
+    strings_.removeUnmarked(epoch_);
+    sweep();
+    scanned_old_ = objects_;
+
+    next_gc_ = std::max(bytes_allocated_ * HEAP_GROW_FACTOR, min_threshold_);
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    stats_.collections++;
+    stats_.lastPauseMs = ms;
+    stats_.totalPauseMs += ms - minorMs; // The nested minor pause was already counted
+    stats_.maxPauseMs = std::max(stats_.maxPauseMs, ms);
+}
+
+void MemoryManager::markValue(Value& value) {
+    if (!isObj(value)) return;
+    Obj* obj = valueToObj(value);
+    if (minor_) {
+        if (isYoung(obj)) value = objToValue(evacuate(obj));
+        return;
+    }
+    markObject(obj);
+}
+
+void MemoryManager::markObject(Obj* obj) {
+    if (!obj || minor_ || obj->markEpoch == epoch_) return;
+    obj->markEpoch = epoch_;
+    gray_stack_.push_back(obj);
+}
+
+void MemoryManager::traceReferences() {
+    while (!gray_stack_.empty()) {
+        Obj* obj = gray_stack_.back();
+        gray_stack_.pop_back();
+        blacken(obj);
+    }
+}
+
+void MemoryManager::blacken(Obj* obj) {
+    switch (obj->type) {
+        case ObjType::OBJ_STRING:
+        case ObjType::OBJ_NATIVE:
+        case ObjType::OBJ_TYPED_ARRAY:
+            break;
+        case ObjType::OBJ_ARRAY:
+            for (Value& v : ((ObjArray*)obj)->elements) markValue(v);
+            break;
+        case ObjType::OBJ_FUNCTION:
+            for (Value& v : ((ObjFunction*)obj)->chunk.constants) markValue(v);
+            break;
+        case ObjType::OBJ_CLASS:
+            for (auto& m : ((ObjClass*)obj)->methods) {
+                markObject(m.first);
+                markValue(m.second);
             }
+            break;
+        case ObjType::OBJ_ROPE: {
+            ObjRope* rope = (ObjRope*)obj;
+            markValue(rope->left);
+            markValue(rope->right);
+            markValue(rope->flat);
+            break;
+        }
+        case ObjType::OBJ_INSTANCE: {
+            ObjInstance* instance = (ObjInstance*)obj;
+            markObject(instance->klass);
+            for (Value& v : instance->fields) markValue(v);
+            break;
         }
-        nextGC = bytesAllocated * 2;
     }
+}
 
-    ~MemoryManager() {
-        for (auto obj : objects) delete obj;
+void MemoryManager::sweep() {
+    size_t live = 0;
+    Obj** link = &objects_;
+    while (*link) {
+        Obj* obj = *link;
+        size_t size = objectSize(obj);
+        if (obj->markEpoch == epoch_) {
+            live += size;
+            link = &obj->next;
+        } else {
+            *link = obj->next;
+            stats_.objectsFreed++;
+            stats_.bytesFreed += size;
+            stats_.liveObjects--;
+            delete obj;
+        }
     }
-};
+    bytes_allocated_ = live;
+}
 
-static MemoryManager g_mem;
+size_t MemoryManager::objectSize(const Obj* obj) {
+    switch (obj->type) {
+        case ObjType::OBJ_STRING:
+            return sizeof(ObjString) + ((const ObjString*)obj)->chars.capacity();
+        case ObjType::OBJ_ARRAY:
+            return sizeof(ObjArray) + ((const ObjArray*)obj)->elements.capacity() * sizeof(Value);
+        case ObjType::OBJ_FUNCTION: {
+            const Chunk& chunk = ((const ObjFunction*)obj)->chunk;
+            return sizeof(ObjFunction) + chunk.code.capacity() + chunk.constants.capacity() * sizeof(Value);
+        }
+        case ObjType::OBJ_CLASS:
+            return sizeof(ObjClass) + ((const ObjClass*)obj)->methods.size() * 64;
+        case ObjType::OBJ_INSTANCE:
+            return sizeof(ObjInstance) + ((const ObjInstance*)obj)->fields.capacity() * sizeof(Value);
+        case ObjType::OBJ_ROPE:
+            return sizeof(ObjRope);
+        case ObjType::OBJ_NATIVE:
+            return sizeof(ObjNative);
+        case ObjType::OBJ_TYPED_ARRAY: {
+            const ObjTypedArray* arr = (const ObjTypedArray*)obj;
+            return sizeof(ObjTypedArray) + arr->length * elementSize(arr->kind);
+        }
+    }
+    return sizeof(Obj);
+}
 
-ObjArray* allocate_array() {
-    return (ObjArray*)g_mem.allocate(sizeof(ObjArray), ObjType::OBJ_ARRAY);
+void MemoryManager::printStats(std::ostream& out) const {
+    out << "[GC] collections: " << stats_.collections << " full, " << stats_.minorCollections << " minor"
+        << ", allocated: " << stats_.objectsAllocated << " (" << stats_.youngAllocated << " in nursery)"
+        << ", promoted: " << stats_.objectsPromoted << std::endl;
+    out << "[GC] freed: " << stats_.objectsFreed << " (" << stats_.bytesFreed / 1024 << " KB)"
+        << ", live: " << stats_.liveObjects << " (" << bytes_allocated_ / 1024 << " KB)"
+        << ", peak heap: " << stats_.peakHeapSize / 1024 << " KB" << std::endl;
+    size_t pauses = stats_.collections + stats_.minorCollections;
+    out << "[GC] pause total: " << stats_.totalPauseMs << " ms"
+        << " (minor " << stats_.minorPauseMs << " ms)"
+        << ", max: " << stats_.maxPauseMs << " ms"
+        << ", avg: " << (pauses ? stats_.totalPauseMs / pauses : 0.0) << " ms" << std::endl;
 }
 
 } // namespace kio
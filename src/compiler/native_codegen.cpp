@@ -0,0 +1,456 @@
+/*
+ Copyright (c) 2025 Dipanjan Dhar
+ SPDX-License-Identifier: GPL-3.0-only
+
+ x86-64 code buffer and instruction emitter shared by the native tiers
+*/
+
+#include "axeon/tracing_jit.hpp"
+#include <cstring>
+#include <sys/mman.h>
+
+namespace kio {
+
+// ============================================================================
+// CodeBuffer Implementation
+// ============================================================================
+
+CodeBuffer::CodeBuffer(size_t size) : size_(size), offset_(0) {
+    allocateExecutableMemory();
+}
+
+CodeBuffer::~CodeBuffer() {
+    if (buffer_) {
+        munmap(buffer_, size_);
+    }
+}
+
+// Mapped writable only; finalize() flips it to executable, so no page is
+// ever writable and executable at once
+bool CodeBuffer::allocateExecutableMemory() {
+    buffer_ = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer_ == MAP_FAILED) buffer_ = nullptr;
+    return buffer_ != nullptr;
+}
+
+void CodeBuffer::makeExecutable() {
+    mprotect(buffer_, size_, PROT_READ | PROT_EXEC);
+}
+
+void CodeBuffer::emitByte(uint8_t byte) {
+    if (buffer_ && offset_ < size_) {
+        static_cast<uint8_t*>(buffer_)[offset_++] = byte;
+    } else {
+        overflowed_ = true;
+    }
+}
+
+void CodeBuffer::emitBytes(const uint8_t* bytes, size_t count) {
+    if (buffer_ && offset_ + count <= size_) {
+        memcpy(static_cast<uint8_t*>(buffer_) + offset_, bytes, count);
+        offset_ += count;
+    } else {
+        overflowed_ = true;
+    }
+}
+
+void CodeBuffer::emitInt32(int32_t value) {
+    emitBytes(reinterpret_cast<uint8_t*>(&value), 4);
+}
+
+void CodeBuffer::emitInt64(int64_t value) {
+    emitBytes(reinterpret_cast<uint8_t*>(&value), 8);
+}
+
+void CodeBuffer::emitDouble(double value) {
+    emitBytes(reinterpret_cast<uint8_t*>(&value), 8);
+}
+
+void CodeBuffer::patchInt32(size_t offset, int32_t value) {
+    if (buffer_ && offset + 4 <= offset_) {
+        memcpy(static_cast<uint8_t*>(buffer_) + offset, &value, 4);
+    }
+}
+
+void* CodeBuffer::finalize() {
+    if (!isValid()) return nullptr;
+    makeExecutable();
+    return buffer_;
+}
+
+// ============================================================================
+// NativeCodeGenerator Implementation
+// ============================================================================
+
+NativeCodeGenerator::NativeCodeGenerator(CodeBuffer& buffer) : buffer_(buffer) {}
+
+void NativeCodeGenerator::emitPrologue() {
+    // Save callee-saved registers
+    emitPush(Register::RBX);
+    emitPush(Register::R12);
+    emitPush(Register::R13);
+    emitPush(Register::R14);
+    emitPush(Register::R15);
+}
+
+void NativeCodeGenerator::emitEpilogue() {
+    // Restore callee-saved registers
+    emitPop(Register::R15);
+    emitPop(Register::R14);
+    emitPop(Register::R13);
+    emitPop(Register::R12);
+    emitPop(Register::RBX);
+    buffer_.emitByte(0xC3);  // ret
+}
+
+void NativeCodeGenerator::emitMov(Register dest, Register src) {
+    emitRegisterOp(0x89, regToBits(src), regToBits(dest));
+}
+
+void NativeCodeGenerator::emitMov(Register reg, int64_t imm) {
+    int r = regToBits(reg);
+    if (imm == (int32_t)imm) {
+        // mov r/m64, imm32 sign-extends
+        emitREX(true, 0, 0, r);
+        buffer_.emitByte(0xC7);
+        emitModRM(0b11, 0, r & 7);
+        buffer_.emitInt32((int32_t)imm);
+    } else if (imm == (int64_t)(uint32_t)imm) {
+        // mov r32, imm32 zero-extends
+        emitREX(false, 0, 0, r);
+        buffer_.emitByte(0xB8 | (r & 7));
+        buffer_.emitInt32((int32_t)(uint32_t)imm);
+    } else {
+        emitREX(true, 0, 0, r);
+        buffer_.emitByte(0xB8 | (r & 7));
+        buffer_.emitInt64(imm);
+    }
+}
+
+void NativeCodeGenerator::emitLoad(Register dest, Register base, int32_t disp) {
+    emitREX(true, regToBits(dest), 0, regToBits(base));
+    buffer_.emitByte(0x8B);
+    emitMemory(regToBits(dest), base, disp);
+}
+
+void NativeCodeGenerator::emitStore(Register base, int32_t disp, Register src) {
+    emitREX(true, regToBits(src), 0, regToBits(base));
+    buffer_.emitByte(0x89);
+    emitMemory(regToBits(src), base, disp);
+}
+
+void NativeCodeGenerator::emitLoadInt32(Register dest, Register base, int32_t disp) {
+    emitREX(true, regToBits(dest), 0, regToBits(base));
+    buffer_.emitByte(0x63);
+    emitMemory(regToBits(dest), base, disp);
+}
+
+void NativeCodeGenerator::emitStoreInt32(Register base, int32_t disp, Register src) {
+    emitREX(false, regToBits(src), 0, regToBits(base));
+    buffer_.emitByte(0x89);
+    emitMemory(regToBits(src), base, disp);
+}
+
+void NativeCodeGenerator::emitMovsxd(Register dest, Register src) {
+    emitRegisterOp(0x63, regToBits(dest), regToBits(src));
+}
+
+void NativeCodeGenerator::emitLea(Register dest, Register base, int32_t disp) {
+    emitREX(true, regToBits(dest), 0, regToBits(base));
+    buffer_.emitByte(0x8D);
+    emitMemory(regToBits(dest), base, disp);
+}
+
+void NativeCodeGenerator::emitLea(Register dest, Register base, Register index, uint8_t scale) {
+    // index may not be rsp, and rbp/r13 as base need a displacement
+    int b = regToBits(base);
+    int x = regToBits(index);
+    uint8_t scaleBits = scale == 8 ? 3 : scale == 4 ? 2 : scale == 2 ? 1 : 0;
+    emitREX(true, regToBits(dest), x, b);
+    buffer_.emitByte(0x8D);
+    bool needsDisp = (b & 7) == 5;
+    emitModRM(needsDisp ? 0b01 : 0b00, regToBits(dest) & 7, 0b100);
+    emitSIB(scaleBits, x & 7, b & 7);
+    if (needsDisp) buffer_.emitByte(0);
+}
+
+void NativeCodeGenerator::emitPush(Register reg) {
+    emitREX(false, 0, 0, regToBits(reg));
+    buffer_.emitByte(0x50 | (regToBits(reg) & 7));
+}
+
+void NativeCodeGenerator::emitPop(Register reg) {
+    emitREX(false, 0, 0, regToBits(reg));
+    buffer_.emitByte(0x58 | (regToBits(reg) & 7));
+}
+
+void NativeCodeGenerator::emitAdd(Register reg, int32_t imm) {
+    emitImmediateOp(0, reg, imm);
+}
+
+void NativeCodeGenerator::emitSub(Register reg, int32_t imm) {
+    emitImmediateOp(5, reg, imm);
+}
+
+void NativeCodeGenerator::emitAdd(Register dest, Register src) {
+    emitRegisterOp(0x01, regToBits(src), regToBits(dest));
+}
+
+void NativeCodeGenerator::emitSub(Register dest, Register src) {
+    emitRegisterOp(0x29, regToBits(src), regToBits(dest));
+}
+
+void NativeCodeGenerator::emitImul(Register dest, Register src) {
+    emitREX(true, regToBits(dest), 0, regToBits(src));
+    buffer_.emitByte(0x0F);
+    buffer_.emitByte(0xAF);
+    emitModRM(0b11, regToBits(dest) & 7, regToBits(src) & 7);
+}
+
+void NativeCodeGenerator::emitAnd(Register dest, Register src) {
+    emitRegisterOp(0x21, regToBits(src), regToBits(dest));
+}
+
+void NativeCodeGenerator::emitOr(Register dest, Register src) {
+    emitRegisterOp(0x09, regToBits(src), regToBits(dest));
+}
+
+void NativeCodeGenerator::emitXor(Register dest, Register src) {
+    emitRegisterOp(0x31, regToBits(src), regToBits(dest));
+}
+
+void NativeCodeGenerator::emitNeg(Register reg) {
+    emitREX(true, 0, 0, regToBits(reg));
+    buffer_.emitByte(0xF7);
+    emitModRM(0b11, 3, regToBits(reg) & 7);
+}
+
+void NativeCodeGenerator::emitShl(Register reg, uint8_t count) {
+    emitShift(4, reg, count);
+}
+
+void NativeCodeGenerator::emitShr(Register reg, uint8_t count) {
+    emitShift(5, reg, count);
+}
+
+void NativeCodeGenerator::emitSar(Register reg, uint8_t count) {
+    emitShift(7, reg, count);
+}
+
+void NativeCodeGenerator::emitAddSD(XmmRegister xmm_dest, XmmRegister xmm_src) {
+    emitSSE(0xF2, false, 0x58, regToBits(xmm_dest), regToBits(xmm_src));
+}
+
+void NativeCodeGenerator::emitSubSD(XmmRegister xmm_dest, XmmRegister xmm_src) {
+    emitSSE(0xF2, false, 0x5C, regToBits(xmm_dest), regToBits(xmm_src));
+}
+
+void NativeCodeGenerator::emitMulSD(XmmRegister xmm_dest, XmmRegister xmm_src) {
+    emitSSE(0xF2, false, 0x59, regToBits(xmm_dest), regToBits(xmm_src));
+}
+
+void NativeCodeGenerator::emitDivSD(XmmRegister xmm_dest, XmmRegister xmm_src) {
+    emitSSE(0xF2, false, 0x5E, regToBits(xmm_dest), regToBits(xmm_src));
+}
+
+void NativeCodeGenerator::emitMovq(XmmRegister xmm_dest, Register src) {
+    emitSSE(0x66, true, 0x6E, regToBits(xmm_dest), regToBits(src));
+}
+
+void NativeCodeGenerator::emitMovq(Register dest, XmmRegister xmm_src) {
+    emitSSE(0x66, true, 0x7E, regToBits(xmm_src), regToBits(dest));
+}
+
+void NativeCodeGenerator::emitVAddPD(XmmRegister ymm_dest, XmmRegister ymm_src1, XmmRegister ymm_src2) {
+    emitVEX(regToBits(ymm_dest), regToBits(ymm_src1), regToBits(ymm_src2), 0x58, true);
+    emitModRM(0b11, regToBits(ymm_dest) & 7, regToBits(ymm_src2) & 7);
+}
+
+void NativeCodeGenerator::emitVMulPD(XmmRegister ymm_dest, XmmRegister ymm_src1, XmmRegister ymm_src2) {
+    emitVEX(regToBits(ymm_dest), regToBits(ymm_src1), regToBits(ymm_src2), 0x59, true);
+    emitModRM(0b11, regToBits(ymm_dest) & 7, regToBits(ymm_src2) & 7);
+}
+
+// vmovupd: the address need not be 32-byte aligned
+void NativeCodeGenerator::emitVLoadPD(XmmRegister ymm_dest, Register base, int32_t disp) {
+    emitVEX(regToBits(ymm_dest), 0, regToBits(base), 0x10, true);
+    emitMemory(regToBits(ymm_dest), base, disp);
+}
+
+void NativeCodeGenerator::emitVStorePD(Register base, int32_t disp, XmmRegister ymm_src) {
+    emitVEX(regToBits(ymm_src), 0, regToBits(base), 0x11, true);
+    emitMemory(regToBits(ymm_src), base, disp);
+}
+
+void NativeCodeGenerator::emitCmp(Register reg1, Register reg2) {
+    emitRegisterOp(0x39, regToBits(reg2), regToBits(reg1));
+}
+
+void NativeCodeGenerator::emitCmp(Register reg, int32_t imm) {
+    emitImmediateOp(7, reg, imm);
+}
+
+void NativeCodeGenerator::emitTest(Register reg1, Register reg2) {
+    emitRegisterOp(0x85, regToBits(reg2), regToBits(reg1));
+}
+
+void NativeCodeGenerator::emitUcomisd(XmmRegister xmm1, XmmRegister xmm2) {
+    emitSSE(0x66, false, 0x2E, regToBits(xmm1), regToBits(xmm2));
+}
+
+void NativeCodeGenerator::emitSetcc(Condition cc, Register reg) {
+    int r = regToBits(reg);
+    emitREX(false, 0, 0, r, r >= 4);
+    buffer_.emitByte(0x0F);
+    buffer_.emitByte(0x90 | (uint8_t)cc);
+    emitModRM(0b11, 0, r & 7);
+}
+
+void NativeCodeGenerator::emitMovzxByte(Register dest, Register src) {
+    int s = regToBits(src);
+    emitREX(false, regToBits(dest), 0, s, s >= 4);
+    buffer_.emitByte(0x0F);
+    buffer_.emitByte(0xB6);
+    emitModRM(0b11, regToBits(dest) & 7, s & 7);
+}
+
+void NativeCodeGenerator::emitJump(void* target) {
+    buffer_.emitByte(0xE9);  // jmp rel32
+    buffer_.emitInt32(displacementTo(target));
+}
+
+void NativeCodeGenerator::emitJumpIf(Condition cc, void* target) {
+    buffer_.emitByte(0x0F);  // jcc rel32
+    buffer_.emitByte(0x80 | (uint8_t)cc);
+    buffer_.emitInt32(displacementTo(target));
+}
+
+size_t NativeCodeGenerator::emitJump() {
+    buffer_.emitByte(0xE9);
+    size_t at = buffer_.getOffset();
+    buffer_.emitInt32(0);
+    return at;
+}
+
+size_t NativeCodeGenerator::emitJumpIf(Condition cc) {
+    buffer_.emitByte(0x0F);
+    buffer_.emitByte(0x80 | (uint8_t)cc);
+    size_t at = buffer_.getOffset();
+    buffer_.emitInt32(0);
+    return at;
+}
+
+void NativeCodeGenerator::bind(size_t jump) {
+    bind(jump, buffer_.getOffset());
+}
+
+// Displacements count from the end of the four bytes holding them
+void NativeCodeGenerator::bind(size_t jump, size_t target) {
+    buffer_.patchInt32(jump, (int32_t)((int64_t)target - (int64_t)(jump + 4)));
+}
+
+void NativeCodeGenerator::emitCall(Register target) {
+    emitREX(false, 0, 0, regToBits(target));
+    buffer_.emitByte(0xFF);
+    emitModRM(0b11, 2, regToBits(target) & 7);
+}
+
+void NativeCodeGenerator::emitLoadValue(XmmRegister xmm_reg, Register base, int32_t disp) {
+    // movsd xmm, m64
+    buffer_.emitByte(0xF2);
+    emitREX(false, regToBits(xmm_reg), 0, regToBits(base));
+    buffer_.emitByte(0x0F);
+    buffer_.emitByte(0x10);
+    emitMemory(regToBits(xmm_reg), base, disp);
+}
+
+void NativeCodeGenerator::emitStoreValue(Register base, int32_t disp, XmmRegister xmm_reg) {
+    // movsd m64, xmm
+    buffer_.emitByte(0xF2);
+    emitREX(false, regToBits(xmm_reg), 0, regToBits(base));
+    buffer_.emitByte(0x0F);
+    buffer_.emitByte(0x11);
+    emitMemory(regToBits(xmm_reg), base, disp);
+}
+
+void NativeCodeGenerator::emitREX(bool w, int reg, int index, int base, bool force) {
+    uint8_t rex = 0x40;
+    if (w) rex |= 0x08;
+    if (reg & 8) rex |= 0x04;
+    if (index & 8) rex |= 0x02;
+    if (base & 8) rex |= 0x01;
+    if (rex != 0x40 || force) buffer_.emitByte(rex);
+}
+
+void NativeCodeGenerator::emitModRM(uint8_t mod, uint8_t reg, uint8_t rm) {
+    buffer_.emitByte((mod << 6) | ((reg & 7) << 3) | (rm & 7));
+}
+
+void NativeCodeGenerator::emitSIB(uint8_t scale, uint8_t index, uint8_t base) {
+    buffer_.emitByte((scale << 6) | ((index & 7) << 3) | (base & 7));
+}
+
+void NativeCodeGenerator::emitMemory(int reg, Register base, int32_t disp) {
+    int b = regToBits(base) & 7;
+    // rbp and r13 have no displacement-free form
+    uint8_t mod = disp == 0 && b != 5 ? 0b00 : disp == (int8_t)disp ? 0b01 : 0b10;
+    emitModRM(mod, reg & 7, b);
+    // rsp and r12 need a SIB byte
+    if (b == 4) emitSIB(0, 0b100, 0b100);
+    if (mod == 0b01) buffer_.emitByte((uint8_t)(int8_t)disp);
+    else if (mod == 0b10) buffer_.emitInt32(disp);
+}
+
+void NativeCodeGenerator::emitRegisterOp(uint8_t opcode, int reg, int rm) {
+    emitREX(true, reg, 0, rm);
+    buffer_.emitByte(opcode);
+    emitModRM(0b11, reg & 7, rm & 7);
+}
+
+void NativeCodeGenerator::emitImmediateOp(uint8_t extension, Register reg, int32_t imm) {
+    emitREX(true, 0, 0, regToBits(reg));
+    bool small = imm == (int8_t)imm;
+    buffer_.emitByte(small ? 0x83 : 0x81);
+    emitModRM(0b11, extension, regToBits(reg) & 7);
+    if (small) buffer_.emitByte((uint8_t)(int8_t)imm);
+    else buffer_.emitInt32(imm);
+}
+
+void NativeCodeGenerator::emitShift(uint8_t extension, Register reg, uint8_t count) {
+    emitREX(true, 0, 0, regToBits(reg));
+    buffer_.emitByte(0xC1);
+    emitModRM(0b11, extension, regToBits(reg) & 7);
+    buffer_.emitByte(count & 63);
+}
+
+// The legacy prefix goes before REX, which must come right before 0F
+void NativeCodeGenerator::emitSSE(uint8_t prefix, bool w, uint8_t opcode, int reg, int rm) {
+    buffer_.emitByte(prefix);
+    emitREX(w, reg, 0, rm);
+    buffer_.emitByte(0x0F);
+    buffer_.emitByte(opcode);
+    emitModRM(0b11, reg & 7, rm & 7);
+}
+
+// Three-byte VEX for the 66 0F map; vvvv names the first source
+void NativeCodeGenerator::emitVEX(int reg, int vvvv, int rm, uint8_t opcode, bool ymm) {
+    buffer_.emitByte(0xC4);
+    buffer_.emitByte((uint8_t)(((~reg & 8) << 4) | 0x40 | ((~rm & 8) << 2) | 0x01));
+    buffer_.emitByte((uint8_t)(((~vvvv & 0xF) << 3) | (ymm ? 0x04 : 0) | 0x01));
+    buffer_.emitByte(opcode);
+}
+
+int32_t NativeCodeGenerator::displacementTo(const void* target) const {
+    int64_t next = reinterpret_cast<int64_t>(buffer_.getBuffer()) + (int64_t)buffer_.getOffset() + 4;
+    return static_cast<int32_t>(reinterpret_cast<int64_t>(target) - next);
+}
+
+uint8_t NativeCodeGenerator::regToBits(Register reg) {
+    return static_cast<uint8_t>(reg);
+}
+
+uint8_t NativeCodeGenerator::regToBits(XmmRegister reg) {
+    return static_cast<uint8_t>(reg);
+}
+
+} // namespace kio
@@ -5,59 +5,287 @@ SPDX-License-Identifier: GPL-3.0-only
 
 #include "axeon/optimizer.hpp"
 #include "axeon/ast.hpp"
+#include "axeon/bytecode.hpp"
+#include <cmath>
+#include <functional>
 #include <iostream>
 #include <algorithm>
+#include <utility>
 
 namespace kio {
 
-Optimizer::Optimizer() : optimization_count_(0) {
-    initializeOptimizations();
+// -O2 repeats the pipeline while it still rewrites something; folding a
+// propagated constant can only expose a bounded amount of new work
+static constexpr int MAX_ROUNDS = 8;
+
+// Calls f on every direct child of a node: an ExprPtr&, a StmtPtr& or a
+// std::vector<StmtPtr>& for nested statement lists. Null children are skipped.
+template <typename F>
+static void eachChild(Expr& expr, F&& f) {
+    auto e = [&](ExprPtr& child) { if (child) f(child); };
+    std::visit([&](auto&& node) {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, Expr::Binary> || std::is_same_v<T, Expr::Logical>) {
+            e(node.left);
+            e(node.right);
+        } else if constexpr (std::is_same_v<T, Expr::Grouping>) {
+            e(node.expression);
+        } else if constexpr (std::is_same_v<T, Expr::Assign>) {
+            e(node.value);
+        } else if constexpr (std::is_same_v<T, Expr::Call>) {
+            e(node.callee);
+            for (auto& arg : node.arguments) e(arg);
+        } else if constexpr (std::is_same_v<T, Expr::Get>) {
+            e(node.object);
+        } else if constexpr (std::is_same_v<T, Expr::Set>) {
+            e(node.object);
+            e(node.value);
+        } else if constexpr (std::is_same_v<T, Expr::Unary>) {
+            e(node.right);
+        } else if constexpr (std::is_same_v<T, Expr::Ternary>) {
+            e(node.condition);
+            e(node.thenExpr);
+            e(node.elseExpr);
+        } else if constexpr (std::is_same_v<T, Expr::Array>) {
+            for (auto& element : node.elements) e(element);
+        } else if constexpr (std::is_same_v<T, Expr::Index>) {
+            e(node.object);
+            e(node.index);
+        } else if constexpr (std::is_same_v<T, Expr::IndexSet>) {
+            e(node.object);
+            e(node.index);
+            e(node.value);
+        } else if constexpr (std::is_same_v<T, Expr::Lambda>) {
+            f(node.body);
+        }
+    }, expr.node);
 }
 
-Optimizer::~Optimizer() = default;
+template <typename F>
+static void eachChild(Stmt& stmt, F&& f) {
+    auto e = [&](ExprPtr& child) { if (child) f(child); };
+    auto s = [&](StmtPtr& child) { if (child) f(child); };
+    std::visit([&](auto&& node) {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, Stmt::Print> || std::is_same_v<T, Stmt::Expression> ||
+                      std::is_same_v<T, Stmt::Throw>) {
+            e(node.expression);
+        } else if constexpr (std::is_same_v<T, Stmt::Var>) {
+            e(node.initializer);
+        } else if constexpr (std::is_same_v<T, Stmt::Block>) {
+            f(node.statements);
+        } else if constexpr (std::is_same_v<T, Stmt::If>) {
+            e(node.condition);
+            s(node.thenBranch);
+            s(node.elseBranch);
+        } else if constexpr (std::is_same_v<T, Stmt::While>) {
+            e(node.condition);
+            s(node.body);
+        } else if constexpr (std::is_same_v<T, Stmt::For>) {
+            s(node.initializer);
+            e(node.condition);
+            e(node.increment);
+            s(node.body);
+        } else if constexpr (std::is_same_v<T, Stmt::ForIn>) {
+            e(node.iterable);
+            s(node.body);
+        } else if constexpr (std::is_same_v<T, Stmt::Function>) {
+            f(node.body);
+        } else if constexpr (std::is_same_v<T, Stmt::Switch>) {
+            e(node.expression);
+            for (auto& c : node.cases) {
+                e(c.first);
+                f(c.second);
+            }
+            f(node.defaultCase);
+        } else if constexpr (std::is_same_v<T, Stmt::TryCatch>) {
+            f(node.tryBlock);
+            f(node.catchBlock);
+            f(node.finallyBlock);
+        } else if constexpr (std::is_same_v<T, Stmt::Return>) {
+            e(node.value);
+        } else if constexpr (std::is_same_v<T, Stmt::Class>) {
+            f(node.methods);
+            f(node.fields);
+        } else if constexpr (std::is_same_v<T, Stmt::Namespace>) {
+            f(node.statements);
+        } else if constexpr (std::is_same_v<T, Stmt::Parallel> || std::is_same_v<T, Stmt::Module>) {
+            f(node.body);
+        } else if constexpr (std::is_same_v<T, Stmt::Export>) {
+            s(node.statement);
+        }
+    }, stmt.node);
+}
 
-std::vector<std::unique_ptr<ASTNode>> Optimizer::optimize(
-    const std::vector<std::unique_ptr<ASTNode>>& ast) {
-    std::cout << "Running optimization passes..." << std::endl;
-    
-    std::vector<std::unique_ptr<ASTNode>> result;
-    (void)ast; // Suppress unused parameter warning
-    
-    optimization_count_++;
-    std::cout << "Optimization completed." << std::endl;
-    return result;
+// Calls visit on every Expr and Stmt under (and including) a node, pre-order
+template <typename V>
+static void walk(ExprPtr& expr, V& visit);
+template <typename V>
+static void walk(StmtPtr& stmt, V& visit);
+template <typename V>
+static void walkChild(ExprPtr& child, V& visit) { walk(child, visit); }
+template <typename V>
+static void walkChild(StmtPtr& child, V& visit) { walk(child, visit); }
+template <typename V>
+static void walkChild(std::vector<StmtPtr>& list, V& visit) {
+    for (auto& s : list) walk(s, visit);
+}
+template <typename V>
+static void walk(ExprPtr& expr, V& visit) {
+    visit(*expr);
+    eachChild(*expr, [&](auto& child) { walkChild(child, visit); });
+}
+template <typename V>
+static void walk(StmtPtr& stmt, V& visit) {
+    visit(*stmt);
+    eachChild(*stmt, [&](auto& child) { walkChild(child, visit); });
+}
+
+static size_t countNodes(std::vector<StmtPtr>& program) {
+    size_t count = 0;
+    auto visit = [&](auto&) { count++; };
+    walkChild(program, visit);
+    return count;
 }
 
-std::unique_ptr<Expr> Optimizer::optimizeExpression(std::unique_ptr<Expr> expr) {
-    if (!expr) return nullptr;
-    
-    // Apply constant folding if enabled
-    if (isOptimizationEnabled("constant_folding")) {
-        expr = constantFolding(std::move(expr));
+// Literals for nil, true and false are the strings "", "true" and "false"
+static bool isStringLiteral(const Expr::Literal& literal) {
+    auto s = std::get_if<std::string>(&literal.value);
+    return s && !s->empty() && *s != "true" && *s != "false";
+}
+
+// The value a non-string literal compiles to
+static Value literalValue(const Expr::Literal& literal) {
+    if (auto d = std::get_if<double>(&literal.value)) return literalToValue(*d, literal.integer);
+    const std::string& s = std::get<std::string>(literal.value);
+    if (s == "true") return Value(true);
+    if (s == "false") return Value(false);
+    return Value(); // nil
+}
+
+// The literal for a folded value, or nothing if no literal denotes it. NaN
+// is left to the runtime, whose bit pattern is the one every path expects.
+static std::optional<Expr::Literal> valueLiteral(Value v) {
+    if (isInt(v)) return Expr::Literal{(double)valueToInt(v), true};
+    if (isDouble(v)) {
+        if (std::isnan(asDouble(v))) return std::nullopt;
+        return Expr::Literal{asDouble(v), false};
     }
-    
-    // Apply dead code elimination if enabled
-    if (isOptimizationEnabled("dead_code_elimination")) {
-        expr = deadCodeElimination(std::move(expr));
+    if (isBool(v)) return Expr::Literal{std::string(v == Value(true) ? "true" : "false"), false};
+    if (isNil(v)) return Expr::Literal{std::string(), false};
+    return std::nullopt;
+}
+
+// As VM::isTruthy()
+static bool truthy(const Expr::Literal& literal) {
+    if (isStringLiteral(literal)) return true;
+    Value v = literalValue(literal);
+    if (isNil(v)) return false;
+    if (isBool(v)) return v == Value(true);
+    return valueToDouble(v) != 0;
+}
+
+static bool isNumberLiteral(const Expr::Literal& literal) { return std::holds_alternative<double>(literal.value); }
+
+// Evaluates an operator on two literals the way its opcode would at runtime
+static std::optional<Expr::Literal> foldBinary(TokenType op, const Expr::Literal& l, const Expr::Literal& r) {
+    if (op == TokenType::PLUS && isStringLiteral(l) && isStringLiteral(r)) {
+        Expr::Literal result{std::get<std::string>(l.value) + std::get<std::string>(r.value), false};
+        if (isStringLiteral(result)) return result;
+        return std::nullopt;
     }
-    
-    // Apply CSE if enabled
-    if (isOptimizationEnabled("common_subexpression_elimination")) {
-        expr = commonSubexpressionElimination(std::move(expr));
+    // Strings compare by content at runtime, which folding leaves to it
+    if (isStringLiteral(l) || isStringLiteral(r)) return std::nullopt;
+    Value a = literalValue(l), b = literalValue(r);
+    if (op == TokenType::EQUAL_EQUAL) return valueLiteral(Value(a == b));
+    if (op == TokenType::BANG_EQUAL) return valueLiteral(Value(!(a == b)));
+    if (!isNumberLiteral(l) || !isNumberLiteral(r)) return std::nullopt;
+    switch (op) {
+        case TokenType::PLUS:          return valueLiteral(addNumbers(a, b));
+        case TokenType::MINUS:         return valueLiteral(subtractNumbers(a, b));
+        case TokenType::STAR:          return valueLiteral(multiplyNumbers(a, b));
+        case TokenType::SLASH:         return valueLiteral(Value(valueToDouble(a) / valueToDouble(b)));
+        case TokenType::PERCENT:       return valueLiteral(moduloNumbers(a, b));
+        case TokenType::LESS:          return valueLiteral(Value(valueToDouble(a) < valueToDouble(b)));
+        case TokenType::LESS_EQUAL:    return valueLiteral(Value(valueToDouble(a) <= valueToDouble(b)));
+        case TokenType::GREATER:       return valueLiteral(Value(valueToDouble(a) > valueToDouble(b)));
+        case TokenType::GREATER_EQUAL: return valueLiteral(Value(valueToDouble(a) >= valueToDouble(b)));
+        default:                       return std::nullopt;
     }
-    
-    return expr;
 }
 
-std::unique_ptr<Stmt> Optimizer::optimizeStatement(std::unique_ptr<Stmt> stmt) {
-    if (!stmt) return nullptr;
-    
-    // Apply loop optimization if enabled
-    if (isOptimizationEnabled("loop_optimization")) {
-        stmt = loopOptimization(std::move(stmt));
+static std::optional<Expr::Literal> foldUnary(TokenType op, const Expr::Literal& operand) {
+    if (op == TokenType::BANG) return valueLiteral(Value(!truthy(operand)));
+    if (op != TokenType::MINUS || !isNumberLiteral(operand)) return std::nullopt;
+    Value v = literalValue(operand);
+    // -0 has to stay a double for 1 / -0 to be -inf
+    if (isInt(v) && valueToInt(v) != 0) return valueLiteral(negateNumber(v));
+    return valueLiteral(Value(-valueToDouble(v)));
+}
+
+static bool endsControl(const Stmt& stmt) {
+    return std::holds_alternative<Stmt::Return>(stmt.node) || std::holds_alternative<Stmt::Break>(stmt.node) ||
+           std::holds_alternative<Stmt::Continue>(stmt.node);
+}
+
+static bool isEmptyBlock(const Stmt& stmt) {
+    auto block = std::get_if<Stmt::Block>(&stmt.node);
+    return block && block->statements.empty();
+}
+
+// Statements that bring in or export globals the pass cannot see
+static bool isOpaque(const Stmt& stmt) {
+    return std::holds_alternative<Stmt::Save>(stmt.node) || std::holds_alternative<Stmt::Load>(stmt.node) ||
+           std::holds_alternative<Stmt::Import>(stmt.node) || std::holds_alternative<Stmt::ImportFrom>(stmt.node) ||
+           std::holds_alternative<Stmt::Module>(stmt.node) || std::holds_alternative<Stmt::Namespace>(stmt.node) ||
+           std::holds_alternative<Stmt::Export>(stmt.node);
+}
+
+// floor() and sqrt() compile to opcodes by name, whatever the name is bound to
+static bool isIntrinsicCall(const Expr::Call& call) {
+    auto callee = std::get_if<Expr::Variable>(&call.callee->node);
+    return callee && (callee->name == "floor" || callee->name == "sqrt");
+}
+
+Optimizer::Optimizer(Level level) : level_(level) {
+    initializeOptimizations();
+}
+
+Optimizer::~Optimizer() = default;
+
+void Optimizer::optimize(std::vector<StmtPtr>& program) {
+    if (level_ == Level::O0) return;
+    if (level_ == Level::O1) {
+        runPass("constant_folding", program, &Optimizer::constantFolding);
+        runPass("dead_code_elimination", program, &Optimizer::deadCodeElimination);
+        return;
+    }
+    for (int round = 0; round < MAX_ROUNDS; round++) {
+        bool changed = runPass("function_inlining", program, &Optimizer::functionInlining);
+        changed |= runPass("scalar_replacement", program, &Optimizer::scalarReplacement);
+        changed |= runPass("constant_propagation", program, &Optimizer::constantPropagation);
+        changed |= runPass("constant_folding", program, &Optimizer::constantFolding);
+        changed |= runPass("dead_code_elimination", program, &Optimizer::deadCodeElimination);
+        if (!changed) break;
     }
-    
-    return stmt;
+    runPass("loop_optimization", program, &Optimizer::loopOptimization);
+}
+
+// Runs one pass if it is enabled and adds what it did to its statistics.
+// Returns true if the pass rewrote anything.
+bool Optimizer::runPass(const std::string& name, std::vector<StmtPtr>& program,
+                        void (Optimizer::*pass)(std::vector<StmtPtr>&)) {
+    if (!isOptimizationEnabled(name)) return false;
+    size_t before = countNodes(program);
+    rewrites_ = 0;
+    (this->*pass)(program);
+    size_t after = countNodes(program);
+
+    auto it = std::find_if(stats_.begin(), stats_.end(), [&](const PassStats& s) { return s.name == name; });
+    if (it == stats_.end()) it = stats_.insert(stats_.end(), PassStats{name});
+    it->removed += before > after ? before - after : 0;
+    it->rewrites += rewrites_;
+    return rewrites_ > 0;
 }
 
 void Optimizer::enableOptimization(const std::string& name, bool enabled) {
@@ -73,44 +301,1049 @@ bool Optimizer::isOptimizationEnabled(const std::string& name) const {
     return it != enabled_optimizations_.end() && it->second;
 }
 
+void Optimizer::printStats(std::ostream& out, bool verbose) const {
+    static const char* const levels[] = {"O0", "O1", "O2"};
+    out << "[Optimizer] level " << levels[static_cast<int>(level_)] << std::endl;
+    for (const auto& s : stats_) {
+        out << "[Optimizer] " << s.name << ": " << s.removed << " nodes removed, " << s.rewrites << " rewrites"
+            << std::endl;
+    }
+    if (!verbose) return;
+    for (const auto& site : inlinedSites_) out << "[Optimizer] inlined " << site << std::endl;
+}
+
 void Optimizer::resetStatistics() {
-    optimization_count_ = 0;
+    stats_.clear();
+    inlinedSites_.clear();
+}
+
+// ---------------------------------------------------------------------------
+// Constant propagation: reads of a `const` whose initializer folded to a
+// literal become that literal. Scoping follows the compiler: blocks nest,
+// and functions see their own locals plus the globals declared before them.
+// A name assigned anywhere, or declared twice as a global, is never
+// treated as constant; neither is any global once the program loads or
+// imports code the pass cannot see.
+// ---------------------------------------------------------------------------
+
+// Finds the names that are not stable across the program, and whether it
+// loads code whose globals the passes cannot see
+void Optimizer::scanProgram(std::vector<StmtPtr>& program) {
+    unstable_.clear();
+    bool opaque = false;
+    std::unordered_map<std::string, int> declarations;
+    auto visit = [&](auto& node) {
+        using N = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<N, Expr>) {
+            if (auto assign = std::get_if<Expr::Assign>(&node.node)) unstable_.insert(assign->name);
+            else if (auto post = std::get_if<Expr::PostOp>(&node.node)) unstable_.insert(post->name);
+        } else {
+            if (isOpaque(node)) opaque = true;
+        }
+    };
+    walkChild(program, visit);
+
+    // Globals are whatever is declared outside any block, including as the
+    // unbraced branch of a top-level `if` or body of a `while`
+    std::function<void(const Stmt&)> global = [&](const Stmt& s) {
+        if (auto var = std::get_if<Stmt::Var>(&s.node)) declarations[var->name]++;
+        else if (auto fn = std::get_if<Stmt::Function>(&s.node)) declarations[fn->name]++;
+        else if (auto cls = std::get_if<Stmt::Class>(&s.node)) declarations[cls->name]++;
+        else if (auto branch = std::get_if<Stmt::If>(&s.node)) {
+            global(*branch->thenBranch);
+            if (branch->elseBranch) global(*branch->elseBranch);
+        } else if (auto loop = std::get_if<Stmt::While>(&s.node)) {
+            global(*loop->body);
+        }
+    };
+    for (const auto& s : program) global(*s);
+    for (const auto& [name, count] : declarations) {
+        if (count > 1) unstable_.insert(name);
+    }
+    globalsVisible_ = !opaque;
 }
 
-std::unique_ptr<Expr> Optimizer::constantFolding(std::unique_ptr<Expr> expr) {
-    if (!expr) return nullptr;
-    
-    // Basic constant folding implementation
-    // This would evaluate constant expressions at compile time
-    return expr;
+void Optimizer::constantPropagation(std::vector<StmtPtr>& program) {
+    scanProgram(program);
+    scopes_.assign(1, Scope());
+    for (auto& s : program) propagate(s, true);
+    scopes_.clear();
 }
 
-std::unique_ptr<Expr> Optimizer::deadCodeElimination(std::unique_ptr<Expr> expr) {
-    if (!expr) return nullptr;
-    
-    // Dead code elimination for expressions
-    return expr;
+void Optimizer::declare(const std::string& name, const ExprPtr& initializer, bool isConst, bool unconditional) {
+    std::optional<Expr::Literal> value;
+    auto literal = initializer ? std::get_if<Expr::Literal>(&initializer->node) : nullptr;
+    bool global = scopes_.size() == 1;
+    if (isConst && literal && unconditional && !unstable_.count(name) && (!global || globalsVisible_)) value = *literal;
+    scopes_.back()[name] = value;
 }
 
-std::unique_ptr<Expr> Optimizer::commonSubexpressionElimination(std::unique_ptr<Expr> expr) {
-    if (!expr) return nullptr;
-    
-    // Common subexpression elimination
-    return expr;
+// Statements in a list run unconditionally; a branch or loop body that is
+// a bare declaration may not run at all, so it never defines a constant
+void Optimizer::propagate(StmtPtr& stmt, bool unconditional) {
+    std::visit([&](auto&& node) {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, Stmt::Print> || std::is_same_v<T, Stmt::Expression> ||
+                      std::is_same_v<T, Stmt::Throw>) {
+            propagate(node.expression);
+        } else if constexpr (std::is_same_v<T, Stmt::Var>) {
+            if (node.initializer) propagate(node.initializer);
+            declare(node.name, node.initializer, node.isConst, unconditional);
+        } else if constexpr (std::is_same_v<T, Stmt::Return>) {
+            if (node.value) propagate(node.value);
+        } else if constexpr (std::is_same_v<T, Stmt::Block>) {
+            scopes_.emplace_back();
+            for (auto& s : node.statements) propagate(s, true);
+            scopes_.pop_back();
+        } else if constexpr (std::is_same_v<T, Stmt::If>) {
+            propagate(node.condition);
+            propagate(node.thenBranch, false);
+            if (node.elseBranch) propagate(node.elseBranch, false);
+        } else if constexpr (std::is_same_v<T, Stmt::While>) {
+            propagate(node.condition);
+            propagate(node.body, false);
+        } else if constexpr (std::is_same_v<T, Stmt::For>) {
+            scopes_.emplace_back();
+            if (node.initializer) propagate(node.initializer, true);
+            if (node.condition) propagate(node.condition);
+            if (node.increment) propagate(node.increment);
+            propagate(node.body, false);
+            scopes_.pop_back();
+        } else if constexpr (std::is_same_v<T, Stmt::ForIn>) {
+            // The counter is declared before the limit is evaluated
+            scopes_.emplace_back();
+            declare(node.name, nullptr, false, true);
+            propagate(node.iterable);
+            propagate(node.body, false);
+            scopes_.pop_back();
+        } else if constexpr (std::is_same_v<T, Stmt::Function>) {
+            declare(node.name, nullptr, false, true);
+            std::string caller = std::exchange(caller_, node.name);
+            propagateFunction(node.params, node.body, false);
+            caller_ = std::move(caller);
+            // Its own calls are inlined first, so a caller of leaves can become one
+            if (inlining_ && unconditional && scopes_.size() == 1) addInlinable(node);
+        } else if constexpr (std::is_same_v<T, Stmt::Class>) {
+            declare(node.name, nullptr, false, true);
+            for (auto& m : node.methods) {
+                if (auto method = std::get_if<Stmt::Function>(&m->node)) {
+                    std::string caller = std::exchange(caller_, node.name + "." + method->name);
+                    propagateFunction(method->params, method->body, true);
+                    caller_ = std::move(caller);
+                }
+            }
+        }
+        // Anything else is not compiled, or is opaque; it is left alone
+    }, stmt->node);
+}
+
+void Optimizer::propagateFunction(const std::vector<std::pair<std::string, std::string>>& params,
+                                  std::vector<StmtPtr>& body, bool method) {
+    std::vector<Scope> outer = enterFunction(params, method);
+    for (auto& s : body) propagate(s, true);
+    scopes_ = std::move(outer);
+}
+
+void Optimizer::propagate(ExprPtr& expr) {
+    if (auto var = std::get_if<Expr::Variable>(&expr->node)) {
+        for (auto it = scopes_.rbegin(); it != scopes_.rend(); ++it) {
+            auto found = it->find(var->name);
+            if (found == it->end()) continue;
+            if (found->second && !inlining_) {
+                expr->node = *found->second;
+                rewrites_++;
+            }
+            return;
+        }
+        return;
+    }
+    if (auto lambda = std::get_if<Expr::Lambda>(&expr->node)) {
+        std::string caller = std::exchange(caller_, "a lambda");
+        propagateFunction(lambda->params, lambda->body, false);
+        caller_ = std::move(caller);
+        return;
+    }
+    if (auto call = std::get_if<Expr::Call>(&expr->node)) {
+        // A callee stays a name: floor() and sqrt() compile by it
+        if (!std::holds_alternative<Expr::Variable>(call->callee->node)) propagate(call->callee);
+        for (auto& arg : call->arguments) propagate(arg);
+        if (inlining_) inlineCall(expr);
+        return;
+    }
+    eachChild(*expr, [&](auto& child) {
+        using C = std::decay_t<decltype(child)>;
+        if constexpr (std::is_same_v<C, ExprPtr>) propagate(child);
+    });
+}
+
+// ---------------------------------------------------------------------------
+// Function inlining (-O2): a call to a global function whose body is only
+// `return <expr>;` becomes that expression with the arguments in place of
+// the parameters. The function must be declared once, unconditionally, and
+// never assigned, and the call must come after the declaration and see the
+// global (not a local of the same name). Its expression may only read the
+// parameters and use operators, property and index reads, and floor() and
+// sqrt(), which makes it a non-recursive leaf; inlining the calls in a
+// function first lets a function built from leaves become one too.
+// ---------------------------------------------------------------------------
+
+// Expanded expressions larger than this stay calls
+static constexpr size_t MAX_INLINE_NODES = 24;
+
+// True for expressions whose only effect is their value (or a runtime
+// error), so they can be evaluated more than once or in another order.
+// With params, variables must also be among them.
+static bool pure(Expr& expr, const std::vector<std::pair<std::string, std::string>>* params = nullptr) {
+    if (std::holds_alternative<Expr::Literal>(expr.node)) return true;
+    if (auto var = std::get_if<Expr::Variable>(&expr.node)) {
+        if (!params) return true;
+        return std::any_of(params->begin(), params->end(), [&](const auto& p) { return p.first == var->name; });
+    }
+    if (auto call = std::get_if<Expr::Call>(&expr.node)) {
+        if (!isIntrinsicCall(*call) || call->arguments.empty()) return false;
+        return std::all_of(call->arguments.begin(), call->arguments.end(), [&](ExprPtr& a) { return pure(*a, params); });
+    }
+    if (!std::holds_alternative<Expr::Binary>(expr.node) && !std::holds_alternative<Expr::Grouping>(expr.node) &&
+        !std::holds_alternative<Expr::Unary>(expr.node) && !std::holds_alternative<Expr::Get>(expr.node) &&
+        !std::holds_alternative<Expr::Index>(expr.node)) return false;
+    bool result = true;
+    eachChild(expr, [&](auto& child) {
+        using C = std::decay_t<decltype(child)>;
+        if constexpr (std::is_same_v<C, ExprPtr>) result = result && pure(*child, params);
+    });
+    return result;
+}
+
+static ExprPtr makeVariable(const std::string& name) {
+    return std::make_unique<Expr>(Expr{Expr::Variable{name}});
+}
+
+static size_t countNodes(ExprPtr& expr) {
+    size_t count = 0;
+    auto visit = [&](auto&) { count++; };
+    walk(expr, visit);
+    return count;
+}
+
+static size_t countUses(ExprPtr& expr, const std::string& name) {
+    size_t count = 0;
+    auto visit = [&](auto& node) {
+        using N = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<N, Expr>) {
+            auto var = std::get_if<Expr::Variable>(&node.node);
+            count += var && var->name == name;
+        }
+    };
+    walk(expr, visit);
+    return count;
+}
+
+// Copies an expression pure() accepts, with the variables named in args
+// replaced by their argument: a copy if it is pure, otherwise the argument
+// itself, which inlineCall() only allows for a parameter used once.
+static ExprPtr substitute(const Expr& expr, std::unordered_map<std::string, ExprPtr*>& args) {
+    return std::visit([&](auto&& node) -> ExprPtr {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, Expr::Literal>) {
+            return std::make_unique<Expr>(Expr{node});
+        } else if constexpr (std::is_same_v<T, Expr::Variable>) {
+            auto found = args.find(node.name);
+            if (found == args.end()) return makeVariable(node.name);
+            ExprPtr& arg = *found->second;
+            if (!pure(*arg)) return std::move(arg);
+            std::unordered_map<std::string, ExprPtr*> none;
+            return substitute(*arg, none);
+        } else if constexpr (std::is_same_v<T, Expr::Binary>) {
+            return std::make_unique<Expr>(Expr{Expr::Binary{substitute(*node.left, args), node.op, substitute(*node.right, args)}});
+        } else if constexpr (std::is_same_v<T, Expr::Grouping>) {
+            return std::make_unique<Expr>(Expr{Expr::Grouping{substitute(*node.expression, args)}});
+        } else if constexpr (std::is_same_v<T, Expr::Unary>) {
+            return std::make_unique<Expr>(Expr{Expr::Unary{node.op, substitute(*node.right, args)}});
+        } else if constexpr (std::is_same_v<T, Expr::Get>) {
+            return std::make_unique<Expr>(Expr{Expr::Get{substitute(*node.object, args), node.name}});
+        } else if constexpr (std::is_same_v<T, Expr::Index>) {
+            return std::make_unique<Expr>(Expr{Expr::Index{substitute(*node.object, args), substitute(*node.index, args)}});
+        } else if constexpr (std::is_same_v<T, Expr::Call>) {
+            // An intrinsic; its callee is a name, not a parameter
+            std::vector<ExprPtr> arguments;
+            for (const auto& a : node.arguments) arguments.push_back(substitute(*a, args));
+            return std::make_unique<Expr>(Expr{Expr::Call{makeVariable(std::get<Expr::Variable>(node.callee->node).name),
+                                                          std::move(arguments)}});
+        } else {
+            return nullptr;
+        }
+    }, expr.node);
+}
+
+void Optimizer::functionInlining(std::vector<StmtPtr>& program) {
+    scanProgram(program);
+    inlining_ = true;
+    caller_ = "the script";
+    scopes_.assign(1, Scope());
+    for (auto& s : program) propagate(s, true);
+    scopes_.clear();
+    inlinable_.clear();
+    inlining_ = false;
+}
+
+void Optimizer::addInlinable(Stmt::Function& function) {
+    if (unstable_.count(function.name) || !globalsVisible_ || function.body.size() != 1) return;
+    auto ret = std::get_if<Stmt::Return>(&function.body[0]->node);
+    if (!ret || !ret->value || !pure(*ret->value, &function.params)) return;
+    if (countNodes(ret->value) > MAX_INLINE_NODES) return;
+    inlinable_[function.name] = &function;
+}
+
+void Optimizer::inlineCall(ExprPtr& expr) {
+    auto& call = std::get<Expr::Call>(expr->node);
+    auto callee = std::get_if<Expr::Variable>(&call.callee->node);
+    if (!callee || isIntrinsicCall(call) || scopeOf(callee->name) != 0) return;
+    auto found = inlinable_.find(callee->name);
+    if (found == inlinable_.end()) return;
+    Stmt::Function& function = *found->second;
+    if (call.arguments.size() != function.params.size()) return; // Left to fail at runtime
+    ExprPtr& body = std::get<Stmt::Return>(function.body[0]->node).value;
+
+    // Pure arguments may be copied to every use. One that is not must be
+    // used exactly once, with literals for the others, so it still runs
+    // once and nothing it does can be observed out of order. An argument
+    // that is never used is dropped, so it must be a literal.
+    std::unordered_map<std::string, ExprPtr*> args;
+    size_t impure = 0, literals = 0, size = countNodes(body);
+    for (size_t i = 0; i < call.arguments.size(); i++) {
+        ExprPtr& arg = call.arguments[i];
+        size_t uses = countUses(body, function.params[i].first);
+        bool literal = std::holds_alternative<Expr::Literal>(arg->node);
+        if (uses == 0 && !literal) return;
+        if (!pure(*arg)) {
+            if (uses != 1) return;
+            impure++;
+        }
+        literals += literal;
+        size += uses * countNodes(arg) - uses;
+        args[function.params[i].first] = &arg;
+    }
+    if (impure > 1 || (impure == 1 && literals + 1 < call.arguments.size())) return;
+    if (size > MAX_INLINE_NODES) return;
+
+    ExprPtr inlined = substitute(*body, args);
+    inlinedSites_.push_back(callee->name + " into " + caller_);
+    expr = std::move(inlined);
+    rewrites_++;
+}
+
+// ---------------------------------------------------------------------------
+// Constant folding: operators whose operands are literals become the literal
+// their opcode would compute, bottom up, so whole constant subtrees collapse.
+// Short-circuit operators and ternaries are left alone.
+// ---------------------------------------------------------------------------
+
+void Optimizer::constantFolding(std::vector<StmtPtr>& program) {
+    for (auto& s : program) fold(s);
+}
+
+void Optimizer::fold(StmtPtr& stmt) {
+    eachChild(*stmt, [&](auto& child) {
+        using C = std::decay_t<decltype(child)>;
+        if constexpr (std::is_same_v<C, std::vector<StmtPtr>>) {
+            for (auto& s : child) fold(s);
+        } else {
+            fold(child);
+        }
+    });
+}
+
+void Optimizer::fold(ExprPtr& expr) {
+    eachChild(*expr, [&](auto& child) {
+        using C = std::decay_t<decltype(child)>;
+        if constexpr (std::is_same_v<C, std::vector<StmtPtr>>) {
+            for (auto& s : child) fold(s);
+        } else {
+            fold(child);
+        }
+    });
+
+    std::optional<Expr::Literal> result;
+    if (auto group = std::get_if<Expr::Grouping>(&expr->node)) {
+        if (auto inner = std::get_if<Expr::Literal>(&group->expression->node)) result = *inner;
+    } else if (auto unary = std::get_if<Expr::Unary>(&expr->node)) {
+        if (auto operand = std::get_if<Expr::Literal>(&unary->right->node)) result = foldUnary(unary->op.type, *operand);
+    } else if (auto binary = std::get_if<Expr::Binary>(&expr->node)) {
+        auto l = std::get_if<Expr::Literal>(&binary->left->node);
+        auto r = std::get_if<Expr::Literal>(&binary->right->node);
+        if (l && r) result = foldBinary(binary->op.type, *l, *r);
+    }
+    if (result) {
+        expr->node = std::move(*result);
+        rewrites_++;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Dead code elimination: `if` and `while` on a literal condition, statements
+// after a return, break or continue in the same list, and expression
+// statements that are only a literal.
+// ---------------------------------------------------------------------------
+
+void Optimizer::deadCodeElimination(std::vector<StmtPtr>& program) {
+    eliminate(program);
+}
+
+void Optimizer::eliminate(std::vector<StmtPtr>& statements) {
+    for (auto& s : statements) eliminate(s);
+
+    size_t before = statements.size();
+    auto end = std::find_if(statements.begin(), statements.end(), [](const StmtPtr& s) { return endsControl(*s); });
+    if (end != statements.end()) statements.erase(end + 1, statements.end());
+    statements.erase(std::remove_if(statements.begin(), statements.end(), [](const StmtPtr& s) {
+        if (isEmptyBlock(*s)) return true;
+        auto expression = std::get_if<Stmt::Expression>(&s->node);
+        return expression && std::holds_alternative<Expr::Literal>(expression->expression->node);
+    }), statements.end());
+    rewrites_ += before - statements.size();
+}
+
+// Expressions hold statements only inside lambdas
+void Optimizer::eliminate(ExprPtr& expr) {
+    if (auto lambda = std::get_if<Expr::Lambda>(&expr->node)) {
+        eliminate(lambda->body);
+        return;
+    }
+    eachChild(*expr, [&](auto& child) {
+        using C = std::decay_t<decltype(child)>;
+        if constexpr (std::is_same_v<C, ExprPtr>) eliminate(child);
+    });
+}
+
+void Optimizer::eliminate(StmtPtr& stmt) {
+    eachChild(*stmt, [&](auto& child) {
+        using C = std::decay_t<decltype(child)>;
+        if constexpr (std::is_same_v<C, std::vector<StmtPtr>>) {
+            eliminate(child);
+        } else if constexpr (std::is_same_v<C, StmtPtr>) {
+            eliminate(child);
+        } else {
+            eliminate(child);
+        }
+    });
+
+    if (auto branch = std::get_if<Stmt::If>(&stmt->node)) {
+        auto condition = std::get_if<Expr::Literal>(&branch->condition->node);
+        if (!condition) return;
+        StmtPtr taken = truthy(*condition) ? std::move(branch->thenBranch) : std::move(branch->elseBranch);
+        if (!taken) taken = std::make_unique<Stmt>(Stmt{Stmt::Block{}});
+        stmt = std::move(taken);
+        rewrites_++;
+    } else if (auto loop = std::get_if<Stmt::While>(&stmt->node)) {
+        auto condition = std::get_if<Expr::Literal>(&loop->condition->node);
+        if (!condition || truthy(*condition)) return;
+        stmt = std::make_unique<Stmt>(Stmt{Stmt::Block{}});
+        rewrites_++;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Loop optimization (-O2): invariant code motion and strength reduction. A
+// loop that has work to move is wrapped in a block whose new locals, its
+// preheader, are computed once before the loop starts:
+//
+//     let i = 0;                          let i = 0;
+//     while (i < n * 2) {                 { let #inv0 = n * 2; let #iv0: int = 0;
+//         a[i * 4] = i * 4 + 1;    =>       while (i < #inv0) {
+//         i = i + 1;                            a[#iv0] = #iv0 + 1;
+//     }                                         i = i + 1; #iv0 = #iv0 + 4; } }
+//
+// Only expressions that can neither fail nor have side effects move:
+// arithmetic, comparisons, floor() and sqrt() of literals and of variables
+// the loop never assigns or declares. A global also has to be one that no
+// function the loop calls could assign. Strength reduction applies to an
+// int induction variable: the counter of `for in`, or a variable set to an
+// int literal just before the loop and stepped by one once per iteration.
+// ---------------------------------------------------------------------------
+
+// Hoisted expressions per loop; each takes a local slot
+static constexpr size_t MAX_HOISTED = 8;
+
+// What a loop does to the names it mentions
+struct Optimizer::LoopEffects {
+    std::unordered_map<std::string, int> assigned; // Assignments, ++ and --
+    std::unordered_map<std::string, int> declared; // let, fn, class, parameters, loop counters
+    bool calls = false; // Calls something that may assign a global
+    bool jumps = false; // break or continue
+};
+
+static ExprPtr makeInt(int64_t n) {
+    return std::make_unique<Expr>(Expr{Expr::Literal{(double)n, true}});
+}
+
+static StmtPtr makeLet(const std::string& name, ExprPtr initializer, const std::string& type = "") {
+    return std::make_unique<Stmt>(Stmt{Stmt::Var{name, std::move(initializer), type, false}});
+}
+
+// name = name + n, which compiles to INCREMENT_LOCAL
+static StmtPtr makeIncrement(const std::string& name, int64_t n) {
+    ExprPtr sum = std::make_unique<Expr>(Expr{Expr::Binary{makeVariable(name), Token{TokenType::PLUS, "+", 0, 0}, makeInt(n)}});
+    return std::make_unique<Stmt>(Stmt{Stmt::Expression{std::make_unique<Expr>(Expr{Expr::Assign{name, std::move(sum)}})}});
+}
+
+// The value of an int literal that compiles to a small int
+static std::optional<int64_t> intLiteral(const ExprPtr& expr) {
+    auto literal = std::get_if<Expr::Literal>(&expr->node);
+    if (!literal || !literal->integer || !isNumberLiteral(*literal)) return std::nullopt;
+    Value v = literalValue(*literal);
+    if (!isInt(v)) return std::nullopt;
+    return valueToInt(v);
+}
+
+// The step of `name = name + k` or `name = name - k` for an int literal k
+static std::optional<int64_t> stepOf(const Expr& expr, const std::string& name) {
+    auto assign = std::get_if<Expr::Assign>(&expr.node);
+    if (!assign || assign->name != name) return std::nullopt;
+    auto sum = std::get_if<Expr::Binary>(&assign->value->node);
+    if (!sum || (sum->op.type != TokenType::PLUS && sum->op.type != TokenType::MINUS)) return std::nullopt;
+    auto var = std::get_if<Expr::Variable>(&sum->left->node);
+    auto k = intLiteral(sum->right);
+    if (!var || var->name != name || !k) return std::nullopt;
+    return sum->op.type == TokenType::PLUS ? *k : -*k;
+}
+
+static bool isBareDeclaration(const Stmt& stmt) {
+    return std::holds_alternative<Stmt::Var>(stmt.node) || std::holds_alternative<Stmt::Function>(stmt.node) ||
+           std::holds_alternative<Stmt::Class>(stmt.node);
+}
+
+// Structural equality, for the expressions hoisting can move
+static bool sameExpr(const Expr& a, const Expr& b) {
+    if (a.node.index() != b.node.index()) return false;
+    if (auto l = std::get_if<Expr::Literal>(&a.node)) {
+        auto& r = std::get<Expr::Literal>(b.node);
+        if (l->integer != r.integer || l->value.index() != r.value.index()) return false;
+        if (auto d = std::get_if<double>(&l->value)) {
+            double e = std::get<double>(r.value);
+            return *d == e && std::signbit(*d) == std::signbit(e);
+        }
+        return l->value == r.value;
+    }
+    if (auto l = std::get_if<Expr::Variable>(&a.node)) return l->name == std::get<Expr::Variable>(b.node).name;
+    if (auto l = std::get_if<Expr::Grouping>(&a.node)) {
+        return sameExpr(*l->expression, *std::get<Expr::Grouping>(b.node).expression);
+    }
+    if (auto l = std::get_if<Expr::Unary>(&a.node)) {
+        auto& r = std::get<Expr::Unary>(b.node);
+        return l->op.type == r.op.type && sameExpr(*l->right, *r.right);
+    }
+    if (auto l = std::get_if<Expr::Binary>(&a.node)) {
+        auto& r = std::get<Expr::Binary>(b.node);
+        return l->op.type == r.op.type && sameExpr(*l->left, *r.left) && sameExpr(*l->right, *r.right);
+    }
+    if (auto l = std::get_if<Expr::Call>(&a.node)) {
+        auto& r = std::get<Expr::Call>(b.node);
+        if (!sameExpr(*l->callee, *r.callee) || l->arguments.size() != r.arguments.size()) return false;
+        for (size_t i = 0; i < l->arguments.size(); i++) {
+            if (!sameExpr(*l->arguments[i], *r.arguments[i])) return false;
+        }
+        return true;
+    }
+    return false;
+}
+
+// Reading a local costs one dispatch, so only operators are worth a slot
+static bool worthHoisting(const Expr& expr) {
+    if (auto group = std::get_if<Expr::Grouping>(&expr.node)) return worthHoisting(*group->expression);
+    if (auto unary = std::get_if<Expr::Unary>(&expr.node)) return worthHoisting(*unary->right);
+    return std::holds_alternative<Expr::Binary>(expr.node) || std::holds_alternative<Expr::Call>(expr.node);
+}
+
+// Calls f on the expressions a loop evaluates on every iteration, and on
+// those of the statements nested in it, down to but not into functions,
+// lambdas and the operands of the operators the compiler skips
+template <typename F>
+static void eachIterationExpr(StmtPtr& loop, F&& f) {
+    auto inExpr = [&](ExprPtr& expr, auto& self) -> void {
+        if (f(expr)) return;
+        if (std::holds_alternative<Expr::Lambda>(expr->node) || std::holds_alternative<Expr::Logical>(expr->node) ||
+            std::holds_alternative<Expr::Ternary>(expr->node)) return;
+        eachChild(*expr, [&](auto& child) {
+            using C = std::decay_t<decltype(child)>;
+            if constexpr (std::is_same_v<C, ExprPtr>) self(child, self);
+        });
+    };
+    auto inStmt = [&](StmtPtr& stmt, auto& self) -> void {
+        if (std::holds_alternative<Stmt::Function>(stmt->node) || std::holds_alternative<Stmt::Class>(stmt->node)) return;
+        eachChild(*stmt, [&](auto& child) {
+            using C = std::decay_t<decltype(child)>;
+            if constexpr (std::is_same_v<C, ExprPtr>) inExpr(child, inExpr);
+            else if constexpr (std::is_same_v<C, StmtPtr>) self(child, self);
+            else for (auto& s : child) self(s, self);
+        });
+    };
+    std::visit([&](auto&& node) {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, Stmt::While>) {
+            inExpr(node.condition, inExpr);
+            inStmt(node.body, inStmt);
+        } else if constexpr (std::is_same_v<T, Stmt::For>) {
+            if (node.condition) inExpr(node.condition, inExpr);
+            if (node.increment) inExpr(node.increment, inExpr);
+            inStmt(node.body, inStmt);
+        } else if constexpr (std::is_same_v<T, Stmt::ForIn>) {
+            inStmt(node.body, inStmt);
+        }
+    }, loop->node);
+}
+
+Optimizer::LoopEffects Optimizer::loopEffects(StmtPtr& loop) {
+    LoopEffects effects;
+    auto visit = [&](auto& node) {
+        using N = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<N, Expr>) {
+            if (auto assign = std::get_if<Expr::Assign>(&node.node)) effects.assigned[assign->name]++;
+            else if (auto post = std::get_if<Expr::PostOp>(&node.node)) effects.assigned[post->name]++;
+            else if (auto call = std::get_if<Expr::Call>(&node.node)) effects.calls |= !isIntrinsicCall(*call);
+            else if (auto lambda = std::get_if<Expr::Lambda>(&node.node)) {
+                for (const auto& param : lambda->params) effects.declared[param.first]++;
+            }
+        } else {
+            if (auto var = std::get_if<Stmt::Var>(&node.node)) effects.declared[var->name]++;
+            else if (auto cls = std::get_if<Stmt::Class>(&node.node)) effects.declared[cls->name]++;
+            else if (auto each = std::get_if<Stmt::ForIn>(&node.node)) effects.declared[each->name]++;
+            else if (auto fn = std::get_if<Stmt::Function>(&node.node)) {
+                effects.declared[fn->name]++;
+                for (const auto& param : fn->params) effects.declared[param.first]++;
+            } else if (std::holds_alternative<Stmt::Break>(node.node) || std::holds_alternative<Stmt::Continue>(node.node)) {
+                effects.jumps = true;
+            } else if (isOpaque(node)) {
+                effects.calls = true;
+            }
+        }
+    };
+    walk(loop, visit);
+    return effects;
+}
+
+void Optimizer::loopOptimization(std::vector<StmtPtr>& program) {
+    scanProgram(program);
+    scopes_.assign(1, Scope());
+    optimizeLoops(program);
+    scopes_.clear();
+}
+
+void Optimizer::optimizeLoops(std::vector<StmtPtr>& statements) {
+    for (size_t i = 0; i < statements.size(); i++) optimizeLoops(statements[i], &statements, i);
+}
+
+// Inner loops first, so that what they hoisted can move further out. The
+// scopes are tracked as in constant propagation, for resolving names.
+void Optimizer::optimizeLoops(StmtPtr& stmt, std::vector<StmtPtr>* list, size_t index) {
+    bool loop = false;
+    std::visit([&](auto&& node) {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, Stmt::Var>) {
+            if (node.initializer) optimizeLoops(node.initializer);
+            scopes_.back()[node.name];
+        } else if constexpr (std::is_same_v<T, Stmt::Function>) {
+            scopes_.back()[node.name];
+            std::vector<Scope> outer = enterFunction(node.params, false);
+            optimizeLoops(node.body);
+            scopes_ = std::move(outer);
+        } else if constexpr (std::is_same_v<T, Stmt::Class>) {
+            scopes_.back()[node.name];
+            for (auto& m : node.methods) {
+                auto method = std::get_if<Stmt::Function>(&m->node);
+                if (!method) continue;
+                std::vector<Scope> outer = enterFunction(method->params, true);
+                optimizeLoops(method->body);
+                scopes_ = std::move(outer);
+            }
+        } else if constexpr (std::is_same_v<T, Stmt::Block>) {
+            scopes_.emplace_back();
+            optimizeLoops(node.statements);
+            scopes_.pop_back();
+        } else if constexpr (std::is_same_v<T, Stmt::If>) {
+            optimizeLoops(node.condition);
+            optimizeLoops(node.thenBranch, nullptr, 0);
+            if (node.elseBranch) optimizeLoops(node.elseBranch, nullptr, 0);
+        } else if constexpr (std::is_same_v<T, Stmt::While>) {
+            optimizeLoops(node.condition);
+            optimizeLoops(node.body, nullptr, 0);
+            loop = !isBareDeclaration(*node.body);
+        } else if constexpr (std::is_same_v<T, Stmt::For>) {
+            scopes_.emplace_back();
+            if (node.initializer) optimizeLoops(node.initializer, nullptr, 0);
+            if (node.condition) optimizeLoops(node.condition);
+            if (node.increment) optimizeLoops(node.increment);
+            optimizeLoops(node.body, nullptr, 0);
+            scopes_.pop_back();
+            loop = !isBareDeclaration(*node.body);
+        } else if constexpr (std::is_same_v<T, Stmt::ForIn>) {
+            optimizeLoops(node.iterable);
+            scopes_.emplace_back();
+            scopes_.back()[node.name];
+            scopes_.back()["_limit"];
+            optimizeLoops(node.body, nullptr, 0);
+            scopes_.pop_back();
+            loop = !isBareDeclaration(*node.body);
+        } else if constexpr (std::is_same_v<T, Stmt::Print> || std::is_same_v<T, Stmt::Expression>) {
+            optimizeLoops(node.expression);
+        } else if constexpr (std::is_same_v<T, Stmt::Return>) {
+            if (node.value) optimizeLoops(node.value);
+        }
+    }, stmt->node);
+    if (!loop) return;
+
+    LoopEffects effects = loopEffects(stmt);
+    std::vector<StmtPtr> preheader;
+    hoistInvariants(stmt, effects, preheader);
+    reduceStrength(stmt, list, index, effects, preheader);
+    if (preheader.empty()) return;
+    preheader.push_back(std::move(stmt));
+    stmt = std::make_unique<Stmt>(Stmt{Stmt::Block{std::move(preheader)}});
+}
+
+// Loops inside lambdas
+void Optimizer::optimizeLoops(ExprPtr& expr) {
+    if (auto lambda = std::get_if<Expr::Lambda>(&expr->node)) {
+        std::vector<Scope> outer = enterFunction(lambda->params, false);
+        optimizeLoops(lambda->body);
+        scopes_ = std::move(outer);
+        return;
+    }
+    eachChild(*expr, [&](auto& child) {
+        using C = std::decay_t<decltype(child)>;
+        if constexpr (std::is_same_v<C, ExprPtr>) optimizeLoops(child);
+    });
+}
+
+void Optimizer::hoistInvariants(StmtPtr& loop, const LoopEffects& effects, std::vector<StmtPtr>& preheader) {
+    eachIterationExpr(loop, [&](ExprPtr& expr) {
+        if (!worthHoisting(*expr) || !invariant(expr, effects)) return false;
+        std::string name;
+        for (const auto& s : preheader) {
+            const auto& var = std::get<Stmt::Var>(s->node);
+            if (sameExpr(*var.initializer, *expr)) {
+                name = var.name;
+                break;
+            }
+        }
+        if (name.empty()) {
+            if (preheader.size() >= MAX_HOISTED) return true;
+            name = "#inv" + std::to_string(temporaries_++);
+            preheader.push_back(makeLet(name, std::move(expr)));
+        }
+        expr = makeVariable(name);
+        rewrites_++;
+        return true;
+    });
+}
+
+// True if expr computes the same value on every iteration of the loop and
+// can be evaluated early without failing or doing anything else
+bool Optimizer::invariant(const ExprPtr& expr, const LoopEffects& effects) const {
+    return std::visit([&](auto&& node) -> bool {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, Expr::Literal>) {
+            return true;
+        } else if constexpr (std::is_same_v<T, Expr::Variable>) {
+            if (effects.assigned.count(node.name) || effects.declared.count(node.name)) return false;
+            int scope = scopeOf(node.name);
+            if (scope < 0) return false; // May not exist; reading it would report that
+            if (scope > 0) return true;  // Called functions cannot see locals
+            return globalsVisible_ && (!effects.calls || !unstable_.count(node.name));
+        } else if constexpr (std::is_same_v<T, Expr::Grouping>) {
+            return invariant(node.expression, effects);
+        } else if constexpr (std::is_same_v<T, Expr::Unary>) {
+            return (node.op.type == TokenType::MINUS || node.op.type == TokenType::BANG) && invariant(node.right, effects);
+        } else if constexpr (std::is_same_v<T, Expr::Binary>) {
+            switch (node.op.type) {
+                case TokenType::PLUS: case TokenType::MINUS: case TokenType::STAR: case TokenType::SLASH:
+                case TokenType::PERCENT: case TokenType::LESS: case TokenType::LESS_EQUAL: case TokenType::GREATER:
+                case TokenType::GREATER_EQUAL: case TokenType::EQUAL_EQUAL: case TokenType::BANG_EQUAL:
+                    return invariant(node.left, effects) && invariant(node.right, effects);
+                default:
+                    return false;
+            }
+        } else if constexpr (std::is_same_v<T, Expr::Call>) {
+            return isIntrinsicCall(node) && node.arguments.size() == 1 && invariant(node.arguments[0], effects);
+        } else {
+            return false;
+        }
+    }, expr->node);
+}
+
+// Replaces i * c, for an int literal c, with a local that starts at the
+// product and steps by step * c right after i steps
+void Optimizer::reduceStrength(StmtPtr& loop, std::vector<StmtPtr>* list, size_t index,
+                               const LoopEffects& effects, std::vector<StmtPtr>& preheader) {
+    if (effects.jumps) return;
+    std::string name;
+    int64_t start = 0, step = 0;
+    std::vector<StmtPtr>* body = nullptr;
+    size_t update = 0;
+    auto count = [](const std::unordered_map<std::string, int>& map, const std::string& key) {
+        auto it = map.find(key);
+        return it == map.end() ? 0 : it->second;
+    };
+    auto blockOf = [](StmtPtr& stmt) {
+        auto block = std::get_if<Stmt::Block>(&stmt->node);
+        return block ? &block->statements : nullptr;
+    };
+
+    if (auto each = std::get_if<Stmt::ForIn>(&loop->node)) {
+        if (count(effects.assigned, each->name) != 0 || count(effects.declared, each->name) != 1) return;
+        name = each->name;
+        step = 1;
+        body = blockOf(each->body);
+        if (body) update = body->size();
+    } else if (auto counted = std::get_if<Stmt::For>(&loop->node)) {
+        auto init = counted->initializer ? std::get_if<Stmt::Var>(&counted->initializer->node) : nullptr;
+        if (!init || !init->initializer || !counted->increment) return;
+        auto first = intLiteral(init->initializer);
+        auto by = stepOf(*counted->increment, init->name);
+        if (!first || !by) return;
+        if (count(effects.assigned, init->name) != 1 || count(effects.declared, init->name) != 1) return;
+        name = init->name;
+        start = *first;
+        step = *by;
+        body = blockOf(counted->body);
+        if (body) update = body->size();
+    } else if (auto loopWhile = std::get_if<Stmt::While>(&loop->node)) {
+        body = blockOf(loopWhile->body);
+        if (!body) return;
+        for (size_t i = 0; i < body->size(); i++) {
+            auto expression = std::get_if<Stmt::Expression>(&(*body)[i]->node);
+            if (!expression) continue;
+            auto assign = std::get_if<Expr::Assign>(&expression->expression->node);
+            auto by = assign ? stepOf(*expression->expression, assign->name) : std::nullopt;
+            if (by && count(effects.assigned, assign->name) == 1 && count(effects.declared, assign->name) == 0) {
+                name = assign->name;
+                step = *by;
+                update = i + 1;
+                break;
+            }
+        }
+        if (update == 0) return;
+        int scope = scopeOf(name);
+        if (scope < 0 || (scope == 0 && (effects.calls || !globalsVisible_))) return;
+
+        // Set to an int literal earlier in the same list, and left alone since
+        if (!list) return;
+        std::optional<int64_t> first;
+        for (size_t i = index; i-- > 0;) {
+            const Stmt& s = *(*list)[i];
+            if (auto var = std::get_if<Stmt::Var>(&s.node); var && var->name == name) {
+                if (!var->initializer || !(first = intLiteral(var->initializer))) return;
+            } else if (auto expression = std::get_if<Stmt::Expression>(&s.node)) {
+                auto assign = std::get_if<Expr::Assign>(&expression->expression->node);
+                if (assign && assign->name == name && !(first = intLiteral(assign->value))) return;
+            }
+            if (first) break;
+            LoopEffects between = loopEffects((*list)[i]);
+            if (between.assigned.count(name) || between.declared.count(name)) return;
+            if (scope == 0 && between.calls) return;
+        }
+        if (!first) return;
+        start = *first;
+    }
+    if (!body || name.empty()) return;
+
+    std::vector<std::pair<int64_t, std::string>> reduced; // Factor, local
+    std::vector<StmtPtr> updates;
+    eachIterationExpr(loop, [&](ExprPtr& expr) {
+        auto product = std::get_if<Expr::Binary>(&expr->node);
+        if (!product || product->op.type != TokenType::STAR) return false;
+        auto factor = intLiteral(product->right);
+        auto var = std::get_if<Expr::Variable>(&product->left->node);
+        if (!factor) {
+            factor = intLiteral(product->left);
+            var = std::get_if<Expr::Variable>(&product->right->node);
+        }
+        if (!factor || !var || var->name != name) return false;
+
+        auto found = std::find_if(reduced.begin(), reduced.end(), [&](const auto& r) { return r.first == *factor; });
+        if (found == reduced.end()) {
+            Value initial, increment;
+            if (!multiplyInts(intToValue(start), intToValue(*factor), initial) ||
+                !multiplyInts(intToValue(step), intToValue(*factor), increment)) {
+                return true;
+            }
+            std::string local = "#iv" + std::to_string(temporaries_++);
+            preheader.push_back(makeLet(local, makeInt(valueToInt(initial)), "int"));
+            updates.push_back(makeIncrement(local, valueToInt(increment)));
+            found = reduced.insert(reduced.end(), {*factor, local});
+        }
+        expr = makeVariable(found->second);
+        rewrites_++;
+        return true;
+    });
+    body->insert(body->begin() + update, std::make_move_iterator(updates.begin()), std::make_move_iterator(updates.end()));
+}
+
+// ---------------------------------------------------------------------------
+// Scalar replacement (-O2): a local initialized with a short array literal,
+// whose later uses in its block only index it with int literals in range,
+// never escapes; it becomes one local per element and is never allocated.
+//
+//     let p = [x, y];               let #sr0 = x; let #sr1 = y;
+//     p[1] = p[0] * 2;      =>      #sr1 = #sr0 * 2;
+//
+// Any other use (passing it, printing it, a variable or out-of-range index,
+// len(), assigning or redeclaring the name) keeps the array. Globals are
+// left alone: a function could read them.
+// ---------------------------------------------------------------------------
+
+// Arrays longer than this stay arrays
+static constexpr size_t MAX_SCALARS = 8;
+
+// The element `array[index]` names if it indexes the array with an int
+// literal in range
+static std::optional<size_t> elementOf(const Expr& array, const ExprPtr& index, const std::string& name, size_t length) {
+    auto var = std::get_if<Expr::Variable>(&array.node);
+    if (!var || var->name != name) return std::nullopt;
+    auto k = intLiteral(index);
+    if (!k || *k < 0 || (size_t)*k >= length) return std::nullopt;
+    return (size_t)*k;
+}
+
+// True if the array bound to name is used in expr other than by element.
+// Functions and lambdas cannot see it, so their bodies do not count.
+static bool escapes(Expr& expr, const std::string& name, size_t length) {
+    if (auto var = std::get_if<Expr::Variable>(&expr.node)) return var->name == name;
+    if (auto assign = std::get_if<Expr::Assign>(&expr.node)) {
+        return assign->name == name || escapes(*assign->value, name, length);
+    }
+    if (auto post = std::get_if<Expr::PostOp>(&expr.node)) return post->name == name;
+    if (auto index = std::get_if<Expr::Index>(&expr.node)) {
+        if (elementOf(*index->object, index->index, name, length)) return false;
+    }
+    if (auto set = std::get_if<Expr::IndexSet>(&expr.node)) {
+        if (elementOf(*set->object, set->index, name, length)) return escapes(*set->value, name, length);
+    }
+    if (std::holds_alternative<Expr::Lambda>(expr.node)) return false;
+    bool result = false;
+    eachChild(expr, [&](auto& child) {
+        using C = std::decay_t<decltype(child)>;
+        if constexpr (std::is_same_v<C, ExprPtr>) result = result || escapes(*child, name, length);
+    });
+    return result;
+}
+
+// The same for a statement, which also must not declare the name again
+static bool escapes(Stmt& stmt, const std::string& name, size_t length) {
+    if (auto var = std::get_if<Stmt::Var>(&stmt.node); var && var->name == name) return true;
+    if (auto loop = std::get_if<Stmt::ForIn>(&stmt.node); loop && loop->name == name) return true;
+    if (auto fn = std::get_if<Stmt::Function>(&stmt.node)) return fn->name == name;
+    if (auto cls = std::get_if<Stmt::Class>(&stmt.node)) return cls->name == name;
+    bool result = false;
+    eachChild(stmt, [&](auto& child) {
+        using C = std::decay_t<decltype(child)>;
+        if constexpr (std::is_same_v<C, ExprPtr>) result = result || escapes(*child, name, length);
+        else if constexpr (std::is_same_v<C, StmtPtr>) result = result || escapes(*child, name, length);
+        else for (auto& s : child) result = result || escapes(*s, name, length);
+    });
+    return result;
+}
+
+// Rewrites the element uses escapes() allowed to the element locals
+static void replaceElements(ExprPtr& expr, const std::string& name, const std::vector<std::string>& elements) {
+    if (auto index = std::get_if<Expr::Index>(&expr->node)) {
+        if (auto k = elementOf(*index->object, index->index, name, elements.size())) {
+            expr = makeVariable(elements[*k]);
+            return;
+        }
+    }
+    if (auto set = std::get_if<Expr::IndexSet>(&expr->node)) {
+        if (auto k = elementOf(*set->object, set->index, name, elements.size())) {
+            replaceElements(set->value, name, elements);
+            expr = std::make_unique<Expr>(Expr{Expr::Assign{elements[*k], std::move(set->value)}});
+            return;
+        }
+    }
+    if (std::holds_alternative<Expr::Lambda>(expr->node)) return;
+    eachChild(*expr, [&](auto& child) {
+        using C = std::decay_t<decltype(child)>;
+        if constexpr (std::is_same_v<C, ExprPtr>) replaceElements(child, name, elements);
+    });
+}
+
+static void replaceElements(StmtPtr& stmt, const std::string& name, const std::vector<std::string>& elements) {
+    if (std::holds_alternative<Stmt::Function>(stmt->node) || std::holds_alternative<Stmt::Class>(stmt->node)) return;
+    eachChild(*stmt, [&](auto& child) {
+        using C = std::decay_t<decltype(child)>;
+        if constexpr (std::is_same_v<C, ExprPtr>) replaceElements(child, name, elements);
+        else if constexpr (std::is_same_v<C, StmtPtr>) replaceElements(child, name, elements);
+        else for (auto& s : child) replaceElements(s, name, elements);
+    });
+}
+
+void Optimizer::scalarReplacement(std::vector<StmtPtr>& program) {
+    replaceArrays(program, true);
+}
+
+void Optimizer::replaceArrays(std::vector<StmtPtr>& statements, bool global) {
+    for (size_t i = 0; i < statements.size(); i++) {
+        replaceArrays(statements[i]);
+        auto var = std::get_if<Stmt::Var>(&statements[i]->node);
+        if (global || !var || !var->initializer) continue;
+        auto array = std::get_if<Expr::Array>(&var->initializer->node);
+        if (!array || array->elements.size() > MAX_SCALARS) continue;
+
+        const std::string name = var->name;
+        size_t length = array->elements.size();
+        // An element naming the array reads whatever it shadows
+        bool escaped = std::any_of(array->elements.begin(), array->elements.end(),
+                                   [&](ExprPtr& e) { return countUses(e, name) > 0; });
+        for (size_t j = i + 1; j < statements.size() && !escaped; j++) escaped = escapes(*statements[j], name, length);
+        if (escaped) continue;
+
+        std::vector<std::string> elements;
+        std::vector<StmtPtr> locals;
+        for (auto& e : array->elements) {
+            elements.push_back("#sr" + std::to_string(temporaries_++));
+            locals.push_back(makeLet(elements.back(), std::move(e)));
+        }
+        for (size_t j = i + 1; j < statements.size(); j++) replaceElements(statements[j], name, elements);
+        statements.erase(statements.begin() + i);
+        statements.insert(statements.begin() + i, std::make_move_iterator(locals.begin()), std::make_move_iterator(locals.end()));
+        i += length;
+        i--;
+        rewrites_++;
+    }
+}
+
+// Statement lists nested in stmt are blocks or function bodies, all local
+void Optimizer::replaceArrays(StmtPtr& stmt) {
+    eachChild(*stmt, [&](auto& child) {
+        using C = std::decay_t<decltype(child)>;
+        if constexpr (std::is_same_v<C, StmtPtr>) replaceArrays(child);
+        else if constexpr (std::is_same_v<C, std::vector<StmtPtr>>) replaceArrays(child, false);
+    });
+}
+
+int Optimizer::scopeOf(const std::string& name) const {
+    for (size_t i = scopes_.size(); i-- > 0;) {
+        if (scopes_[i].count(name)) return (int)i;
+    }
+    return -1;
 }
 
-std::unique_ptr<Stmt> Optimizer::loopOptimization(std::unique_ptr<Stmt> stmt) {
-    if (!stmt) return nullptr;
-    
-    // Loop optimization (unrolling, invariant code motion, etc.)
-    return stmt;
+// Makes the scopes a function body sees current: the globals declared so
+// far, then one for its parameters. Returns the scopes to restore after.
+std::vector<Optimizer::Scope> Optimizer::enterFunction(const std::vector<std::pair<std::string, std::string>>& params,
+                                                       bool method) {
+    std::vector<Scope> outer = std::move(scopes_);
+    scopes_ = {outer.front(), Scope()};
+    if (method) scopes_.back()["this"];
+    for (const auto& param : params) scopes_.back()[param.first];
+    return outer;
 }
 
 void Optimizer::initializeOptimizations() {
-    // Enable all optimizations by default
+    // Enable all optimizations by default; the level picks which run
+    enabled_optimizations_["function_inlining"] = true;
+    enabled_optimizations_["scalar_replacement"] = true;
+    enabled_optimizations_["constant_propagation"] = true;
     enabled_optimizations_["constant_folding"] = true;
     enabled_optimizations_["dead_code_elimination"] = true;
-    enabled_optimizations_["common_subexpression_elimination"] = true;
     enabled_optimizations_["loop_optimization"] = true;
 }
 
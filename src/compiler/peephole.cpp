@@ -0,0 +1,270 @@
+/*
+Copyright (c) 2026 Dipanjan Dhar
+SPDX-License-Identifier: GPL-3.0-only
+*/
+
+#include "axeon/peephole.hpp"
+#include <unordered_map>
+
+namespace kio {
+
+// Each round can expose more work for the next (a dropped jump makes two
+// instructions adjacent); a few are enough for anything the Compiler emits
+static constexpr int MAX_ROUNDS = 8;
+// Bounds the walk along a jump chain, which may be a cycle
+static constexpr int MAX_HOPS = 8;
+
+static bool isJump(OpCode op) {
+    switch (op) {
+        case OpCode::JUMP: case OpCode::JUMP_IF_FALSE: case OpCode::LOOP:
+        case OpCode::LESS_JUMP_IF_FALSE: case OpCode::EQUAL_JUMP_IF_FALSE: case OpCode::LESS_LOCALS_JUMP_IF_FALSE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Conditional jumps only encode forward offsets
+static bool isConditional(OpCode op) { return isJump(op) && op != OpCode::JUMP && op != OpCode::LOOP; }
+
+// Instructions that never fall through to the next one. TAIL_CALL does when
+// the callee is not a function of the right arity.
+static bool endsBlock(OpCode op) {
+    return op == OpCode::JUMP || op == OpCode::LOOP || op == OpCode::RETURN || op == OpCode::HALT;
+}
+
+// Operand index of the 16-bit jump offset
+static int offsetOperand(OpCode op) { return op == OpCode::LESS_LOCALS_JUMP_IF_FALSE ? 2 : 0; }
+
+// Operand index of a constant-table index, or -1
+static int constantOperand(OpCode op) {
+    switch (op) {
+        case OpCode::CONSTANT: case OpCode::GET_GLOBAL: case OpCode::DEFINE_GLOBAL: case OpCode::SET_GLOBAL:
+        case OpCode::CLASS: case OpCode::METHOD: case OpCode::SYS_QUERY: case OpCode::ADD_CONST:
+        case OpCode::GET_PROPERTY: case OpCode::SET_PROPERTY: case OpCode::GET_PROPERTY_SLOT: case OpCode::INVOKE:
+            return 0;
+        case OpCode::INCREMENT_LOCAL:
+            return 1;
+        case OpCode::INCREMENT_GLOBAL_SLOT:
+            return 2;
+        default:
+            return -1;
+    }
+}
+
+Peephole::Stats Peephole::optimize(Chunk& chunk) {
+    Stats stats;
+    stats.constantsBefore = stats.constantsAfter = chunk.constants.size();
+    std::vector<Instruction> code;
+    if (!decode(chunk, code)) return stats;
+    stats.instructionsBefore = stats.instructionsAfter = code.size();
+
+    for (int round = 0; round < MAX_ROUNDS; round++) {
+        bool changed = threadJumps(code);
+        markLabels(code);
+        changed |= rewrite(code);
+        changed |= removeUnreachable(code);
+        if (!changed) break;
+    }
+
+    std::vector<Value> constants = chunk.constants;
+    compactConstants(code, constants);
+    std::vector<uint8_t> bytes;
+    if (!encode(code, bytes)) return stats;
+
+    chunk.code = std::move(bytes);
+    chunk.constants = std::move(constants);
+    chunk.feedback.assign(chunk.code.size(), TypeFeedback());
+    stats.instructionsAfter = 0;
+    for (const Instruction& instr : code) stats.instructionsAfter += instr.live;
+    stats.constantsAfter = chunk.constants.size();
+    return stats;
+}
+
+bool Peephole::decode(const Chunk& chunk, std::vector<Instruction>& code) {
+    const std::vector<uint8_t>& bytes = chunk.code;
+    std::vector<int> index(bytes.size() + 1, -1);
+    std::vector<size_t> offsets;
+    for (size_t offset = 0; offset < bytes.size();) {
+        Instruction instr;
+        instr.op = (OpCode)bytes[offset];
+        int length = instructionLength(instr.op);
+        if (offset + length > bytes.size()) return false;
+        std::copy(bytes.begin() + offset + 1, bytes.begin() + offset + length, instr.operands);
+        index[offset] = (int)code.size();
+        offsets.push_back(offset);
+        code.push_back(instr);
+        offset += length;
+    }
+
+    for (size_t i = 0; i < code.size(); i++) {
+        Instruction& instr = code[i];
+        if (!isJump(instr.op)) continue;
+        int at = offsetOperand(instr.op);
+        size_t distance = (size_t)((instr.operands[at] << 8) | instr.operands[at + 1]);
+        size_t next = offsets[i] + instructionLength(instr.op);
+        if (instr.op == OpCode::LOOP ? distance > next : next + distance >= bytes.size()) return false;
+        instr.target = index[instr.op == OpCode::LOOP ? next - distance : next + distance];
+        if (instr.target < 0) return false; // Lands inside an instruction
+    }
+    return true;
+}
+
+// Points each jump straight at the end of the chain of unconditional jumps
+// it starts. An unconditional jump takes whichever direction that needs.
+bool Peephole::threadJumps(std::vector<Instruction>& code) {
+    bool changed = false;
+    for (size_t i = 0; i < code.size(); i++) {
+        Instruction& jump = code[i];
+        if (!jump.live || !isJump(jump.op)) continue;
+        int target = jump.target;
+        for (int hops = 0; hops < MAX_HOPS; hops++) {
+            const Instruction& next = code[target];
+            if (next.op != OpCode::JUMP && next.op != OpCode::LOOP) break;
+            if (next.target == target) break;
+            if (isConditional(jump.op) && next.target <= (int)i) break;
+            target = next.target;
+        }
+        if (target == jump.target) continue;
+        jump.target = target;
+        if (!isConditional(jump.op)) jump.op = target > (int)i ? OpCode::JUMP : OpCode::LOOP;
+        changed = true;
+    }
+    return changed;
+}
+
+void Peephole::markLabels(std::vector<Instruction>& code) {
+    for (Instruction& instr : code) instr.label = false;
+    for (const Instruction& instr : code) {
+        if (instr.live && isJump(instr.op)) code[instr.target].label = true;
+    }
+}
+
+// Rewrites sequences within a basic block; a label on any instruction but
+// the first would let a jump skip part of the sequence.
+bool Peephole::rewrite(std::vector<Instruction>& code) {
+    auto nextLive = [&](size_t i) {
+        do { i++; } while (i < code.size() && !code[i].live);
+        return i;
+    };
+    bool changed = false;
+    for (size_t i = 0; i < code.size(); i = nextLive(i)) {
+        Instruction& first = code[i];
+        if (!first.live) continue;
+        size_t j = nextLive(i);
+        if (j == code.size()) break;
+        Instruction& second = code[j];
+
+        // A jump to the next instruction; JUMP_IF_FALSE still pops its condition
+        if (isJump(first.op) && first.target == (int)j && !first.label) {
+            if (first.op == OpCode::JUMP) {
+                first.live = false;
+                changed = true;
+            } else if (first.op == OpCode::JUMP_IF_FALSE) {
+                first.op = OpCode::POP;
+                changed = true;
+            }
+            continue;
+        }
+        if (second.label) continue;
+
+        if (first.op == OpCode::EQUAL && second.op == OpCode::NOT) {
+            first.op = OpCode::NOT_EQUAL;
+            second.live = false;
+            changed = true;
+            continue;
+        }
+
+        // An assignment statement followed by a read of the same variable
+        // keeps the assigned value on the stack instead
+        if ((first.op == OpCode::SET_LOCAL || first.op == OpCode::SET_GLOBAL_SLOT) && second.op == OpCode::POP) {
+            size_t k = nextLive(j);
+            if (k == code.size()) continue;
+            Instruction& third = code[k];
+            bool local = first.op == OpCode::SET_LOCAL;
+            if (third.label || third.op != (local ? OpCode::GET_LOCAL : OpCode::GET_GLOBAL_SLOT)) continue;
+            if (first.operands[0] != third.operands[0] || (!local && first.operands[1] != third.operands[1])) continue;
+            second.live = false;
+            third.live = false;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+bool Peephole::removeUnreachable(std::vector<Instruction>& code) {
+    if (code.empty()) return false;
+    std::vector<bool> reached(code.size(), false);
+    std::vector<size_t> work {0};
+    while (!work.empty()) {
+        size_t i = work.back();
+        work.pop_back();
+        // Instructions a rewrite removed fall through to the next live one
+        while (i < code.size() && !code[i].live) i++;
+        if (i == code.size() || reached[i]) continue;
+        reached[i] = true;
+        if (isJump(code[i].op)) work.push_back(code[i].target);
+        if (!endsBlock(code[i].op)) work.push_back(i + 1);
+    }
+
+    bool changed = false;
+    for (size_t i = 0; i < code.size(); i++) {
+        if (code[i].live && !reached[i]) {
+            code[i].live = false;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// Keeps one copy of each constant any live instruction uses. Constants are
+// compared bit for bit, so 0 and -0 (or the int and double 1) stay apart.
+void Peephole::compactConstants(std::vector<Instruction>& code, std::vector<Value>& constants) {
+    std::vector<Value> kept;
+    std::unordered_map<uint64_t, uint8_t> remap;
+    for (Instruction& instr : code) {
+        int at = constantOperand(instr.op);
+        if (!instr.live || at < 0) continue;
+        Value value = constants[instr.operands[at]];
+        auto found = remap.find(value.v);
+        if (found == remap.end()) {
+            found = remap.emplace(value.v, (uint8_t)kept.size()).first;
+            kept.push_back(value);
+        }
+        instr.operands[at] = found->second;
+    }
+    constants = std::move(kept);
+}
+
+bool Peephole::encode(const std::vector<Instruction>& code, std::vector<uint8_t>& out) {
+    std::vector<size_t> offsets(code.size(), 0);
+    size_t offset = 0;
+    for (size_t i = 0; i < code.size(); i++) {
+        offsets[i] = offset;
+        if (code[i].live) offset += instructionLength(code[i].op);
+    }
+
+    out.clear();
+    out.reserve(offset);
+    for (size_t i = 0; i < code.size(); i++) {
+        const Instruction& instr = code[i];
+        if (!instr.live) continue;
+        int length = instructionLength(instr.op);
+        out.push_back((uint8_t)instr.op);
+        out.insert(out.end(), instr.operands, instr.operands + length - 1);
+        if (!isJump(instr.op)) continue;
+
+        if (!code[instr.target].live) return false;
+        size_t next = offsets[i] + length, target = offsets[instr.target];
+        bool backward = instr.op == OpCode::LOOP;
+        if (backward ? target > next : target < next) return false;
+        size_t distance = backward ? next - target : target - next;
+        if (distance > 0xffff) return false;
+        size_t at = offsets[i] + 1 + offsetOperand(instr.op);
+        out[at] = (distance >> 8) & 0xff;
+        out[at + 1] = distance & 0xff;
+    }
+    return true;
+}
+
+} // namespace kio
@@ -0,0 +1,520 @@
+/*
+Copyright (c) 2026 Dipanjan Dhar
+SPDX-License-Identifier: GPL-3.0-only
+*/
+
+#include "axeon/register_compiler.hpp"
+#include "axeon/memory_manager.hpp"
+#include <algorithm>
+#include <iostream>
+
+namespace kio {
+
+static constexpr int MAX_REGISTERS = 256;
+
+// True if evaluating expr may assign a local. An operand that is a plain
+// local is read in place, so it must be copied first when a later operand
+// could overwrite it (e.g. x + (x = 5)).
+static bool writesLocals(const Expr& expr) {
+    return std::visit([](auto&& node) -> bool {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, Expr::Assign> || std::is_same_v<T, Expr::PostOp>) {
+            return true;
+        } else if constexpr (std::is_same_v<T, Expr::Binary> || std::is_same_v<T, Expr::Logical>) {
+            return writesLocals(*node.left) || writesLocals(*node.right);
+        } else if constexpr (std::is_same_v<T, Expr::Grouping>) {
+            return writesLocals(*node.expression);
+        } else if constexpr (std::is_same_v<T, Expr::Unary>) {
+            return writesLocals(*node.right);
+        } else if constexpr (std::is_same_v<T, Expr::Ternary>) {
+            return writesLocals(*node.condition) || writesLocals(*node.thenExpr) || writesLocals(*node.elseExpr);
+        } else if constexpr (std::is_same_v<T, Expr::Call>) {
+            if (writesLocals(*node.callee)) return true;
+            for (const auto& arg : node.arguments) if (writesLocals(*arg)) return true;
+            return false;
+        } else if constexpr (std::is_same_v<T, Expr::Array>) {
+            for (const auto& element : node.elements) if (writesLocals(*element)) return true;
+            return false;
+        } else if constexpr (std::is_same_v<T, Expr::Get>) {
+            return writesLocals(*node.object);
+        } else if constexpr (std::is_same_v<T, Expr::Set>) {
+            return writesLocals(*node.object) || writesLocals(*node.value);
+        } else if constexpr (std::is_same_v<T, Expr::Index>) {
+            return writesLocals(*node.object) || writesLocals(*node.index);
+        } else if constexpr (std::is_same_v<T, Expr::IndexSet>) {
+            return writesLocals(*node.object) || writesLocals(*node.index) || writesLocals(*node.value);
+        } else {
+            return false;
+        }
+    }, expr.node);
+}
+
+static const Expr& unwrap(const ExprPtr& expr) {
+    const Expr* e = expr.get();
+    while (auto group = std::get_if<Expr::Grouping>(&e->node)) e = group->expression.get();
+    return *e;
+}
+
+RegisterCompiler::RegisterCompiler(FunctionType type) : type_(type) {
+    function_ = allocateObject<ObjFunction>();
+    if (type == FunctionType::TYPE_SCRIPT) {
+        function_->name = "script";
+    }
+
+    // R0 holds the callee, or the receiver of a method
+    locals_.push_back({type == FunctionType::TYPE_METHOD ? "this" : "", 0});
+    freeReg_ = 1;
+    function_->chunk.registerCount = 1;
+}
+
+ObjFunction* RegisterCompiler::compile(const std::vector<StmtPtr>& statements) {
+    // Constants are unreachable from any VM root until the script is running
+    MemoryManager::Pause pause(MemoryManager::heap());
+    for (const auto& stmt : statements) compileStmt(stmt);
+    emit(RegOp::HALT);
+    return hadError_ ? nullptr : function_;
+}
+
+ObjFunction* RegisterCompiler::compileFunction(const std::string& name,
+                                               const std::vector<std::pair<std::string, std::string>>& params,
+                                               const std::vector<StmtPtr>& body, FunctionType type) {
+    RegisterCompiler sub(type);
+    sub.integerGlobals_ = integerGlobals_;
+    sub.function_->name = name;
+    sub.function_->arity = params.size();
+    sub.beginScope();
+    for (const auto& param : params) sub.addLocal(param.first, isIntegerTypeName(param.second));
+    for (const auto& stmt : body) sub.compileStmt(stmt);
+
+    // Falling off the end returns nil
+    int result = sub.allocateRegister();
+    sub.emit(RegOp::LOADNIL, result);
+    sub.emit(RegOp::RETURN, result);
+    if (sub.hadError_) hadError_ = true;
+    return sub.function_;
+}
+
+// --- Emission -----------------------------------------------------------------
+
+int RegisterCompiler::emit(RegOp op, int a, int b, int c, int32_t d) {
+    currentChunk()->registerCode.push_back({op, (uint8_t)a, (uint8_t)b, (uint8_t)c, d});
+    return (int)currentChunk()->registerCode.size() - 1;
+}
+
+void RegisterCompiler::patchJump(int index) {
+    currentChunk()->registerCode[index].d = (int32_t)currentChunk()->registerCode.size() - (index + 1);
+}
+
+void RegisterCompiler::emitLoop(int loopStart) {
+    emit(RegOp::JUMP, 0, 0, 0, loopStart - ((int)currentChunk()->registerCode.size() + 1));
+}
+
+int RegisterCompiler::constant(Value value) { return currentChunk()->addConstant(value); }
+
+int RegisterCompiler::globalSlot(const std::string& name) { return GlobalTable::shared().resolve(name); }
+
+// --- Registers ----------------------------------------------------------------
+
+int RegisterCompiler::allocateRegister() {
+    if (freeReg_ >= MAX_REGISTERS) {
+        if (!hadError_) std::cerr << "Too many registers needed in function '" << function_->name << "'" << std::endl;
+        hadError_ = true;
+        return MAX_REGISTERS - 1;
+    }
+    int reg = freeReg_++;
+    currentChunk()->registerCount = std::max(currentChunk()->registerCount, freeReg_);
+    return reg;
+}
+
+int RegisterCompiler::addLocal(const std::string& name, bool integer) {
+    int reg = allocateRegister();
+    locals_.push_back({name, scopeDepth_, integer});
+    return reg;
+}
+
+int RegisterCompiler::resolveLocal(const std::string& name) {
+    for (int i = locals_.size() - 1; i >= 0; i--) {
+        if (locals_[i].name == name) return i;
+    }
+    return -1;
+}
+
+void RegisterCompiler::endScope() {
+    while (!locals_.empty() && locals_.back().depth == scopeDepth_) locals_.pop_back();
+    scopeDepth_--;
+    releaseTemporaries();
+}
+
+// --- Statements ---------------------------------------------------------------
+
+void RegisterCompiler::compileBlock(const std::vector<StmtPtr>& statements) {
+    beginScope();
+    for (const auto& stmt : statements) compileStmt(stmt);
+    endScope();
+}
+
+void RegisterCompiler::compileStmt(const StmtPtr& stmt) {
+    std::visit([&](auto&& node) {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, Stmt::Print>) {
+            emit(RegOp::PRINT, compileOperand(node.expression));
+        } else if constexpr (std::is_same_v<T, Stmt::Expression>) {
+            compileEffect(node.expression);
+        } else if constexpr (std::is_same_v<T, Stmt::Var>) {
+            if (scopeDepth_ > 0) {
+                // The initializer cannot see the new local, as in Compiler
+                int reg = allocateRegister();
+                if (node.initializer) compileExpr(node.initializer, reg);
+                else emit(RegOp::LOADNIL, reg);
+                locals_.push_back({node.name, scopeDepth_, isIntegerTypeName(node.typeAnnotation)});
+            } else {
+                if (isIntegerTypeName(node.typeAnnotation)) integerGlobals_.insert(node.name);
+                int reg = compileOperand(node.initializer);
+                emit(RegOp::SET_GLOBAL, reg, 0, 0, globalSlot(node.name));
+            }
+        } else if constexpr (std::is_same_v<T, Stmt::Function>) {
+            ObjFunction* function = compileFunction(node.name, node.params, node.body, FunctionType::TYPE_FUNCTION);
+            int reg = scopeDepth_ > 0 ? addLocal(node.name) : allocateRegister();
+            emit(RegOp::LOADK, reg, 0, 0, constant(objToValue(function)));
+            if (scopeDepth_ == 0) emit(RegOp::SET_GLOBAL, reg, 0, 0, globalSlot(node.name));
+        } else if constexpr (std::is_same_v<T, Stmt::Return>) {
+            int reg;
+            auto call = node.value ? std::get_if<Expr::Call>(&unwrap(node.value).node) : nullptr;
+            if (call && type_ != FunctionType::TYPE_SCRIPT) {
+                reg = allocateRegister();
+                compileCall(*call, reg, true);
+            } else if (node.value) {
+                reg = compileOperand(node.value);
+            } else {
+                reg = allocateRegister();
+                emit(RegOp::LOADNIL, reg);
+            }
+            emit(RegOp::RETURN, reg);
+        } else if constexpr (std::is_same_v<T, Stmt::Class>) {
+            int reg = scopeDepth_ > 0 ? addLocal(node.name) : allocateRegister();
+            emit(RegOp::CLASS, reg, 0, 0, constant(objToValue(internString(node.name))));
+            if (scopeDepth_ == 0) emit(RegOp::SET_GLOBAL, reg, 0, 0, globalSlot(node.name));
+            for (const auto& m : node.methods) {
+                if (auto func = std::get_if<Stmt::Function>(&m->node)) {
+                    ObjFunction* method = compileFunction(func->name, func->params, func->body, FunctionType::TYPE_METHOD);
+                    int tmp = allocateRegister();
+                    emit(RegOp::LOADK, tmp, 0, 0, constant(objToValue(method)));
+                    emit(RegOp::METHOD, reg, tmp, 0, constant(objToValue(internString(func->name))));
+                    freeReg_ = tmp;
+                }
+            }
+        } else if constexpr (std::is_same_v<T, Stmt::If>) {
+            int thenJump = compileConditionJump(node.condition);
+            compileStmt(node.thenBranch);
+            if (node.elseBranch) {
+                int elseJump = emit(RegOp::JUMP);
+                patchJump(thenJump);
+                compileStmt(node.elseBranch);
+                patchJump(elseJump);
+            } else {
+                patchJump(thenJump);
+            }
+        } else if constexpr (std::is_same_v<T, Stmt::While>) {
+            int loopStart = currentChunk()->registerCode.size();
+            int exitJump = compileConditionJump(node.condition);
+            compileStmt(node.body);
+            emitLoop(loopStart);
+            patchJump(exitJump);
+        } else if constexpr (std::is_same_v<T, Stmt::Block>) {
+            compileBlock(node.statements);
+        } else if constexpr (std::is_same_v<T, Stmt::ForIn>) {
+            // for name in limit: counts name from 0 while name < limit
+            beginScope();
+            int counter = addLocal(node.name, true);
+            emit(RegOp::LOADK, counter, 0, 0, constant(intToValue(0)));
+            int limit = allocateRegister();
+            compileExpr(node.iterable, limit);
+            locals_.push_back({"_limit", scopeDepth_});
+            int loopStart = currentChunk()->registerCode.size();
+            int exitJump = emit(isIntExpr(node.iterable) ? RegOp::JUMP_IF_NOT_LESS_INT : RegOp::JUMP_IF_NOT_LESS, 0, counter, limit);
+            compileStmt(node.body);
+            emit(RegOp::ADDK, counter, counter, 0, constant(intToValue(1)));
+            emitLoop(loopStart);
+            patchJump(exitJump);
+            endScope();
+        } else if constexpr (std::is_same_v<T, Stmt::For>) {
+            beginScope();
+            if (node.initializer) compileStmt(node.initializer);
+            int loopStart = currentChunk()->registerCode.size();
+            int exitJump = -1;
+            if (node.condition) exitJump = compileConditionJump(node.condition);
+            compileStmt(node.body);
+            if (node.increment) compileEffect(node.increment);
+            emitLoop(loopStart);
+            if (exitJump != -1) patchJump(exitJump);
+            endScope();
+        }
+    }, stmt->node);
+    releaseTemporaries();
+}
+
+// Compiles a branch condition and the jump taken when it is false. Returns
+// the jump's index for patchJump().
+int RegisterCompiler::compileConditionJump(const ExprPtr& condition) {
+    int saved = freeReg_;
+    int jump = -1;
+    const Expr& cond = unwrap(condition);
+    auto binary = std::get_if<Expr::Binary>(&cond.node);
+    TokenType op = binary ? binary->op.type : TokenType::END_OF_FILE;
+    bool relational = op == TokenType::LESS || op == TokenType::LESS_EQUAL ||
+                      op == TokenType::GREATER || op == TokenType::GREATER_EQUAL;
+
+    if (relational && std::holds_alternative<Expr::Literal>(unwrap(binary->right).node) &&
+        std::holds_alternative<double>(std::get<Expr::Literal>(unwrap(binary->right).node).value) &&
+        currentChunk()->constants.size() < 256) {
+        int left = compileOperand(binary->left);
+        const auto& literal = std::get<Expr::Literal>(unwrap(binary->right).node);
+        int k = constant(literalToValue(std::get<double>(literal.value), literal.integer));
+        RegOp jumpOp = op == TokenType::LESS ? RegOp::JUMP_IF_NOT_LESSK
+                     : op == TokenType::LESS_EQUAL ? RegOp::JUMP_IF_NOT_LESS_EQUALK
+                     : op == TokenType::GREATER ? RegOp::JUMP_IF_NOT_GREATERK : RegOp::JUMP_IF_NOT_GREATER_EQUALK;
+        jump = emit(jumpOp, 0, left, k);
+    } else if (relational || op == TokenType::EQUAL_EQUAL || op == TokenType::BANG_EQUAL) {
+        bool integer = isIntExpr(binary->left) && isIntExpr(binary->right);
+        RegOp less = integer ? RegOp::JUMP_IF_NOT_LESS_INT : RegOp::JUMP_IF_NOT_LESS;
+        RegOp lessEqual = integer ? RegOp::JUMP_IF_NOT_LESS_EQUAL_INT : RegOp::JUMP_IF_NOT_LESS_EQUAL;
+        int left = compileOperand(binary->left, writesLocals(*binary->right));
+        int right = compileOperand(binary->right);
+        switch (op) {
+            case TokenType::LESS:          jump = emit(less, 0, left, right); break;
+            case TokenType::LESS_EQUAL:    jump = emit(lessEqual, 0, left, right); break;
+            case TokenType::GREATER:       jump = emit(less, 0, right, left); break;
+            case TokenType::GREATER_EQUAL: jump = emit(lessEqual, 0, right, left); break;
+            case TokenType::EQUAL_EQUAL:   jump = emit(RegOp::JUMP_IF_NOT_EQUAL, 0, left, right); break;
+            default:                       jump = emit(RegOp::JUMP_IF_EQUAL, 0, left, right); break;
+        }
+    } else if (auto unary = std::get_if<Expr::Unary>(&cond.node); unary && unary->op.type == TokenType::BANG) {
+        jump = emit(RegOp::JUMP_IF_TRUE, compileOperand(unary->right));
+    } else {
+        jump = emit(RegOp::JUMP_IF_FALSE, compileOperand(condition));
+    }
+    freeReg_ = saved;
+    return jump;
+}
+
+// --- Expressions --------------------------------------------------------------
+
+// True if expr is statically an int, as in Compiler::isIntExpr().
+bool RegisterCompiler::isIntExpr(const ExprPtr& expr) {
+    const Expr& e = unwrap(expr);
+    if (auto literal = std::get_if<Expr::Literal>(&e.node)) {
+        return literal->integer && isInt(literalToValue(std::get<double>(literal->value), true));
+    }
+    if (auto var = std::get_if<Expr::Variable>(&e.node)) {
+        int local = resolveLocal(var->name);
+        return local != -1 ? locals_[local].integer : integerGlobals_.count(var->name) > 0;
+    }
+    if (auto unary = std::get_if<Expr::Unary>(&e.node)) {
+        return unary->op.type == TokenType::MINUS && isIntExpr(unary->right);
+    }
+    if (auto binary = std::get_if<Expr::Binary>(&e.node)) {
+        TokenType op = binary->op.type;
+        bool arithmetic = op == TokenType::PLUS || op == TokenType::MINUS || op == TokenType::STAR || op == TokenType::PERCENT;
+        return arithmetic && isIntExpr(binary->left) && isIntExpr(binary->right);
+    }
+    return false;
+}
+
+// Compiles an expression whose value is discarded.
+void RegisterCompiler::compileEffect(const ExprPtr& expr) {
+    if (auto assign = std::get_if<Expr::Assign>(&expr->node)) {
+        int local = resolveLocal(assign->name);
+        if (local != -1) {
+            compileAssign(assign->value, local);
+        } else {
+            emit(RegOp::SET_GLOBAL, compileOperand(assign->value), 0, 0, globalSlot(assign->name));
+        }
+        return;
+    }
+    compileExpr(expr, allocateRegister());
+}
+
+// Evaluates value straight into a local's register. Expressions that write
+// their destination before they are done reading (and/or, ?:, x++) go
+// through a temporary so the local keeps its old value until then.
+void RegisterCompiler::compileAssign(const ExprPtr& value, int local) {
+    const Expr& v = unwrap(value);
+    if (std::holds_alternative<Expr::Logical>(v.node) || std::holds_alternative<Expr::Ternary>(v.node) ||
+        std::holds_alternative<Expr::PostOp>(v.node)) {
+        int tmp = allocateRegister();
+        compileExpr(value, tmp);
+        emit(RegOp::MOVE, local, tmp);
+        freeReg_ = tmp;
+        return;
+    }
+    compileExpr(value, local);
+}
+
+// Returns a register holding the value of expr: a local's own register when
+// possible, otherwise a new temporary.
+int RegisterCompiler::compileOperand(const ExprPtr& expr, bool copyLocals) {
+    if (!copyLocals) {
+        if (auto var = std::get_if<Expr::Variable>(&unwrap(expr).node)) {
+            int local = resolveLocal(var->name);
+            if (local != -1) return local;
+        }
+    }
+    int reg = allocateRegister();
+    compileExpr(expr, reg);
+    return reg;
+}
+
+void RegisterCompiler::compileCall(const Expr::Call& call, int dst, bool tail) {
+    if (auto var = std::get_if<Expr::Variable>(&call.callee->node)) {
+        if (var->name == "floor" && !call.arguments.empty()) { emit(RegOp::FLOOR, dst, compileOperand(call.arguments[0])); return; }
+        if (var->name == "sqrt" && !call.arguments.empty()) { emit(RegOp::SQRT, dst, compileOperand(call.arguments[0])); return; }
+    }
+
+    // Callee (or receiver) and arguments go to consecutive registers, which
+    // become R0.. of the callee's frame
+    int base = allocateRegister();
+    auto get = std::get_if<Expr::Get>(&call.callee->node);
+    compileExpr(get ? get->object : call.callee, base);
+    for (const auto& arg : call.arguments) compileExpr(arg, allocateRegister());
+    if (get) {
+        emit(RegOp::INVOKE, base, (int)call.arguments.size(), currentChunk()->addCache(),
+             constant(objToValue(internString(get->name))));
+    } else {
+        emit(tail ? RegOp::TAIL_CALL : RegOp::CALL, base, (int)call.arguments.size());
+    }
+    if (dst != base) emit(RegOp::MOVE, dst, base);
+}
+
+void RegisterCompiler::compileExpr(const ExprPtr& expr, int dst) {
+    int saved = freeReg_;
+    std::visit([&](auto&& node) {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, Expr::Literal>) {
+            if (std::holds_alternative<double>(node.value)) {
+                emit(RegOp::LOADK, dst, 0, 0, constant(literalToValue(std::get<double>(node.value), node.integer)));
+            } else {
+                const std::string& s = std::get<std::string>(node.value);
+                if (s == "true") emit(RegOp::LOADTRUE, dst);
+                else if (s == "false") emit(RegOp::LOADFALSE, dst);
+                else if (s == "") emit(RegOp::LOADNIL, dst);
+                else emit(RegOp::LOADK, dst, 0, 0, constant(objToValue(internString(s))));
+            }
+        } else if constexpr (std::is_same_v<T, Expr::Variable>) {
+            int local = resolveLocal(node.name);
+            if (local == -1) emit(RegOp::GET_GLOBAL, dst, 0, 0, globalSlot(node.name));
+            else if (local != dst) emit(RegOp::MOVE, dst, local);
+        } else if constexpr (std::is_same_v<T, Expr::Grouping>) {
+            compileExpr(node.expression, dst);
+        } else if constexpr (std::is_same_v<T, Expr::Binary>) {
+            TokenType op = node.op.type;
+            auto literal = std::get_if<Expr::Literal>(&unwrap(node.right).node);
+            if (literal && (op == TokenType::PLUS || op == TokenType::MINUS || op == TokenType::STAR)) {
+                // Only literals that load a constant (not true/false/"")
+                const std::string* str = std::get_if<std::string>(&literal->value);
+                bool isNumber = std::holds_alternative<double>(literal->value);
+                if (isNumber || (op == TokenType::PLUS && str && *str != "" && *str != "true" && *str != "false")) {
+                    int left = compileOperand(node.left);
+                    Value k = isNumber ? literalToValue(std::get<double>(literal->value), literal->integer) : objToValue(internString(*str));
+                    RegOp kop = op == TokenType::PLUS ? RegOp::ADDK : op == TokenType::MINUS ? RegOp::SUBTRACTK : RegOp::MULTIPLYK;
+                    emit(kop, dst, left, 0, constant(k));
+                    return;
+                }
+            }
+            bool integer = isIntExpr(node.left) && isIntExpr(node.right);
+            int left = compileOperand(node.left, writesLocals(*node.right));
+            int right = compileOperand(node.right);
+            switch (op) {
+                case TokenType::PLUS:          emit(integer ? RegOp::ADD_INT : RegOp::ADD, dst, left, right); break;
+                case TokenType::MINUS:         emit(integer ? RegOp::SUBTRACT_INT : RegOp::SUBTRACT, dst, left, right); break;
+                case TokenType::STAR:          emit(integer ? RegOp::MULTIPLY_INT : RegOp::MULTIPLY, dst, left, right); break;
+                case TokenType::SLASH:         emit(RegOp::DIVIDE, dst, left, right); break;
+                case TokenType::PERCENT:       emit(integer ? RegOp::MODULO_INT : RegOp::MODULO, dst, left, right); break;
+                case TokenType::LESS:          emit(integer ? RegOp::LESS_INT : RegOp::LESS, dst, left, right); break;
+                case TokenType::LESS_EQUAL:    emit(integer ? RegOp::LESS_EQUAL_INT : RegOp::LESS_EQUAL, dst, left, right); break;
+                case TokenType::GREATER:       emit(integer ? RegOp::LESS_INT : RegOp::LESS, dst, right, left); break;
+                case TokenType::GREATER_EQUAL: emit(integer ? RegOp::LESS_EQUAL_INT : RegOp::LESS_EQUAL, dst, right, left); break;
+                case TokenType::EQUAL_EQUAL:   emit(RegOp::EQUAL, dst, left, right); break;
+                case TokenType::BANG_EQUAL:    emit(RegOp::NOT_EQUAL, dst, left, right); break;
+                default:
+                    std::cerr << "Unknown operator in compiler: " << (int)op << std::endl;
+                    emit(RegOp::LOADNIL, dst);
+                    break;
+            }
+        } else if constexpr (std::is_same_v<T, Expr::Assign>) {
+            int local = resolveLocal(node.name);
+            if (local != -1) {
+                compileAssign(node.value, local);
+                if (local != dst) emit(RegOp::MOVE, dst, local);
+            } else {
+                compileExpr(node.value, dst);
+                emit(RegOp::SET_GLOBAL, dst, 0, 0, globalSlot(node.name));
+            }
+        } else if constexpr (std::is_same_v<T, Expr::Logical>) {
+            compileExpr(node.left, dst);
+            int skip = emit(node.op.type == TokenType::AND ? RegOp::JUMP_IF_FALSE : RegOp::JUMP_IF_TRUE, dst);
+            compileExpr(node.right, dst);
+            patchJump(skip);
+        } else if constexpr (std::is_same_v<T, Expr::Ternary>) {
+            int elseJump = compileConditionJump(node.condition);
+            compileExpr(node.thenExpr, dst);
+            int endJump = emit(RegOp::JUMP);
+            patchJump(elseJump);
+            compileExpr(node.elseExpr, dst);
+            patchJump(endJump);
+        } else if constexpr (std::is_same_v<T, Expr::Unary>) {
+            emit(node.op.type == TokenType::MINUS ? RegOp::NEGATE : RegOp::NOT, dst, compileOperand(node.right));
+        } else if constexpr (std::is_same_v<T, Expr::PostOp>) {
+            // Yields the old value
+            int k = constant(intToValue(node.op.type == TokenType::PLUS_PLUS ? 1 : -1));
+            int local = resolveLocal(node.name);
+            if (local != -1) {
+                emit(RegOp::MOVE, dst, local);
+                emit(RegOp::ADDK, local, local, 0, k);
+            } else {
+                int tmp = allocateRegister();
+                emit(RegOp::GET_GLOBAL, dst, 0, 0, globalSlot(node.name));
+                emit(RegOp::ADDK, tmp, dst, 0, k);
+                emit(RegOp::SET_GLOBAL, tmp, 0, 0, globalSlot(node.name));
+            }
+        } else if constexpr (std::is_same_v<T, Expr::Call>) {
+            compileCall(node, dst);
+        } else if constexpr (std::is_same_v<T, Expr::Get>) {
+            emit(RegOp::GET_PROPERTY, dst, compileOperand(node.object), currentChunk()->addCache(),
+                 constant(objToValue(internString(node.name))));
+        } else if constexpr (std::is_same_v<T, Expr::Set>) {
+            int object = compileOperand(node.object, writesLocals(*node.value));
+            int value = compileOperand(node.value);
+            emit(RegOp::SET_PROPERTY, object, value, currentChunk()->addCache(), constant(objToValue(internString(node.name))));
+            if (value != dst) emit(RegOp::MOVE, dst, value);
+        } else if constexpr (std::is_same_v<T, Expr::This>) {
+            int local = resolveLocal("this");
+            if (local != -1) emit(RegOp::MOVE, dst, local);
+            else emit(RegOp::LOADNIL, dst);
+        } else if constexpr (std::is_same_v<T, Expr::SysQuery>) {
+            emit(RegOp::SYS_QUERY, dst, 0, 0, constant(objToValue(internString(node.key))));
+        } else if constexpr (std::is_same_v<T, Expr::Array>) {
+            int base = freeReg_;
+            for (const auto& element : node.elements) compileExpr(element, allocateRegister());
+            emit(RegOp::ARRAY_NEW, dst, base, (int)node.elements.size());
+        } else if constexpr (std::is_same_v<T, Expr::Index>) {
+            int object = compileOperand(node.object, writesLocals(*node.index));
+            int index = compileOperand(node.index);
+            emit(RegOp::ARRAY_GET, dst, object, index);
+        } else if constexpr (std::is_same_v<T, Expr::IndexSet>) {
+            bool later = writesLocals(*node.index) || writesLocals(*node.value);
+            int object = compileOperand(node.object, later);
+            int index = compileOperand(node.index, writesLocals(*node.value));
+            int value = compileOperand(node.value);
+            emit(RegOp::ARRAY_SET, object, index, value);
+            if (value != dst) emit(RegOp::MOVE, dst, value);
+        } else if constexpr (std::is_same_v<T, Expr::Lambda>) {
+            ObjFunction* function = compileFunction("lambda", node.params, node.body, FunctionType::TYPE_FUNCTION);
+            emit(RegOp::LOADK, dst, 0, 0, constant(objToValue(function)));
+        } else {
+            emit(RegOp::LOADNIL, dst);
+        }
+    }, expr->node);
+    freeReg_ = saved;
+}
+
+} // namespace kio
@@ -13,8 +13,6 @@
 #include "axeon/tracing_jit.hpp"
 #include <cstring>
 #include <iostream>
-#include <sys/mman.h>
-#include <unistd.h>
 
 #ifdef KIO_JIT_ENABLED
 
@@ -76,335 +74,8 @@ bool Trace::canEliminateTypeChecks() const {
     return first_type != ValueType::VAL_NIL;
 }
 
-// ============================================================================
-// CodeBuffer Implementation
-// ============================================================================
-
-CodeBuffer::CodeBuffer(size_t size) : size_(size), offset_(0) {
-    allocateExecutableMemory();
-}
-
-CodeBuffer::~CodeBuffer() {
-    if (buffer_) {
-        munmap(buffer_, size_);
-    }
-}
-
-bool CodeBuffer::allocateExecutableMemory() {
-    buffer_ = mmap(nullptr, size_, PROT_READ | PROT_WRITE | PROT_EXEC,
-                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    return buffer_ != MAP_FAILED;
-}
-
-void CodeBuffer::makeExecutable() {
-    mprotect(buffer_, size_, PROT_READ | PROT_EXEC);
-}
-
-void CodeBuffer::emitByte(uint8_t byte) {
-    if (offset_ < size_) {
-        static_cast<uint8_t*>(buffer_)[offset_++] = byte;
-    }
-}
-
-void CodeBuffer::emitBytes(const uint8_t* bytes, size_t count) {
-    if (offset_ + count <= size_) {
-        memcpy(static_cast<uint8_t*>(buffer_) + offset_, bytes, count);
-        offset_ += count;
-    }
-}
-
-void CodeBuffer::emitInt32(int32_t value) {
-    emitBytes(reinterpret_cast<uint8_t*>(&value), 4);
-}
-
-void CodeBuffer::emitInt64(int64_t value) {
-    emitBytes(reinterpret_cast<uint8_t*>(&value), 8);
-}
-
-void CodeBuffer::emitDouble(double value) {
-    emitBytes(reinterpret_cast<uint8_t*>(&value), 8);
-}
-
-void* CodeBuffer::finalize() {
-    makeExecutable();
-    return buffer_;
-}
-
-// ============================================================================
-// NativeCodeGenerator Implementation
-// ============================================================================
-
-NativeCodeGenerator::NativeCodeGenerator(CodeBuffer& buffer) : buffer_(buffer) {}
-
-void NativeCodeGenerator::emitPrologue() {
-    // Save callee-saved registers
-    buffer_.emitByte(0x53);  // push rbx
-    buffer_.emitByte(0x41); buffer_.emitByte(0x54);  // push r12
-    buffer_.emitByte(0x41); buffer_.emitByte(0x55);  // push r13
-    buffer_.emitByte(0x41); buffer_.emitByte(0x56);  // push r14
-    buffer_.emitByte(0x41); buffer_.emitByte(0x57);  // push r15
-}
-
-void NativeCodeGenerator::emitEpilogue() {
-    // Restore callee-saved registers
-    buffer_.emitByte(0x41); buffer_.emitByte(0x5F);  // pop r15
-    buffer_.emitByte(0x41); buffer_.emitByte(0x5E);  // pop r14
-    buffer_.emitByte(0x41); buffer_.emitByte(0x5D);  // pop r13
-    buffer_.emitByte(0x41); buffer_.emitByte(0x5C);  // pop r12
-    buffer_.emitByte(0x5B);  // pop rbx
-    buffer_.emitByte(0xC3);  // ret
-}
-
-void NativeCodeGenerator::emitMov(Register dest, Register src) {
-    emitREX(true, false, false, regToBits(dest) >> 3);
-    buffer_.emitByte(0x8B);
-    emitModRM(0b11, regToBits(dest) & 7, regToBits(src) & 7);
-}
-
-void NativeCodeGenerator::emitMov(Register reg, int64_t imm) {
-    emitREX(true, false, false, regToBits(reg) >> 3);
-    buffer_.emitByte(0xB8 | (regToBits(reg) & 7));
-    buffer_.emitInt64(imm);
-}
-
-void NativeCodeGenerator::emitMov(Register reg, void* addr) {
-    emitREX(true, false, false, regToBits(reg) >> 3);
-    buffer_.emitByte(0x48);  // REX.W
-    buffer_.emitByte(0x8B);
-    emitModRM(0b00, regToBits(reg) & 7, 0b101);  // [rip+disp32]
-    int64_t disp = reinterpret_cast<int64_t>(addr) - 
-                   reinterpret_cast<int64_t>(buffer_.getBuffer()) - 
-                   buffer_.getOffset() - 4;
-    buffer_.emitInt32(static_cast<int32_t>(disp));
-}
-
-void NativeCodeGenerator::emitMov(void* addr, Register reg) {
-    emitREX(true, false, false, regToBits(reg) >> 3);
-    buffer_.emitByte(0x48);  // REX.W
-    buffer_.emitByte(0x89);
-    emitModRM(0b00, regToBits(reg) & 7, 0b101);  // [rip+disp32]
-    int64_t disp = reinterpret_cast<int64_t>(addr) - 
-                   reinterpret_cast<int64_t>(buffer_.getBuffer()) - 
-                   buffer_.getOffset() - 4;
-    buffer_.emitInt32(static_cast<int32_t>(disp));
-}
-
-void NativeCodeGenerator::emitPush(Register reg) {
-    buffer_.emitByte(0x50 | (regToBits(reg) & 7));
-}
-
-void NativeCodeGenerator::emitPop(Register reg) {
-    buffer_.emitByte(0x58 | (regToBits(reg) & 7));
-}
-
-void NativeCodeGenerator::emitAdd(Register reg, int32_t imm) {
-    emitREX(true, false, false, regToBits(reg) >> 3);
-    buffer_.emitByte(0x83);
-    emitModRM(0b11, 0b000, regToBits(reg) & 7);
-    buffer_.emitByte(static_cast<uint8_t>(imm));
-}
-
-void NativeCodeGenerator::emitSub(Register reg, int32_t imm) {
-    emitREX(true, false, false, regToBits(reg) >> 3);
-    buffer_.emitByte(0x83);
-    emitModRM(0b11, 0b101, regToBits(reg) & 7);
-    buffer_.emitByte(static_cast<uint8_t>(imm));
-}
-
-void NativeCodeGenerator::emitAddSD(Register xmm_dest, Register xmm_src) {
-    buffer_.emitByte(0xF2);  // F2 prefix
-    emitREX(false, regToBits(xmm_src) >> 3, false, regToBits(xmm_dest) >> 3);
-    buffer_.emitByte(0x0F);
-    buffer_.emitByte(0x58);
-    emitModRM(0b11, regToBits(xmm_dest) & 7, regToBits(xmm_src) & 7);
-}
-
-void NativeCodeGenerator::emitSubSD(Register xmm_dest, Register xmm_src) {
-    buffer_.emitByte(0xF2);  // F2 prefix
-    emitREX(false, regToBits(xmm_src) >> 3, false, regToBits(xmm_dest) >> 3);
-    buffer_.emitByte(0x0F);
-    buffer_.emitByte(0x5C);
-    emitModRM(0b11, regToBits(xmm_dest) & 7, regToBits(xmm_src) & 7);
-}
-
-void NativeCodeGenerator::emitMulSD(Register xmm_dest, Register xmm_src) {
-    buffer_.emitByte(0xF2);  // F2 prefix
-    emitREX(false, regToBits(xmm_src) >> 3, false, regToBits(xmm_dest) >> 3);
-    buffer_.emitByte(0x0F);
-    buffer_.emitByte(0x59);
-    emitModRM(0b11, regToBits(xmm_dest) & 7, regToBits(xmm_src) & 7);
-}
-
-void NativeCodeGenerator::emitDivSD(Register xmm_dest, Register xmm_src) {
-    buffer_.emitByte(0xF2);  // F2 prefix
-    emitREX(false, regToBits(xmm_src) >> 3, false, regToBits(xmm_dest) >> 3);
-    buffer_.emitByte(0x0F);
-    buffer_.emitByte(0x5E);
-    emitModRM(0b11, regToBits(xmm_dest) & 7, regToBits(xmm_src) & 7);
-}
-
-void NativeCodeGenerator::emitVAddPD(Register ymm_dest, Register ymm_src1, Register ymm_src2) {
-    buffer_.emitByte(0xC5);  // VEX prefix
-    emitREX(false, regToBits(ymm_src2) >> 3, false, regToBits(ymm_src1) >> 3);
-    buffer_.emitByte(0x58);
-    emitModRM(0b11, regToBits(ymm_dest) & 7, regToBits(ymm_src2) & 7);
-}
-
-void NativeCodeGenerator::emitVMulPD(Register ymm_dest, Register ymm_src1, Register ymm_src2) {
-    buffer_.emitByte(0xC5);  // VEX prefix
-    emitREX(false, regToBits(ymm_src2) >> 3, false, regToBits(ymm_src1) >> 3);
-    buffer_.emitByte(0x59);
-    emitModRM(0b11, regToBits(ymm_dest) & 7, regToBits(ymm_src2) & 7);
-}
-
-void NativeCodeGenerator::emitVLoadPD(Register ymm_dest, void* addr) {
-    buffer_.emitByte(0xC5);  // VEX prefix
-    buffer_.emitByte(0xFD);  // VEX.LIG.F2.0F.WIG
-    buffer_.emitByte(0x6F);
-    emitModRM(0b00, regToBits(ymm_dest) & 7, 0b101);  // [rip+disp32]
-    int64_t disp = reinterpret_cast<int64_t>(addr) - 
-                   reinterpret_cast<int64_t>(buffer_.getBuffer()) - 
-                   buffer_.getOffset() - 4;
-    buffer_.emitInt32(static_cast<int32_t>(disp));
-}
-
-void NativeCodeGenerator::emitVStorePD(void* addr, Register ymm_src) {
-    buffer_.emitByte(0xC5);  // VEX prefix
-    buffer_.emitByte(0xFD);  // VEX.LIG.F2.0F.WIG
-    buffer_.emitByte(0x7F);
-    emitModRM(0b00, regToBits(ymm_src) & 7, 0b101);  // [rip+disp32]
-    int64_t disp = reinterpret_cast<int64_t>(addr) - 
-                   reinterpret_cast<int64_t>(buffer_.getBuffer()) - 
-                   buffer_.getOffset() - 4;
-    buffer_.emitInt32(static_cast<int32_t>(disp));
-}
-
-void NativeCodeGenerator::emitCmp(Register reg1, Register reg2) {
-    emitREX(true, false, false, regToBits(reg2) >> 3);
-    buffer_.emitByte(0x3B);
-    emitModRM(0b11, regToBits(reg1) & 7, regToBits(reg2) & 7);
-}
-
-void NativeCodeGenerator::emitJump(void* target) {
-    buffer_.emitByte(0xE9);  // jmp rel32
-    int64_t disp = reinterpret_cast<int64_t>(target) - 
-                   reinterpret_cast<int64_t>(buffer_.getBuffer()) - 
-                   buffer_.getOffset() - 4;
-    buffer_.emitInt32(static_cast<int32_t>(disp));
-}
-
-void NativeCodeGenerator::emitJumpIfEqual(void* target) {
-    buffer_.emitByte(0x0F); buffer_.emitByte(0x84);  // je rel32
-    int64_t disp = reinterpret_cast<int64_t>(target) - 
-                   reinterpret_cast<int64_t>(buffer_.getBuffer()) - 
-                   buffer_.getOffset() - 4;
-    buffer_.emitInt32(static_cast<int32_t>(disp));
-}
-
-void NativeCodeGenerator::emitJumpIfNotEqual(void* target) {
-    buffer_.emitByte(0x0F); buffer_.emitByte(0x85);  // jne rel32
-    int64_t disp = reinterpret_cast<int64_t>(target) - 
-                   reinterpret_cast<int64_t>(buffer_.getBuffer()) - 
-                   buffer_.getOffset() - 4;
-    buffer_.emitInt32(static_cast<int32_t>(disp));
-}
-
-void NativeCodeGenerator::emitJumpIfGreater(void* target) {
-    buffer_.emitByte(0x0F); buffer_.emitByte(0x8F);  // jg rel32
-    int64_t disp = reinterpret_cast<int64_t>(target) - 
-                   reinterpret_cast<int64_t>(buffer_.getBuffer()) - 
-                   buffer_.getOffset() - 4;
-    buffer_.emitInt32(static_cast<int32_t>(disp));
-}
-
-void NativeCodeGenerator::emitJumpIfLess(void* target) {
-    buffer_.emitByte(0x0F); buffer_.emitByte(0x8C);  // jl rel32
-    int64_t disp = reinterpret_cast<int64_t>(target) - 
-                   reinterpret_cast<int64_t>(buffer_.getBuffer()) - 
-                   buffer_.getOffset() - 4;
-    buffer_.emitInt32(static_cast<int32_t>(disp));
-}
-
-void NativeCodeGenerator::emitTypeCheck(Register reg, ValueType expected_type, bool can_eliminate) {
-    if (can_eliminate) {
-        // Type check can be eliminated - no code generated
-        return;
-    }
-    
-    // Generate type check code
-    // This would check the type tag in the value
-    // For simplicity, we'll skip the actual implementation
-}
-
-void NativeCodeGenerator::emitLoadValue(Register xmm_reg, Register stack_ptr, int offset) {
-    // Load double from stack
-    buffer_.emitByte(0xF2);  // F2 prefix
-    emitREX(false, false, false, regToBits(stack_ptr) >> 3);
-    buffer_.emitByte(0x0F);
-    buffer_.emitByte(0x10);  // movsd xmm, m64
-    emitModRM(0b01, regToBits(xmm_reg) & 7, regToBits(stack_ptr) & 7);
-    buffer_.emitByte(static_cast<uint8_t>(offset));
-}
-
-void NativeCodeGenerator::emitStoreValue(Register stack_ptr, int offset, Register xmm_reg) {
-    // Store double to stack
-    buffer_.emitByte(0xF2);  // F2 prefix
-    emitREX(false, false, false, regToBits(stack_ptr) >> 3);
-    buffer_.emitByte(0x0F);
-    buffer_.emitByte(0x11);  // movsd m64, xmm
-    emitModRM(0b01, regToBits(xmm_reg) & 7, regToBits(stack_ptr) & 7);
-    buffer_.emitByte(static_cast<uint8_t>(offset));
-}
-
-void NativeCodeGenerator::emitLoopStart(Register counter_reg, int limit) {
-    // Initialize counter
-    emitMov(counter_reg, 0);
-}
-
-void NativeCodeGenerator::emitLoopEnd(void* loop_start) {
-    // Decrement counter and jump if not zero
-    // For simplicity, we'll just jump back
-    emitJump(loop_start);
-}
-
-void NativeCodeGenerator::emitREX(bool w, bool r, bool x, bool b) {
-    uint8_t rex = 0x40;
-    if (w) rex |= 0x08;
-    if (r) rex |= 0x04;
-    if (x) rex |= 0x02;
-    if (b) rex |= 0x01;
-    buffer_.emitByte(rex);
-}
-
-void NativeCodeGenerator::emitModRM(uint8_t mod, uint8_t reg, uint8_t rm) {
-    buffer_.emitByte((mod << 6) | (reg << 3) | rm);
-}
-
-void NativeCodeGenerator::emitSIB(uint8_t scale, uint8_t index, uint8_t base) {
-    buffer_.emitByte((scale << 6) | (index << 3) | base);
-}
-
-uint8_t NativeCodeGenerator::regToBits(Register reg) {
-    switch (reg) {
-        case Register::RAX: return 0;
-        case Register::RCX: return 1;
-        case Register::RDX: return 2;
-        case Register::RBX: return 3;
-        case Register::RSP: return 4;
-        case Register::RBP: return 5;
-        case Register::RSI: return 6;
-        case Register::RDI: return 7;
-        case Register::R8:  return 8;
-        case Register::R9:  return 9;
-        case Register::R10: return 10;
-        case Register::R11: return 11;
-        case Register::R12: return 12;
-        case Register::R13: return 13;
-        case Register::R14: return 14;
-        case Register::R15: return 15;
-        default: return 0;
-    }
-}
+// CodeBuffer and NativeCodeGenerator are built on their own, in
+// native_codegen.cpp, for the baseline JIT.
 
 // ============================================================================
 // TracingJIT Implementation
@@ -434,11 +105,11 @@ void TracingJIT::recordInstruction(OpCode opcode, uint8_t* ip) {
     current_trace_->addInstruction(opcode, ip);
 }
 
-void TracingJIT::recordType(int stack_slot, ValueType type) {
+void TracingJIT::recordType(int stack_slot, Value value) {
     if (state_ != TraceState::RECORDING) return;
     
-    type_feedback_[stack_slot].record(type);
-    current_trace_->addOperandType(type);
+    type_feedback_[stack_slot].record(value);
+    current_trace_->addOperandType(isNumber(value) ? ValueType::VAL_NUMBER : isObj(value) ? ValueType::VAL_OBJ : ValueType::VAL_NIL);
 }
 
 TracingJIT::CompiledTrace TracingJIT::stopRecordingAndCompile() {
@@ -499,54 +170,54 @@ void TracingJIT::generateCodeForInstruction(const TraceInstruction& inst) {
     
     // Check if we can eliminate type checks for this instruction
     auto it = type_feedback_.find(0);  // Simplified: check first operand
-    if (it != type_feedback_.end() && it->second.canEliminateTypeCheck()) {
+    if (it != type_feedback_.end() && it->second.monomorphic()) {
         can_eliminate_type_check = true;
     }
     
     switch (inst.opcode) {
         case OpCode::ADD: {
             // Generate optimized add with type check elimination
-            code_gen_->emitLoadValue(NativeCodeGenerator::Register::XMM0, 
+            code_gen_->emitLoadValue(NativeCodeGenerator::XmmRegister::XMM0, 
                                      NativeCodeGenerator::Register::RDI, 0);
-            code_gen_->emitLoadValue(NativeCodeGenerator::Register::XMM1, 
+            code_gen_->emitLoadValue(NativeCodeGenerator::XmmRegister::XMM1, 
                                      NativeCodeGenerator::Register::RDI, 8);
-            code_gen_->emitAddSD(NativeCodeGenerator::Register::XMM0, 
-                                NativeCodeGenerator::Register::XMM1);
+            code_gen_->emitAddSD(NativeCodeGenerator::XmmRegister::XMM0, 
+                                NativeCodeGenerator::XmmRegister::XMM1);
             code_gen_->emitStoreValue(NativeCodeGenerator::Register::RDI, 0, 
-                                     NativeCodeGenerator::Register::XMM0);
+                                     NativeCodeGenerator::XmmRegister::XMM0);
             break;
         }
         case OpCode::MULTIPLY: {
-            code_gen_->emitLoadValue(NativeCodeGenerator::Register::XMM0, 
+            code_gen_->emitLoadValue(NativeCodeGenerator::XmmRegister::XMM0, 
                                      NativeCodeGenerator::Register::RDI, 0);
-            code_gen_->emitLoadValue(NativeCodeGenerator::Register::XMM1, 
+            code_gen_->emitLoadValue(NativeCodeGenerator::XmmRegister::XMM1, 
                                      NativeCodeGenerator::Register::RDI, 8);
-            code_gen_->emitMulSD(NativeCodeGenerator::Register::XMM0, 
-                                NativeCodeGenerator::Register::XMM1);
+            code_gen_->emitMulSD(NativeCodeGenerator::XmmRegister::XMM0, 
+                                NativeCodeGenerator::XmmRegister::XMM1);
             code_gen_->emitStoreValue(NativeCodeGenerator::Register::RDI, 0, 
-                                     NativeCodeGenerator::Register::XMM0);
+                                     NativeCodeGenerator::XmmRegister::XMM0);
             break;
         }
         case OpCode::SUBTRACT: {
-            code_gen_->emitLoadValue(NativeCodeGenerator::Register::XMM0, 
+            code_gen_->emitLoadValue(NativeCodeGenerator::XmmRegister::XMM0, 
                                      NativeCodeGenerator::Register::RDI, 0);
-            code_gen_->emitLoadValue(NativeCodeGenerator::Register::XMM1, 
+            code_gen_->emitLoadValue(NativeCodeGenerator::XmmRegister::XMM1, 
                                      NativeCodeGenerator::Register::RDI, 8);
-            code_gen_->emitSubSD(NativeCodeGenerator::Register::XMM0, 
-                                NativeCodeGenerator::Register::XMM1);
+            code_gen_->emitSubSD(NativeCodeGenerator::XmmRegister::XMM0, 
+                                NativeCodeGenerator::XmmRegister::XMM1);
             code_gen_->emitStoreValue(NativeCodeGenerator::Register::RDI, 0, 
-                                     NativeCodeGenerator::Register::XMM0);
+                                     NativeCodeGenerator::XmmRegister::XMM0);
             break;
         }
         case OpCode::DIVIDE: {
-            code_gen_->emitLoadValue(NativeCodeGenerator::Register::XMM0, 
+            code_gen_->emitLoadValue(NativeCodeGenerator::XmmRegister::XMM0, 
                                      NativeCodeGenerator::Register::RDI, 0);
-            code_gen_->emitLoadValue(NativeCodeGenerator::Register::XMM1, 
+            code_gen_->emitLoadValue(NativeCodeGenerator::XmmRegister::XMM1, 
                                      NativeCodeGenerator::Register::RDI, 8);
-            code_gen_->emitDivSD(NativeCodeGenerator::Register::XMM0, 
-                                NativeCodeGenerator::Register::XMM1);
+            code_gen_->emitDivSD(NativeCodeGenerator::XmmRegister::XMM0, 
+                                NativeCodeGenerator::XmmRegister::XMM1);
             code_gen_->emitStoreValue(NativeCodeGenerator::Register::RDI, 0, 
-                                     NativeCodeGenerator::Register::XMM0);
+                                     NativeCodeGenerator::XmmRegister::XMM0);
             break;
         }
         case OpCode::LOOP: {
@@ -570,43 +241,6 @@ void TracingJIT::optimizeAndVectorize() {
     std::cout << "[TracingJIT] Applying SIMD vectorization optimizations" << std::endl;
 }
 
-// ============================================================================
-// InlineCache Implementation
-// ============================================================================
-
-InlineCache::InlineCache() : next_entry_(0) {
-    for (auto& entry : entries_) {
-        entry.valid = false;
-        entry.handler = nullptr;
-        entry.type = ValueType::VAL_NIL;
-    }
-}
-
-InlineCache::CacheEntry* InlineCache::lookup(ValueType type) {
-    for (auto& entry : entries_) {
-        if (entry.valid && entry.type == type) {
-            return &entry;
-        }
-    }
-    return nullptr;
-}
-
-void InlineCache::update(ValueType type, void* handler) {
-    entries_[next_entry_].type = type;
-    entries_[next_entry_].handler = handler;
-    entries_[next_entry_].valid = true;
-    next_entry_ = (next_entry_ + 1) % CACHE_SIZE;
-}
-
-void InlineCache::clear() {
-    for (auto& entry : entries_) {
-        entry.valid = false;
-        entry.handler = nullptr;
-        entry.type = ValueType::VAL_NIL;
-    }
-    next_entry_ = 0;
-}
-
 // ============================================================================
 // HotPathOptimizer Implementation
 // ============================================================================
@@ -638,7 +272,6 @@ void HotPathOptimizer::reset() {
 OptimizingCompiler::OptimizingCompiler() {
     tracing_jit_ = std::make_unique<TracingJIT>();
     hot_path_optimizer_ = std::make_unique<HotPathOptimizer>();
-    inline_cache_ = std::make_unique<InlineCache>();
 }
 
 OptimizingCompiler::~OptimizingCompiler() = default;
@@ -681,62 +314,14 @@ void Trace::markLoopBack() {}
 bool Trace::canVectorize() const { return false; }
 bool Trace::canEliminateTypeChecks() const { return false; }
 
-struct CodeBuffer::Impl {};
-CodeBuffer::CodeBuffer(size_t) : impl_(nullptr) {}
-CodeBuffer::~CodeBuffer() = default;
-void CodeBuffer::emitByte(uint8_t) {}
-void CodeBuffer::emitBytes(const uint8_t*, size_t) {}
-void CodeBuffer::emitInt32(int32_t) {}
-void CodeBuffer::emitInt64(int64_t) {}
-void CodeBuffer::emitDouble(double) {}
-void* CodeBuffer::finalize() { return nullptr; }
-
-struct NativeCodeGenerator::Impl {};
-NativeCodeGenerator::NativeCodeGenerator(CodeBuffer&) : impl_(nullptr) {}
-void NativeCodeGenerator::emitPrologue() {}
-void NativeCodeGenerator::emitEpilogue() {}
-void NativeCodeGenerator::emitMov(Register, Register) {}
-void NativeCodeGenerator::emitMov(Register, int64_t) {}
-void NativeCodeGenerator::emitMov(Register, void*) {}
-void NativeCodeGenerator::emitMov(void*, Register) {}
-void NativeCodeGenerator::emitPush(Register) {}
-void NativeCodeGenerator::emitPop(Register) {}
-void NativeCodeGenerator::emitAdd(Register, int32_t) {}
-void NativeCodeGenerator::emitSub(Register, int32_t) {}
-void NativeCodeGenerator::emitAddSD(Register, Register) {}
-void NativeCodeGenerator::emitSubSD(Register, Register) {}
-void NativeCodeGenerator::emitMulSD(Register, Register) {}
-void NativeCodeGenerator::emitDivSD(Register, Register) {}
-void NativeCodeGenerator::emitVAddPD(Register, Register, Register) {}
-void NativeCodeGenerator::emitVMulPD(Register, Register, Register) {}
-void NativeCodeGenerator::emitVLoadPD(Register, void*) {}
-void NativeCodeGenerator::emitVStorePD(void*, Register) {}
-void NativeCodeGenerator::emitCmp(Register, Register) {}
-void NativeCodeGenerator::emitJump(void*) {}
-void NativeCodeGenerator::emitJumpIfEqual(void*) {}
-void NativeCodeGenerator::emitJumpIfNotEqual(void*) {}
-void NativeCodeGenerator::emitJumpIfGreater(void*) {}
-void NativeCodeGenerator::emitJumpIfLess(void*) {}
-void NativeCodeGenerator::emitTypeCheck(Register, ValueType, bool) {}
-void NativeCodeGenerator::emitLoadValue(Register, Register, int) {}
-void NativeCodeGenerator::emitStoreValue(Register, int, Register) {}
-void NativeCodeGenerator::emitLoopStart(Register, int) {}
-void NativeCodeGenerator::emitLoopEnd(void*) {}
-
 struct TracingJIT::Impl {};
 TracingJIT::TracingJIT() : impl_(nullptr) {}
 TracingJIT::~TracingJIT() = default;
 void TracingJIT::startRecording(VM*, uint8_t*) {}
 void TracingJIT::recordInstruction(OpCode, uint8_t*) {}
-void TracingJIT::recordType(int, ValueType) {}
+void TracingJIT::recordType(int, Value) {}
 TracingJIT::CompiledTrace TracingJIT::stopRecordingAndCompile() { return nullptr; }
 
-struct InlineCache::Impl {};
-InlineCache::InlineCache() : impl_(nullptr) {}
-InlineCache::CacheEntry* InlineCache::lookup(ValueType) { return nullptr; }
-void InlineCache::update(ValueType, void*) {}
-void InlineCache::clear() {}
-
 struct HotPathOptimizer::Impl {};
 HotPathOptimizer::HotPathOptimizer() : impl_(nullptr) {}
 void HotPathOptimizer::recordExecution(uint8_t*) {}
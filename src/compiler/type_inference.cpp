@@ -0,0 +1,341 @@
+/*
+Copyright (c) 2026 Dipanjan Dhar
+SPDX-License-Identifier: GPL-3.0-only
+*/
+
+#include "axeon/type_inference.hpp"
+#include <algorithm>
+#include <functional>
+
+namespace kio {
+
+// Globals are re-inferred until a pass finds what the one before it assumed
+static constexpr int MAX_PASSES = 16;
+// Loops normally settle in a few iterations; this only bounds odd shapes
+// such as an unbraced `let` as the body, which grows the locals each time
+static constexpr int MAX_LOOP_ITERATIONS = 32;
+
+static const std::pair<const char*, ElementKind> typedArrayConstructors[] = {
+    {"Float64Array", ElementKind::FLOAT64}, {"Float32Array", ElementKind::FLOAT32},
+    {"Int32Array", ElementKind::INT32},     {"Int64Array", ElementKind::INT64},
+    {"Uint8Array", ElementKind::UINT8},
+};
+
+// + - * and %: two ints stay ints (or overflow to a double, which Int
+// allows for); any other pair of numbers is computed in doubles.
+static StaticType arithmetic(StaticType l, StaticType r) {
+    if (l.unset || r.unset) return StaticType::none();
+    if (l.is(TypeKind::Int) && r.is(TypeKind::Int)) return StaticType::of(TypeKind::Int);
+    if (l.isNumber() && r.isNumber()) return StaticType::of(TypeKind::Float);
+    return StaticType();
+}
+
+void TypeInference::run(const std::vector<StmtPtr>& program) {
+    // A first pass finds the names the program assigns as globals, then the
+    // passes start from those being unset and each assumes what the one
+    // before it saw assigned. Once the two agree, every read of a global has
+    // the join of every write to it. Names nothing assigns are builtins.
+    pass(program);
+    globals_.clear();
+    for (const auto& entry : assigned_) globals_[entry.first] = StaticType::none();
+    for (int i = 0; i < MAX_PASSES; i++) {
+        bool wasOpaque = opaque_;
+        pass(program);
+        if (assigned_ == globals_ && opaque_ == wasOpaque) return;
+        for (const auto& entry : assigned_) globals_[entry.first] = entry.second;
+    }
+    opaque_ = true;
+    pass(program);
+}
+
+StaticType TypeInference::typeOf(const ExprPtr& expr) const {
+    auto it = types_.find(expr.get());
+    return it == types_.end() ? StaticType() : it->second;
+}
+
+void TypeInference::pass(const std::vector<StmtPtr>& program) {
+    assigned_.clear();
+    Env env;
+    env.locals.push_back({"", 0, StaticType()}); // Slot 0, as in Compiler
+    depth_ = 0;
+    for (const auto& s : program) stmt(s, env);
+}
+
+// Functions see only their own locals; every other name is a global
+void TypeInference::function(const std::vector<std::pair<std::string, std::string>>& params,
+                             const std::vector<StmtPtr>& body, bool method) {
+    int outerDepth = depth_;
+    depth_ = 1;
+    Env env;
+    env.locals.push_back({method ? "this" : "", 0, StaticType()});
+    // Annotations are not checked at the call, so they prove nothing here
+    for (const auto& param : params) env.locals.push_back({param.first, depth_, StaticType()});
+    for (const auto& s : body) stmt(s, env);
+    depth_ = outerDepth;
+}
+
+void TypeInference::stmt(const StmtPtr& stmt, Env& env) {
+    std::visit([&](auto&& node) {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, Stmt::Print>) {
+            expr(node.expression, env);
+        } else if constexpr (std::is_same_v<T, Stmt::Expression>) {
+            expr(node.expression, env);
+        } else if constexpr (std::is_same_v<T, Stmt::Var>) {
+            StaticType type = node.initializer ? expr(node.initializer, env) : StaticType::of(TypeKind::Void);
+            declare(node.name, type, env);
+        } else if constexpr (std::is_same_v<T, Stmt::Function>) {
+            function(node.params, node.body, false);
+            declare(node.name, StaticType::of(TypeKind::Function), env);
+        } else if constexpr (std::is_same_v<T, Stmt::Return>) {
+            if (node.value) expr(node.value, env);
+            env.reachable = false;
+        } else if constexpr (std::is_same_v<T, Stmt::Class>) {
+            declare(node.name, StaticType::of(TypeKind::Class), env);
+            for (const auto& m : node.methods) {
+                if (auto method = std::get_if<Stmt::Function>(&m->node)) function(method->params, method->body, true);
+            }
+        } else if constexpr (std::is_same_v<T, Stmt::If>) {
+            expr(node.condition, env);
+            Env otherwise = env;
+            this->stmt(node.thenBranch, env);
+            if (node.elseBranch) this->stmt(node.elseBranch, otherwise);
+            env = join(env, otherwise);
+        } else if constexpr (std::is_same_v<T, Stmt::While>) {
+            loop(env, &node.condition, node.body, nullptr);
+        } else if constexpr (std::is_same_v<T, Stmt::Block>) {
+            depth_++;
+            for (const auto& s : node.statements) this->stmt(s, env);
+            endScope(env);
+            depth_--;
+        } else if constexpr (std::is_same_v<T, Stmt::For>) {
+            depth_++;
+            if (node.initializer) this->stmt(node.initializer, env);
+            loop(env, node.condition ? &node.condition : nullptr, node.body, [&](Env& state) {
+                if (node.increment) expr(node.increment, state);
+            });
+            endScope(env);
+            depth_--;
+        } else if constexpr (std::is_same_v<T, Stmt::ForIn>) {
+            // The counter is declared before the limit is evaluated, and
+            // stepped by one after the body
+            depth_++;
+            declare(node.name, StaticType::of(TypeKind::Int), env);
+            declare("_limit", expr(node.iterable, env), env);
+            loop(env, nullptr, node.body, [&](Env& state) {
+                assign(node.name, arithmetic(read(node.name, state), StaticType::of(TypeKind::Int)), state);
+            });
+            endScope(env);
+            depth_--;
+        } else if constexpr (std::is_same_v<T, Stmt::Save> || std::is_same_v<T, Stmt::Load> ||
+                             std::is_same_v<T, Stmt::Import> || std::is_same_v<T, Stmt::ImportFrom> ||
+                             std::is_same_v<T, Stmt::Module> || std::is_same_v<T, Stmt::Namespace> ||
+                             std::is_same_v<T, Stmt::Export>) {
+            opaque_ = true;
+        } else {
+            // Control flow the pass does not model (break, continue, switch,
+            // try, throw, parallel): forget everything about the locals
+            for (auto& local : env.locals) local.type = StaticType();
+        }
+    }, stmt->node);
+}
+
+// A loop of any kind; step runs after the body. The head state is the join
+// of the entry and every back edge, and the body is re-analysed until that
+// stops changing, so the types recorded by the last iteration hold on every
+// trip. The exit state is the one the condition leaves.
+void TypeInference::loop(Env& env, const ExprPtr* condition, const StmtPtr& body,
+                         const std::function<void(Env&)>& step) {
+    Env head = env;
+    for (int i = 0;; i++) {
+        Env state = head;
+        if (condition) expr(*condition, state);
+        Env exit = state;
+        stmt(body, state);
+        if (step) step(state);
+        Env next = join(head, state);
+        if (i >= MAX_LOOP_ITERATIONS) {
+            next.locals.resize(std::min(next.locals.size(), head.locals.size()));
+            for (auto& local : next.locals) local.type = StaticType();
+        }
+        if (same(next, head)) {
+            env = exit;
+            return;
+        }
+        head = next;
+    }
+}
+
+StaticType TypeInference::expr(const ExprPtr& expr, Env& env) {
+    StaticType type = std::visit([&](auto&& node) -> StaticType {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, Expr::Literal>) {
+            if (std::holds_alternative<double>(node.value)) {
+                return StaticType::of(node.integer ? TypeKind::Int : TypeKind::Float);
+            }
+            const std::string& s = std::get<std::string>(node.value);
+            if (s == "true" || s == "false") return StaticType::of(TypeKind::Bool);
+            return StaticType::of(s.empty() ? TypeKind::Void : TypeKind::String);
+        } else if constexpr (std::is_same_v<T, Expr::Variable>) {
+            return read(node.name, env);
+        } else if constexpr (std::is_same_v<T, Expr::Binary>) {
+            return binary(node, env);
+        } else if constexpr (std::is_same_v<T, Expr::Grouping>) {
+            return this->expr(node.expression, env);
+        } else if constexpr (std::is_same_v<T, Expr::Assign>) {
+            StaticType value = this->expr(node.value, env);
+            assign(node.name, value, env);
+            return value;
+        } else if constexpr (std::is_same_v<T, Expr::Unary>) {
+            StaticType operand = this->expr(node.right, env);
+            if (node.op.type == TokenType::BANG) return StaticType::of(TypeKind::Bool);
+            if (node.op.type == TokenType::MINUS) return operand.isNumber() || operand.unset ? operand : StaticType();
+            return operand;
+        } else if constexpr (std::is_same_v<T, Expr::Call>) {
+            return call(node, env);
+        } else if constexpr (std::is_same_v<T, Expr::Get>) {
+            this->expr(node.object, env);
+            return StaticType();
+        } else if constexpr (std::is_same_v<T, Expr::Set>) {
+            this->expr(node.object, env);
+            this->expr(node.value, env);
+            return StaticType();
+        } else if constexpr (std::is_same_v<T, Expr::Array>) {
+            for (const auto& element : node.elements) this->expr(element, env);
+            return StaticType::of(TypeKind::Array);
+        } else if constexpr (std::is_same_v<T, Expr::Index>) {
+            // Nothing proves the index in bounds, so the element type stays unknown
+            this->expr(node.object, env);
+            this->expr(node.index, env);
+            return StaticType();
+        } else if constexpr (std::is_same_v<T, Expr::IndexSet>) {
+            this->expr(node.object, env);
+            this->expr(node.index, env);
+            return this->expr(node.value, env);
+        } else if constexpr (std::is_same_v<T, Expr::Logical>) {
+            this->expr(node.left, env);
+            Env skipped = env;
+            this->expr(node.right, env);
+            env = join(env, skipped);
+            return StaticType();
+        } else if constexpr (std::is_same_v<T, Expr::Ternary>) {
+            this->expr(node.condition, env);
+            Env otherwise = env;
+            StaticType a = this->expr(node.thenExpr, env);
+            StaticType b = this->expr(node.elseExpr, otherwise);
+            env = join(env, otherwise);
+            return join(a, b);
+        } else if constexpr (std::is_same_v<T, Expr::PostOp>) {
+            assign(node.name, StaticType(), env);
+            return StaticType();
+        } else if constexpr (std::is_same_v<T, Expr::Lambda>) {
+            function(node.params, node.body, false);
+            return StaticType::of(TypeKind::Function);
+        } else {
+            return StaticType(); // This, Super, SysQuery
+        }
+    }, expr->node);
+    types_[expr.get()] = type;
+    return type;
+}
+
+StaticType TypeInference::binary(const Expr::Binary& binary, Env& env) {
+    StaticType l = expr(binary.left, env);
+    StaticType r = expr(binary.right, env);
+    switch (binary.op.type) {
+        case TokenType::PLUS:
+            // A string on either side makes ADD concatenate
+            if (l.is(TypeKind::String) || r.is(TypeKind::String)) return StaticType::of(TypeKind::String);
+            return arithmetic(l, r);
+        case TokenType::MINUS: case TokenType::STAR: case TokenType::PERCENT:
+            return arithmetic(l, r);
+        case TokenType::SLASH:
+            if (l.unset || r.unset) return StaticType::none();
+            return l.isNumber() && r.isNumber() ? StaticType::of(TypeKind::Float) : StaticType();
+        case TokenType::LESS: case TokenType::LESS_EQUAL: case TokenType::GREATER: case TokenType::GREATER_EQUAL:
+        case TokenType::EQUAL_EQUAL: case TokenType::BANG_EQUAL:
+            return StaticType::of(TypeKind::Bool);
+        default:
+            return StaticType();
+    }
+}
+
+StaticType TypeInference::call(const Expr::Call& call, Env& env) {
+    if (auto var = std::get_if<Expr::Variable>(&call.callee->node)) {
+        // Compiled to FLOOR and SQRT whatever the name is bound to
+        if ((var->name == "floor" || var->name == "sqrt") && !call.arguments.empty()) {
+            StaticType arg = expr(call.arguments[0], env);
+            if (arg.unset) return arg;
+            return arg.isNumber() ? StaticType::of(TypeKind::Float) : StaticType();
+        }
+    }
+    expr(call.callee, env);
+    for (const auto& arg : call.arguments) expr(arg, env);
+
+    // A typed array constructor, as long as the program never rebinds it
+    auto var = std::get_if<Expr::Variable>(&call.callee->node);
+    if (!var || opaque_ || globals_.count(var->name)) return StaticType();
+    bool local = std::any_of(env.locals.begin(), env.locals.end(), [&](const Local& l) { return l.name == var->name; });
+    if (local) return StaticType();
+    for (const auto& [name, element] : typedArrayConstructors) {
+        if (var->name == name) return StaticType::typed(element);
+    }
+    return StaticType();
+}
+
+void TypeInference::declare(const std::string& name, StaticType type, Env& env) {
+    if (depth_ > 0) {
+        env.locals.push_back({name, depth_, type});
+    } else {
+        assign(name, type, env);
+    }
+}
+
+void TypeInference::assign(const std::string& name, StaticType type, Env& env) {
+    for (auto it = env.locals.rbegin(); it != env.locals.rend(); ++it) {
+        if (it->name == name) {
+            it->type = type;
+            return;
+        }
+    }
+    auto it = assigned_.find(name);
+    if (it == assigned_.end()) assigned_[name] = type;
+    else it->second = join(it->second, type);
+}
+
+StaticType TypeInference::read(const std::string& name, const Env& env) const {
+    for (auto it = env.locals.rbegin(); it != env.locals.rend(); ++it) {
+        if (it->name == name) return it->type;
+    }
+    if (opaque_) return StaticType();
+    auto it = globals_.find(name);
+    return it == globals_.end() ? StaticType() : it->second;
+}
+
+void TypeInference::endScope(Env& env) {
+    while (!env.locals.empty() && env.locals.back().depth == depth_) env.locals.pop_back();
+}
+
+bool TypeInference::same(const Env& a, const Env& b) {
+    if (a.reachable != b.reachable || a.locals.size() != b.locals.size()) return false;
+    for (size_t i = 0; i < a.locals.size(); i++) {
+        if (a.locals[i].type != b.locals[i].type) return false;
+    }
+    return true;
+}
+
+// Where control merges. Code after a return contributes nothing; locals
+// only one side declared (an unbraced `let` as a branch) are left unknown.
+TypeInference::Env TypeInference::join(const Env& a, const Env& b) {
+    if (!a.reachable) return b;
+    if (!b.reachable) return a;
+    const Env& longer = a.locals.size() >= b.locals.size() ? a : b;
+    size_t common = std::min(a.locals.size(), b.locals.size());
+    Env result = longer;
+    for (size_t i = 0; i < result.locals.size(); i++) {
+        result.locals[i].type = i < common ? join(a.locals[i].type, b.locals[i].type) : StaticType();
+    }
+    return result;
+}
+
+} // namespace kio
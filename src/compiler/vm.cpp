@@ -5,6 +5,7 @@ SPDX-License-Identifier: GPL-3.0-only
 
 #include "axeon/vm.hpp"
 #include "axeon/bytecode.hpp"
+#include "axeon/memory_manager.hpp"
 #include "axeon/builtin_functions.hpp"
 #include "axeon/asm_helpers.hpp"
 #include "axeon/platform.hpp"
@@ -15,24 +16,38 @@ SPDX-License-Identifier: GPL-3.0-only
 
 namespace kio {
 
-VM::VM() {
+VM::VM() : frames(FRAMES_INITIAL), stack_(STACK_INITIAL) {
     sp = 0;
     frameCount = 0;
-    for (const auto& pair : builtins_.getFunctionNames()) {
-        globals_[pair] = objToValue(new ObjString(pair));
+    MemoryManager::heap().addRoots(this, [this](MemoryManager& gc) { markRoots(gc); });
+    for (const auto& pair : builtins_.functions()) {
+        const BuiltinEntry& entry = pair.second;
+        ObjNative* native = allocateObject<ObjNative>(pair.first, entry.function, entry.arity, entry.flags);
+        globals_[globalSlot(pair.first)] = objToValue(native);
     }
 }
 
-VM::~VM() {}
+VM::~VM() {
+    MemoryManager::heap().removeRoots(this);
+}
+
+void VM::markRoots(MemoryManager& gc) {
+    for (int i = 0; i < sp; i++) gc.markValue(stack_[i]);
+    for (int i = 0; i < frameCount; i++) gc.markObject(frames[i].function);
+    for (Value& v : globals_) gc.markValue(v);
+}
 
 InterpretResult VM::interpret(ObjFunction* function) {
+    // The compiler may have resolved globals the VM has not seen yet.
+    globals_.resize(GlobalTable::shared().size(), UNDEFINED_VAL);
+    if (!ensureStack(sp + frameSize(function))) return InterpretResult::RUNTIME_ERROR;
     push(objToValue(function));
     CallFrame* frame = &frames[frameCount++];
     frame->function = function;
     frame->ip = function->chunk.code.data();
     frame->slots = 0;
     
-    return run();
+    return threaded_ ? runThreaded() : run();
 }
 
 std::string VM::valToString(Value v) {
@@ -49,6 +64,7 @@ std::string VM::valToString(Value v) {
         Obj* o = valueToObj(v);
         if (!o) return "nil";
         if (o->type == ObjType::OBJ_STRING) return ((ObjString*)o)->chars;
+        if (o->type == ObjType::OBJ_ROPE) return flattenRope((ObjRope*)o)->chars;
         if (o->type == ObjType::OBJ_ARRAY) {
             std::string res = "[";
             ObjArray* arr = (ObjArray*)o;
@@ -59,7 +75,18 @@ std::string VM::valToString(Value v) {
             res += "]";
             return res;
         }
+        if (o->type == ObjType::OBJ_TYPED_ARRAY) {
+            std::string res = "[";
+            ObjTypedArray* arr = (ObjTypedArray*)o;
+            for (size_t i = 0; i < arr->length; ++i) {
+                res += valToString(Value(arr->get(i)));
+                if (i < arr->length - 1) res += ", ";
+            }
+            res += "]";
+            return res;
+        }
         if (o->type == ObjType::OBJ_FUNCTION) return "<fn " + ((ObjFunction*)o)->name + ">";
+        if (o->type == ObjType::OBJ_NATIVE) return "<native fn " + ((ObjNative*)o)->name + ">";
         if (o->type == ObjType::OBJ_CLASS) return "<class " + ((ObjClass*)o)->name + ">";
         if (o->type == ObjType::OBJ_INSTANCE) return "<instance of " + ((ObjInstance*)o)->klass->name + ">";
     }
@@ -76,7 +103,7 @@ bool VM::isTruthy(Value v) {
 InterpretResult VM::run() {
     CallFrame* frame = &frames[frameCount - 1];
     uint8_t* ip = frame->ip;
-    Value* stack = stack_;
+    Value* stack = stack_.data();
     int sp_local = sp;
     
     // Scratch variables
@@ -91,17 +118,63 @@ InterpretResult VM::run() {
         &&code_ADD, &&code_SUBTRACT, &&code_MULTIPLY, &&code_DIVIDE, &&code_MODULO,
         &&code_EQUAL, &&code_GREATER, &&code_GREATER_EQUAL, &&code_LESS, &&code_LESS_EQUAL,
         &&code_NOT, &&code_NEGATE, &&code_PRINT, &&code_JUMP, &&code_JUMP_IF_FALSE, &&code_LOOP,
-        &&code_CALL, &&code_INVOKE, &&code_RETURN,
+        &&code_CALL, &&code_INVOKE, &&code_RETURN, &&code_TAIL_CALL,
         &&code_CLASS, &&code_METHOD, &&code_GET_PROPERTY, &&code_SET_PROPERTY, &&code_INHERIT,
         &&code_ARRAY_NEW, &&code_ARRAY_GET, &&code_ARRAY_SET, &&code_SYS_QUERY,
         &&code_FLOOR, &&code_SQRT,
+        &&code_GET_GLOBAL_SLOT, &&code_SET_GLOBAL_SLOT, &&code_DEFINE_GLOBAL_SLOT,
+        &&code_ADD_CONST, &&code_ADD_LOCALS, &&code_SUBTRACT_LOCALS, &&code_MULTIPLY_LOCALS,
+        &&code_INCREMENT_LOCAL, &&code_INCREMENT_GLOBAL_SLOT,
+        &&code_LESS_JUMP_IF_FALSE, &&code_EQUAL_JUMP_IF_FALSE, &&code_LESS_LOCALS_JUMP_IF_FALSE,
+        &&code_NOT_EQUAL,
+        &&code_ADD_INT, &&code_SUBTRACT_INT, &&code_MULTIPLY_INT, &&code_MODULO_INT,
+        &&code_LESS_INT, &&code_LESS_EQUAL_INT, &&code_GREATER_INT, &&code_GREATER_EQUAL_INT,
+        &&code_MASK_INT,
+        &&code_ADD_NUM, &&code_SUBTRACT_NUM, &&code_MULTIPLY_NUM,
+        &&code_LESS_NUM, &&code_LESS_EQUAL_NUM, &&code_GREATER_NUM, &&code_GREATER_EQUAL_NUM,
+        &&code_ADD_STR, &&code_GET_PROPERTY_SLOT,
+        &&code_ADD_F64, &&code_SUBTRACT_F64, &&code_MULTIPLY_F64, &&code_DIVIDE_F64,
+        &&code_LESS_F64, &&code_LESS_EQUAL_F64, &&code_GREATER_F64, &&code_GREATER_EQUAL_F64,
+        &&code_CONCAT, &&code_ARRAY_GET_F64, &&code_ARRAY_SET_F64,
         &&code_FAST_LOOP, &&code_HALT
     };
 
+#ifdef AXEON_DISPATCH_STATS
+    #define COUNT_DISPATCH() dispatch_count_++;
+#else
+    #define COUNT_DISPATCH()
+#endif
+
     #define DISPATCH() { \
         /* printf("OP: %d, IP: %ld, SP: %d\n", (int)*ip, (long)(ip - frame->function->chunk.code.data()), sp_local); */ \
+        COUNT_DISPATCH() \
         goto *dispatch_table[*ip++]; \
     }
+    // Two doubles and two ints are the common cases for the generic numeric
+    // handlers. Each finishes with its own dispatch so those paths stay
+    // straight-line; anything else falls through to the shared helpers
+    #define NUMBER_OP(dst, l, r, op, intOp) \
+        if (bothDoubles(l, r)) { dst = Value(asDouble(l) op asDouble(r)); DISPATCH(); } \
+        if (bothInts(l, r)) { \
+            Value result; \
+            if (intOp(l, r, result)) { dst = result; DISPATCH(); } \
+        }
+    #define COMPARE_OP(dst, l, r, op) \
+        if (bothDoubles(l, r)) { dst = Value(asDouble(l) op asDouble(r)); DISPATCH(); } \
+        if (bothInts(l, r)) { dst = Value(valueToInt(l) op valueToInt(r)); DISPATCH(); }
+    #define JUMP_UNLESS(l, r, op, offset) \
+        if (bothDoubles(l, r)) { if (!(asDouble(l) op asDouble(r))) ip += (offset); DISPATCH(); } \
+        if (bothInts(l, r)) { if (!(valueToInt(l) op valueToInt(r))) ip += (offset); DISPATCH(); }
+    // Gives the generic instruction just dispatched a chance to quicken from
+    // the operands on top of the stack
+    #define QUICKEN() { \
+        Chunk& chunk = frame->function->chunk; \
+        if (chunk.feedbackAt(ip - 1).canQuicken()) quicken(chunk, ip - 1, stack[sp_local - 2], stack[sp_local - 1]); \
+    }
+    #define DEOPTIMIZE(generic) { \
+        deoptimize(frame->function->chunk, ip - 1, OpCode::generic); \
+        goto code_##generic; \
+    }
     DISPATCH();
 
 code_CONSTANT:
@@ -135,39 +208,63 @@ code_SET_LOCAL:
 code_GET_GLOBAL: {
     scratch_byte = *ip++;
     scratch_str = ((ObjString*)valueToObj(frame->function->chunk.constants[scratch_byte]))->chars;
-    if (globals_.find(scratch_str) == globals_.end()) {
+    Value value = globals_[globalSlot(scratch_str)];
+    if (isUndefined(value)) {
         std::cerr << "Global '" << scratch_str << "' not found." << std::endl;
-        stack[sp_local++] = NIL_VAL;
-    } else {
-        stack[sp_local++] = globals_[scratch_str];
+        value = NIL_VAL;
     }
+    stack[sp_local++] = value;
     DISPATCH();
 }
 
 code_DEFINE_GLOBAL: {
     scratch_byte = *ip++;
     scratch_str = ((ObjString*)valueToObj(frame->function->chunk.constants[scratch_byte]))->chars;
-    globals_[scratch_str] = stack[--sp_local];
-    // std::cout << "Defined global: " << scratch_str << std::endl;
+    globals_[globalSlot(scratch_str)] = stack[--sp_local];
     DISPATCH();
 }
 
 code_SET_GLOBAL: {
     scratch_byte = *ip++;
     scratch_str = ((ObjString*)valueToObj(frame->function->chunk.constants[scratch_byte]))->chars;
-    globals_[scratch_str] = stack[sp_local - 1];
+    globals_[globalSlot(scratch_str)] = stack[sp_local - 1];
+    DISPATCH();
+}
+
+code_GET_GLOBAL_SLOT: {
+    scratch_u16 = (uint16_t)((ip[0] << 8) | ip[1]);
+    ip += 2;
+    stack[sp_local++] = readGlobal(scratch_u16);
+    DISPATCH();
+}
+
+code_DEFINE_GLOBAL_SLOT: {
+    scratch_u16 = (uint16_t)((ip[0] << 8) | ip[1]);
+    ip += 2;
+    globals_[scratch_u16] = stack[--sp_local];
     DISPATCH();
 }
 
-code_ADD: {
+code_SET_GLOBAL_SLOT: {
+    scratch_u16 = (uint16_t)((ip[0] << 8) | ip[1]);
+    ip += 2;
+    globals_[scratch_u16] = stack[sp_local - 1];
+    DISPATCH();
+}
+
+code_ADD:
+    QUICKEN();
+add_operands: { // ADD_CONST and ADD_LOCALS land here with their operands pushed
     Value r = stack[--sp_local];
     Value l = stack[--sp_local];
+    NUMBER_OP(stack[sp_local++], l, r, +, addInts)
     if (isNumber(l) && isNumber(r)) {
-        stack[sp_local++] = Value(valueToDouble(l) + valueToDouble(r));
+        stack[sp_local++] = addNumbers(l, r);
     } else if (isObj(l) || isObj(r)) {
-        std::string s1 = valToString(l);
-        std::string s2 = valToString(r);
-        stack[sp_local++] = objToValue(new ObjString(s1 + s2));
+        sp_local += 2;
+        sp = sp_local; // Operands stay rooted while the result is allocated
+        concatenate();
+        sp_local = sp;
     } else {
         stack[sp_local++] = NIL_VAL;
     }
@@ -175,16 +272,20 @@ code_ADD: {
 }
 
 code_SUBTRACT: {
+    QUICKEN();
     Value r = stack[--sp_local];
     Value l = stack[--sp_local];
-    stack[sp_local++] = Value(valueToDouble(l) - valueToDouble(r));
+    NUMBER_OP(stack[sp_local++], l, r, -, subtractInts)
+    stack[sp_local++] = subtractNumbers(l, r);
     DISPATCH();
 }
 
 code_MULTIPLY: {
+    QUICKEN();
     Value r = stack[--sp_local];
     Value l = stack[--sp_local];
-    stack[sp_local++] = Value(valueToDouble(l) * valueToDouble(r));
+    NUMBER_OP(stack[sp_local++], l, r, *, multiplyInts)
+    stack[sp_local++] = multiplyNumbers(l, r);
     DISPATCH();
 }
 
@@ -196,9 +297,10 @@ code_DIVIDE: {
 }
 
 code_MODULO: {
+    QUICKEN();
     Value r = stack[--sp_local];
     Value l = stack[--sp_local];
-    stack[sp_local++] = Value(fmod(valueToDouble(l), valueToDouble(r)));
+    stack[sp_local++] = moduloNumbers(l, r);
     DISPATCH();
 }
 
@@ -209,31 +311,46 @@ code_EQUAL: {
     DISPATCH();
 }
 
+code_NOT_EQUAL: {
+    Value r = stack[--sp_local];
+    Value l = stack[--sp_local];
+    stack[sp_local++] = Value(!(l == r));
+    DISPATCH();
+}
+
 code_GREATER: {
+    QUICKEN();
     Value r = stack[--sp_local];
     Value l = stack[--sp_local];
-    stack[sp_local++] = Value(valueToDouble(l) > valueToDouble(r));
+    COMPARE_OP(stack[sp_local++], l, r, >)
+    stack[sp_local++] = Value(lessNumbers(r, l));
     DISPATCH();
 }
 
 code_GREATER_EQUAL: {
+    QUICKEN();
     Value r = stack[--sp_local];
     Value l = stack[--sp_local];
-    stack[sp_local++] = Value(valueToDouble(l) >= valueToDouble(r));
+    COMPARE_OP(stack[sp_local++], l, r, >=)
+    stack[sp_local++] = Value(lessEqualNumbers(r, l));
     DISPATCH();
 }
 
 code_LESS: {
+    QUICKEN();
     Value r = stack[--sp_local];
     Value l = stack[--sp_local];
-    stack[sp_local++] = Value(valueToDouble(l) < valueToDouble(r));
+    COMPARE_OP(stack[sp_local++], l, r, <)
+    stack[sp_local++] = Value(lessNumbers(l, r));
     DISPATCH();
 }
 
 code_LESS_EQUAL: {
+    QUICKEN();
     Value r = stack[--sp_local];
     Value l = stack[--sp_local];
-    stack[sp_local++] = Value(valueToDouble(l) <= valueToDouble(r));
+    COMPARE_OP(stack[sp_local++], l, r, <=)
+    stack[sp_local++] = Value(lessEqualNumbers(l, r));
     DISPATCH();
 }
 
@@ -242,7 +359,7 @@ code_NOT:
     DISPATCH();
 
 code_NEGATE:
-    stack[sp_local - 1] = Value(-valueToDouble(stack[sp_local - 1]));
+    stack[sp_local - 1] = negateNumber(stack[sp_local - 1]);
     DISPATCH();
 
 code_PRINT: {
@@ -267,41 +384,32 @@ code_LOOP: {
     scratch_u16 = (uint16_t)((ip[0] << 8) | ip[1]);
     ip += 2;
     uint8_t* target_ip = ip - scratch_u16;
-    
-    auto it = optimized_loops_.find(target_ip);
-    if (it != optimized_loops_.end()) {
-        if (it->second) {
-            sp = sp_local;
-            it->second(stack, sp, frame->slots, globals_);
-            sp_local = sp;
-            ip = target_ip;
-            DISPATCH();
-        }
-    } else if (++loop_hits_[target_ip] >= HOT_THRESHOLD) {
+    uint8_t* back_edge = ip - 3;
+    ip = target_ip;
+
+    if (JITEngine::CompiledLoop compiled = hotLoop(target_ip, back_edge, sp_local)) {
+        // The native loop hands back the header, or the instruction its side
+        // exit left off at with the operands for it pushed
         sp = sp_local;
-        JITEngine::CompiledLoop compiled = jit_.compileLoop(&frame->function->chunk, target_ip);
-        
-        if (compiled) {
-            optimized_loops_[target_ip] = compiled;
-            compiled(stack, sp, frame->slots, globals_);
-        } else {
-            std::cerr << "[JIT] Failed to compile loop at offset " << (int)(target_ip - frame->function->chunk.code.data()) << std::endl;
-            optimized_loops_[target_ip] = nullptr; 
-        }
+        ip = frame->function->chunk.code.data() + compiled(stack, sp, frame->slots, globals_.data());
         sp_local = sp;
     }
-    
-    ip = target_ip;
     DISPATCH();
 }
 
 code_CALL: {
     scratch_byte = *ip++;
+    frame->ip = ip;
     sp = sp_local;
+    if (callCompiled(stack[sp - scratch_byte - 1], scratch_byte)) {
+        sp_local = sp;
+        DISPATCH();
+    }
     if (!callValue(stack[sp - scratch_byte - 1], scratch_byte)) {
         return InterpretResult::RUNTIME_ERROR;
     }
     frame = &frames[frameCount - 1];
+    stack = stack_.data();
     ip = frame->ip;
     sp_local = sp;
     DISPATCH();
@@ -310,10 +418,13 @@ code_CALL: {
 code_INVOKE: {
     scratch_byte = *ip++; // constant index for name
     int argCount = *ip++;
-    scratch_str = ((ObjString*)valueToObj(frame->function->chunk.constants[scratch_byte]))->chars;
+    ObjString* name = (ObjString*)valueToObj(frame->function->chunk.constants[scratch_byte]);
+    InlineCache* cache = frame->function->chunk.cache(*ip++);
+    frame->ip = ip;
     sp = sp_local;
-    if (!invoke(scratch_str, argCount)) return InterpretResult::RUNTIME_ERROR;
+    if (!invoke(name, argCount, cache)) return InterpretResult::RUNTIME_ERROR;
     frame = &frames[frameCount - 1];
+    stack = stack_.data();
     ip = frame->ip;
     sp_local = sp;
     DISPATCH();
@@ -334,58 +445,75 @@ code_RETURN: {
     DISPATCH();
 }
 
+code_TAIL_CALL: {
+    int argCount = *ip;
+    Value callee = stack[sp_local - argCount - 1];
+    if (isObj(callee) && valueToObj(callee)->type == ObjType::OBJ_FUNCTION &&
+        ((ObjFunction*)valueToObj(callee))->arity == argCount) {
+        // Slide the callee and its arguments down over the returning frame
+        ObjFunction* function = (ObjFunction*)valueToObj(callee);
+        std::copy(stack + sp_local - argCount - 1, stack + sp_local, stack + frame->slots);
+        sp_local = frame->slots + argCount + 1;
+        sp = sp_local;
+        if (!ensureStack(frame->slots + frameSize(function))) return InterpretResult::RUNTIME_ERROR;
+        stack = stack_.data();
+        frame->function = function;
+        ip = function->chunk.code.data();
+        DISPATCH();
+    }
+    // Anything else is an ordinary call; the RETURN after it still runs
+    goto code_CALL;
+}
+
 code_CLASS: {
     scratch_byte = *ip++;
     scratch_str = ((ObjString*)valueToObj(frame->function->chunk.constants[scratch_byte]))->chars;
-    stack[sp_local++] = objToValue(new ObjClass(scratch_str));
+    sp = sp_local;
+    stack[sp_local++] = objToValue(allocateObject<ObjClass>(scratch_str));
     DISPATCH();
 }
 
 code_METHOD: {
     scratch_byte = *ip++;
-    scratch_str = ((ObjString*)valueToObj(frame->function->chunk.constants[scratch_byte]))->chars;
+    ObjString* name = (ObjString*)valueToObj(frame->function->chunk.constants[scratch_byte]);
     Value method = stack[--sp_local];
     ObjClass* klass = (ObjClass*)valueToObj(stack[sp_local - 1]);
-    klass->methods[scratch_str] = method;
+    klass->methods[name] = method;
+    MemoryManager::heap().writeBarrier(klass, method);
+    InlineCache::methodEpoch++;
     DISPATCH();
 }
 
 code_GET_PROPERTY: {
-    if (!isObj(stack[sp_local - 1]) || valueToObj(stack[sp_local - 1])->type != ObjType::OBJ_INSTANCE) {
-        std::cerr << "Only instances have properties." << std::endl;
-        return InterpretResult::RUNTIME_ERROR;
-    }
-    ObjInstance* instance = (ObjInstance*)valueToObj(stack[--sp_local]);
+    Chunk& chunk = frame->function->chunk;
+    uint8_t* instruction = ip - 1;
     scratch_byte = *ip++;
-    scratch_str = ((ObjString*)valueToObj(frame->function->chunk.constants[scratch_byte]))->chars;
-    
-    auto it = instance->fields.find(scratch_str);
-    if (it != instance->fields.end()) {
-        stack[sp_local++] = it->second;
-    } else {
-        // Look in methods
-        auto mit = instance->klass->methods.find(scratch_str);
-        if (mit != instance->klass->methods.end()) {
-            stack[sp_local++] = mit->second;
-        } else {
-            stack[sp_local++] = NIL_VAL;
-        }
+    InlineCache* cache = chunk.cache(*ip++);
+    if (cache && cache->load(stack[sp_local - 1], stack[sp_local - 1])) {
+        if (chunk.feedbackAt(instruction).canQuicken()) quickenProperty(chunk, instruction, cache);
+        DISPATCH();
+    }
+    sp = sp_local;
+    if (!getProperty((ObjString*)valueToObj(chunk.constants[scratch_byte]), cache)) {
+        return InterpretResult::RUNTIME_ERROR;
     }
     DISPATCH();
 }
 
 code_SET_PROPERTY: {
-    if (!isObj(stack[sp_local - 2]) || valueToObj(stack[sp_local - 2])->type != ObjType::OBJ_INSTANCE) {
-        std::cerr << "Only instances have properties." << std::endl;
+    scratch_byte = *ip++;
+    InlineCache* cache = frame->function->chunk.cache(*ip++);
+    if (cache && cache->store(stack[sp_local - 2], stack[sp_local - 1])) {
+        MemoryManager::heap().writeBarrier(valueToObj(stack[sp_local - 2]), stack[sp_local - 1]);
+        stack[sp_local - 2] = stack[sp_local - 1];
+        sp_local--;
+        DISPATCH();
+    }
+    sp = sp_local;
+    if (!setProperty((ObjString*)valueToObj(frame->function->chunk.constants[scratch_byte]), cache)) {
         return InterpretResult::RUNTIME_ERROR;
     }
-    ObjInstance* instance = (ObjInstance*)valueToObj(stack[sp_local - 2]);
-    scratch_byte = *ip++;
-    scratch_str = ((ObjString*)valueToObj(frame->function->chunk.constants[scratch_byte]))->chars;
-    instance->fields[scratch_str] = stack[sp_local - 1];
-    Value value = stack[--sp_local];
-    sp_local--; // obj
-    stack[sp_local++] = value;
+    sp_local = sp;
     DISPATCH();
 }
 
@@ -394,23 +522,26 @@ code_INHERIT: {
     DISPATCH();
 }
 
-code_ARRAY_NEW: {
-    uint8_t elementCount = *ip++;
-    ObjArray* array = new ObjArray();
-    array->elements.resize(elementCount);
-    for (int i = elementCount - 1; i >= 0; --i) {
-        array->elements[i] = stack[--sp_local];
-    }
-    stack[sp_local++] = objToValue(array);
+code_ARRAY_NEW:
+    sp = sp_local;
+    newArray(*ip++);
+    sp_local = sp;
     DISPATCH();
-}
 
 code_ARRAY_GET: {
     Value index = stack[--sp_local];
     Value arrayVal = stack[--sp_local];
-    ObjArray* array = (ObjArray*)valueToObj(arrayVal);
-    int idx = (int)index.toNumber();
-    stack[sp_local++] = array->elements[idx];
+    Obj* obj = valueToObj(arrayVal);
+    if (obj->type == ObjType::OBJ_ARRAY) {
+        stack[sp_local++] = ((ObjArray*)obj)->elements[(int)index.toNumber()];
+        DISPATCH();
+    }
+    size_t at;
+    if (!typedArrayIndex((ObjTypedArray*)obj, index, at)) {
+        sp = sp_local;
+        return InterpretResult::RUNTIME_ERROR;
+    }
+    stack[sp_local++] = doubleToValue(((ObjTypedArray*)obj)->get(at));
     DISPATCH();
 }
 
@@ -418,43 +549,28 @@ code_ARRAY_SET: {
     Value value = stack[--sp_local];
     Value index = stack[--sp_local];
     Value arrayVal = stack[--sp_local];
-    ObjArray* array = (ObjArray*)valueToObj(arrayVal);
-    int idx = (int)index.toNumber();
-    array->elements[idx] = value;
+    Obj* obj = valueToObj(arrayVal);
+    if (obj->type == ObjType::OBJ_ARRAY) {
+        ((ObjArray*)obj)->elements[(int)index.toNumber()] = value;
+        MemoryManager::heap().writeBarrier(obj, value);
+    } else {
+        size_t at;
+        if (!typedArrayIndex((ObjTypedArray*)obj, index, at)) {
+            sp = sp_local;
+            return InterpretResult::RUNTIME_ERROR;
+        }
+        ((ObjTypedArray*)obj)->set(at, value.toNumber());
+    }
     stack[sp_local++] = value;
     DISPATCH();
 }
 
-code_SYS_QUERY: {
+code_SYS_QUERY:
     scratch_byte = *ip++;
-    scratch_str = ((ObjString*)valueToObj(frame->function->chunk.constants[scratch_byte]))->chars;
-    if (scratch_str == "time") {
-        auto now = std::chrono::steady_clock::now().time_since_epoch();
-        double ms = std::chrono::duration<double, std::milli>(now).count();
-        stack[sp_local++] = Value(ms);
-    } else if (scratch_str == "os_name") {
-#ifdef _WIN32
-        stack[sp_local++] = objToValue(new ObjString("Windows"));
-#elif __APPLE__
-        stack[sp_local++] = objToValue(new ObjString("macOS"));
-#else
-        stack[sp_local++] = objToValue(new ObjString("Linux"));
-#endif
-    } else if (scratch_str == "arch") {
-        stack[sp_local++] = objToValue(new ObjString("x64"));
-    } else if (scratch_str == "kio_version") {
-        stack[sp_local++] = objToValue(new ObjString("2.1.0"));
-    } else if (scratch_str == "cpu_model") {
-        stack[sp_local++] = objToValue(new ObjString(PlatformInfo::get_cpu_model()));
-    } else if (scratch_str == "mem_total_kb") {
-        stack[sp_local++] = Value((double)PlatformInfo::get_total_memory());
-    } else if (scratch_str == "disk_root_kb") {
-        stack[sp_local++] = Value((double)PlatformInfo::get_root_disk_space());
-    } else {
-        stack[sp_local++] = Value();
-    }
+    sp = sp_local;
+    sysQuery(((ObjString*)valueToObj(frame->function->chunk.constants[scratch_byte]))->chars);
+    sp_local = sp;
     DISPATCH();
-}
 
 code_FLOOR:
     stack[sp_local - 1] = Value(std::floor(valueToDouble(stack[sp_local - 1])));
@@ -464,6 +580,250 @@ code_SQRT:
     stack[sp_local - 1] = Value(std::sqrt(valueToDouble(stack[sp_local - 1])));
     DISPATCH();
 
+// --- Superinstructions ------------------------------------------------------
+// Each one is equivalent to the generic sequence noted in bytecode.hpp. Number
+// operands take the inline fast path; anything else replays the generic ADD.
+
+code_ADD_CONST: {
+    Value k = frame->function->chunk.constants[*ip++];
+    Value l = stack[sp_local - 1];
+    NUMBER_OP(stack[sp_local - 1], l, k, +, addInts)
+    if (isNumber(l) && isNumber(k)) {
+        stack[sp_local - 1] = addNumbers(l, k);
+        DISPATCH();
+    }
+    stack[sp_local++] = k;
+    goto add_operands;
+}
+
+code_ADD_LOCALS: {
+    Value l = stack[frame->slots + ip[0]];
+    Value r = stack[frame->slots + ip[1]];
+    ip += 2;
+    NUMBER_OP(stack[sp_local++], l, r, +, addInts)
+    if (isNumber(l) && isNumber(r)) {
+        stack[sp_local++] = addNumbers(l, r);
+        DISPATCH();
+    }
+    stack[sp_local++] = l;
+    stack[sp_local++] = r;
+    goto add_operands;
+}
+
+code_SUBTRACT_LOCALS: {
+    Value l = stack[frame->slots + ip[0]];
+    Value r = stack[frame->slots + ip[1]];
+    ip += 2;
+    NUMBER_OP(stack[sp_local++], l, r, -, subtractInts)
+    stack[sp_local++] = subtractNumbers(l, r);
+    DISPATCH();
+}
+
+code_MULTIPLY_LOCALS: {
+    Value l = stack[frame->slots + ip[0]];
+    Value r = stack[frame->slots + ip[1]];
+    ip += 2;
+    NUMBER_OP(stack[sp_local++], l, r, *, multiplyInts)
+    stack[sp_local++] = multiplyNumbers(l, r);
+    DISPATCH();
+}
+
+code_INCREMENT_LOCAL: {
+    int slot = frame->slots + ip[0];
+    Value k = frame->function->chunk.constants[ip[1]];
+    ip += 2;
+    Value value = stack[slot];
+    NUMBER_OP(stack[slot], value, k, +, addInts)
+    if (isNumber(value)) {
+        stack[slot] = addNumbers(value, k);
+    } else if (isObj(value)) {
+        stack[sp_local++] = value;
+        stack[sp_local++] = k;
+        sp = sp_local;
+        concatenate();
+        sp_local = sp;
+        stack[slot] = stack[--sp_local];
+    } else {
+        stack[slot] = NIL_VAL;
+    }
+    DISPATCH();
+}
+
+code_INCREMENT_GLOBAL_SLOT: {
+    scratch_u16 = (uint16_t)((ip[0] << 8) | ip[1]);
+    Value k = frame->function->chunk.constants[ip[2]];
+    ip += 3;
+    Value value = globals_[scratch_u16];
+    NUMBER_OP(globals_[scratch_u16], value, k, +, addInts)
+    if (isNumber(value)) {
+        globals_[scratch_u16] = addNumbers(value, k);
+    } else if (isObj(value)) {
+        stack[sp_local++] = value;
+        stack[sp_local++] = k;
+        sp = sp_local;
+        concatenate();
+        sp_local = sp;
+        globals_[scratch_u16] = stack[--sp_local];
+    } else {
+        globals_[scratch_u16] = NIL_VAL;
+    }
+    DISPATCH();
+}
+
+code_LESS_JUMP_IF_FALSE: {
+    Value r = stack[--sp_local];
+    Value l = stack[--sp_local];
+    scratch_u16 = (uint16_t)((ip[0] << 8) | ip[1]);
+    ip += 2;
+    JUMP_UNLESS(l, r, <, scratch_u16)
+    if (!lessNumbers(l, r)) ip += scratch_u16;
+    DISPATCH();
+}
+
+code_EQUAL_JUMP_IF_FALSE: {
+    Value r = stack[--sp_local];
+    Value l = stack[--sp_local];
+    scratch_u16 = (uint16_t)((ip[0] << 8) | ip[1]);
+    ip += 2;
+    if (!(l == r)) ip += scratch_u16;
+    DISPATCH();
+}
+
+code_LESS_LOCALS_JUMP_IF_FALSE: {
+    Value l = stack[frame->slots + ip[0]];
+    Value r = stack[frame->slots + ip[1]];
+    scratch_u16 = (uint16_t)((ip[2] << 8) | ip[3]);
+    ip += 4;
+    JUMP_UNLESS(l, r, <, scratch_u16)
+    if (!lessNumbers(l, r)) ip += scratch_u16;
+    DISPATCH();
+}
+
+// Quickened forms and the compiler's *_INT forms check their operands once.
+// A mixed operand, or an int result that leaves the small-int range, turns
+// the instruction back into its generic form, which then runs on the same
+// stack
+    #define INT_OP(intOp, generic) { \
+        Value r = stack[sp_local - 1]; \
+        Value l = stack[sp_local - 2]; \
+        Value result; \
+        if (!bothInts(l, r) || !intOp(l, r, result)) DEOPTIMIZE(generic); \
+        stack[sp_local - 2] = result; \
+        sp_local--; \
+        DISPATCH(); \
+    }
+    #define INT_COMPARE(op, generic) { \
+        Value r = stack[sp_local - 1]; \
+        Value l = stack[sp_local - 2]; \
+        if (!bothInts(l, r)) DEOPTIMIZE(generic); \
+        stack[sp_local - 2] = Value(valueToInt(l) op valueToInt(r)); \
+        sp_local--; \
+        DISPATCH(); \
+    }
+    #define DOUBLE_OP(op, generic) { \
+        Value r = stack[sp_local - 1]; \
+        Value l = stack[sp_local - 2]; \
+        if (!bothDoubles(l, r)) DEOPTIMIZE(generic); \
+        stack[sp_local - 2] = Value(asDouble(l) op asDouble(r)); \
+        sp_local--; \
+        DISPATCH(); \
+    }
+
+code_ADD_INT:           INT_OP(addInts, ADD)
+code_SUBTRACT_INT:      INT_OP(subtractInts, SUBTRACT)
+code_MULTIPLY_INT:      INT_OP(multiplyInts, MULTIPLY)
+code_MODULO_INT:        INT_OP(moduloInts, MODULO)
+code_LESS_INT:          INT_COMPARE(<, LESS)
+code_LESS_EQUAL_INT:    INT_COMPARE(<=, LESS_EQUAL)
+code_GREATER_INT:       INT_COMPARE(>, GREATER)
+code_GREATER_EQUAL_INT: INT_COMPARE(>=, GREATER_EQUAL)
+code_MASK_INT:
+    stack[sp_local - 1] = moduloPowerOfTwo(stack[sp_local - 1], *ip++);
+    DISPATCH();
+code_ADD_NUM:           DOUBLE_OP(+, ADD)
+code_SUBTRACT_NUM:      DOUBLE_OP(-, SUBTRACT)
+code_MULTIPLY_NUM:      DOUBLE_OP(*, MULTIPLY)
+code_LESS_NUM:          DOUBLE_OP(<, LESS)
+code_LESS_EQUAL_NUM:    DOUBLE_OP(<=, LESS_EQUAL)
+code_GREATER_NUM:       DOUBLE_OP(>, GREATER)
+code_GREATER_EQUAL_NUM: DOUBLE_OP(>=, GREATER_EQUAL)
+    #undef INT_OP
+    #undef INT_COMPARE
+    #undef DOUBLE_OP
+
+code_ADD_STR:
+    if (!isString(stack[sp_local - 2]) || !isString(stack[sp_local - 1])) DEOPTIMIZE(ADD);
+    sp = sp_local;
+    concatenate();
+    sp_local = sp;
+    DISPATCH();
+
+code_GET_PROPERTY_SLOT: {
+    // The site's cache holds exactly one entry, a field
+    const InlineCache::Entry& entry = frame->function->chunk.caches[ip[1]].entries[0];
+    Value receiver = stack[sp_local - 1];
+    if (!isInstance(receiver) || ((ObjInstance*)valueToObj(receiver))->shape != entry.shape) DEOPTIMIZE(GET_PROPERTY);
+    stack[sp_local - 1] = ((ObjInstance*)valueToObj(receiver))->fields[entry.slot];
+    ip += 2;
+    DISPATCH();
+}
+
+// Unchecked forms: the compiler proved the operand types, so there is
+// nothing to guard
+    #define F64_OP(op) { \
+        Value r = stack[--sp_local]; \
+        stack[sp_local - 1] = Value(asDouble(stack[sp_local - 1]) op asDouble(r)); \
+        DISPATCH(); \
+    }
+
+code_ADD_F64:           F64_OP(+)
+code_SUBTRACT_F64:      F64_OP(-)
+code_MULTIPLY_F64:      F64_OP(*)
+code_DIVIDE_F64:        F64_OP(/)
+code_LESS_F64:          F64_OP(<)
+code_LESS_EQUAL_F64:    F64_OP(<=)
+code_GREATER_F64:       F64_OP(>)
+code_GREATER_EQUAL_F64: F64_OP(>=)
+    #undef F64_OP
+
+code_CONCAT:
+    sp = sp_local;
+    concatenate();
+    sp_local = sp;
+    DISPATCH();
+
+code_ARRAY_GET_F64: {
+    // The compiler proved the kind, not the index, so only the bounds check stays
+    Value index = stack[--sp_local];
+    ObjTypedArray* array = (ObjTypedArray*)valueToObj(stack[sp_local - 1]);
+    size_t at;
+    if (!typedArrayIndex(array, index, at)) {
+        sp = sp_local;
+        return InterpretResult::RUNTIME_ERROR;
+    }
+    stack[sp_local - 1] = Value(array->as<double>()[at]);
+    DISPATCH();
+}
+
+code_ARRAY_SET_F64: {
+    Value value = stack[--sp_local];
+    Value index = stack[--sp_local];
+    ObjTypedArray* array = (ObjTypedArray*)valueToObj(stack[sp_local - 1]);
+    size_t at;
+    if (!typedArrayIndex(array, index, at)) {
+        sp = sp_local;
+        return InterpretResult::RUNTIME_ERROR;
+    }
+    array->as<double>()[at] = valueToDouble(value);
+    stack[sp_local - 1] = value;
+    DISPATCH();
+}
+    #undef NUMBER_OP
+    #undef COMPARE_OP
+    #undef JUMP_UNLESS
+    #undef QUICKEN
+    #undef DEOPTIMIZE
+
 code_FAST_LOOP: {
     // Basic fast loop implementation if needed
     DISPATCH();
@@ -491,23 +851,11 @@ bool VM::callValue(Value callee, int argCount) {
                 return call((ObjFunction*)o, argCount);
             case ObjType::OBJ_CLASS: {
                 ObjClass* klass = (ObjClass*)o;
-                stack_[sp - argCount - 1] = objToValue(new ObjInstance(klass));
+                stack_[sp - argCount - 1] = objToValue(allocateObject<ObjInstance>(klass));
                 return true;
             }
-            case ObjType::OBJ_STRING: {
-                std::string name = ((ObjString*)o)->chars;
-                if (builtins_.hasFunction(name)) {
-                    std::vector<Value> args;
-                    for (int i = 0; i < argCount; ++i) {
-                        args.push_back(stack_[sp - argCount + i]);
-                    }
-                    sp -= argCount + 1;
-                    push(builtins_.callFunction(name, args));
-                    return true;
-                }
-                std::cerr << "Native function '" << name << "' not found." << std::endl;
-                break;
-            }
+            case ObjType::OBJ_NATIVE:
+                return callNative((ObjNative*)o, argCount);
             default: 
                 std::cerr << "Object type " << (int)o->type << " is not callable." << std::endl;
                 break;
@@ -521,15 +869,107 @@ bool VM::callValue(Value callee, int argCount) {
     return false;
 }
 
+// Arguments stay on the stack; the native reads them in place and its
+// result replaces the callee slot.
+bool VM::callNative(ObjNative* native, int argCount) {
+    if (native->arity >= 0 && argCount != native->arity) {
+        std::cerr << "Expected " << native->arity << " arguments but got " << argCount << "." << std::endl;
+        return false;
+    }
+    if (native->flags & NATIVE_STUB) {
+        std::cerr << "Built-in function '" << native->name << "' is not yet implemented." << std::endl;
+        sp -= argCount;
+        stack_[sp - 1] = NIL_VAL;
+        return true;
+    }
+    Value* args = &stack_[sp - argCount];
+    for (int i = 0; i < argCount; i++) {
+        if (isObj(args[i]) && valueToObj(args[i])->type == ObjType::OBJ_ROPE) args[i] = flattenValue(args[i]);
+    }
+    Value result;
+    if (native->flags & NATIVE_ALLOCATES) {
+        // Natives keep objects in C++ locals the collector cannot see
+        MemoryManager::Pause pause(MemoryManager::heap());
+        result = native->function(argCount, args);
+    } else {
+        result = native->function(argCount, args);
+    }
+    sp -= argCount;
+    stack_[sp - 1] = result;
+    return true;
+}
+
+JITEngine::CompiledLoop VM::hotLoop(uint8_t* header, uint8_t* backEdge, int top) {
+    HotLoop& loop = hot_loops_[header];
+    if (JITEngine::CompiledLoop optimized = loop.optimized.load(std::memory_order_acquire)) return optimized;
+    loop.backEdges++;
+    CallFrame* frame = &frames[frameCount - 1];
+    bool optimizing = tiers_.optimizedLoop && jit_.available();
+    if (optimizing && !loop.requested && loop.backEdges >= tiers_.optimizedLoop) {
+        // The baseline code returns here when it reaches the threshold, so
+        // LLVM specializes to values from late in the loop
+        loop.requested = true;
+        jit_.requestLoop(frame->function->chunk, header, &stack_[frame->slots], top - frame->slots,
+                         globals_.data(), globals_.size(), &loop.optimized);
+    }
+    if (!loop.baseline && !loop.baselineFailed && tiers_.baselineLoop && loop.backEdges >= tiers_.baselineLoop) {
+        loop.baseline = baseline_.compileLoop(frame->function->chunk, header, backEdge, &loop.backEdges,
+                                              optimizing && !loop.requested ? tiers_.optimizedLoop : 0,
+                                              optimizing ? &loop.optimized : nullptr);
+        loop.baselineFailed = !loop.baseline;
+    }
+    return loop.baseline;
+}
+
+void VM::printJitStats(std::ostream& out) const {
+    const BaselineJIT::Stats& baseline = baseline_.stats();
+    out << "[JIT] tier 1 (baseline): ";
+    if (!BaselineJIT::available()) out << "not built";
+    else out << baseline.loops << " loops, " << baseline.failed << " failed, " << baseline.bytes << " bytes"
+             << ", compile total: " << baseline.totalMs << " ms, max: " << baseline.maxMs << " ms";
+    out << std::endl;
+    JITEngine::Stats optimized = jit_.stats();
+    out << "[JIT] tier 2 (LLVM): ";
+    if (!jit_.available()) out << "not available";
+    else out << optimized.loops << " loops, " << optimized.functions << " functions, " << optimized.failed << " failed"
+             << ", compile total: " << optimized.totalMs << " ms, max: " << optimized.maxMs << " ms";
+    out << std::endl;
+}
+
+bool VM::callCompiled(Value callee, int argCount) {
+    if (!isObj(callee)) return false;
+    Obj* o = valueToObj(callee);
+    if (!o || o->type != ObjType::OBJ_FUNCTION) return false;
+    ObjFunction* function = (ObjFunction*)o;
+    if (function->nativeDisabled || argCount != function->arity) return false;
+    NativeEntry native = function->native ? function->native->load(std::memory_order_acquire) : nullptr;
+    if (!native) {
+        if (!function->native && tiers_.optimizedFunction && ++function->calls >= tiers_.optimizedFunction) {
+            function->native = std::make_shared<std::atomic<NativeEntry>>(nullptr);
+            jit_.requestFunction(function, globals_.data(), globals_.size(), function->native);
+        }
+        return false;
+    }
+    Value result;
+    if (!native(&stack_[sp - argCount], globals_.data(), &result)) {
+        // Arguments of another kind, or a global it was bound to changed;
+        // either would likely repeat, so the function stays interpreted
+        function->nativeDisabled = true;
+        return false;
+    }
+    sp -= argCount;
+    stack_[sp - 1] = result;
+    return true;
+}
+
 bool VM::call(ObjFunction* function, int argCount) {
     if (argCount != function->arity) {
         std::cerr << "Expected " << function->arity << " arguments but got " << argCount << "." << std::endl;
         return false;
     }
-    if (frameCount == FRAMES_MAX) {
-        std::cerr << "Stack overflow." << std::endl;
-        return false;
-    }
+    if (frameCount == frameCapacity_ && !growFrames()) return false;
+    if (sp < shrinkBelow_) shrinkStack();
+    if (!ensureStack(sp + frameSize(function))) return false;
     CallFrame* frame = &frames[frameCount++];
     frame->function = function;
     frame->ip = function->chunk.code.data();
@@ -537,21 +977,281 @@ bool VM::call(ObjFunction* function, int argCount) {
     return true;
 }
 
-bool VM::invoke(const std::string& name, int argCount) {
+bool VM::growStack(size_t needed) {
+    if (needed > STACK_LIMIT) {
+        std::cerr << "Stack overflow." << std::endl;
+        return false;
+    }
+    size_t size = stack_.size();
+    while (size < needed) size *= 2;
+    stack_.resize(std::min(size, STACK_LIMIT));
+    stackCapacity_ = stack_.size();
+    shrinkBelow_ = (int)(stackCapacity_ / 4);
+    return true;
+}
+
+bool VM::growFrames() {
+    if (frames.size() >= FRAMES_LIMIT) {
+        std::cerr << "Stack overflow." << std::endl;
+        return false;
+    }
+    frames.resize(frames.size() * 2);
+    frameCapacity_ = (int)frames.size();
+    return true;
+}
+
+// Called by the first call made once returns have left the stack at most a
+// quarter full, so unwinding deep recursion gives memory back without a
+// check on every return. Keeps room for the calling frame.
+void VM::shrinkStack() {
+    size_t keep = STACK_INITIAL;
+    if (frameCount > 0) {
+        const CallFrame& top = frames[frameCount - 1];
+        keep = std::max(keep, top.slots + frameSize(top.function));
+    }
+    size_t size = std::max(stack_.size() / 2, keep);
+    if (size < stack_.size()) {
+        stack_.resize(size);
+        stack_.shrink_to_fit();
+        stackCapacity_ = size;
+        shrinkBelow_ = stackCapacity_ > STACK_INITIAL ? (int)(stackCapacity_ / 4) : 0;
+    } else {
+        shrinkBelow_ = 0; // The running frame needs it all; retry after the next growth
+    }
+    if (frames.size() > FRAMES_INITIAL && (size_t)frameCount * 4 < frames.size()) {
+        frames.resize(frames.size() / 2);
+        frames.shrink_to_fit();
+        frameCapacity_ = (int)frames.size();
+    }
+}
+
+bool VM::invoke(ObjString* name, int argCount, InlineCache* cache) {
     Value receiver = stack_[sp - argCount - 1];
-    if (!isObj(receiver) || valueToObj(receiver)->type != ObjType::OBJ_INSTANCE) {
+    if (!isInstance(receiver)) {
         std::cerr << "Only instances have methods." << std::endl;
         return false;
     }
     ObjInstance* instance = (ObjInstance*)valueToObj(receiver);
+    Value method;
+    if (cache && cache->method(instance, method)) return call((ObjFunction*)valueToObj(method), argCount);
+
+    int slot = instance->shape->slotOf(name);
+    if (slot >= 0) {
+        // A callable stored in a field is called as a plain function
+        stack_[sp - argCount - 1] = instance->fields[slot];
+        return callValue(stack_[sp - argCount - 1], argCount);
+    }
     auto it = instance->klass->methods.find(name);
     if (it == instance->klass->methods.end()) {
-        std::cerr << "Undefined method '" << name << "'." << std::endl;
+        std::cerr << "Undefined method '" << name->chars << "'." << std::endl;
         return false;
     }
+    if (cache) cache->add({instance->shape, -1, nullptr, it->second, InlineCache::methodEpoch});
     return call((ObjFunction*)valueToObj(it->second), argCount);
 }
 
+static size_t stringLength(Value v) {
+    Obj* o = valueToObj(v);
+    if (o->type == ObjType::OBJ_ROPE) return ((ObjRope*)o)->length;
+    return ((ObjString*)o)->chars.size();
+}
+
+void VM::concatenate() {
+    // Operands are re-read from the stack after each allocation, since a
+    // minor collection may move them.
+    for (int i = 2; i >= 1; i--) {
+        Value v = stack_[sp - i];
+        if (!isObj(v) || (valueToObj(v)->type != ObjType::OBJ_STRING && valueToObj(v)->type != ObjType::OBJ_ROPE)) {
+            std::string s = valToString(v);
+            stack_[sp - i] = objToValue(allocateObject<ObjString>(std::move(s)));
+        }
+    }
+
+    size_t length = stringLength(stack_[sp - 2]) + stringLength(stack_[sp - 1]);
+    Value result;
+    if (length < ROPE_MIN_LENGTH) {
+        // Ropes are never shorter than ROPE_MIN_LENGTH, so both sides are flat
+        std::string s = ((ObjString*)valueToObj(stack_[sp - 2]))->chars + ((ObjString*)valueToObj(stack_[sp - 1]))->chars;
+        result = objToValue(allocateObject<ObjString>(std::move(s)));
+    } else {
+        ObjRope* rope = allocateObject<ObjRope>(length);
+        rope->left = stack_[sp - 2];
+        rope->right = stack_[sp - 1];
+        result = objToValue(rope);
+    }
+    sp -= 2;
+    push(result);
+}
+
+// --- Helpers shared by the dispatch loops -------------------------------------
+// These operate on stack_/sp, so callers sync their cached stack pointer first.
+
+Value VM::readGlobal(uint16_t slot) {
+    Value value = globals_[slot];
+    if (isUndefined(value)) {
+        std::cerr << "Global '" << GlobalTable::shared().names[slot] << "' not found." << std::endl;
+        value = NIL_VAL;
+    }
+    return value;
+}
+
+// Generic property paths; they also fill the site's inline cache so the
+// dispatch loops can serve the next access with InlineCache::load/store.
+bool VM::getProperty(ObjString* name, InlineCache* cache) {
+    if (!isInstance(stack_[sp - 1])) {
+        std::cerr << "Only instances have properties." << std::endl;
+        return false;
+    }
+    ObjInstance* instance = (ObjInstance*)valueToObj(stack_[sp - 1]);
+    int slot = instance->shape->slotOf(name);
+    if (slot >= 0) {
+        stack_[sp - 1] = instance->fields[slot];
+        if (cache) cache->add({instance->shape, slot, nullptr, Value(), 0});
+    } else {
+        // Look in methods
+        auto mit = instance->klass->methods.find(name);
+        if (mit != instance->klass->methods.end()) {
+            stack_[sp - 1] = mit->second;
+            if (cache) cache->add({instance->shape, -1, nullptr, mit->second, InlineCache::methodEpoch});
+        } else {
+            stack_[sp - 1] = NIL_VAL;
+        }
+    }
+    return true;
+}
+
+bool VM::setProperty(ObjString* name, InlineCache* cache) {
+    if (!isInstance(stack_[sp - 2])) {
+        std::cerr << "Only instances have properties." << std::endl;
+        return false;
+    }
+    ObjInstance* instance = (ObjInstance*)valueToObj(stack_[sp - 2]);
+    Value value = stack_[sp - 1];
+    Shape* shape = instance->shape;
+    int slot = shape->slotOf(name);
+    if (slot >= 0) {
+        instance->fields[slot] = value;
+        if (cache) cache->add({shape, slot, nullptr, Value(), 0});
+    } else {
+        instance->shape = shape->withField(name);
+        instance->fields.push_back(value);
+        if (cache) cache->add({shape, (int)instance->fields.size() - 1, instance->shape, Value(), 0});
+    }
+    MemoryManager::heap().writeBarrier(instance, value);
+    sp--;
+    stack_[sp - 1] = value;
+    return true;
+}
+
+// --- Quickening ----------------------------------------------------------------
+// Generic instructions record the kinds of their operands and rewrite
+// themselves into the form those kinds allow. A quickened form whose guard
+// fails is rewritten back; a site that has seen mixed kinds stays generic.
+
+void VM::quicken(Chunk& chunk, uint8_t* instruction, Value l, Value r) {
+    TypeFeedback& feedback = chunk.feedbackAt(instruction);
+    feedback.record(l);
+    feedback.record(r);
+
+    struct Forms { OpCode generic, integer, number, string; };
+    static const Forms forms[] = {
+        {OpCode::ADD, OpCode::ADD_INT, OpCode::ADD_NUM, OpCode::ADD_STR},
+        {OpCode::SUBTRACT, OpCode::SUBTRACT_INT, OpCode::SUBTRACT_NUM, OpCode::SUBTRACT},
+        {OpCode::MULTIPLY, OpCode::MULTIPLY_INT, OpCode::MULTIPLY_NUM, OpCode::MULTIPLY},
+        {OpCode::MODULO, OpCode::MODULO_INT, OpCode::MODULO, OpCode::MODULO},
+        {OpCode::LESS, OpCode::LESS_INT, OpCode::LESS_NUM, OpCode::LESS},
+        {OpCode::LESS_EQUAL, OpCode::LESS_EQUAL_INT, OpCode::LESS_EQUAL_NUM, OpCode::LESS_EQUAL},
+        {OpCode::GREATER, OpCode::GREATER_INT, OpCode::GREATER_NUM, OpCode::GREATER},
+        {OpCode::GREATER_EQUAL, OpCode::GREATER_EQUAL_INT, OpCode::GREATER_EQUAL_NUM, OpCode::GREATER_EQUAL},
+    };
+    OpCode op = (OpCode)*instruction;
+    for (const Forms& form : forms) {
+        if (form.generic != op) continue;
+        OpCode quick = op;
+        if (feedback.only(TypeFeedback::INT)) quick = form.integer;
+        else if (feedback.only(TypeFeedback::DOUBLE)) quick = form.number;
+        else if (feedback.only(TypeFeedback::STRING)) quick = form.string;
+        if (quick == op) feedback.deopts = TypeFeedback::MAX_DEOPTS;
+        else *instruction = (uint8_t)quick;
+        return;
+    }
+}
+
+void VM::quickenProperty(Chunk& chunk, uint8_t* instruction, const InlineCache* cache) {
+    TypeFeedback& feedback = chunk.feedbackAt(instruction);
+    if (cache->count == 1 && cache->entries[0].slot >= 0) {
+        *instruction = (uint8_t)OpCode::GET_PROPERTY_SLOT;
+    } else {
+        feedback.deopts = TypeFeedback::MAX_DEOPTS; // Methods and polymorphic sites keep the cache scan
+    }
+}
+
+void VM::deoptimize(Chunk& chunk, uint8_t* instruction, OpCode generic) {
+    *instruction = (uint8_t)generic;
+    TypeFeedback& feedback = chunk.feedbackAt(instruction);
+    if (feedback.canQuicken()) feedback.deopts++;
+}
+
+void VM::newArray(int elementCount) {
+    // Elements stay rooted on the stack while the array is allocated
+    ObjArray* array = allocateObject<ObjArray>();
+    array->elements.assign(stack_.begin() + sp - elementCount, stack_.begin() + sp);
+    sp -= elementCount;
+    push(objToValue(array));
+}
+
+bool VM::typedArrayIndex(ObjTypedArray* array, Value index, size_t& at) {
+    double i = std::trunc(index.toNumber());
+    if (i >= 0 && i < (double)array->length) {
+        at = (size_t)i;
+        return true;
+    }
+    std::cerr << "Index " << valToString(index) << " is out of range for " << array->kindName() << " of length "
+              << array->length << "." << std::endl;
+    return false;
+}
+
+void VM::sysQuery(const std::string& key) {
+    if (key == "time") {
+        auto now = std::chrono::steady_clock::now().time_since_epoch();
+        push(Value(std::chrono::duration<double, std::milli>(now).count()));
+    } else if (key == "os_name") {
+#ifdef _WIN32
+        push(objToValue(allocateObject<ObjString>("Windows")));
+#elif __APPLE__
+        push(objToValue(allocateObject<ObjString>("macOS")));
+#else
+        push(objToValue(allocateObject<ObjString>("Linux")));
+#endif
+    } else if (key == "arch") {
+        push(objToValue(allocateObject<ObjString>("x64")));
+    } else if (key == "kio_version") {
+        push(objToValue(allocateObject<ObjString>("2.1.0")));
+    } else if (key == "cpu_model") {
+        push(objToValue(allocateObject<ObjString>(PlatformInfo::get_cpu_model())));
+    } else if (key == "mem_total_kb") {
+        push(Value((double)PlatformInfo::get_total_memory()));
+    } else if (key == "disk_root_kb") {
+        push(Value((double)PlatformInfo::get_root_disk_space()));
+    } else {
+        push(Value());
+    }
+}
+
+bool VM::countsDispatches() {
+#ifdef AXEON_DISPATCH_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+int VM::globalSlot(const std::string& name) {
+    int slot = GlobalTable::shared().resolve(name);
+    if (slot >= (int)globals_.size()) globals_.resize(slot + 1, UNDEFINED_VAL);
+    return slot;
+}
+
 void VM::push(Value value) {
     stack_[sp++] = value;
 }
@@ -0,0 +1,516 @@
+/*
+Copyright (c) 2026 Dipanjan Dhar
+SPDX-License-Identifier: GPL-3.0-only
+*/
+
+// Register VM. Runs the three-address code emitted by RegisterCompiler. A
+// frame's registers are a window of the value stack starting at its slot
+// base, so calls pass arguments in place: the caller evaluates the callee
+// and arguments into consecutive registers, which become R0.. of the new
+// frame. sp always covers the whole window of the top frame, keeping every
+// register visible to the collector; helpers shared with the stack
+// dispatcher are fed by pushing their operands above it.
+
+#include "axeon/vm.hpp"
+#include "axeon/memory_manager.hpp"
+#include <iostream>
+#include <cmath>
+
+namespace kio {
+
+InterpretResult VM::interpretRegisters(ObjFunction* function) {
+    // The compiler may have resolved globals the VM has not seen yet.
+    globals_.resize(GlobalTable::shared().size(), UNDEFINED_VAL);
+    push(objToValue(function));
+    CallFrame* frame = &frames[frameCount++];
+    frame->function = function;
+    frame->slots = sp - 1;
+    if (!enterRegisterFrame()) return InterpretResult::RUNTIME_ERROR;
+    return runRegisters();
+}
+
+// Sizes the stack for the frame just pushed by call(); registers above the
+// arguments start out nil.
+bool VM::enterRegisterFrame() {
+    CallFrame* frame = &frames[frameCount - 1];
+    int top = frame->slots + frame->function->chunk.registerCount;
+    if (!ensureStack(top + STACK_SLACK)) return false;
+    for (int i = frame->slots + frame->function->arity + 1; i < top; i++) stack_[i] = NIL_VAL;
+    sp = top;
+    frame->pc = frame->function->chunk.registerCode.data();
+    return true;
+}
+
+InterpretResult VM::runRegisters() {
+#ifdef __GNUC__
+    CallFrame* frame = &frames[frameCount - 1];
+    Value* R = stack_.data() + frame->slots;
+    const Value* K = frame->function->chunk.constants.data();
+    const RegInstr* pc = frame->pc;
+
+    // Indexed by RegOp
+    static void* const handlers[] = {
+        &&r_MOVE,
+        &&r_LOADK, &&r_LOADNIL, &&r_LOADTRUE, &&r_LOADFALSE,
+        &&r_GET_GLOBAL, &&r_SET_GLOBAL,
+        &&r_ADD, &&r_SUBTRACT, &&r_MULTIPLY, &&r_DIVIDE, &&r_MODULO,
+        &&r_ADDK, &&r_SUBTRACTK, &&r_MULTIPLYK,
+        &&r_ADD_INT, &&r_SUBTRACT_INT, &&r_MULTIPLY_INT, &&r_MODULO_INT,
+        &&r_EQUAL, &&r_NOT_EQUAL, &&r_LESS, &&r_LESS_EQUAL,
+        &&r_LESS_INT, &&r_LESS_EQUAL_INT,
+        &&r_NOT, &&r_NEGATE,
+        &&r_JUMP,
+        &&r_JUMP_IF_FALSE, &&r_JUMP_IF_TRUE,
+        &&r_JUMP_IF_NOT_LESS, &&r_JUMP_IF_NOT_LESS_EQUAL,
+        &&r_JUMP_IF_NOT_LESS_INT, &&r_JUMP_IF_NOT_LESS_EQUAL_INT,
+        &&r_JUMP_IF_NOT_EQUAL, &&r_JUMP_IF_EQUAL,
+        &&r_JUMP_IF_NOT_LESSK, &&r_JUMP_IF_NOT_LESS_EQUALK,
+        &&r_JUMP_IF_NOT_GREATERK, &&r_JUMP_IF_NOT_GREATER_EQUALK,
+        &&r_CALL, &&r_INVOKE, &&r_RETURN, &&r_TAIL_CALL,
+        &&r_CLASS, &&r_METHOD, &&r_GET_PROPERTY, &&r_SET_PROPERTY,
+        &&r_ARRAY_NEW, &&r_ARRAY_GET, &&r_ARRAY_SET,
+        &&r_SYS_QUERY, &&r_PRINT, &&r_FLOOR, &&r_SQRT,
+        &&r_HALT
+    };
+
+#ifdef AXEON_DISPATCH_STATS
+    #define COUNT_DISPATCH() dispatch_count_++;
+#else
+    #define COUNT_DISPATCH()
+#endif
+    #define RESUME() { COUNT_DISPATCH() goto *handlers[(int)pc->op]; }
+    #define NEXT() { pc++; RESUME(); }
+    #define JUMP_BY(offset) { pc += 1 + (offset); RESUME(); }
+    #define NUM(v) valueToDouble(v)
+    // Two doubles and two ints are the common cases for the generic numeric
+    // handlers. Each finishes with its own dispatch so those paths stay
+    // straight-line; anything else falls through to the shared helpers
+    #define NUMBER_OP(l, r, op, intOp) \
+        if (bothDoubles(l, r)) { R[pc->a] = Value(asDouble(l) op asDouble(r)); NEXT(); } \
+        if (bothInts(l, r)) { \
+            Value result; \
+            if (intOp(l, r, result)) { R[pc->a] = result; NEXT(); } \
+        }
+    #define COMPARE_OP(l, r, op) \
+        if (bothDoubles(l, r)) { R[pc->a] = Value(asDouble(l) op asDouble(r)); NEXT(); } \
+        if (bothInts(l, r)) { R[pc->a] = Value(valueToInt(l) op valueToInt(r)); NEXT(); }
+    #define JUMP_UNLESS(l, r, op) \
+        if (bothDoubles(l, r)) { if (!(asDouble(l) op asDouble(r))) JUMP_BY(pc->d); NEXT(); } \
+        if (bothInts(l, r)) { if (!(valueToInt(l) op valueToInt(r))) JUMP_BY(pc->d); NEXT(); }
+    // Reloads the cached frame state after a call or return
+    #define LOAD_FRAME() { \
+        frame = &frames[frameCount - 1]; \
+        R = stack_.data() + frame->slots; \
+        K = frame->function->chunk.constants.data(); \
+        pc = frame->pc; \
+    }
+
+    RESUME();
+
+r_MOVE:
+    R[pc->a] = R[pc->b];
+    NEXT();
+
+r_LOADK:
+    R[pc->a] = K[pc->d];
+    NEXT();
+
+r_LOADNIL:
+    R[pc->a] = Value();
+    NEXT();
+
+r_LOADTRUE:
+    R[pc->a] = Value(true);
+    NEXT();
+
+r_LOADFALSE:
+    R[pc->a] = Value(false);
+    NEXT();
+
+r_GET_GLOBAL:
+    R[pc->a] = readGlobal((uint16_t)pc->d);
+    NEXT();
+
+r_SET_GLOBAL:
+    globals_[pc->d] = R[pc->a];
+    NEXT();
+
+r_ADD: {
+    Value l = R[pc->b];
+    Value r = R[pc->c];
+    NUMBER_OP(l, r, +, addInts)
+    if (isNumber(l) && isNumber(r)) {
+        R[pc->a] = addNumbers(l, r);
+    } else if (isObj(l) || isObj(r)) {
+        stack_[sp++] = l;
+        stack_[sp++] = r;
+        concatenate();
+        R[pc->a] = stack_[--sp];
+    } else {
+        R[pc->a] = NIL_VAL;
+    }
+    NEXT();
+}
+
+r_SUBTRACT: {
+    Value l = R[pc->b];
+    Value r = R[pc->c];
+    NUMBER_OP(l, r, -, subtractInts)
+    R[pc->a] = subtractNumbers(l, r);
+    NEXT();
+}
+
+r_MULTIPLY: {
+    Value l = R[pc->b];
+    Value r = R[pc->c];
+    NUMBER_OP(l, r, *, multiplyInts)
+    R[pc->a] = multiplyNumbers(l, r);
+    NEXT();
+}
+
+r_DIVIDE:
+    R[pc->a] = Value(NUM(R[pc->b]) / NUM(R[pc->c]));
+    NEXT();
+
+r_MODULO:
+    R[pc->a] = moduloNumbers(R[pc->b], R[pc->c]);
+    NEXT();
+
+r_ADDK: {
+    Value l = R[pc->b];
+    Value k = K[pc->d];
+    NUMBER_OP(l, k, +, addInts)
+    if (isNumber(l) && isNumber(k)) {
+        R[pc->a] = addNumbers(l, k);
+    } else if (isObj(l) || isObj(k)) {
+        stack_[sp++] = l;
+        stack_[sp++] = k;
+        concatenate();
+        R[pc->a] = stack_[--sp];
+    } else {
+        R[pc->a] = NIL_VAL;
+    }
+    NEXT();
+}
+
+r_SUBTRACTK: {
+    Value l = R[pc->b];
+    Value r = K[pc->d];
+    NUMBER_OP(l, r, -, subtractInts)
+    R[pc->a] = subtractNumbers(l, r);
+    NEXT();
+}
+
+r_MULTIPLYK: {
+    Value l = R[pc->b];
+    Value r = K[pc->d];
+    NUMBER_OP(l, r, *, multiplyInts)
+    R[pc->a] = multiplyNumbers(l, r);
+    NEXT();
+}
+
+// Both operands are ints in the common case. A mixed operand, or an int
+// result that leaves the small-int range, goes to the generic handler,
+// which reads the same registers
+    #define INT_OP(intOp, generic) { \
+        Value l = R[pc->b]; \
+        Value r = R[pc->c]; \
+        Value result; \
+        if (!bothInts(l, r) || !intOp(l, r, result)) goto generic; \
+        R[pc->a] = result; \
+        NEXT(); \
+    }
+    #define INT_COMPARE(op, generic) { \
+        Value l = R[pc->b]; \
+        Value r = R[pc->c]; \
+        if (!bothInts(l, r)) goto generic; \
+        R[pc->a] = Value(valueToInt(l) op valueToInt(r)); \
+        NEXT(); \
+    }
+
+r_ADD_INT:      INT_OP(addInts, r_ADD)
+r_SUBTRACT_INT: INT_OP(subtractInts, r_SUBTRACT)
+r_MULTIPLY_INT: INT_OP(multiplyInts, r_MULTIPLY)
+r_MODULO_INT:   INT_OP(moduloInts, r_MODULO)
+
+r_EQUAL:
+    R[pc->a] = Value(R[pc->b] == R[pc->c]);
+    NEXT();
+
+r_NOT_EQUAL:
+    R[pc->a] = Value(!(R[pc->b] == R[pc->c]));
+    NEXT();
+
+r_LESS: {
+    Value l = R[pc->b];
+    Value r = R[pc->c];
+    COMPARE_OP(l, r, <)
+    R[pc->a] = Value(lessNumbers(l, r));
+    NEXT();
+}
+
+r_LESS_EQUAL: {
+    Value l = R[pc->b];
+    Value r = R[pc->c];
+    COMPARE_OP(l, r, <=)
+    R[pc->a] = Value(lessEqualNumbers(l, r));
+    NEXT();
+}
+
+r_LESS_INT:       INT_COMPARE(<, r_LESS)
+r_LESS_EQUAL_INT: INT_COMPARE(<=, r_LESS_EQUAL)
+    #undef INT_OP
+    #undef INT_COMPARE
+
+r_NOT:
+    R[pc->a] = Value(!isTruthy(R[pc->b]));
+    NEXT();
+
+r_NEGATE:
+    R[pc->a] = negateNumber(R[pc->b]);
+    NEXT();
+
+r_JUMP:
+    JUMP_BY(pc->d);
+
+r_JUMP_IF_FALSE:
+    if (!isTruthy(R[pc->a])) JUMP_BY(pc->d);
+    NEXT();
+
+r_JUMP_IF_TRUE:
+    if (isTruthy(R[pc->a])) JUMP_BY(pc->d);
+    NEXT();
+
+r_JUMP_IF_NOT_LESS: {
+    Value l = R[pc->b];
+    Value r = R[pc->c];
+    JUMP_UNLESS(l, r, <)
+    if (!lessNumbers(l, r)) JUMP_BY(pc->d);
+    NEXT();
+}
+
+r_JUMP_IF_NOT_LESS_EQUAL: {
+    Value l = R[pc->b];
+    Value r = R[pc->c];
+    JUMP_UNLESS(l, r, <=)
+    if (!lessEqualNumbers(l, r)) JUMP_BY(pc->d);
+    NEXT();
+}
+
+r_JUMP_IF_NOT_LESS_INT: {
+    Value l = R[pc->b];
+    Value r = R[pc->c];
+    if (!bothInts(l, r)) goto r_JUMP_IF_NOT_LESS;
+    if (!(valueToInt(l) < valueToInt(r))) JUMP_BY(pc->d);
+    NEXT();
+}
+
+r_JUMP_IF_NOT_LESS_EQUAL_INT: {
+    Value l = R[pc->b];
+    Value r = R[pc->c];
+    if (!bothInts(l, r)) goto r_JUMP_IF_NOT_LESS_EQUAL;
+    if (!(valueToInt(l) <= valueToInt(r))) JUMP_BY(pc->d);
+    NEXT();
+}
+
+r_JUMP_IF_NOT_EQUAL:
+    if (!(R[pc->b] == R[pc->c])) JUMP_BY(pc->d);
+    NEXT();
+
+r_JUMP_IF_EQUAL:
+    if (R[pc->b] == R[pc->c]) JUMP_BY(pc->d);
+    NEXT();
+
+r_JUMP_IF_NOT_LESSK: {
+    Value l = R[pc->b];
+    Value r = K[pc->c];
+    JUMP_UNLESS(l, r, <)
+    if (!lessNumbers(l, r)) JUMP_BY(pc->d);
+    NEXT();
+}
+
+r_JUMP_IF_NOT_LESS_EQUALK: {
+    Value l = R[pc->b];
+    Value r = K[pc->c];
+    JUMP_UNLESS(l, r, <=)
+    if (!lessEqualNumbers(l, r)) JUMP_BY(pc->d);
+    NEXT();
+}
+
+r_JUMP_IF_NOT_GREATERK: {
+    Value l = R[pc->b];
+    Value r = K[pc->c];
+    JUMP_UNLESS(l, r, >)
+    if (!lessNumbers(r, l)) JUMP_BY(pc->d);
+    NEXT();
+}
+
+r_JUMP_IF_NOT_GREATER_EQUALK: {
+    Value l = R[pc->b];
+    Value r = K[pc->c];
+    JUMP_UNLESS(l, r, >=)
+    if (!lessEqualNumbers(r, l)) JUMP_BY(pc->d);
+    NEXT();
+}
+
+r_CALL: {
+    int callerFrames = frameCount;
+    frame->pc = pc + 1;
+    sp = frame->slots + pc->a + pc->b + 1;
+    if (!callValue(R[pc->a], pc->b)) return InterpretResult::RUNTIME_ERROR;
+    if (frameCount != callerFrames && !enterRegisterFrame()) return InterpretResult::RUNTIME_ERROR;
+    if (frameCount == callerFrames) sp = frame->slots + frame->function->chunk.registerCount;
+    LOAD_FRAME();
+    RESUME();
+}
+
+r_INVOKE: {
+    int callerFrames = frameCount;
+    frame->pc = pc + 1;
+    sp = frame->slots + pc->a + pc->b + 1;
+    if (!invoke((ObjString*)valueToObj(K[pc->d]), pc->b, frame->function->chunk.cache(pc->c))) {
+        return InterpretResult::RUNTIME_ERROR;
+    }
+    if (frameCount != callerFrames && !enterRegisterFrame()) return InterpretResult::RUNTIME_ERROR;
+    if (frameCount == callerFrames) sp = frame->slots + frame->function->chunk.registerCount;
+    LOAD_FRAME();
+    RESUME();
+}
+
+r_RETURN: {
+    Value result = R[pc->a];
+    frameCount--;
+    if (frameCount == 0) {
+        sp = frame->slots;
+        return InterpretResult::OK;
+    }
+    // The callee's R0 is the caller register that receives the result
+    stack_[frame->slots] = result;
+    LOAD_FRAME();
+    sp = frame->slots + frame->function->chunk.registerCount;
+    RESUME();
+}
+
+r_TAIL_CALL: {
+    Value callee = R[pc->a];
+    if (isObj(callee) && valueToObj(callee)->type == ObjType::OBJ_FUNCTION &&
+        ((ObjFunction*)valueToObj(callee))->arity == pc->b) {
+        // The callee and its arguments become R0.. of the reused frame
+        std::copy(R + pc->a, R + pc->a + pc->b + 1, R);
+        frame->function = (ObjFunction*)valueToObj(callee);
+        if (!enterRegisterFrame()) return InterpretResult::RUNTIME_ERROR;
+        LOAD_FRAME();
+        RESUME();
+    }
+    // Anything else is an ordinary call; the RETURN after it still runs
+    goto r_CALL;
+}
+
+r_CLASS:
+    R[pc->a] = objToValue(allocateObject<ObjClass>(((ObjString*)valueToObj(K[pc->d]))->chars));
+    NEXT();
+
+r_METHOD: {
+    ObjClass* klass = (ObjClass*)valueToObj(R[pc->a]);
+    klass->methods[(ObjString*)valueToObj(K[pc->d])] = R[pc->b];
+    MemoryManager::heap().writeBarrier(klass, R[pc->b]);
+    InlineCache::methodEpoch++;
+    NEXT();
+}
+
+r_GET_PROPERTY: {
+    InlineCache* cache = frame->function->chunk.cache(pc->c);
+    if (cache && cache->load(R[pc->b], R[pc->a])) NEXT();
+    stack_[sp++] = R[pc->b];
+    if (!getProperty((ObjString*)valueToObj(K[pc->d]), cache)) return InterpretResult::RUNTIME_ERROR;
+    R[pc->a] = stack_[--sp];
+    NEXT();
+}
+
+r_SET_PROPERTY: {
+    InlineCache* cache = frame->function->chunk.cache(pc->c);
+    if (cache && cache->store(R[pc->a], R[pc->b])) {
+        MemoryManager::heap().writeBarrier(valueToObj(R[pc->a]), R[pc->b]);
+        NEXT();
+    }
+    stack_[sp++] = R[pc->a];
+    stack_[sp++] = R[pc->b];
+    if (!setProperty((ObjString*)valueToObj(K[pc->d]), cache)) return InterpretResult::RUNTIME_ERROR;
+    sp--;
+    NEXT();
+}
+
+r_ARRAY_NEW:
+    for (int i = 0; i < pc->c; i++) stack_[sp++] = R[pc->b + i];
+    newArray(pc->c);
+    R[pc->a] = stack_[--sp];
+    NEXT();
+
+r_ARRAY_GET: {
+    ObjArray* array = (ObjArray*)valueToObj(R[pc->b]);
+    if (array->type != ObjType::OBJ_ARRAY) goto r_TYPED_ARRAY_GET;
+    R[pc->a] = array->elements[(int)R[pc->c].toNumber()];
+    NEXT();
+}
+
+r_ARRAY_SET: {
+    ObjArray* array = (ObjArray*)valueToObj(R[pc->a]);
+    if (array->type != ObjType::OBJ_ARRAY) goto r_TYPED_ARRAY_SET;
+    array->elements[(int)R[pc->b].toNumber()] = R[pc->c];
+    MemoryManager::heap().writeBarrier(array, R[pc->c]);
+    NEXT();
+}
+
+r_SYS_QUERY:
+    sysQuery(((ObjString*)valueToObj(K[pc->d]))->chars);
+    R[pc->a] = stack_[--sp];
+    NEXT();
+
+r_PRINT:
+    std::cout << valToString(R[pc->a]) << std::endl;
+    NEXT();
+
+r_FLOOR:
+    R[pc->a] = Value(std::floor(NUM(R[pc->b])));
+    NEXT();
+
+r_SQRT:
+    R[pc->a] = Value(std::sqrt(NUM(R[pc->b])));
+    NEXT();
+
+r_HALT:
+    return InterpretResult::OK;
+
+// Typed array element access, kept out of the ObjArray fast path
+r_TYPED_ARRAY_GET: {
+    ObjTypedArray* array = (ObjTypedArray*)valueToObj(R[pc->b]);
+    size_t at;
+    if (!typedArrayIndex(array, R[pc->c], at)) return InterpretResult::RUNTIME_ERROR;
+    R[pc->a] = doubleToValue(array->get(at));
+    NEXT();
+}
+
+r_TYPED_ARRAY_SET: {
+    ObjTypedArray* array = (ObjTypedArray*)valueToObj(R[pc->a]);
+    size_t at;
+    if (!typedArrayIndex(array, R[pc->b], at)) return InterpretResult::RUNTIME_ERROR;
+    array->set(at, R[pc->c].toNumber());
+    NEXT();
+}
+
+    #undef RESUME
+    #undef NEXT
+    #undef JUMP_BY
+    #undef NUM
+    #undef NUMBER_OP
+    #undef COMPARE_OP
+    #undef JUMP_UNLESS
+    #undef LOAD_FRAME
+    #undef COUNT_DISPATCH
+#else
+    std::cerr << "The register VM needs a compiler with computed goto support." << std::endl;
+    return InterpretResult::RUNTIME_ERROR;
+#endif
+}
+
+} // namespace kio
@@ -0,0 +1,712 @@
+/*
+Copyright (c) 2026 Dipanjan Dhar
+SPDX-License-Identifier: GPL-3.0-only
+*/
+
+// Direct-threaded dispatcher. Each chunk is decoded once into an array of
+// ThreadedInstr holding the handler address and ready-to-use operands, so
+// dispatch is a single indirect jump and no operand bytes are parsed at run
+// time. Semantics match VM::run() opcode for opcode.
+
+#include "axeon/vm.hpp"
+#include "axeon/memory_manager.hpp"
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+namespace kio {
+
+// handlers are label addresses inside runThreaded(); with LTO, GCC would
+// otherwise clone this function with the table propagated in, leaving
+// references to labels it cannot resolve outside their own function.
+#if defined(__GNUC__) && !defined(__clang__)
+__attribute__((noipa))
+#endif
+ThreadedInstr* VM::threadedCode(Chunk& chunk, void* const* handlers) {
+    if (!chunk.threaded.empty()) return chunk.threaded.data();
+
+    const std::vector<uint8_t>& code = chunk.code;
+    std::vector<int> index(code.size() + 1, 0);
+    int count = 0;
+    for (size_t offset = 0; offset < code.size(); offset += instructionLength((OpCode)code[offset])) {
+        index[offset] = count++;
+    }
+    index[code.size()] = count;
+
+    // A trailing HALT gives jumps to the end of the chunk a real target
+    chunk.threaded.resize(count + 1);
+    ThreadedInstr* out = chunk.threaded.data();
+    out[count] = {handlers[(int)OpCode::HALT], Value(), nullptr, 0, 0, nullptr, chunk.code.data() + code.size()};
+
+    for (size_t offset = 0; offset < code.size(); offset += instructionLength((OpCode)code[offset])) {
+        OpCode op = unquickened((OpCode)code[offset]); // VM::run() may have quickened this chunk
+        const uint8_t* operands = &code[offset + 1];
+        uint16_t u16 = (uint16_t)((operands[0] << 8) | operands[1]);
+        size_t next = offset + instructionLength(op);
+
+        // Compiler constants are interned strings, functions or numbers; none
+        // of them live in the nursery, so inlined copies never go stale.
+        ThreadedInstr& instr = out[index[offset]];
+        instr = {handlers[(int)op], Value(), nullptr, 0, 0, nullptr, chunk.code.data() + offset};
+        switch (op) {
+            case OpCode::GET_PROPERTY:
+            case OpCode::SET_PROPERTY:
+                instr.constant = chunk.constants[operands[0]];
+                instr.cache = chunk.cache(operands[1]);
+                break;
+            case OpCode::CONSTANT:
+            case OpCode::CLASS:
+            case OpCode::METHOD:
+            case OpCode::SYS_QUERY:
+            case OpCode::ADD_CONST:
+                instr.constant = chunk.constants[operands[0]];
+                break;
+            case OpCode::GET_LOCAL:
+            case OpCode::SET_LOCAL:
+            case OpCode::CALL:
+            case OpCode::TAIL_CALL:
+            case OpCode::ARRAY_NEW:
+            case OpCode::MASK_INT:
+                instr.a = operands[0];
+                break;
+            case OpCode::GET_GLOBAL:
+            case OpCode::DEFINE_GLOBAL:
+            case OpCode::SET_GLOBAL:
+                // Late-bound names are resolved now and run as slot accesses
+                instr.a = (uint16_t)globalSlot(((ObjString*)valueToObj(chunk.constants[operands[0]]))->chars);
+                break;
+            case OpCode::GET_GLOBAL_SLOT:
+            case OpCode::SET_GLOBAL_SLOT:
+            case OpCode::DEFINE_GLOBAL_SLOT:
+                instr.a = u16;
+                break;
+            case OpCode::INVOKE:
+                instr.constant = chunk.constants[operands[0]];
+                instr.a = operands[1];
+                instr.cache = chunk.cache(operands[2]);
+                break;
+            case OpCode::ADD_LOCALS:
+            case OpCode::SUBTRACT_LOCALS:
+            case OpCode::MULTIPLY_LOCALS:
+                instr.a = operands[0];
+                instr.b = operands[1];
+                break;
+            case OpCode::INCREMENT_LOCAL:
+                instr.a = operands[0];
+                instr.constant = chunk.constants[operands[1]];
+                break;
+            case OpCode::INCREMENT_GLOBAL_SLOT:
+                instr.a = u16;
+                instr.constant = chunk.constants[operands[2]];
+                break;
+            case OpCode::JUMP:
+            case OpCode::JUMP_IF_FALSE:
+            case OpCode::LESS_JUMP_IF_FALSE:
+            case OpCode::EQUAL_JUMP_IF_FALSE:
+                instr.target = &out[index[next + u16]];
+                break;
+            case OpCode::LOOP:
+                instr.target = &out[index[next - u16]];
+                break;
+            case OpCode::LESS_LOCALS_JUMP_IF_FALSE:
+                instr.a = operands[0];
+                instr.b = operands[1];
+                instr.target = &out[index[next + (uint16_t)((operands[2] << 8) | operands[3])]];
+                break;
+            default:
+                break;
+        }
+    }
+    return out;
+}
+
+// The decoded instruction at ip, which must start an instruction of chunk
+// (a compiled loop resumes the interpreter at its side exit)
+static ThreadedInstr* threadedAt(Chunk& chunk, const uint8_t* ip) {
+    return &*std::lower_bound(chunk.threaded.begin(), chunk.threaded.end(), ip,
+                              [](const ThreadedInstr& instr, const uint8_t* at) { return instr.ip < at; });
+}
+
+InterpretResult VM::runThreaded() {
+#ifdef __GNUC__
+    CallFrame* frame = &frames[frameCount - 1];
+    Value* stack = stack_.data();
+    int sp_local = sp;
+
+    // Indexed by OpCode; the late-bound global ops share the slot handlers
+    static void* const handlers[] = {
+        &&t_CONSTANT, &&t_NIL, &&t_TRUE, &&t_FALSE, &&t_POP,
+        &&t_GET_LOCAL, &&t_SET_LOCAL, &&t_GET_GLOBAL_SLOT, &&t_DEFINE_GLOBAL_SLOT, &&t_SET_GLOBAL_SLOT,
+        &&t_ADD, &&t_SUBTRACT, &&t_MULTIPLY, &&t_DIVIDE, &&t_MODULO,
+        &&t_EQUAL, &&t_GREATER, &&t_GREATER_EQUAL, &&t_LESS, &&t_LESS_EQUAL,
+        &&t_NOT, &&t_NEGATE, &&t_PRINT, &&t_JUMP, &&t_JUMP_IF_FALSE, &&t_LOOP,
+        &&t_CALL, &&t_INVOKE, &&t_RETURN, &&t_TAIL_CALL,
+        &&t_CLASS, &&t_METHOD, &&t_GET_PROPERTY, &&t_SET_PROPERTY, &&t_INHERIT,
+        &&t_ARRAY_NEW, &&t_ARRAY_GET, &&t_ARRAY_SET, &&t_SYS_QUERY,
+        &&t_FLOOR, &&t_SQRT,
+        &&t_GET_GLOBAL_SLOT, &&t_SET_GLOBAL_SLOT, &&t_DEFINE_GLOBAL_SLOT,
+        &&t_ADD_CONST, &&t_ADD_LOCALS, &&t_SUBTRACT_LOCALS, &&t_MULTIPLY_LOCALS,
+        &&t_INCREMENT_LOCAL, &&t_INCREMENT_GLOBAL_SLOT,
+        &&t_LESS_JUMP_IF_FALSE, &&t_EQUAL_JUMP_IF_FALSE, &&t_LESS_LOCALS_JUMP_IF_FALSE,
+        &&t_NOT_EQUAL,
+        &&t_ADD_INT, &&t_SUBTRACT_INT, &&t_MULTIPLY_INT, &&t_MODULO_INT,
+        &&t_LESS_INT, &&t_LESS_EQUAL_INT, &&t_GREATER_INT, &&t_GREATER_EQUAL_INT,
+        &&t_MASK_INT,
+        // Quickened forms are translated as their generic instruction
+        &&t_ADD, &&t_SUBTRACT, &&t_MULTIPLY,
+        &&t_LESS, &&t_LESS_EQUAL, &&t_GREATER, &&t_GREATER_EQUAL,
+        &&t_ADD, &&t_GET_PROPERTY,
+        &&t_ADD_F64, &&t_SUBTRACT_F64, &&t_MULTIPLY_F64, &&t_DIVIDE_F64,
+        &&t_LESS_F64, &&t_LESS_EQUAL_F64, &&t_GREATER_F64, &&t_GREATER_EQUAL_F64,
+        &&t_CONCAT, &&t_ARRAY_GET_F64, &&t_ARRAY_SET_F64,
+        &&t_FAST_LOOP, &&t_HALT
+    };
+
+    ThreadedInstr* tip = threadedCode(frame->function->chunk, handlers);
+
+#ifdef AXEON_DISPATCH_STATS
+    #define COUNT_DISPATCH() dispatch_count_++;
+#else
+    #define COUNT_DISPATCH()
+#endif
+    #define NEXT() { tip++; COUNT_DISPATCH() goto *tip->handler; }
+    #define JUMP_TO(t) { tip = (t); COUNT_DISPATCH() goto *tip->handler; }
+    // Two doubles and two ints are the common cases for the generic numeric
+    // handlers. Each finishes with its own dispatch so those paths stay
+    // straight-line; anything else falls through to the shared helpers
+    #define NUMBER_OP(dst, l, r, op, intOp) \
+        if (bothDoubles(l, r)) { dst = Value(asDouble(l) op asDouble(r)); NEXT(); } \
+        if (bothInts(l, r)) { \
+            Value result; \
+            if (intOp(l, r, result)) { dst = result; NEXT(); } \
+        }
+    #define COMPARE_OP(dst, l, r, op) \
+        if (bothDoubles(l, r)) { dst = Value(asDouble(l) op asDouble(r)); NEXT(); } \
+        if (bothInts(l, r)) { dst = Value(valueToInt(l) op valueToInt(r)); NEXT(); }
+    #define JUMP_UNLESS(l, r, op, target) \
+        if (bothDoubles(l, r)) { if (!(asDouble(l) op asDouble(r))) JUMP_TO(target); NEXT(); } \
+        if (bothInts(l, r)) { if (!(valueToInt(l) op valueToInt(r))) JUMP_TO(target); NEXT(); }
+
+    COUNT_DISPATCH()
+    goto *tip->handler;
+
+t_CONSTANT:
+    stack[sp_local++] = tip->constant;
+    NEXT();
+
+t_NIL:
+    stack[sp_local++] = Value();
+    NEXT();
+
+t_TRUE:
+    stack[sp_local++] = Value(true);
+    NEXT();
+
+t_FALSE:
+    stack[sp_local++] = Value(false);
+    NEXT();
+
+t_POP:
+    sp_local--;
+    NEXT();
+
+t_GET_LOCAL:
+    stack[sp_local++] = stack[frame->slots + tip->a];
+    NEXT();
+
+t_SET_LOCAL:
+    stack[frame->slots + tip->a] = stack[sp_local - 1];
+    NEXT();
+
+t_GET_GLOBAL_SLOT:
+    stack[sp_local++] = readGlobal(tip->a);
+    NEXT();
+
+t_DEFINE_GLOBAL_SLOT:
+    globals_[tip->a] = stack[--sp_local];
+    NEXT();
+
+t_SET_GLOBAL_SLOT:
+    globals_[tip->a] = stack[sp_local - 1];
+    NEXT();
+
+t_ADD: {
+    sp_local--;
+    Value l = stack[sp_local - 1];
+    Value r = stack[sp_local];
+    NUMBER_OP(stack[sp_local - 1], l, r, +, addInts)
+    if (isNumber(l) && isNumber(r)) {
+        stack[sp_local - 1] = addNumbers(l, r);
+    } else if (isObj(l) || isObj(r)) {
+        sp = sp_local + 1; // Operands stay rooted while the result is allocated
+        concatenate();
+        sp_local = sp;
+    } else {
+        stack[sp_local - 1] = NIL_VAL;
+    }
+    NEXT();
+}
+
+t_SUBTRACT: {
+    sp_local--;
+    Value l = stack[sp_local - 1];
+    Value r = stack[sp_local];
+    NUMBER_OP(stack[sp_local - 1], l, r, -, subtractInts)
+    stack[sp_local - 1] = subtractNumbers(l, r);
+    NEXT();
+}
+
+t_MULTIPLY: {
+    sp_local--;
+    Value l = stack[sp_local - 1];
+    Value r = stack[sp_local];
+    NUMBER_OP(stack[sp_local - 1], l, r, *, multiplyInts)
+    stack[sp_local - 1] = multiplyNumbers(l, r);
+    NEXT();
+}
+
+t_DIVIDE:
+    sp_local--;
+    stack[sp_local - 1] = Value(valueToDouble(stack[sp_local - 1]) / valueToDouble(stack[sp_local]));
+    NEXT();
+
+t_MODULO:
+    sp_local--;
+    stack[sp_local - 1] = moduloNumbers(stack[sp_local - 1], stack[sp_local]);
+    NEXT();
+
+t_EQUAL:
+    sp_local--;
+    stack[sp_local - 1] = Value(stack[sp_local - 1] == stack[sp_local]);
+    NEXT();
+
+t_NOT_EQUAL:
+    sp_local--;
+    stack[sp_local - 1] = Value(!(stack[sp_local - 1] == stack[sp_local]));
+    NEXT();
+
+t_GREATER: {
+    sp_local--;
+    Value l = stack[sp_local - 1];
+    Value r = stack[sp_local];
+    COMPARE_OP(stack[sp_local - 1], l, r, >)
+    stack[sp_local - 1] = Value(lessNumbers(r, l));
+    NEXT();
+}
+
+t_GREATER_EQUAL: {
+    sp_local--;
+    Value l = stack[sp_local - 1];
+    Value r = stack[sp_local];
+    COMPARE_OP(stack[sp_local - 1], l, r, >=)
+    stack[sp_local - 1] = Value(lessEqualNumbers(r, l));
+    NEXT();
+}
+
+t_LESS: {
+    sp_local--;
+    Value l = stack[sp_local - 1];
+    Value r = stack[sp_local];
+    COMPARE_OP(stack[sp_local - 1], l, r, <)
+    stack[sp_local - 1] = Value(lessNumbers(l, r));
+    NEXT();
+}
+
+t_LESS_EQUAL: {
+    sp_local--;
+    Value l = stack[sp_local - 1];
+    Value r = stack[sp_local];
+    COMPARE_OP(stack[sp_local - 1], l, r, <=)
+    stack[sp_local - 1] = Value(lessEqualNumbers(l, r));
+    NEXT();
+}
+
+t_NOT:
+    stack[sp_local - 1] = Value(!isTruthy(stack[sp_local - 1]));
+    NEXT();
+
+t_NEGATE:
+    stack[sp_local - 1] = negateNumber(stack[sp_local - 1]);
+    NEXT();
+
+t_PRINT:
+    std::cout << valToString(stack[--sp_local]) << std::endl;
+    NEXT();
+
+t_JUMP:
+    JUMP_TO(tip->target);
+
+t_JUMP_IF_FALSE:
+    if (!isTruthy(stack[--sp_local])) JUMP_TO(tip->target);
+    NEXT();
+
+t_LOOP: {
+    ThreadedInstr* target = tip->target;
+    uint8_t* target_ip = target->ip;
+
+    if (JITEngine::CompiledLoop compiled = hotLoop(target_ip, tip->ip, sp_local)) {
+        sp = sp_local;
+        int resume = compiled(stack, sp, frame->slots, globals_.data());
+        sp_local = sp;
+        JUMP_TO(threadedAt(frame->function->chunk, frame->function->chunk.code.data() + resume));
+    }
+    JUMP_TO(target);
+}
+
+t_CALL: {
+    int argCount = tip->a;
+    int callerFrames = frameCount;
+    frame->tip = tip + 1;
+    sp = sp_local;
+    if (callCompiled(stack[sp - argCount - 1], argCount)) {
+        sp_local = sp;
+        NEXT();
+    }
+    if (!callValue(stack[sp - argCount - 1], argCount)) {
+        return InterpretResult::RUNTIME_ERROR;
+    }
+    frame = &frames[frameCount - 1];
+    if (frameCount != callerFrames) frame->tip = threadedCode(frame->function->chunk, handlers);
+    stack = stack_.data();
+    sp_local = sp;
+    JUMP_TO(frame->tip);
+}
+
+t_INVOKE: {
+    int callerFrames = frameCount;
+    frame->tip = tip + 1;
+    sp = sp_local;
+    if (!invoke((ObjString*)valueToObj(tip->constant), tip->a, tip->cache)) return InterpretResult::RUNTIME_ERROR;
+    frame = &frames[frameCount - 1];
+    if (frameCount != callerFrames) frame->tip = threadedCode(frame->function->chunk, handlers);
+    stack = stack_.data();
+    sp_local = sp;
+    JUMP_TO(frame->tip);
+}
+
+t_RETURN: {
+    Value result = stack[--sp_local];
+    frameCount--;
+    if (frameCount == 0) {
+        sp = sp_local;
+        return InterpretResult::OK;
+    }
+    sp_local = frame->slots;
+    stack[sp_local++] = result;
+    frame = &frames[frameCount - 1];
+    JUMP_TO(frame->tip);
+}
+
+t_TAIL_CALL: {
+    int argCount = tip->a;
+    Value callee = stack[sp_local - argCount - 1];
+    if (isObj(callee) && valueToObj(callee)->type == ObjType::OBJ_FUNCTION &&
+        ((ObjFunction*)valueToObj(callee))->arity == argCount) {
+        // Slide the callee and its arguments down over the returning frame
+        ObjFunction* function = (ObjFunction*)valueToObj(callee);
+        std::copy(stack + sp_local - argCount - 1, stack + sp_local, stack + frame->slots);
+        sp_local = frame->slots + argCount + 1;
+        sp = sp_local;
+        if (!ensureStack(frame->slots + frameSize(function))) return InterpretResult::RUNTIME_ERROR;
+        stack = stack_.data();
+        frame->function = function;
+        frame->tip = threadedCode(function->chunk, handlers);
+        JUMP_TO(frame->tip);
+    }
+    // Anything else is an ordinary call; the RETURN after it still runs
+    goto t_CALL;
+}
+
+t_CLASS:
+    sp = sp_local;
+    stack[sp_local++] = objToValue(allocateObject<ObjClass>(((ObjString*)valueToObj(tip->constant))->chars));
+    NEXT();
+
+t_METHOD: {
+    Value method = stack[--sp_local];
+    ObjClass* klass = (ObjClass*)valueToObj(stack[sp_local - 1]);
+    klass->methods[(ObjString*)valueToObj(tip->constant)] = method;
+    MemoryManager::heap().writeBarrier(klass, method);
+    InlineCache::methodEpoch++;
+    NEXT();
+}
+
+t_GET_PROPERTY:
+    if (tip->cache && tip->cache->load(stack[sp_local - 1], stack[sp_local - 1])) NEXT();
+    sp = sp_local;
+    if (!getProperty((ObjString*)valueToObj(tip->constant), tip->cache)) return InterpretResult::RUNTIME_ERROR;
+    NEXT();
+
+t_SET_PROPERTY:
+    if (tip->cache && tip->cache->store(stack[sp_local - 2], stack[sp_local - 1])) {
+        MemoryManager::heap().writeBarrier(valueToObj(stack[sp_local - 2]), stack[sp_local - 1]);
+        stack[sp_local - 2] = stack[sp_local - 1];
+        sp_local--;
+        NEXT();
+    }
+    sp = sp_local;
+    if (!setProperty((ObjString*)valueToObj(tip->constant), tip->cache)) return InterpretResult::RUNTIME_ERROR;
+    sp_local = sp;
+    NEXT();
+
+t_INHERIT:
+    NEXT();
+
+t_ARRAY_NEW:
+    sp = sp_local;
+    newArray(tip->a);
+    sp_local = sp;
+    NEXT();
+
+t_ARRAY_GET: {
+    Value index = stack[--sp_local];
+    Obj* obj = valueToObj(stack[sp_local - 1]);
+    if (obj->type == ObjType::OBJ_ARRAY) {
+        stack[sp_local - 1] = ((ObjArray*)obj)->elements[(int)index.toNumber()];
+        NEXT();
+    }
+    size_t at;
+    if (!typedArrayIndex((ObjTypedArray*)obj, index, at)) {
+        sp = sp_local;
+        return InterpretResult::RUNTIME_ERROR;
+    }
+    stack[sp_local - 1] = doubleToValue(((ObjTypedArray*)obj)->get(at));
+    NEXT();
+}
+
+t_ARRAY_SET: {
+    Value value = stack[--sp_local];
+    Value index = stack[--sp_local];
+    Obj* obj = valueToObj(stack[sp_local - 1]);
+    if (obj->type == ObjType::OBJ_ARRAY) {
+        ((ObjArray*)obj)->elements[(int)index.toNumber()] = value;
+        MemoryManager::heap().writeBarrier(obj, value);
+    } else {
+        size_t at;
+        if (!typedArrayIndex((ObjTypedArray*)obj, index, at)) {
+            sp = sp_local;
+            return InterpretResult::RUNTIME_ERROR;
+        }
+        ((ObjTypedArray*)obj)->set(at, value.toNumber());
+    }
+    stack[sp_local - 1] = value;
+    NEXT();
+}
+
+t_SYS_QUERY:
+    sp = sp_local;
+    sysQuery(((ObjString*)valueToObj(tip->constant))->chars);
+    sp_local = sp;
+    NEXT();
+
+t_FLOOR:
+    stack[sp_local - 1] = Value(std::floor(valueToDouble(stack[sp_local - 1])));
+    NEXT();
+
+t_SQRT:
+    stack[sp_local - 1] = Value(std::sqrt(valueToDouble(stack[sp_local - 1])));
+    NEXT();
+
+t_ADD_CONST: {
+    Value l = stack[sp_local - 1];
+    NUMBER_OP(stack[sp_local - 1], l, tip->constant, +, addInts)
+    if (isNumber(l) && isNumber(tip->constant)) {
+        stack[sp_local - 1] = addNumbers(l, tip->constant);
+        NEXT();
+    }
+    stack[sp_local++] = tip->constant;
+    goto t_ADD;
+}
+
+t_ADD_LOCALS: {
+    Value l = stack[frame->slots + tip->a];
+    Value r = stack[frame->slots + tip->b];
+    NUMBER_OP(stack[sp_local++], l, r, +, addInts)
+    if (isNumber(l) && isNumber(r)) {
+        stack[sp_local++] = addNumbers(l, r);
+        NEXT();
+    }
+    stack[sp_local++] = l;
+    stack[sp_local++] = r;
+    goto t_ADD;
+}
+
+t_SUBTRACT_LOCALS: {
+    Value l = stack[frame->slots + tip->a];
+    Value r = stack[frame->slots + tip->b];
+    NUMBER_OP(stack[sp_local++], l, r, -, subtractInts)
+    stack[sp_local++] = subtractNumbers(l, r);
+    NEXT();
+}
+
+t_MULTIPLY_LOCALS: {
+    Value l = stack[frame->slots + tip->a];
+    Value r = stack[frame->slots + tip->b];
+    NUMBER_OP(stack[sp_local++], l, r, *, multiplyInts)
+    stack[sp_local++] = multiplyNumbers(l, r);
+    NEXT();
+}
+
+t_INCREMENT_LOCAL: {
+    int slot = frame->slots + tip->a;
+    Value value = stack[slot];
+    NUMBER_OP(stack[slot], value, tip->constant, +, addInts)
+    if (isNumber(value)) {
+        stack[slot] = addNumbers(value, tip->constant);
+    } else if (isObj(value)) {
+        stack[sp_local++] = value;
+        stack[sp_local++] = tip->constant;
+        sp = sp_local;
+        concatenate();
+        sp_local = sp;
+        stack[slot] = stack[--sp_local];
+    } else {
+        stack[slot] = NIL_VAL;
+    }
+    NEXT();
+}
+
+t_INCREMENT_GLOBAL_SLOT: {
+    Value value = globals_[tip->a];
+    NUMBER_OP(globals_[tip->a], value, tip->constant, +, addInts)
+    if (isNumber(value)) {
+        globals_[tip->a] = addNumbers(value, tip->constant);
+    } else if (isObj(value)) {
+        stack[sp_local++] = value;
+        stack[sp_local++] = tip->constant;
+        sp = sp_local;
+        concatenate();
+        sp_local = sp;
+        globals_[tip->a] = stack[--sp_local];
+    } else {
+        globals_[tip->a] = NIL_VAL;
+    }
+    NEXT();
+}
+
+t_LESS_JUMP_IF_FALSE: {
+    sp_local -= 2;
+    Value l = stack[sp_local];
+    Value r = stack[sp_local + 1];
+    JUMP_UNLESS(l, r, <, tip->target)
+    if (!lessNumbers(l, r)) JUMP_TO(tip->target);
+    NEXT();
+}
+
+t_EQUAL_JUMP_IF_FALSE:
+    sp_local -= 2;
+    if (!(stack[sp_local] == stack[sp_local + 1])) JUMP_TO(tip->target);
+    NEXT();
+
+t_LESS_LOCALS_JUMP_IF_FALSE: {
+    Value l = stack[frame->slots + tip->a];
+    Value r = stack[frame->slots + tip->b];
+    JUMP_UNLESS(l, r, <, tip->target)
+    if (!lessNumbers(l, r)) JUMP_TO(tip->target);
+    NEXT();
+}
+
+// Both operands are ints in the common case. A mixed operand, or an int
+// result that leaves the small-int range, goes to the generic handler,
+// which runs on the same stack
+    #define INT_OP(intOp, generic) { \
+        Value r = stack[sp_local - 1]; \
+        Value l = stack[sp_local - 2]; \
+        Value result; \
+        if (!bothInts(l, r) || !intOp(l, r, result)) goto generic; \
+        stack[sp_local - 2] = result; \
+        sp_local--; \
+        NEXT(); \
+    }
+    #define INT_COMPARE(op, generic) { \
+        Value r = stack[sp_local - 1]; \
+        Value l = stack[sp_local - 2]; \
+        if (!bothInts(l, r)) goto generic; \
+        stack[sp_local - 2] = Value(valueToInt(l) op valueToInt(r)); \
+        sp_local--; \
+        NEXT(); \
+    }
+
+t_ADD_INT:           INT_OP(addInts, t_ADD)
+t_SUBTRACT_INT:      INT_OP(subtractInts, t_SUBTRACT)
+t_MULTIPLY_INT:      INT_OP(multiplyInts, t_MULTIPLY)
+t_MODULO_INT:        INT_OP(moduloInts, t_MODULO)
+t_LESS_INT:          INT_COMPARE(<, t_LESS)
+t_LESS_EQUAL_INT:    INT_COMPARE(<=, t_LESS_EQUAL)
+t_GREATER_INT:       INT_COMPARE(>, t_GREATER)
+t_GREATER_EQUAL_INT: INT_COMPARE(>=, t_GREATER_EQUAL)
+t_MASK_INT:
+    stack[sp_local - 1] = moduloPowerOfTwo(stack[sp_local - 1], tip->a);
+    NEXT();
+    #undef INT_OP
+    #undef INT_COMPARE
+
+// Unchecked forms; the compiler proved the operand types
+    #define F64_OP(op) { \
+        Value r = stack[--sp_local]; \
+        stack[sp_local - 1] = Value(asDouble(stack[sp_local - 1]) op asDouble(r)); \
+        NEXT(); \
+    }
+
+t_ADD_F64:           F64_OP(+)
+t_SUBTRACT_F64:      F64_OP(-)
+t_MULTIPLY_F64:      F64_OP(*)
+t_DIVIDE_F64:        F64_OP(/)
+t_LESS_F64:          F64_OP(<)
+t_LESS_EQUAL_F64:    F64_OP(<=)
+t_GREATER_F64:       F64_OP(>)
+t_GREATER_EQUAL_F64: F64_OP(>=)
+    #undef F64_OP
+
+t_CONCAT:
+    sp = sp_local;
+    concatenate();
+    sp_local = sp;
+    NEXT();
+
+t_ARRAY_GET_F64: {
+    Value index = stack[--sp_local];
+    ObjTypedArray* array = (ObjTypedArray*)valueToObj(stack[sp_local - 1]);
+    size_t at;
+    if (!typedArrayIndex(array, index, at)) {
+        sp = sp_local;
+        return InterpretResult::RUNTIME_ERROR;
+    }
+    stack[sp_local - 1] = Value(array->as<double>()[at]);
+    NEXT();
+}
+
+t_ARRAY_SET_F64: {
+    Value value = stack[--sp_local];
+    Value index = stack[--sp_local];
+    ObjTypedArray* array = (ObjTypedArray*)valueToObj(stack[sp_local - 1]);
+    size_t at;
+    if (!typedArrayIndex(array, index, at)) {
+        sp = sp_local;
+        return InterpretResult::RUNTIME_ERROR;
+    }
+    array->as<double>()[at] = valueToDouble(value);
+    stack[sp_local - 1] = value;
+    NEXT();
+}
+    #undef NUMBER_OP
+    #undef COMPARE_OP
+    #undef JUMP_UNLESS
+
+t_FAST_LOOP:
+    NEXT();
+
+t_HALT:
+    sp = sp_local;
+    return InterpretResult::OK;
+
+    #undef NEXT
+    #undef JUMP_TO
+    #undef COUNT_DISPATCH
+#else
+    // Label addresses are a GNU extension; fall back to the byte dispatcher
+    return run();
+#endif
+}
+
+} // namespace kio
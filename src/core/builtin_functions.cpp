@@ -5,6 +5,7 @@ SPDX-License-Identifier: GPL-3.0-only
 
 #include "axeon/builtin_functions.hpp"
 #include "axeon/bytecode.hpp"
+#include "axeon/memory_manager.hpp"
 #include <iostream>
 #include <cmath>
 #include <chrono>
@@ -25,22 +26,14 @@ BuiltinFunctions::BuiltinFunctions() {
 
 BuiltinFunctions::~BuiltinFunctions() {}
 
-void BuiltinFunctions::registerFunction(const std::string& name, BuiltinFunction func) {
-    functions_[name] = func;
+void BuiltinFunctions::registerFunction(const std::string& name, NativeFn func, int arity, uint8_t flags) {
+    functions_[name] = {func, arity, flags};
 }
 
 bool BuiltinFunctions::hasFunction(const std::string& name) const {
     return functions_.find(name) != functions_.end();
 }
 
-Value BuiltinFunctions::callFunction(const std::string& name, const std::vector<Value>& args) const {
-    auto it = functions_.find(name);
-    if (it != functions_.end()) {
-        return it->second(args);
-    }
-    return NIL_VAL;
-}
-
 std::vector<std::string> BuiltinFunctions::getFunctionNames() const {
     std::vector<std::string> names;
     for (const auto& pair : functions_) {
@@ -70,38 +63,30 @@ extern Value native_gui_window(int argCount, Value* args);
 extern Value native_gui_button(int argCount, Value* args);
 
 // Vectorized ops
-extern void vectorized_add(ObjArray* a, ObjArray* b, ObjArray* result);
-extern void vectorized_sub(ObjArray* a, ObjArray* b, ObjArray* result);
-extern void vectorized_mul(ObjArray* a, ObjArray* b, ObjArray* result);
-extern void vectorized_div(ObjArray* a, ObjArray* b, ObjArray* result);
-extern double vectorized_dot(ObjArray* a, ObjArray* b);
-extern void vectorized_cross(ObjArray* a, ObjArray* b, ObjArray* result);
-extern void vectorized_normalize(ObjArray* a, ObjArray* result);
+extern void vectorized_add(ObjTypedArray* a, ObjTypedArray* b, ObjTypedArray* result);
+extern void vectorized_sub(ObjTypedArray* a, ObjTypedArray* b, ObjTypedArray* result);
+extern void vectorized_mul(ObjTypedArray* a, ObjTypedArray* b, ObjTypedArray* result);
+extern void vectorized_div(ObjTypedArray* a, ObjTypedArray* b, ObjTypedArray* result);
+extern double vectorized_dot(ObjTypedArray* a, ObjTypedArray* b);
+extern double vectorized_sum(ObjTypedArray* a);
+extern void vectorized_cross(ObjTypedArray* a, ObjTypedArray* b, ObjTypedArray* result);
+extern void vectorized_normalize(ObjTypedArray* a, ObjTypedArray* result);
 
 void BuiltinFunctions::registerBuiltinFunctions() {
-    // Register implementations
-    functions_["print"] = print;
-    functions_["println"] = println;
-    functions_["floor"] = floor_func;
-    functions_["len"] = len;
-    functions_["type"] = type;
-    functions_["str"] = str;
-    functions_["abs"] = abs_func;
-    functions_["min"] = min_func;
-    functions_["max"] = max_func;
-    functions_["pow"] = pow_func;
-    functions_["sqrt"] = sqrt_func;
-    functions_["substr"] = substr;
-
-    // Helper to register stubs for un-implemented functions
-    auto registerStub = [&](const std::string& name) {
-        if (functions_.find(name) == functions_.end()) {
-            functions_[name] = [name](const std::vector<Value>&) {
-                std::cerr << "Built-in function '" << name << "' is not yet implemented." << std::endl;
-                return NIL_VAL;
-            };
-        }
-    };
+    // Arity is exact where the implementation takes a fixed argument list;
+    // natives that never allocate skip the collector pause.
+    registerFunction("print", print, -1, 0);
+    registerFunction("println", println, -1, 0);
+    registerFunction("floor", floor_func, 1, 0);
+    registerFunction("len", len, 1, 0);
+    registerFunction("type", type, 1);
+    registerFunction("str", str, 1);
+    registerFunction("abs", abs_func, 1, 0);
+    registerFunction("min", min_func, -1, 0);
+    registerFunction("max", max_func, -1, 0);
+    registerFunction("pow", pow_func, 2, 0);
+    registerFunction("sqrt", sqrt_func, 1, 0);
+    registerFunction("substr", substr);
 
     const std::vector<std::string> stubs = {
         "input", "format", "to_string", "to_int", "to_float", "to_bool", "to_array",
@@ -125,204 +110,219 @@ void BuiltinFunctions::registerBuiltinFunctions() {
         "with_capacity", "push", "pop", "insert", "remove_at"
     };
 
-    for (const auto& name : stubs) registerStub(name);
+    // Register stubs for un-implemented functions
+    for (const auto& name : stubs) {
+        if (!hasFunction(name)) registerFunction(name, stub_func, -1, NATIVE_STUB);
+    }
 
     // Override some stubs with actual implementations/wrappers if they exist
-    functions_["sha256"] = [](const std::vector<Value>& args) { return native_crypto_sha256(args.size(), const_cast<Value*>(args.data())); };
-    functions_["aes_encrypt"] = [](const std::vector<Value>& args) { return native_crypto_aes_encrypt(args.size(), const_cast<Value*>(args.data())); };
-    functions_["aes_decrypt"] = [](const std::vector<Value>& args) { return native_crypto_aes_decrypt(args.size(), const_cast<Value*>(args.data())); };
+    registerFunction("sha256", native_crypto_sha256);
+    registerFunction("aes_encrypt", native_crypto_aes_encrypt);
+    registerFunction("aes_decrypt", native_crypto_aes_decrypt);
     
     // Math module functions
-    functions_["sin"] = sin_func;
-    functions_["cos"] = cos_func;
-    functions_["tan"] = tan_func;
-    functions_["asin"] = asin_func;
-    functions_["acos"] = acos_func;
-    functions_["atan"] = atan_func;
-    functions_["atan2"] = atan2_func;
-    functions_["ceil"] = ceil_func;
-    functions_["round"] = round_func;
-    functions_["log"] = log_func;
-    functions_["log10"] = log10_func;
-    functions_["exp"] = exp_func;
-    functions_["sign"] = sign_func;
+    registerFunction("sin", sin_func, 1, 0);
+    registerFunction("cos", cos_func, 1, 0);
+    registerFunction("tan", tan_func, 1, 0);
+    registerFunction("asin", asin_func, 1, 0);
+    registerFunction("acos", acos_func, 1, 0);
+    registerFunction("atan", atan_func, 1, 0);
+    registerFunction("atan2", atan2_func, 2, 0);
+    registerFunction("ceil", ceil_func, 1, 0);
+    registerFunction("round", round_func, 1, 0);
+    registerFunction("log", log_func, 1, 0);
+    registerFunction("log10", log10_func, 1, 0);
+    registerFunction("exp", exp_func, 1, 0);
+    registerFunction("sign", sign_func, 1, 0);
     
     // Time module functions
-    functions_["time"] = time_func;
-    functions_["sleep"] = sleep_func;
-    functions_["timestamp"] = timestamp_func;
+    registerFunction("time", time_func, 0, 0);
+    registerFunction("sleep", sleep_func, 1, 0);
+    registerFunction("timestamp", timestamp_func, 0, 0);
     
     // Random module functions
-    functions_["rand"] = rand_func;
-    functions_["rand_int"] = rand_int_func;
-    functions_["rand_float"] = rand_float_func;
+    registerFunction("rand", rand_func, 0, 0);
+    registerFunction("rand_int", rand_int_func, -1, 0);
+    registerFunction("rand_float", rand_float_func, -1, 0);
     
     // String module functions
-    functions_["upper"] = [](const std::vector<Value>& args) { return BuiltinFunctions::upper_func(args); };
-    functions_["lower"] = [](const std::vector<Value>& args) { return BuiltinFunctions::lower_func(args); };
-    functions_["trim"] = [](const std::vector<Value>& args) { return BuiltinFunctions::trim_func(args); };
-    functions_["replace"] = [](const std::vector<Value>& args) { return BuiltinFunctions::replace_func(args); };
-    functions_["contains"] = [](const std::vector<Value>& args) { return BuiltinFunctions::contains_func(args); };
-    functions_["startswith"] = startswith_func;
-    functions_["endswith"] = endswith_func;
-    functions_["split"] = split_func;
-    functions_["join"] = join_func;
+    registerFunction("upper", upper_func, 1);
+    registerFunction("lower", lower_func, 1);
+    registerFunction("trim", trim_func, 1);
+    registerFunction("replace", replace_func, 3);
+    registerFunction("contains", contains_func, 2, 0);
+    registerFunction("startswith", startswith_func, 2, 0);
+    registerFunction("endswith", endswith_func, 2, 0);
+    registerFunction("split", split_func);
+    registerFunction("join", join_func);
     
     // Array module functions
-    functions_["range"] = range_func;
-    functions_["map"] = map_func;
-    functions_["filter"] = filter_func;
-    functions_["reduce"] = reduce_func;
-    functions_["sum"] = sum_func;
-    functions_["avg"] = avg_func;
-    functions_["sort"] = sort_func;
-    functions_["reverse"] = reverse_func;
+    registerFunction("range", range_func);
+    registerFunction("map", map_func);
+    registerFunction("filter", filter_func);
+    registerFunction("reduce", reduce_func);
+    registerFunction("sum", sum_func, 1, 0);
+    registerFunction("avg", avg_func, 1, 0);
+    registerFunction("sort", sort_func, 1);
+    registerFunction("reverse", reverse_func, 1);
+    registerFunction("Float64Array", float64_array_func, 1);
+    registerFunction("Float32Array", float32_array_func, 1);
+    registerFunction("Int32Array", int32_array_func, 1);
+    registerFunction("Int64Array", int64_array_func, 1);
+    registerFunction("Uint8Array", uint8_array_func, 1);
     
     // File module functions
-    functions_["read_file"] = read_file_func;
-    functions_["write_file"] = write_file_func;
-    functions_["exists"] = exists_func;
-    functions_["list_dir"] = list_dir_func;
+    registerFunction("read_file", read_file_func, 1);
+    registerFunction("write_file", write_file_func, 2, 0);
+    registerFunction("exists", exists_func, 1, 0);
+    registerFunction("list_dir", list_dir_func, 1);
 }
 
-Value BuiltinFunctions::print(const std::vector<Value>& args) {
-    for (size_t i = 0; i < args.size(); ++i) {
-        std::cout << args[i].toString() << (i == args.size() - 1 ? "" : " ");
+// The VM reports the name before calling a NATIVE_STUB
+Value BuiltinFunctions::stub_func(int, Value*) {
+    return NIL_VAL;
+}
+
+Value BuiltinFunctions::print(int argCount, Value* args) {
+    for (int i = 0; i < argCount; ++i) {
+        std::cout << args[i].toString() << (i == argCount - 1 ? "" : " ");
     }
     return NIL_VAL;
 }
 
-Value BuiltinFunctions::println(const std::vector<Value>& args) {
-    print(args);
+Value BuiltinFunctions::println(int argCount, Value* args) {
+    print(argCount, args);
     std::cout << std::endl;
     return NIL_VAL;
 }
 
-Value BuiltinFunctions::len(const std::vector<Value>& args) {
-    if (args.empty()) return doubleToValue(0);
+Value BuiltinFunctions::len(int argCount, Value* args) {
+    if (argCount == 0) return doubleToValue(0);
     if (isObj(args[0])) {
         Obj* o = valueToObj(args[0]);
         if (o->type == ObjType::OBJ_STRING) return doubleToValue(((ObjString*)o)->chars.length());
         if (o->type == ObjType::OBJ_ARRAY) return doubleToValue(((ObjArray*)o)->elements.size());
+        if (o->type == ObjType::OBJ_TYPED_ARRAY) return doubleToValue(((ObjTypedArray*)o)->length);
     }
     return doubleToValue(0);
 }
 
-Value BuiltinFunctions::type(const std::vector<Value>& args) {
-    if (args.empty()) return objToValue(new ObjString("nil"));
-    if (isNil(args[0])) return objToValue(new ObjString("nil"));
-    if (isBool(args[0])) return objToValue(new ObjString("bool"));
-    if (isNumber(args[0])) return objToValue(new ObjString("number"));
+Value BuiltinFunctions::type(int argCount, Value* args) {
+    if (argCount == 0) return objToValue(allocateObject<ObjString>("nil"));
+    if (isNil(args[0])) return objToValue(allocateObject<ObjString>("nil"));
+    if (isBool(args[0])) return objToValue(allocateObject<ObjString>("bool"));
+    if (isNumber(args[0])) return objToValue(allocateObject<ObjString>("number"));
     if (isObj(args[0])) {
         Obj* o = valueToObj(args[0]);
-        if (o->type == ObjType::OBJ_STRING) return objToValue(new ObjString("string"));
-        if (o->type == ObjType::OBJ_ARRAY) return objToValue(new ObjString("array"));
-        return objToValue(new ObjString("object"));
+        if (o->type == ObjType::OBJ_STRING) return objToValue(allocateObject<ObjString>("string"));
+        if (o->type == ObjType::OBJ_ARRAY) return objToValue(allocateObject<ObjString>("array"));
+        if (o->type == ObjType::OBJ_TYPED_ARRAY) return objToValue(allocateObject<ObjString>(((ObjTypedArray*)o)->kindName()));
+        return objToValue(allocateObject<ObjString>("object"));
     }
-    return objToValue(new ObjString("unknown"));
+    return objToValue(allocateObject<ObjString>("unknown"));
 }
 
-Value BuiltinFunctions::str(const std::vector<Value>& args) {
-    if (args.empty()) return objToValue(new ObjString(""));
-    return objToValue(new ObjString(args[0].toString()));
+Value BuiltinFunctions::str(int argCount, Value* args) {
+    if (argCount == 0) return objToValue(allocateObject<ObjString>(""));
+    return objToValue(allocateObject<ObjString>(args[0].toString()));
 }
 
-Value BuiltinFunctions::abs_func(const std::vector<Value>& args) {
-    if (args.empty()) return doubleToValue(0);
+Value BuiltinFunctions::abs_func(int argCount, Value* args) {
+    if (argCount == 0) return doubleToValue(0);
     return doubleToValue(std::abs(args[0].toNumber()));
 }
 
-Value BuiltinFunctions::min_func(const std::vector<Value>& args) {
-    if (args.empty()) return NIL_VAL;
+Value BuiltinFunctions::min_func(int argCount, Value* args) {
+    if (argCount == 0) return NIL_VAL;
     double m = args[0].toNumber();
-    for (size_t i = 1; i < args.size(); ++i) {
+    for (int i = 1; i < argCount; ++i) {
         m = std::min(m, args[i].toNumber());
     }
     return doubleToValue(m);
 }
 
-Value BuiltinFunctions::max_func(const std::vector<Value>& args) {
-    if (args.empty()) return NIL_VAL;
+Value BuiltinFunctions::max_func(int argCount, Value* args) {
+    if (argCount == 0) return NIL_VAL;
     double m = args[0].toNumber();
-    for (size_t i = 1; i < args.size(); ++i) {
+    for (int i = 1; i < argCount; ++i) {
         m = std::max(m, args[i].toNumber());
     }
     return doubleToValue(m);
 }
 
-Value BuiltinFunctions::pow_func(const std::vector<Value>& args) {
-    if (args.size() < 2) return doubleToValue(0);
+Value BuiltinFunctions::pow_func(int argCount, Value* args) {
+    if (argCount < 2) return doubleToValue(0);
     return doubleToValue(std::pow(args[0].toNumber(), args[1].toNumber()));
 }
 
-Value BuiltinFunctions::sqrt_func(const std::vector<Value>& args) {
-    if (args.empty()) return doubleToValue(0);
+Value BuiltinFunctions::sqrt_func(int argCount, Value* args) {
+    if (argCount == 0) return doubleToValue(0);
     return doubleToValue(std::sqrt(args[0].toNumber()));
 }
 
 // Math functions implementation
-Value BuiltinFunctions::sin_func(const std::vector<Value>& args) {
-    if (args.empty()) return doubleToValue(0);
+Value BuiltinFunctions::sin_func(int argCount, Value* args) {
+    if (argCount == 0) return doubleToValue(0);
     return doubleToValue(std::sin(args[0].toNumber()));
 }
 
-Value BuiltinFunctions::cos_func(const std::vector<Value>& args) {
-    if (args.empty()) return doubleToValue(0);
+Value BuiltinFunctions::cos_func(int argCount, Value* args) {
+    if (argCount == 0) return doubleToValue(0);
     return doubleToValue(std::cos(args[0].toNumber()));
 }
 
-Value BuiltinFunctions::tan_func(const std::vector<Value>& args) {
-    if (args.empty()) return doubleToValue(0);
+Value BuiltinFunctions::tan_func(int argCount, Value* args) {
+    if (argCount == 0) return doubleToValue(0);
     return doubleToValue(std::tan(args[0].toNumber()));
 }
 
-Value BuiltinFunctions::asin_func(const std::vector<Value>& args) {
-    if (args.empty()) return doubleToValue(0);
+Value BuiltinFunctions::asin_func(int argCount, Value* args) {
+    if (argCount == 0) return doubleToValue(0);
     return doubleToValue(std::asin(args[0].toNumber()));
 }
 
-Value BuiltinFunctions::acos_func(const std::vector<Value>& args) {
-    if (args.empty()) return doubleToValue(0);
+Value BuiltinFunctions::acos_func(int argCount, Value* args) {
+    if (argCount == 0) return doubleToValue(0);
     return doubleToValue(std::acos(args[0].toNumber()));
 }
 
-Value BuiltinFunctions::atan_func(const std::vector<Value>& args) {
-    if (args.empty()) return doubleToValue(0);
+Value BuiltinFunctions::atan_func(int argCount, Value* args) {
+    if (argCount == 0) return doubleToValue(0);
     return doubleToValue(std::atan(args[0].toNumber()));
 }
 
-Value BuiltinFunctions::atan2_func(const std::vector<Value>& args) {
-    if (args.size() < 2) return doubleToValue(0);
+Value BuiltinFunctions::atan2_func(int argCount, Value* args) {
+    if (argCount < 2) return doubleToValue(0);
     return doubleToValue(std::atan2(args[0].toNumber(), args[1].toNumber()));
 }
 
-Value BuiltinFunctions::ceil_func(const std::vector<Value>& args) {
-    if (args.empty()) return doubleToValue(0);
+Value BuiltinFunctions::ceil_func(int argCount, Value* args) {
+    if (argCount == 0) return doubleToValue(0);
     return doubleToValue(std::ceil(args[0].toNumber()));
 }
 
-Value BuiltinFunctions::round_func(const std::vector<Value>& args) {
-    if (args.empty()) return doubleToValue(0);
+Value BuiltinFunctions::round_func(int argCount, Value* args) {
+    if (argCount == 0) return doubleToValue(0);
     return doubleToValue(std::round(args[0].toNumber()));
 }
 
-Value BuiltinFunctions::log_func(const std::vector<Value>& args) {
-    if (args.empty()) return doubleToValue(0);
+Value BuiltinFunctions::log_func(int argCount, Value* args) {
+    if (argCount == 0) return doubleToValue(0);
     return doubleToValue(std::log(args[0].toNumber()));
 }
 
-Value BuiltinFunctions::log10_func(const std::vector<Value>& args) {
-    if (args.empty()) return doubleToValue(0);
+Value BuiltinFunctions::log10_func(int argCount, Value* args) {
+    if (argCount == 0) return doubleToValue(0);
     return doubleToValue(std::log10(args[0].toNumber()));
 }
 
-Value BuiltinFunctions::exp_func(const std::vector<Value>& args) {
-    if (args.empty()) return doubleToValue(0);
+Value BuiltinFunctions::exp_func(int argCount, Value* args) {
+    if (argCount == 0) return doubleToValue(0);
     return doubleToValue(std::exp(args[0].toNumber()));
 }
 
-Value BuiltinFunctions::sign_func(const std::vector<Value>& args) {
-    if (args.empty()) return doubleToValue(0);
+Value BuiltinFunctions::sign_func(int argCount, Value* args) {
+    if (argCount == 0) return doubleToValue(0);
     double val = args[0].toNumber();
     if (val > 0) return doubleToValue(1);
     if (val < 0) return doubleToValue(-1);
@@ -330,21 +330,21 @@ Value BuiltinFunctions::sign_func(const std::vector<Value>& args) {
 }
 
 // Time functions implementation
-Value BuiltinFunctions::time_func(const std::vector<Value>& args) {
+Value BuiltinFunctions::time_func(int argCount, Value* args) {
     auto now = std::chrono::system_clock::now();
     auto duration = now.time_since_epoch();
     auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
     return doubleToValue(millis / 1000.0);
 }
 
-Value BuiltinFunctions::sleep_func(const std::vector<Value>& args) {
-    if (args.empty()) return NIL_VAL;
+Value BuiltinFunctions::sleep_func(int argCount, Value* args) {
+    if (argCount == 0) return NIL_VAL;
     double seconds = args[0].toNumber();
     std::this_thread::sleep_for(std::chrono::milliseconds(static_cast<int>(seconds * 1000)));
     return NIL_VAL;
 }
 
-Value BuiltinFunctions::timestamp_func(const std::vector<Value>& args) {
+Value BuiltinFunctions::timestamp_func(int argCount, Value* args) {
     auto now = std::chrono::system_clock::now();
     auto duration = now.time_since_epoch();
     auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
@@ -355,13 +355,13 @@ Value BuiltinFunctions::timestamp_func(const std::vector<Value>& args) {
 static std::random_device rd;
 static std::mt19937 gen(rd());
 
-Value BuiltinFunctions::rand_func(const std::vector<Value>& args) {
+Value BuiltinFunctions::rand_func(int argCount, Value* args) {
     std::uniform_real_distribution<> dis(0.0, 1.0);
     return doubleToValue(dis(gen));
 }
 
-Value BuiltinFunctions::rand_int_func(const std::vector<Value>& args) {
-    if (args.empty()) {
+Value BuiltinFunctions::rand_int_func(int argCount, Value* args) {
+    if (argCount == 0) {
         std::uniform_int_distribution<> dis(0, RAND_MAX);
         return doubleToValue(dis(gen));
     }
@@ -370,8 +370,8 @@ Value BuiltinFunctions::rand_int_func(const std::vector<Value>& args) {
     return doubleToValue(dis(gen));
 }
 
-Value BuiltinFunctions::rand_float_func(const std::vector<Value>& args) {
-    if (args.empty()) {
+Value BuiltinFunctions::rand_float_func(int argCount, Value* args) {
+    if (argCount == 0) {
         std::uniform_real_distribution<> dis(0.0, 1.0);
         return doubleToValue(dis(gen));
     }
@@ -381,32 +381,32 @@ Value BuiltinFunctions::rand_float_func(const std::vector<Value>& args) {
 }
 
 // String functions implementation
-Value BuiltinFunctions::upper_func(const std::vector<Value>& args) {
-    if (args.empty()) return objToValue(new ObjString(""));
+Value BuiltinFunctions::upper_func(int argCount, Value* args) {
+    if (argCount == 0) return objToValue(allocateObject<ObjString>(""));
     std::string s = args[0].toString();
     std::transform(s.begin(), s.end(), s.begin(), ::toupper);
-    return objToValue(new ObjString(s));
+    return objToValue(allocateObject<ObjString>(s));
 }
 
-Value BuiltinFunctions::lower_func(const std::vector<Value>& args) {
-    if (args.empty()) return objToValue(new ObjString(""));
+Value BuiltinFunctions::lower_func(int argCount, Value* args) {
+    if (argCount == 0) return objToValue(allocateObject<ObjString>(""));
     std::string s = args[0].toString();
     std::transform(s.begin(), s.end(), s.begin(), ::tolower);
-    return objToValue(new ObjString(s));
+    return objToValue(allocateObject<ObjString>(s));
 }
 
-Value BuiltinFunctions::trim_func(const std::vector<Value>& args) {
-    if (args.empty()) return objToValue(new ObjString(""));
+Value BuiltinFunctions::trim_func(int argCount, Value* args) {
+    if (argCount == 0) return objToValue(allocateObject<ObjString>(""));
     std::string s = args[0].toString();
     // Simple trim - remove leading/trailing whitespace
     auto start = s.find_first_not_of(" \\t\\n\\r");
     auto end = s.find_last_not_of(" \\t\\n\\r");
-    if (start == std::string::npos) return objToValue(new ObjString(""));
-    return objToValue(new ObjString(s.substr(start, end - start + 1)));
+    if (start == std::string::npos) return objToValue(allocateObject<ObjString>(""));
+    return objToValue(allocateObject<ObjString>(s.substr(start, end - start + 1)));
 }
 
-Value BuiltinFunctions::replace_func(const std::vector<Value>& args) {
-    if (args.size() < 3) return args.empty() ? objToValue(new ObjString("")) : args[0];
+Value BuiltinFunctions::replace_func(int argCount, Value* args) {
+    if (argCount < 3) return argCount == 0 ? objToValue(allocateObject<ObjString>("")) : args[0];
     std::string s = args[0].toString();
     std::string from = args[1].toString();
     std::string to = args[2].toString();
@@ -415,25 +415,25 @@ Value BuiltinFunctions::replace_func(const std::vector<Value>& args) {
         s.replace(pos, from.length(), to);
         pos += to.length();
     }
-    return objToValue(new ObjString(s));
+    return objToValue(allocateObject<ObjString>(s));
 }
 
-Value BuiltinFunctions::contains_func(const std::vector<Value>& args) {
-    if (args.size() < 2) return BOOL_VAL(false);
+Value BuiltinFunctions::contains_func(int argCount, Value* args) {
+    if (argCount < 2) return BOOL_VAL(false);
     std::string s = args[0].toString();
     std::string sub = args[1].toString();
     return BOOL_VAL(s.find(sub) != std::string::npos);
 }
 
-Value BuiltinFunctions::startswith_func(const std::vector<Value>& args) {
-    if (args.size() < 2) return BOOL_VAL(false);
+Value BuiltinFunctions::startswith_func(int argCount, Value* args) {
+    if (argCount < 2) return BOOL_VAL(false);
     std::string s = args[0].toString();
     std::string prefix = args[1].toString();
     return BOOL_VAL(s.rfind(prefix, 0) == 0);
 }
 
-Value BuiltinFunctions::endswith_func(const std::vector<Value>& args) {
-    if (args.size() < 2) return BOOL_VAL(false);
+Value BuiltinFunctions::endswith_func(int argCount, Value* args) {
+    if (argCount < 2) return BOOL_VAL(false);
     std::string s = args[0].toString();
     std::string suffix = args[1].toString();
     if (s.length() >= suffix.length()) {
@@ -442,26 +442,26 @@ Value BuiltinFunctions::endswith_func(const std::vector<Value>& args) {
     return BOOL_VAL(false);
 }
 
-Value BuiltinFunctions::split_func(const std::vector<Value>& args) {
-    if (args.empty()) return objToValue(new ObjArray());
+Value BuiltinFunctions::split_func(int argCount, Value* args) {
+    if (argCount == 0) return objToValue(allocateObject<ObjArray>());
     std::string s = args[0].toString();
-    std::string delim = args.size() > 1 ? args[1].toString() : " ";
+    std::string delim = argCount > 1 ? args[1].toString() : " ";
     
-    auto* arr = new ObjArray();
+    auto* arr = allocateObject<ObjArray>();
     size_t start = 0;
     size_t end = s.find(delim);
     while (end != std::string::npos) {
-        arr->elements.push_back(objToValue(new ObjString(s.substr(start, end - start))));
+        arr->elements.push_back(objToValue(allocateObject<ObjString>(s.substr(start, end - start))));
         start = end + delim.length();
         end = s.find(delim, start);
     }
-    arr->elements.push_back(objToValue(new ObjString(s.substr(start))));
+    arr->elements.push_back(objToValue(allocateObject<ObjString>(s.substr(start))));
     return objToValue(arr);
 }
 
-Value BuiltinFunctions::join_func(const std::vector<Value>& args) {
-    if (args.empty()) return objToValue(new ObjString(""));
-    std::string delim = args.size() > 1 ? args[1].toString() : " ";
+Value BuiltinFunctions::join_func(int argCount, Value* args) {
+    if (argCount == 0) return objToValue(allocateObject<ObjString>(""));
+    std::string delim = argCount > 1 ? args[1].toString() : " ";
     
     std::ostringstream result;
     bool first = true;
@@ -477,31 +477,31 @@ Value BuiltinFunctions::join_func(const std::vector<Value>& args) {
             }
         }
     }
-    return objToValue(new ObjString(result.str()));
+    return objToValue(allocateObject<ObjString>(result.str()));
 }
 
 // Array functions implementation
-Value BuiltinFunctions::range_func(const std::vector<Value>& args) {
+Value BuiltinFunctions::range_func(int argCount, Value* args) {
     int start = 0, end = 0, step = 1;
     
-    if (args.empty()) return objToValue(new ObjArray());
-    if (args.size() == 1) {
+    if (argCount == 0) return objToValue(allocateObject<ObjArray>());
+    if (argCount == 1) {
         end = static_cast<int>(args[0].toNumber());
-    } else if (args.size() >= 2) {
+    } else if (argCount >= 2) {
         start = static_cast<int>(args[0].toNumber());
         end = static_cast<int>(args[1].toNumber());
-        if (args.size() >= 3) step = static_cast<int>(args[2].toNumber());
+        if (argCount >= 3) step = static_cast<int>(args[2].toNumber());
     }
     
-    auto* arr = new ObjArray();
+    auto* arr = allocateObject<ObjArray>();
     for (int i = start; i < end; i += step) {
         arr->elements.push_back(doubleToValue(i));
     }
     return objToValue(arr);
 }
 
-Value BuiltinFunctions::sum_func(const std::vector<Value>& args) {
-    if (args.empty()) return doubleToValue(0);
+Value BuiltinFunctions::sum_func(int argCount, Value* args) {
+    if (argCount == 0) return doubleToValue(0);
     double sum = 0;
     if (isObj(args[0])) {
         Obj* o = valueToObj(args[0]);
@@ -510,13 +510,15 @@ Value BuiltinFunctions::sum_func(const std::vector<Value>& args) {
             for (const auto& elem : arr->elements) {
                 sum += elem.toNumber();
             }
+        } else if (o->type == ObjType::OBJ_TYPED_ARRAY) {
+            sum = vectorized_sum((ObjTypedArray*)o);
         }
     }
     return doubleToValue(sum);
 }
 
-Value BuiltinFunctions::avg_func(const std::vector<Value>& args) {
-    if (args.empty()) return doubleToValue(0);
+Value BuiltinFunctions::avg_func(int argCount, Value* args) {
+    if (argCount == 0) return doubleToValue(0);
     double sum = 0;
     int count = 0;
     if (isObj(args[0])) {
@@ -532,8 +534,8 @@ Value BuiltinFunctions::avg_func(const std::vector<Value>& args) {
     return count > 0 ? doubleToValue(sum / count) : doubleToValue(0);
 }
 
-Value BuiltinFunctions::sort_func(const std::vector<Value>& args) {
-    if (args.empty() || !isObj(args[0])) return args.empty() ? objToValue(new ObjArray()) : args[0];
+Value BuiltinFunctions::sort_func(int argCount, Value* args) {
+    if (argCount == 0 || !isObj(args[0])) return argCount == 0 ? objToValue(allocateObject<ObjArray>()) : args[0];
     Obj* o = valueToObj(args[0]);
     if (o->type == ObjType::OBJ_ARRAY) {
         ObjArray* arr = (ObjArray*)o;
@@ -546,12 +548,22 @@ Value BuiltinFunctions::sort_func(const std::vector<Value>& args) {
         for (double n : nums) {
             arr->elements.push_back(doubleToValue(n));
         }
+    } else if (o->type == ObjType::OBJ_TYPED_ARRAY) {
+        // Sorts in place on the unboxed storage
+        ObjTypedArray* arr = (ObjTypedArray*)o;
+        switch (arr->kind) {
+            case ElementKind::FLOAT64: std::sort(arr->as<double>(), arr->as<double>() + arr->length); break;
+            case ElementKind::FLOAT32: std::sort(arr->as<float>(), arr->as<float>() + arr->length); break;
+            case ElementKind::INT32:   std::sort(arr->as<int32_t>(), arr->as<int32_t>() + arr->length); break;
+            case ElementKind::INT64:   std::sort(arr->as<int64_t>(), arr->as<int64_t>() + arr->length); break;
+            case ElementKind::UINT8:   std::sort(arr->as<uint8_t>(), arr->as<uint8_t>() + arr->length); break;
+        }
     }
     return args[0];
 }
 
-Value BuiltinFunctions::reverse_func(const std::vector<Value>& args) {
-    if (args.empty() || !isObj(args[0])) return args.empty() ? objToValue(new ObjArray()) : args[0];
+Value BuiltinFunctions::reverse_func(int argCount, Value* args) {
+    if (argCount == 0 || !isObj(args[0])) return argCount == 0 ? objToValue(allocateObject<ObjArray>()) : args[0];
     Obj* o = valueToObj(args[0]);
     if (o->type == ObjType::OBJ_ARRAY) {
         ObjArray* arr = (ObjArray*)o;
@@ -560,36 +572,53 @@ Value BuiltinFunctions::reverse_func(const std::vector<Value>& args) {
     return args[0];
 }
 
+static Value makeTypedArray(ElementKind kind, int argCount, Value* args) {
+    if (argCount > 0 && isObj(args[0]) && valueToObj(args[0])->type == ObjType::OBJ_ARRAY) {
+        ObjArray* src = (ObjArray*)valueToObj(args[0]);
+        ObjTypedArray* arr = allocateObject<ObjTypedArray>(kind, src->elements.size());
+        for (size_t i = 0; i < src->elements.size(); ++i) arr->set(i, src->elements[i].toNumber());
+        return objToValue(arr);
+    }
+    double n = argCount > 0 ? args[0].toNumber() : 0;
+    return objToValue(allocateObject<ObjTypedArray>(kind, n > 0 ? (size_t)n : 0));
+}
+
+Value BuiltinFunctions::float64_array_func(int argCount, Value* args) { return makeTypedArray(ElementKind::FLOAT64, argCount, args); }
+Value BuiltinFunctions::float32_array_func(int argCount, Value* args) { return makeTypedArray(ElementKind::FLOAT32, argCount, args); }
+Value BuiltinFunctions::int32_array_func(int argCount, Value* args) { return makeTypedArray(ElementKind::INT32, argCount, args); }
+Value BuiltinFunctions::int64_array_func(int argCount, Value* args) { return makeTypedArray(ElementKind::INT64, argCount, args); }
+Value BuiltinFunctions::uint8_array_func(int argCount, Value* args) { return makeTypedArray(ElementKind::UINT8, argCount, args); }
+
 // Stub implementations for map, filter, reduce
-Value BuiltinFunctions::map_func(const std::vector<Value>& args) {
-    if (args.empty() || !isObj(args[0])) return objToValue(new ObjArray());
+Value BuiltinFunctions::map_func(int argCount, Value* args) {
+    if (argCount == 0 || !isObj(args[0])) return objToValue(allocateObject<ObjArray>());
     // Return the array as-is for now (higher-order functions require lambda support)
     return args[0];
 }
 
-Value BuiltinFunctions::filter_func(const std::vector<Value>& args) {
-    if (args.empty() || !isObj(args[0])) return objToValue(new ObjArray());
+Value BuiltinFunctions::filter_func(int argCount, Value* args) {
+    if (argCount == 0 || !isObj(args[0])) return objToValue(allocateObject<ObjArray>());
     return args[0];
 }
 
-Value BuiltinFunctions::reduce_func(const std::vector<Value>& args) {
-    if (args.empty()) return NIL_VAL;
+Value BuiltinFunctions::reduce_func(int argCount, Value* args) {
+    if (argCount == 0) return NIL_VAL;
     return args[0];
 }
 
 // File functions implementation
-Value BuiltinFunctions::read_file_func(const std::vector<Value>& args) {
-    if (args.empty()) return objToValue(new ObjString(""));
+Value BuiltinFunctions::read_file_func(int argCount, Value* args) {
+    if (argCount == 0) return objToValue(allocateObject<ObjString>(""));
     std::string filename = args[0].toString();
     std::ifstream file(filename);
-    if (!file.is_open()) return objToValue(new ObjString(""));
+    if (!file.is_open()) return objToValue(allocateObject<ObjString>(""));
     std::stringstream buffer;
     buffer << file.rdbuf();
-    return objToValue(new ObjString(buffer.str()));
+    return objToValue(allocateObject<ObjString>(buffer.str()));
 }
 
-Value BuiltinFunctions::write_file_func(const std::vector<Value>& args) {
-    if (args.size() < 2) return BOOL_VAL(false);
+Value BuiltinFunctions::write_file_func(int argCount, Value* args) {
+    if (argCount < 2) return BOOL_VAL(false);
     std::string filename = args[0].toString();
     std::string content = args[1].toString();
     std::ofstream file(filename);
@@ -599,20 +628,20 @@ Value BuiltinFunctions::write_file_func(const std::vector<Value>& args) {
     return BOOL_VAL(true);
 }
 
-Value BuiltinFunctions::exists_func(const std::vector<Value>& args) {
-    if (args.empty()) return BOOL_VAL(false);
+Value BuiltinFunctions::exists_func(int argCount, Value* args) {
+    if (argCount == 0) return BOOL_VAL(false);
     std::string filename = args[0].toString();
     return BOOL_VAL(std::filesystem::exists(filename));
 }
 
-Value BuiltinFunctions::list_dir_func(const std::vector<Value>& args) {
-    if (args.empty()) return objToValue(new ObjArray());
+Value BuiltinFunctions::list_dir_func(int argCount, Value* args) {
+    if (argCount == 0) return objToValue(allocateObject<ObjArray>());
     std::string path = args[0].toString();
-    auto* arr = new ObjArray();
+    auto* arr = allocateObject<ObjArray>();
     
     try {
         for (const auto& entry : std::filesystem::directory_iterator(path)) {
-            arr->elements.push_back(objToValue(new ObjString(entry.path().filename().string())));
+            arr->elements.push_back(objToValue(allocateObject<ObjString>(entry.path().filename().string())));
         }
     } catch (...) {
         // Return empty array on error
@@ -620,19 +649,19 @@ Value BuiltinFunctions::list_dir_func(const std::vector<Value>& args) {
     return objToValue(arr);
 }
 
-Value BuiltinFunctions::substr(const std::vector<Value>& args) {
-    if (args.size() < 2) return NIL_VAL;
+Value BuiltinFunctions::substr(int argCount, Value* args) {
+    if (argCount < 2) return NIL_VAL;
     std::string s = args[0].toString();
     int start = (int)args[1].toNumber();
-    int len = (args.size() > 2) ? (int)args[2].toNumber() : (int)s.length() - start;
+    int len = (argCount > 2) ? (int)args[2].toNumber() : (int)s.length() - start;
     if (start < 0) start = 0;
     if (len < 0) len = 0;
-    if (start >= (int)s.length()) return objToValue(new ObjString(""));
-    return objToValue(new ObjString(s.substr(start, len)));
+    if (start >= (int)s.length()) return objToValue(allocateObject<ObjString>(""));
+    return objToValue(allocateObject<ObjString>(s.substr(start, len)));
 }
 
-Value BuiltinFunctions::floor_func(const std::vector<Value>& args) {
-    if (args.empty()) return doubleToValue(0);
+Value BuiltinFunctions::floor_func(int argCount, Value* args) {
+    if (argCount == 0) return doubleToValue(0);
     return doubleToValue(std::floor(args[0].toNumber()));
 }
 
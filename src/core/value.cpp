@@ -4,6 +4,7 @@ SPDX-License-Identifier: GPL-3.0-only
 */
 
 #include "axeon/bytecode.hpp"
+#include "axeon/memory_manager.hpp"
 #include <iostream>
 
 namespace kio {
@@ -15,15 +16,38 @@ Value::Value(double n) {
 }
 
 Value::Value(const std::string& s) {
-    Obj* o = new ObjString(s);
+    Obj* o = allocateObject<ObjString>(s);
     v = (uint64_t)(0x8000000000000000 | 0x7ff8000000000000 | (uintptr_t)o);
 }
 
 Value::Value(const char* s) {
-    Obj* o = new ObjString(std::string(s));
+    Obj* o = allocateObject<ObjString>(std::string(s));
     v = (uint64_t)(0x8000000000000000 | 0x7ff8000000000000 | (uintptr_t)o);
 }
 
+double ObjTypedArray::get(size_t i) const {
+    switch (kind) {
+        case ElementKind::FLOAT64: return as<double>()[i];
+        case ElementKind::FLOAT32: return as<float>()[i];
+        case ElementKind::INT32:   return as<int32_t>()[i];
+        case ElementKind::INT64:   return (double)as<int64_t>()[i];
+        case ElementKind::UINT8:   return as<uint8_t>()[i];
+    }
+    return 0;
+}
+
+void ObjTypedArray::set(size_t i, double v) {
+    // Out-of-range and non-finite values store 0 rather than hit UB
+    int64_t n = std::isfinite(v) && std::fabs(v) < 9.2e18 ? (int64_t)v : 0;
+    switch (kind) {
+        case ElementKind::FLOAT64: as<double>()[i] = v; break;
+        case ElementKind::FLOAT32: as<float>()[i] = (float)v; break;
+        case ElementKind::INT32:   as<int32_t>()[i] = (int32_t)n; break;
+        case ElementKind::INT64:   as<int64_t>()[i] = n; break;
+        case ElementKind::UINT8:   as<uint8_t>()[i] = (uint8_t)n; break;
+    }
+}
+
 double Value::toNumber() const {
     if (isNumber(*this)) return valueToDouble(*this);
     if (isBool(*this)) return (v == (0x7ff8000000000000 | 3)) ? 1.0 : 0.0;
@@ -42,8 +66,11 @@ std::string Value::toString() const {
         Obj* o = valueToObj(*this);
         if (!o) return "nil";
         if (o->type == ObjType::OBJ_STRING) return ((ObjString*)o)->chars;
+        if (o->type == ObjType::OBJ_ROPE) return flattenRope((ObjRope*)o)->chars;
         if (o->type == ObjType::OBJ_ARRAY) return "[Array]";
+        if (o->type == ObjType::OBJ_TYPED_ARRAY) return std::string("[") + ((ObjTypedArray*)o)->kindName() + "]";
         if (o->type == ObjType::OBJ_FUNCTION) return "<fn " + ((ObjFunction*)o)->name + ">";
+        if (o->type == ObjType::OBJ_NATIVE) return "<native fn " + ((ObjNative*)o)->name + ">";
         if (o->type == ObjType::OBJ_CLASS) return "<class " + ((ObjClass*)o)->name + ">";
         if (o->type == ObjType::OBJ_INSTANCE) return "<instance of " + ((ObjInstance*)o)->klass->name + ">";
         return "[Object]";
@@ -51,14 +78,86 @@ std::string Value::toString() const {
     return "unknown";
 }
 
+GlobalTable& GlobalTable::shared() {
+    static GlobalTable table;
+    return table;
+}
+
+static std::vector<Shape*>& shapes() {
+    static std::vector<Shape*> all;
+    return all;
+}
+
+Shape* Shape::newRoot() {
+    Shape* shape = new Shape(nullptr);
+    shapes().push_back(shape);
+    return shape;
+}
+
+Shape* Shape::withField(ObjString* name) {
+    for (const auto& transition : transitions) {
+        if (transition.first == name) return transition.second;
+    }
+    Shape* shape = new Shape(this);
+    shape->names = names;
+    shape->names.push_back(name);
+    transitions.emplace_back(name, shape);
+    shapes().push_back(shape);
+    return shape;
+}
+
+const std::vector<Shape*>& Shape::all() { return shapes(); }
+
+ObjString* flattenRope(ObjRope* rope) {
+    if (isObj(rope->flat)) return (ObjString*)valueToObj(rope->flat);
+
+    // Iterative left-to-right walk; ropes built by a loop are as deep as the
+    // number of appends.
+    std::string buffer;
+    buffer.reserve(rope->length);
+    std::vector<Obj*> pending {valueToObj(rope->right), valueToObj(rope->left)};
+    while (!pending.empty()) {
+        Obj* o = pending.back();
+        pending.pop_back();
+        if (o->type == ObjType::OBJ_STRING) {
+            buffer += ((ObjString*)o)->chars;
+            continue;
+        }
+        ObjRope* node = (ObjRope*)o;
+        if (isObj(node->flat)) {
+            buffer += ((ObjString*)valueToObj(node->flat))->chars;
+        } else {
+            pending.push_back(valueToObj(node->right));
+            pending.push_back(valueToObj(node->left));
+        }
+    }
+
+    // Callers hold the rope in C++ locals, so nothing may move here
+    MemoryManager::Pause pause(MemoryManager::heap());
+    ObjString* flat = allocateObject<ObjString>(std::move(buffer));
+    rope->flat = objToValue(flat);
+    rope->left = NIL_VAL;
+    rope->right = NIL_VAL;
+    MemoryManager::heap().writeBarrier(rope, rope->flat);
+    return flat;
+}
+
 bool Value::operator==(const Value& other) const {
     if (v == other.v) return true;
+    if (isInt(*this) || isInt(other)) {
+        // An int equals the double of the same value
+        return isNumber(*this) && isNumber(other) && valueToDouble(*this) == valueToDouble(other);
+    }
     if (isObj(*this) && isObj(other)) {
-        Obj* o1 = valueToObj(*this);
-        Obj* o2 = valueToObj(other);
+        Obj* o1 = valueToObj(flattenValue(*this));
+        Obj* o2 = valueToObj(flattenValue(other));
         if (!o1 || !o2) return o1 == o2;
         if (o1->type == ObjType::OBJ_STRING && o2->type == ObjType::OBJ_STRING) {
-            return ((ObjString*)o1)->chars == ((ObjString*)o2)->chars;
+            ObjString* s1 = (ObjString*)o1;
+            ObjString* s2 = (ObjString*)o2;
+            // Distinct interned strings always differ; so do strings whose hashes do
+            if ((s1->interned && s2->interned) || s1->hash != s2->hash) return false;
+            return s1->chars == s2->chars;
         }
     }
     return false;
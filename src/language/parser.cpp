@@ -157,6 +157,13 @@ bool Parser::match(std::initializer_list<TokenType> types) {
     return false;
 }
 
+// Type annotations name either a user type or one of the built-in type keywords
+bool Parser::checkTypeName() const {
+    if (isAtEnd()) return false;
+    TokenType type = peek().type;
+    return type == TokenType::IDENTIFIER || (type >= TokenType::T_I8 && type <= TokenType::T_ISIZE);
+}
+
 StmtPtr Parser::declaration() {
     if (match({TokenType::LET})) return varDeclaration();
     if (match({TokenType::CONST})) return constDeclaration();
@@ -183,7 +190,7 @@ StmtPtr Parser::functionDeclaration() {
             std::string paramName = advance().lexeme;
             std::string paramType;
             if (match({TokenType::COLON})) {
-                 if (!check(TokenType::IDENTIFIER)) throw error(peek(), "Expect type name.");
+                 if (!checkTypeName()) throw error(peek(), "Expect type name.");
                  paramType = advance().lexeme;
             }
             parameters.push_back({paramName, paramType});
@@ -193,7 +200,7 @@ StmtPtr Parser::functionDeclaration() {
 
     std::string returnType;
     if (match({TokenType::COLON})) {
-        if (!check(TokenType::IDENTIFIER)) throw error(peek(), "Expect return type.");
+        if (!checkTypeName()) throw error(peek(), "Expect return type.");
         returnType = advance().lexeme;
     }
 
@@ -218,7 +225,7 @@ StmtPtr Parser::varDeclaration() {
     
     std::string typeAnnotation;
     if (match({TokenType::COLON})) {
-        if (!check(TokenType::IDENTIFIER)) throw error(peek(), "Expect type name after ':'.",
+        if (!checkTypeName()) throw error(peek(), "Expect type name after ':'.",
                                                          ErrorCode::E100_VARIABLE_DECLARATION,
                                                          "valid types: i32, i64, f32, f64, string, bool");
         typeAnnotation = advance().lexeme;
@@ -248,7 +255,7 @@ StmtPtr Parser::constDeclaration() {
 
     std::string typeAnnotation;
     if (match({TokenType::COLON})) {
-        if (!check(TokenType::IDENTIFIER)) throw error(peek(), "Expect type name after ':'.");
+        if (!checkTypeName()) throw error(peek(), "Expect type name after ':'.");
         typeAnnotation = advance().lexeme;
     }
 
@@ -598,7 +605,9 @@ ExprPtr Parser::unary() {
 ExprPtr Parser::primary() {
     if (match({TokenType::NUMBER})) {
         auto node = std::make_unique<Expr>();
-        node->node = Expr::Literal{std::stod(previous().lexeme)};
+        // The lexer only produces digits with an optional fraction
+        const std::string& lexeme = previous().lexeme;
+        node->node = Expr::Literal{std::stod(lexeme), lexeme.find('.') == std::string::npos};
         return node;
     }
     if (match({TokenType::STRING}) || match({TokenType::RAW_STRING})) {
@@ -303,7 +303,7 @@ ExprPtr Parser::lambda() {
             std::string paramName = advance().lexeme;
             std::string paramType;
             if (match({TokenType::COLON})) {
-                if (!check(TokenType::IDENTIFIER)) throw error(peek(), "Expect type name.");
+                if (!checkTypeName()) throw error(peek(), "Expect type name.");
                 paramType = advance().lexeme;
             }
             parameters.push_back({paramName, paramType});
@@ -4,6 +4,7 @@ SPDX-License-Identifier: GPL-3.0-only
 */
 
 #include "axeon/bytecode.hpp"
+#include "axeon/memory_manager.hpp"
 #include <vector>
 #include <string>
 #include <cstring>
@@ -21,7 +22,7 @@ Value native_crypto_aes_encrypt(int argCount, Value* args) {
     if (key.empty()) {
         // With an empty key, return the input unchanged rather than
         // invoking undefined behavior.
-        return objToValue(new ObjString(data));
+        return objToValue(allocateObject<ObjString>(data));
     }
     
     std::string result = data;
@@ -29,7 +30,7 @@ Value native_crypto_aes_encrypt(int argCount, Value* args) {
         result[i] ^= key[i % key.length()];
     }
     
-    return objToValue(new ObjString(result));
+    return objToValue(allocateObject<ObjString>(result));
 }
 
 Value native_crypto_aes_decrypt(int argCount, Value* args) {
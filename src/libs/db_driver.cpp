@@ -7,6 +7,7 @@ SPDX-License-Identifier: GPL-3.0-only
 #include <fstream>
 #include <string>
 #include "axeon/bytecode.hpp"
+#include "axeon/memory_manager.hpp"
 
 namespace kio {
 
@@ -28,9 +29,9 @@ Value native_db_set(int argCount, Value* args) {
 
 Value native_db_get(int argCount, Value* args) {
     if (argCount == 1 && isObj(args[0])) {
-        return objToValue(new ObjString(g_db.get(((ObjString*)valueToObj(args[0]))->chars)));
+        return objToValue(allocateObject<ObjString>(g_db.get(((ObjString*)valueToObj(args[0]))->chars)));
     }
-    return objToValue(new ObjString(""));
+    return objToValue(allocateObject<ObjString>(""));
 }
 
 } // namespace kio
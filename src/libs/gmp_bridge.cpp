@@ -7,6 +7,7 @@ SPDX-License-Identifier: GPL-3.0-only
 #include <iostream>
 #include <string>
 #include "axeon/bytecode.hpp"
+#include "axeon/memory_manager.hpp"
 
 namespace kio {
 
@@ -38,7 +39,7 @@ Value native_bigint_add(int argCount, Value* args) {
     mpz_clear(b);
     mpz_clear(res);
     
-    return objToValue(new ObjString(result));
+    return objToValue(allocateObject<ObjString>(result));
 }
 
 Value native_bigint_sub(int argCount, Value* args) {
@@ -59,7 +60,7 @@ Value native_bigint_sub(int argCount, Value* args) {
     mpz_clear(b);
     mpz_clear(res);
     
-    return objToValue(new ObjString(result));
+    return objToValue(allocateObject<ObjString>(result));
 }
 
 Value native_bigint_mul(int argCount, Value* args) {
@@ -80,7 +81,7 @@ Value native_bigint_mul(int argCount, Value* args) {
     mpz_clear(b);
     mpz_clear(res);
     
-    return objToValue(new ObjString(result));
+    return objToValue(allocateObject<ObjString>(result));
 }
 
 Value native_bigint_div(int argCount, Value* args) {
@@ -107,7 +108,7 @@ Value native_bigint_div(int argCount, Value* args) {
     mpz_clear(b);
     mpz_clear(res);
     
-    return objToValue(new ObjString(result));
+    return objToValue(allocateObject<ObjString>(result));
 }
 
 Value native_bigint_mod(int argCount, Value* args) {
@@ -134,7 +135,7 @@ Value native_bigint_mod(int argCount, Value* args) {
     mpz_clear(b);
     mpz_clear(res);
     
-    return objToValue(new ObjString(result));
+    return objToValue(allocateObject<ObjString>(result));
 }
 
 Value native_bigint_pow(int argCount, Value* args) {
@@ -154,7 +155,7 @@ Value native_bigint_pow(int argCount, Value* args) {
     mpz_clear(a);
     mpz_clear(res);
     
-    return objToValue(new ObjString(result));
+    return objToValue(allocateObject<ObjString>(result));
 }
 
 Value native_bigint_cmp(int argCount, Value* args) {
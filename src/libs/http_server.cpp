@@ -4,6 +4,7 @@ SPDX-License-Identifier: GPL-3.0-only
 */
 
 #include "axeon/network/http_server.hpp"
+#include "axeon/memory_manager.hpp"
 #include <iostream>
 #include <string>
 #include <vector>
@@ -86,11 +87,11 @@ Value native_server_accept(int argCount, Value* args) {
 
     std::cout << "[HTTP] Connection accepted: " << method << " " << path << std::endl;
 
-    ObjArray* res = new ObjArray();
+    ObjArray* res = allocateObject<ObjArray>();
     res->elements.push_back(doubleToValue((double)new_socket));
-    res->elements.push_back(objToValue(new ObjString(method)));
-    res->elements.push_back(objToValue(new ObjString(path)));
-    res->elements.push_back(objToValue(new ObjString(request))); // Raw request body/headers
+    res->elements.push_back(objToValue(allocateObject<ObjString>(method)));
+    res->elements.push_back(objToValue(allocateObject<ObjString>(path)));
+    res->elements.push_back(objToValue(allocateObject<ObjString>(request))); // Raw request body/headers
     
     return objToValue(res);
 }
@@ -4,6 +4,7 @@ SPDX-License-Identifier: GPL-3.0-only
 */
 
 #include "axeon/bytecode.hpp"
+#include "axeon/memory_manager.hpp"
 #include <vector>
 #include <string>
 #include <iomanip>
@@ -18,7 +19,7 @@ Value native_crypto_sha256(int argCount, Value* args) {
     std::stringstream ss;
     ss << std::hex << std::setw(64) << std::setfill('0') << h;
     
-    return objToValue(new ObjString(ss.str()));
+    return objToValue(allocateObject<ObjString>(ss.str()));
 }
 
 } // namespace kio
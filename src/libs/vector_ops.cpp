@@ -11,126 +11,152 @@ SPDX-License-Identifier: GPL-3.0-only
 
 namespace kio {
 
-void vectorized_add(ObjArray* a, ObjArray* b, ObjArray* result) {
-    size_t size = std::min({a->elements.size(), b->elements.size(), result->elements.size()});
+// Kernels work on typed arrays. Float64 storage is 32-byte aligned, so the
+// AVX2 paths use aligned loads/stores; other element kinds take the scalar
+// path through get/set.
+
+static inline bool allFloat64(const ObjTypedArray* a, const ObjTypedArray* b, const ObjTypedArray* c) {
+    return a->kind == ElementKind::FLOAT64 && b->kind == ElementKind::FLOAT64 && c->kind == ElementKind::FLOAT64;
+}
+
+void vectorized_add(ObjTypedArray* a, ObjTypedArray* b, ObjTypedArray* result) {
+    size_t size = std::min({a->length, b->length, result->length});
     size_t i = 0;
 #ifdef __AVX2__
-    for (; i + 4 <= size; i += 4) {
-        __m256d va = _mm256_set_pd(valueToDouble(a->elements[i+3]), valueToDouble(a->elements[i+2]), valueToDouble(a->elements[i+1]), valueToDouble(a->elements[i]));
-        __m256d vb = _mm256_set_pd(valueToDouble(b->elements[i+3]), valueToDouble(b->elements[i+2]), valueToDouble(b->elements[i+1]), valueToDouble(b->elements[i]));
-        double res[4]; _mm256_storeu_pd(res, _mm256_add_pd(va, vb));
-        for(int j=0; j<4; ++j) result->elements[i+j] = doubleToValue(res[j]);
+    if (allFloat64(a, b, result)) {
+        const double* pa = a->as<double>();
+        const double* pb = b->as<double>();
+        double* pr = result->as<double>();
+        for (; i + 4 <= size; i += 4) {
+            _mm256_store_pd(pr + i, _mm256_add_pd(_mm256_load_pd(pa + i), _mm256_load_pd(pb + i)));
+        }
     }
 #endif
     for (; i < size; ++i) {
-        if (isNumber(a->elements[i]) && isNumber(b->elements[i])) {
-            result->elements[i] = doubleToValue(valueToDouble(a->elements[i]) + valueToDouble(b->elements[i]));
-        }
+        result->set(i, a->get(i) + b->get(i));
     }
 }
 
-void vectorized_sub(ObjArray* a, ObjArray* b, ObjArray* result) {
-    size_t size = std::min({a->elements.size(), b->elements.size(), result->elements.size()});
+void vectorized_sub(ObjTypedArray* a, ObjTypedArray* b, ObjTypedArray* result) {
+    size_t size = std::min({a->length, b->length, result->length});
     size_t i = 0;
 #ifdef __AVX2__
-    for (; i + 4 <= size; i += 4) {
-        __m256d va = _mm256_set_pd(valueToDouble(a->elements[i+3]), valueToDouble(a->elements[i+2]), valueToDouble(a->elements[i+1]), valueToDouble(a->elements[i]));
-        __m256d vb = _mm256_set_pd(valueToDouble(b->elements[i+3]), valueToDouble(b->elements[i+2]), valueToDouble(b->elements[i+1]), valueToDouble(b->elements[i]));
-        double res[4]; _mm256_storeu_pd(res, _mm256_sub_pd(va, vb));
-        for(int j=0; j<4; ++j) result->elements[i+j] = doubleToValue(res[j]);
+    if (allFloat64(a, b, result)) {
+        const double* pa = a->as<double>();
+        const double* pb = b->as<double>();
+        double* pr = result->as<double>();
+        for (; i + 4 <= size; i += 4) {
+            _mm256_store_pd(pr + i, _mm256_sub_pd(_mm256_load_pd(pa + i), _mm256_load_pd(pb + i)));
+        }
     }
 #endif
     for (; i < size; ++i) {
-        if (isNumber(a->elements[i]) && isNumber(b->elements[i])) {
-            result->elements[i] = doubleToValue(valueToDouble(a->elements[i]) - valueToDouble(b->elements[i]));
-        }
+        result->set(i, a->get(i) - b->get(i));
     }
 }
 
-void vectorized_mul(ObjArray* a, ObjArray* b, ObjArray* result) {
-    size_t size = std::min({a->elements.size(), b->elements.size(), result->elements.size()});
+void vectorized_mul(ObjTypedArray* a, ObjTypedArray* b, ObjTypedArray* result) {
+    size_t size = std::min({a->length, b->length, result->length});
     size_t i = 0;
 #ifdef __AVX2__
-    for (; i + 4 <= size; i += 4) {
-        __m256d va = _mm256_set_pd(valueToDouble(a->elements[i+3]), valueToDouble(a->elements[i+2]), valueToDouble(a->elements[i+1]), valueToDouble(a->elements[i]));
-        __m256d vb = _mm256_set_pd(valueToDouble(b->elements[i+3]), valueToDouble(b->elements[i+2]), valueToDouble(b->elements[i+1]), valueToDouble(b->elements[i]));
-        double res[4]; _mm256_storeu_pd(res, _mm256_mul_pd(va, vb));
-        for(int j=0; j<4; ++j) result->elements[i+j] = doubleToValue(res[j]);
+    if (allFloat64(a, b, result)) {
+        const double* pa = a->as<double>();
+        const double* pb = b->as<double>();
+        double* pr = result->as<double>();
+        for (; i + 4 <= size; i += 4) {
+            _mm256_store_pd(pr + i, _mm256_mul_pd(_mm256_load_pd(pa + i), _mm256_load_pd(pb + i)));
+        }
     }
 #endif
     for (; i < size; ++i) {
-        if (isNumber(a->elements[i]) && isNumber(b->elements[i])) {
-            result->elements[i] = doubleToValue(valueToDouble(a->elements[i]) * valueToDouble(b->elements[i]));
-        }
+        result->set(i, a->get(i) * b->get(i));
     }
 }
 
-void vectorized_div(ObjArray* a, ObjArray* b, ObjArray* result) {
-    size_t size = std::min({a->elements.size(), b->elements.size(), result->elements.size()});
+void vectorized_div(ObjTypedArray* a, ObjTypedArray* b, ObjTypedArray* result) {
+    size_t size = std::min({a->length, b->length, result->length});
     size_t i = 0;
 #ifdef __AVX2__
-    for (; i + 4 <= size; i += 4) {
-        __m256d va = _mm256_set_pd(valueToDouble(a->elements[i+3]), valueToDouble(a->elements[i+2]), valueToDouble(a->elements[i+1]), valueToDouble(a->elements[i]));
-        __m256d vb = _mm256_set_pd(valueToDouble(b->elements[i+3]), valueToDouble(b->elements[i+2]), valueToDouble(b->elements[i+1]), valueToDouble(b->elements[i]));
-        double res[4]; _mm256_storeu_pd(res, _mm256_div_pd(va, vb));
-        for(int j=0; j<4; ++j) result->elements[i+j] = doubleToValue(res[j]);
+    if (allFloat64(a, b, result)) {
+        const double* pa = a->as<double>();
+        const double* pb = b->as<double>();
+        double* pr = result->as<double>();
+        for (; i + 4 <= size; i += 4) {
+            _mm256_store_pd(pr + i, _mm256_div_pd(_mm256_load_pd(pa + i), _mm256_load_pd(pb + i)));
+        }
     }
 #endif
     for (; i < size; ++i) {
-        if (isNumber(a->elements[i]) && isNumber(b->elements[i]) && valueToDouble(b->elements[i]) != 0) {
-            result->elements[i] = doubleToValue(valueToDouble(a->elements[i]) / valueToDouble(b->elements[i]));
-        }
+        if (b->get(i) == 0) continue;
+        result->set(i, a->get(i) / b->get(i));
     }
 }
 
-double vectorized_dot(ObjArray* a, ObjArray* b) {
-    size_t size = std::min(a->elements.size(), b->elements.size());
+double vectorized_dot(ObjTypedArray* a, ObjTypedArray* b) {
+    size_t size = std::min(a->length, b->length);
     double total = 0.0;
     size_t i = 0;
 #ifdef __AVX2__
-    __m256d sum = _mm256_setzero_pd();
-    for (; i + 4 <= size; i += 4) {
-        __m256d va = _mm256_set_pd(valueToDouble(a->elements[i+3]), valueToDouble(a->elements[i+2]), valueToDouble(a->elements[i+1]), valueToDouble(a->elements[i]));
-        __m256d vb = _mm256_set_pd(valueToDouble(b->elements[i+3]), valueToDouble(b->elements[i+2]), valueToDouble(b->elements[i+1]), valueToDouble(b->elements[i]));
-        sum = _mm256_add_pd(sum, _mm256_mul_pd(va, vb));
+    if (a->kind == ElementKind::FLOAT64 && b->kind == ElementKind::FLOAT64) {
+        const double* pa = a->as<double>();
+        const double* pb = b->as<double>();
+        __m256d sum = _mm256_setzero_pd();
+        for (; i + 4 <= size; i += 4) {
+            sum = _mm256_add_pd(sum, _mm256_mul_pd(_mm256_load_pd(pa + i), _mm256_load_pd(pb + i)));
+        }
+        alignas(32) double res[4];
+        _mm256_store_pd(res, sum);
+        total = res[0] + res[1] + res[2] + res[3];
     }
-    double res[4];
-    _mm256_storeu_pd(res, sum);
-    total = res[0] + res[1] + res[2] + res[3];
 #endif
     for (; i < size; ++i) {
-        if (isNumber(a->elements[i]) && isNumber(b->elements[i])) {
-            total += valueToDouble(a->elements[i]) * valueToDouble(b->elements[i]);
+        total += a->get(i) * b->get(i);
+    }
+    return total;
+}
+
+double vectorized_sum(ObjTypedArray* a) {
+    size_t size = a->length;
+    double total = 0.0;
+    size_t i = 0;
+#ifdef __AVX2__
+    if (a->kind == ElementKind::FLOAT64) {
+        const double* pa = a->as<double>();
+        __m256d sum = _mm256_setzero_pd();
+        for (; i + 4 <= size; i += 4) {
+            sum = _mm256_add_pd(sum, _mm256_load_pd(pa + i));
         }
+        alignas(32) double res[4];
+        _mm256_store_pd(res, sum);
+        total = res[0] + res[1] + res[2] + res[3];
+    }
+#endif
+    for (; i < size; ++i) {
+        total += a->get(i);
     }
     return total;
 }
 
-void vectorized_cross(ObjArray* a, ObjArray* b, ObjArray* result) {
-    if (a->elements.size() < 3 || b->elements.size() < 3 || result->elements.size() < 3) return;
-    double a1 = valueToDouble(a->elements[0]);
-    double a2 = valueToDouble(a->elements[1]);
-    double a3 = valueToDouble(a->elements[2]);
-    double b1 = valueToDouble(b->elements[0]);
-    double b2 = valueToDouble(b->elements[1]);
-    double b3 = valueToDouble(b->elements[2]);
+void vectorized_cross(ObjTypedArray* a, ObjTypedArray* b, ObjTypedArray* result) {
+    if (a->length < 3 || b->length < 3 || result->length < 3) return;
+    double a1 = a->get(0);
+    double a2 = a->get(1);
+    double a3 = a->get(2);
+    double b1 = b->get(0);
+    double b2 = b->get(1);
+    double b3 = b->get(2);
 
-    result->elements[0] = doubleToValue(a2 * b3 - a3 * b2);
-    result->elements[1] = doubleToValue(a3 * b1 - a1 * b3);
-    result->elements[2] = doubleToValue(a1 * b2 - a2 * b1);
+    result->set(0, a2 * b3 - a3 * b2);
+    result->set(1, a3 * b1 - a1 * b3);
+    result->set(2, a1 * b2 - a2 * b1);
 }
 
-void vectorized_normalize(ObjArray* a, ObjArray* result) {
-    size_t size = std::min(a->elements.size(), result->elements.size());
-    double mag_sq = 0;
-    for (size_t i = 0; i < size; ++i) {
-        double val = valueToDouble(a->elements[i]);
-        mag_sq += val * val;
-    }
-    double mag = std::sqrt(mag_sq);
+void vectorized_normalize(ObjTypedArray* a, ObjTypedArray* result) {
+    size_t size = std::min(a->length, result->length);
+    double mag = std::sqrt(vectorized_dot(a, a));
     if (mag == 0) return;
     for (size_t i = 0; i < size; ++i) {
-        result->elements[i] = doubleToValue(valueToDouble(a->elements[i]) / mag);
+        result->set(i, a->get(i) / mag);
     }
 }
 
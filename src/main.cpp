@@ -9,8 +9,11 @@
 #include "axeon/lexer.hpp"
 #include "axeon/parser.hpp"
 #include "axeon/compiler.hpp"
+#include "axeon/optimizer.hpp"
+#include "axeon/register_compiler.hpp"
 #include "axeon/vm.hpp"
 #include "axeon/jit_engine.hpp"
+#include "axeon/memory_manager.hpp"
 
 using namespace kio;
 
@@ -20,16 +23,40 @@ int main(int argc, char* argv[]) {
         std::cout << "Usage: axeon <file.axe> [options]" << std::endl;
         std::cout << "\nOptions:" << std::endl;
         std::cout << "  --vm          Use stack-based VM (default)" << std::endl;
+        std::cout << "  --vm=<mode>   VM dispatch: stack (default), threaded (pre-decoded)" << std::endl;
+        std::cout << "                or reg (register bytecode)" << std::endl;
         std::cout << "  --interp      Use tree-walking interpreter" << std::endl;
         std::cout << "  --jit         Use JIT compilation" << std::endl;
+        std::cout << "  --gc-stress   Collect garbage on every allocation" << std::endl;
+        std::cout << "  --gc-stats    Print collector statistics on exit" << std::endl;
+        std::cout << "  --vm-stats    Print the number of dispatched instructions on exit" << std::endl;
+        std::cout << "  --jit-stats   Print what each JIT tier compiled and how long it took on exit" << std::endl;
+        std::cout << "  --tier1-threshold=N  Back edges before a loop is baseline compiled (default 16, 0 = off)" << std::endl;
+        std::cout << "  --tier2-threshold=N  Back edges before a loop is compiled with LLVM (default 10000, 0 = off)" << std::endl;
+        std::cout << "  --tier2-calls=N      Calls before a function is compiled with LLVM (default 100, 0 = off)" << std::endl;
+        std::cout << "  --no-superinstructions  Emit only generic opcodes" << std::endl;
+        std::cout << "  --O0, --O1, --O2  Optimization level (default --O1; --O0 skips the bytecode peephole too)" << std::endl;
+        std::cout << "  --opt-stats   Print what each optimization pass removed, per function for bytecode" << std::endl;
+        std::cout << "  --opt-verbose Same as --opt-stats, and list every inlined call" << std::endl;
         std::cout << "\nEnvironment:" << std::endl;
         std::cout << "  AXEON_ENGINE  Set execution engine (vm/interp/jit)" << std::endl;
+        std::cout << "  AXEON_GC_STRESS, AXEON_GC_STATS  Same as the --gc-* flags" << std::endl;
         return 1;
     }
 
     // Get execution mode from arguments or environment
     std::string engine = "vm";  // default
     
+    bool gc_stress = std::getenv("AXEON_GC_STRESS") != nullptr;
+    bool gc_stats = std::getenv("AXEON_GC_STATS") != nullptr;
+    bool vm_stats = false;
+    bool jit_stats = false;
+    VM::TierThresholds tiers;
+    bool opt_stats = false;
+    bool opt_verbose = false;
+    Optimizer::Level opt_level = Optimizer::Level::O1;
+    std::string vm_mode = "stack";
+    
     if (const char* env_engine = std::getenv("AXEON_ENGINE")) {
         engine = env_engine;
     }
@@ -37,10 +64,26 @@ int main(int argc, char* argv[]) {
     for (int i = 2; i < argc; i++) {
         std::string arg = argv[i];
         if (arg == "--vm") engine = "vm";
+        else if (arg.rfind("--vm=", 0) == 0) { engine = "vm"; vm_mode = arg.substr(5); }
         else if (arg == "--interp") engine = "interp";
         else if (arg == "--jit") engine = "jit";
+        else if (arg == "--gc-stress") gc_stress = true;
+        else if (arg == "--gc-stats") gc_stats = true;
+        else if (arg == "--vm-stats") vm_stats = true;
+        else if (arg == "--jit-stats") jit_stats = true;
+        else if (arg.rfind("--tier1-threshold=", 0) == 0) tiers.baselineLoop = std::stoull(arg.substr(18));
+        else if (arg.rfind("--tier2-threshold=", 0) == 0) tiers.optimizedLoop = std::stoull(arg.substr(18));
+        else if (arg.rfind("--tier2-calls=", 0) == 0) tiers.optimizedFunction = (uint32_t)std::stoul(arg.substr(14));
+        else if (arg == "--no-superinstructions") Compiler::setSuperinstructions(false);
+        else if (arg == "--O0") opt_level = Optimizer::Level::O0;
+        else if (arg == "--O1") opt_level = Optimizer::Level::O1;
+        else if (arg == "--O2") opt_level = Optimizer::Level::O2;
+        else if (arg == "--opt-stats") opt_stats = true;
+        else if (arg == "--opt-verbose") opt_stats = opt_verbose = true;
     }
 
+    MemoryManager::heap().setStressMode(gc_stress);
+
     std::string filename = argv[1];
     
     // Read file
@@ -64,10 +107,34 @@ int main(int argc, char* argv[]) {
         Parser::setSourceForErrors(source, filename);
         Parser parser(tokens);
         std::vector<StmtPtr> statements = parser.parse();
+
+        // AST optimization
+        Optimizer optimizer(opt_level);
+        optimizer.optimize(statements);
+        if (opt_stats) optimizer.printStats(std::cerr, opt_verbose);
+        Compiler::setPeephole(opt_level != Optimizer::Level::O0, opt_stats ? &std::cerr : nullptr);
         
+        // The VM registers its roots with the collector, so create it before
+        // compiling to keep the compiled script alive until it is running.
+        VM vm;
+        vm.setTierThresholds(tiers);
+        InterpretResult result = InterpretResult::OK;
+        if (vm_mode == "threaded") {
+            vm.setThreaded(true);
+        } else if (vm_mode != "stack" && vm_mode != "reg") {
+            std::cerr << "Unknown VM mode: " << vm_mode << std::endl;
+            return 1;
+        }
+
         // Compilation
-        Compiler compiler(nullptr, Compiler::FunctionType::TYPE_SCRIPT);
-        ObjFunction* function = compiler.compile(statements);
+        ObjFunction* function = nullptr;
+        if (vm_mode == "reg") {
+            RegisterCompiler compiler;
+            function = compiler.compile(statements);
+        } else {
+            Compiler compiler(nullptr, Compiler::FunctionType::TYPE_SCRIPT);
+            function = compiler.compile(statements);
+        }
         
         if (!function) {
             std::cerr << "Compilation failed" << std::endl;
@@ -75,17 +142,14 @@ int main(int argc, char* argv[]) {
         }
         
         // Execution
-        if (engine == "vm" || engine == "default") {
-            VM vm;
-            InterpretResult result = vm.interpret(function);
-            return (result == InterpretResult::OK) ? 0 : 1;
+        if (vm_mode == "reg") {
+            result = vm.interpretRegisters(function);
+        } else if (engine == "vm" || engine == "default") {
+            result = vm.interpret(function);
         } else if (engine == "jit") {
             #ifdef AXEON_JIT_ENABLED
-            JITEngine jit;
             // JIT execution would go here
-            VM vm;
-            InterpretResult result = vm.interpret(function);
-            return (result == InterpretResult::OK) ? 0 : 1;
+            result = vm.interpret(function);
             #else
             std::cerr << "JIT not enabled in this build" << std::endl;
             return 1;
@@ -93,13 +157,18 @@ int main(int argc, char* argv[]) {
         } else if (engine == "interp") {
             // Interpreter execution would use AST directly
             // For now, fall back to VM
-            VM vm;
-            InterpretResult result = vm.interpret(function);
-            return (result == InterpretResult::OK) ? 0 : 1;
+            result = vm.interpret(function);
         } else {
             std::cerr << "Unknown engine: " << engine << std::endl;
             return 1;
         }
+        if (gc_stats) MemoryManager::heap().printStats(std::cerr);
+        if (jit_stats) vm.printJitStats(std::cerr);
+        if (vm_stats) {
+            if (VM::countsDispatches()) std::cerr << "[VM] instructions dispatched: " << vm.dispatchCount() << std::endl;
+            else std::cerr << "[VM] dispatch counting is off (configure with -DAXEON_DISPATCH_STATS=ON)" << std::endl;
+        }
+        return (result == InterpretResult::OK) ? 0 : 1;
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
         return 1;